@@ -2998,7 +2998,7 @@ then
     %endif
     # cleanup namespace state/flag, may still exist
     PCP_PMNS_DIR=%{_pmnsdir}
-    rm -f "$PCP_PMNS_DIR/.NeedRebuild" >/dev/null 2>&1
+    rm -f "$PCP_PMNS_DIR/.NeedRebuild" "$PCP_PMNS_DIR/root.bin" >/dev/null 2>&1
 fi
 
 %post zeroconf
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * Random access positioning in an archive, for checking the sparse
+ * seek index used by __pmLogSetTime() ... run with different values
+ * of $PCP_LOG_SEEK_STRIDE and the output should not change.
+ *
+ * For each record in the archive, and each point midway between
+ * adjacent records, report the record found by pmSetMode() and
+ * pmFetch() in PM_MODE_FORW and PM_MODE_BACK, and the interpolated
+ * value in PM_MODE_INTERP.
+ *
+ * Usage: archseek [-b] [-D debug] archive metric
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+
+static void
+fetchone(int mode, pmID pmid, pmDesc *desc, struct timespec *when)
+{
+    static struct timespec	delta = { 1, 0 };
+    pmHighResResult		*rp;
+    pmAtomValue			av;
+    int				sts;
+
+    if ((sts = pmSetModeHighRes(mode, when, &delta)) < 0) {
+	printf("pmSetModeHighRes: %s\n", pmErrStr(sts));
+	return;
+    }
+    printf("%s %lld.%09ld -> ",
+	    mode == PM_MODE_FORW ? "forw" : mode == PM_MODE_BACK ? "back" : "interp",
+	    (long long)when->tv_sec, (long)when->tv_nsec);
+    if ((sts = pmFetchHighRes(1, &pmid, &rp)) < 0) {
+	printf("%s\n", pmErrStr(sts));
+	return;
+    }
+    printf("%lld.%09ld", (long long)rp->timestamp.tv_sec, (long)rp->timestamp.tv_nsec);
+    if (rp->numpmid == 1 && rp->vset[0]->numval > 0) {
+	sts = pmExtractValue(rp->vset[0]->valfmt, &rp->vset[0]->vlist[0],
+			desc->type, &av, PM_TYPE_DOUBLE);
+	if (sts < 0)
+	    printf(" %s", pmErrStr(sts));
+	else
+	    printf(" %.6g", av.d);
+    }
+    else
+	printf(" numval=%d", rp->numpmid == 1 ? rp->vset[0]->numval : -1);
+    putchar('\n');
+    pmFreeHighResResult(rp);
+}
+
+static double
+now(void)
+{
+    struct timeval	tv;
+
+    gettimeofday(&tv, NULL);
+    return pmtimevalToReal(&tv);
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			sts;
+    int			errflag = 0;
+    int			bench = 0;
+    int			i;
+    int			nstamp = 0;
+    int			maxstamp = 0;
+    int			reads;
+    double		t0;
+    char		*name;
+    pmID		pmid;
+    pmDesc		desc;
+    pmHighResResult	*rp;
+    struct timespec	*stamp = NULL;
+    struct timespec	mid;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "bD:?")) != EOF) {
+	switch (c) {
+
+	case 'b':	/* report reads and time to stderr */
+	    bench = 1;
+	    break;
+
+	case 'D':	/* debug options */
+	    sts = pmSetDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (optind != argc-2)
+	errflag++;
+
+    if (errflag) {
+	fprintf(stderr,
+"Usage: %s [options] archive metric\n\
+\n\
+Options\n\
+  -b   report log reads and elapsed time on stderr\n\
+  -D   debug flags\n",
+		pmGetProgname());
+	exit(1);
+    }
+
+    if ((sts = pmNewContext(PM_CONTEXT_ARCHIVE, argv[optind])) < 0) {
+	fprintf(stderr, "%s: Cannot open archive \"%s\": %s\n",
+	    pmGetProgname(), argv[optind], pmErrStr(sts));
+	exit(1);
+    }
+    name = argv[optind+1];
+    if ((sts = pmLookupName(1, (const char **)&name, &pmid)) < 0) {
+	fprintf(stderr, "%s: pmLookupName(%s): %s\n",
+	    pmGetProgname(), name, pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmLookupDesc(pmid, &desc)) < 0) {
+	fprintf(stderr, "%s: pmLookupDesc(%s): %s\n",
+	    pmGetProgname(), name, pmErrStr(sts));
+	exit(1);
+    }
+
+    /* one serial pass to find all the record timestamps */
+    while ((sts = pmFetchHighResArchive(&rp)) >= 0) {
+	if (nstamp == maxstamp) {
+	    maxstamp = maxstamp == 0 ? 64 : 2 * maxstamp;
+	    if ((stamp = realloc(stamp, maxstamp * sizeof(stamp[0]))) == NULL) {
+		fprintf(stderr, "%s: realloc failed\n", pmGetProgname());
+		exit(1);
+	    }
+	}
+	stamp[nstamp++] = rp->timestamp;
+	pmFreeHighResResult(rp);
+    }
+    if (sts != PM_ERR_EOL)
+	printf("pmFetchHighResArchive: %s\n", pmErrStr(sts));
+    printf("%d records\n", nstamp);
+
+    reads = __pmLogReads;
+    t0 = now();
+    for (i = 0; i < nstamp; i++) {
+	fetchone(PM_MODE_FORW, pmid, &desc, &stamp[i]);
+	fetchone(PM_MODE_BACK, pmid, &desc, &stamp[i]);
+	fetchone(PM_MODE_INTERP, pmid, &desc, &stamp[i]);
+	if (i == nstamp-1)
+	    break;
+	mid.tv_sec = (stamp[i].tv_sec + stamp[i+1].tv_sec) / 2;
+	mid.tv_nsec = (stamp[i].tv_nsec + stamp[i+1].tv_nsec) / 2;
+	if (mid.tv_sec < stamp[i].tv_sec ||
+	    (mid.tv_sec == stamp[i].tv_sec && mid.tv_nsec < stamp[i].tv_nsec))
+	    mid = stamp[i];
+	fetchone(PM_MODE_FORW, pmid, &desc, &mid);
+	fetchone(PM_MODE_BACK, pmid, &desc, &mid);
+	fetchone(PM_MODE_INTERP, pmid, &desc, &mid);
+    }
+    if (bench)
+	fprintf(stderr, "%d log reads, %.3f msec\n",
+		__pmLogReads - reads, 1000 * (now() - t0));
+
+    free(stamp);
+    exit(0);
+}
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * Fetch derived metrics from every record of an archive, optionally
+ * many times over, to measure the per-fetch cost of derived metric
+ * evaluation (compare with $PCP_DERIVED_TREEWALK=1 to walk the
+ * expression trees rather than evaluating the compiled expressions).
+ *
+ * Without -b, the values from the first pass through the archive are
+ * reported.  With -s, each pass stops after samples fetches.  With -t,
+ * values are interpolated every msec milliseconds, else each record of
+ * the archive is fetched in turn.
+ *
+ * Usage: derivedbench [-b] [-D debug] [-i iter] [-s samples] [-t msec] -a archive -c config metric ...
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+
+static double
+now(void)
+{
+    struct timeval	tv;
+
+    gettimeofday(&tv, NULL);
+    return pmtimevalToReal(&tv);
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			i, j, n;
+    int			sts;
+    int			errflag = 0;
+    int			bench = 0;
+    int			iter = 1;
+    int			samples = -1;
+    int			mode = PM_MODE_FORW;
+    int			delta = 0;
+    int			nmetric;
+    int			nfetch = 0;
+    int			m;
+    char		*archive = NULL;
+    char		*config = NULL;
+    char		*endnum;
+    pmID		*pmids;
+    pmDesc		*descs;
+    pmResult		*rp;
+    pmLogLabel		label;
+    double		start, elapsed = 0;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "a:bc:D:i:s:t:")) != EOF) {
+	switch (c) {
+
+	case 'a':	/* archive */
+	    archive = optarg;
+	    break;
+
+	case 'b':	/* report timing */
+	    bench = 1;
+	    break;
+
+	case 'c':	/* derived metrics config */
+	    config = optarg;
+	    break;
+
+	case 'D':	/* debug options */
+	    sts = pmSetDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'i':	/* passes through the archive */
+	    iter = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || iter < 1) {
+		fprintf(stderr, "%s: -i requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 's':	/* fetches per pass */
+	    samples = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || samples < 1) {
+		fprintf(stderr, "%s: -s requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 't':	/* interpolation interval */
+	    delta = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || delta < 1) {
+		fprintf(stderr, "%s: -t requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    mode = PM_MODE_INTERP;
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || archive == NULL || config == NULL || optind == argc) {
+	fprintf(stderr, "Usage: %s [-b] [-D debug] [-i iter] [-s samples] [-t msec] -a archive -c config metric ...\n", pmGetProgname());
+	exit(1);
+    }
+
+    if ((sts = pmLoadDerivedConfig(config)) < 0) {
+	fprintf(stderr, "pmLoadDerivedConfig(%s): %s\n", config, pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmNewContext(PM_CONTEXT_ARCHIVE, archive)) < 0) {
+	fprintf(stderr, "pmNewContext(%s): %s\n", archive, pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmGetArchiveLabel(&label)) < 0) {
+	fprintf(stderr, "pmGetArchiveLabel: %s\n", pmErrStr(sts));
+	exit(1);
+    }
+
+    nmetric = argc - optind;
+    pmids = (pmID *)malloc(nmetric * sizeof(pmID));
+    descs = (pmDesc *)malloc(nmetric * sizeof(pmDesc));
+    if (pmids == NULL || descs == NULL) {
+	fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	exit(1);
+    }
+    if ((sts = pmLookupName(nmetric, (const char **)&argv[optind], pmids)) < 0) {
+	fprintf(stderr, "pmLookupName: %s\n", pmErrStr(sts));
+	exit(1);
+    }
+    for (i = 0; i < nmetric; i++) {
+	if (pmids[i] == PM_ID_NULL ||
+	    (sts = pmLookupDesc(pmids[i], &descs[i])) < 0) {
+	    fprintf(stderr, "%s: bad metric\n", argv[optind+i]);
+	    exit(1);
+	}
+    }
+
+    for (n = 0; n < iter; n++) {
+	if ((sts = pmSetMode(mode, &label.ll_start, delta)) < 0) {
+	    fprintf(stderr, "pmSetMode: %s\n", pmErrStr(sts));
+	    exit(1);
+	}
+	for (m = 0; samples < 0 || m < samples; m++) {
+	    start = now();
+	    sts = pmFetch(nmetric, pmids, &rp);
+	    elapsed += now() - start;
+	    if (sts < 0)
+		break;
+	    nfetch++;
+	    if (!bench && n == 0) {
+		printf("fetch %d\n", nfetch);
+		for (i = 0; i < rp->numpmid; i++) {
+		    pmValueSet	*vsp = rp->vset[i];
+
+		    printf("%s:", argv[optind+i]);
+		    if (vsp->numval < 0) {
+			printf(" %s\n", pmErrStr(vsp->numval));
+			continue;
+		    }
+		    printf(" %d values\n", vsp->numval);
+		    for (j = 0; j < vsp->numval; j++) {
+			printf("    [%d] ", vsp->vlist[j].inst);
+			pmPrintValue(stdout, vsp->valfmt, descs[i].type,
+				&vsp->vlist[j], 1);
+			putchar('\n');
+		    }
+		}
+	    }
+	    pmFreeResult(rp);
+	}
+	if (sts < 0 && sts != PM_ERR_EOL) {
+	    fprintf(stderr, "pmFetch: %s\n", pmErrStr(sts));
+	    exit(1);
+	}
+    }
+
+    if (bench)
+	fprintf(stderr, "%d fetches of %d metrics: %.2f usec per fetch\n",
+		nfetch, nmetric, nfetch ? 1e6 * elapsed / nfetch : 0.0);
+
+    exit(0);
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * Fetch metrics from a PMDA in a local context many times over, to
+ * measure the per-fetch cost of the PMDA refresh and fetch code, e.g.
+ * with $LINUX_STATSPATH pointing at captured /proc files from a large
+ * machine.  Each -K argument is passed to pmSpecLocalPMDA() in turn.
+ *
+ * Without -b, the number of values for each metric from the first
+ * fetch are reported.
+ *
+ * Usage: fetchbench [-b] [-D debug] [-i iter] -K spec [-K spec ...] metric ...
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+
+static double
+now(void)
+{
+    struct timeval	tv;
+
+    gettimeofday(&tv, NULL);
+    return pmtimevalToReal(&tv);
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			i, n;
+    int			sts;
+    int			errflag = 0;
+    int			bench = 0;
+    int			iter = 1;
+    int			nmetric;
+    int			nvalue = 0;
+    char		*endnum;
+    char		*msg;
+    const char		**names;
+    pmID		*pmids;
+    pmResult		*rp;
+    double		start, elapsed = 0;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "bD:i:K:")) != EOF) {
+	switch (c) {
+
+	case 'b':	/* report timing */
+	    bench = 1;
+	    break;
+
+	case 'D':	/* debug options */
+	    sts = pmSetDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'i':	/* number of fetches */
+	    iter = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || iter < 1) {
+		fprintf(stderr, "%s: -i requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'K':	/* local PMDA specification */
+	    if ((msg = pmSpecLocalPMDA(optarg)) != NULL) {
+		fprintf(stderr, "%s: pmSpecLocalPMDA(%s): %s\n",
+		    pmGetProgname(), optarg, msg);
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind == argc) {
+	fprintf(stderr, "Usage: %s [-b] [-D debug] [-i iter] -K spec [-K spec ...] metric ...\n", pmGetProgname());
+	exit(1);
+    }
+
+    if ((sts = pmNewContext(PM_CONTEXT_LOCAL, NULL)) < 0) {
+	fprintf(stderr, "pmNewContext: %s\n", pmErrStr(sts));
+	exit(1);
+    }
+
+    nmetric = argc - optind;
+    names = (const char **)&argv[optind];
+    if ((pmids = (pmID *)malloc(nmetric * sizeof(pmID))) == NULL) {
+	fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	exit(1);
+    }
+    if ((sts = pmLookupName(nmetric, names, pmids)) < 0) {
+	fprintf(stderr, "pmLookupName: %s\n", pmErrStr(sts));
+	exit(1);
+    }
+
+    for (n = 0; n < iter; n++) {
+	start = now();
+	sts = pmFetch(nmetric, pmids, &rp);
+	elapsed += now() - start;
+	if (sts < 0) {
+	    fprintf(stderr, "pmFetch: %s\n", pmErrStr(sts));
+	    exit(1);
+	}
+	if (n == 0) {
+	    for (i = 0; i < rp->numpmid; i++) {
+		if (rp->vset[i]->numval > 0)
+		    nvalue += rp->vset[i]->numval;
+		if (bench)
+		    continue;
+		printf("%s:", names[i]);
+		if (rp->vset[i]->numval < 0)
+		    printf(" %s\n", pmErrStr(rp->vset[i]->numval));
+		else
+		    printf(" %d values\n", rp->vset[i]->numval);
+	    }
+	}
+	pmFreeResult(rp);
+    }
+
+    if (bench)
+	fprintf(stderr, "%d fetches of %d metrics, %d values: %.2f usec per fetch\n",
+		iter, nmetric, nvalue, 1e6 * elapsed / iter);
+
+    exit(0);
+}
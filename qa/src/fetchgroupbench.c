@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * Fetch metrics from every record of an archive with a fetchgroup,
+ * optionally many times over, to measure the per-fetch cost of value
+ * extraction in pmFetchGroup().
+ *
+ * Each metric is added to the fetchgroup as a whole instance domain,
+ * rate converted if -r and the metric is a counter.  With -x, each
+ * instance (present at the start or the end of the archive) is also
+ * added as a single item.
+ *
+ * Without -b, the values from the first pass through the archive are
+ * reported.  With -s, each pass stops after samples fetches.
+ *
+ * Usage: fetchgroupbench [-brx] [-D debug] [-i iter] [-s samples] -a archive metric ...
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+
+#define MAXINST	16384
+
+typedef struct {
+    char		*name;
+    int			*codes;
+    char		**names;
+    pmAtomValue		*values;
+    int			*stss;
+    unsigned int	num;
+    int			sts;
+    int			nitem;		/* -x items, one per instance */
+    char		**inames;
+    pmAtomValue		*ivalues;
+    int			*istss;
+} metric_t;
+
+static double
+now(void)
+{
+    struct timeval	tv;
+
+    gettimeofday(&tv, NULL);
+    return pmtimevalToReal(&tv);
+}
+
+static void
+report(const char *tag, pmAtomValue *value, int sts)
+{
+    printf("%s", tag);
+    if (sts < 0)
+	printf(" %s\n", pmErrStr(sts));
+    else
+	printf(" %.6g\n", value->d);
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			i, j, k, n;
+    int			sts;
+    int			errflag = 0;
+    int			bench = 0;
+    int			rate = 0;
+    int			items = 0;
+    int			iter = 1;
+    int			samples = -1;
+    int			nmetric;
+    int			nitem = 0;
+    int			nfetch = 0;
+    int			m;
+    int			*instlist;
+    char		**namelist;
+    char		*archive = NULL;
+    char		*endnum;
+    char		tag[256];
+    pmID		pmid;
+    pmDesc		desc;
+    pmFG		fg;
+    metric_t		*mp;
+    pmHighResLogLabel	label;
+    double		start, elapsed = 0;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "a:bD:i:rs:x")) != EOF) {
+	switch (c) {
+
+	case 'a':	/* archive */
+	    archive = optarg;
+	    break;
+
+	case 'b':	/* report timing */
+	    bench = 1;
+	    break;
+
+	case 'D':	/* debug options */
+	    sts = pmSetDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'i':	/* passes through the archive */
+	    iter = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || iter < 1) {
+		fprintf(stderr, "%s: -i requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'r':	/* rate convert counters */
+	    rate = 1;
+	    break;
+
+	case 's':	/* fetches per pass */
+	    samples = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || samples < 1) {
+		fprintf(stderr, "%s: -s requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'x':	/* add each instance as an item too */
+	    items = 1;
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || archive == NULL || optind == argc) {
+	fprintf(stderr, "Usage: %s [-brx] [-D debug] [-i iter] [-s samples] -a archive metric ...\n", pmGetProgname());
+	exit(1);
+    }
+
+    if ((sts = pmCreateFetchGroup(&fg, PM_CONTEXT_ARCHIVE, archive)) < 0) {
+	fprintf(stderr, "pmCreateFetchGroup(%s): %s\n", archive, pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmGetHighResArchiveLabel(&label)) < 0) {
+	fprintf(stderr, "pmGetHighResArchiveLabel: %s\n", pmErrStr(sts));
+	exit(1);
+    }
+
+    nmetric = argc - optind;
+    if ((mp = (metric_t *)calloc(nmetric, sizeof(metric_t))) == NULL) {
+	fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	exit(1);
+    }
+    for (i = 0; i < nmetric; i++) {
+	const char	*scale = NULL;
+
+	mp[i].name = argv[optind+i];
+	if ((sts = pmLookupName(1, (const char **)&mp[i].name, &pmid)) < 0 ||
+	    (sts = pmLookupDesc(pmid, &desc)) < 0) {
+	    fprintf(stderr, "%s: %s\n", mp[i].name, pmErrStr(sts));
+	    exit(1);
+	}
+	if (rate && desc.sem == PM_SEM_COUNTER)
+	    scale = "rate";
+	mp[i].codes = (int *)malloc(MAXINST * sizeof(int));
+	mp[i].names = (char **)malloc(MAXINST * sizeof(char *));
+	mp[i].values = (pmAtomValue *)malloc(MAXINST * sizeof(pmAtomValue));
+	mp[i].stss = (int *)malloc(MAXINST * sizeof(int));
+	if (mp[i].codes == NULL || mp[i].names == NULL ||
+	    mp[i].values == NULL || mp[i].stss == NULL) {
+	    fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	    exit(1);
+	}
+	sts = pmExtendFetchGroup_indom(fg, mp[i].name, scale,
+			mp[i].codes, mp[i].names, mp[i].values, PM_TYPE_DOUBLE,
+			mp[i].stss, MAXINST, &mp[i].num, &mp[i].sts);
+	if (sts < 0) {
+	    fprintf(stderr, "pmExtendFetchGroup_indom(%s): %s\n",
+			mp[i].name, pmErrStr(sts));
+	    exit(1);
+	}
+	if (!items || desc.indom == PM_INDOM_NULL)
+	    continue;
+	if ((n = pmGetInDomArchive(desc.indom, &instlist, &namelist)) < 0) {
+	    fprintf(stderr, "pmGetInDomArchive(%s): %s\n", pmInDomStr(desc.indom), pmErrStr(n));
+	    exit(1);
+	}
+	mp[i].inames = namelist;
+	mp[i].ivalues = (pmAtomValue *)calloc(n, sizeof(pmAtomValue));
+	mp[i].istss = (int *)calloc(n, sizeof(int));
+	if (n > 0 && (mp[i].ivalues == NULL || mp[i].istss == NULL)) {
+	    fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	    exit(1);
+	}
+	for (j = 0; j < n; j++) {
+	    k = mp[i].nitem;
+	    sts = pmExtendFetchGroup_item(fg, mp[i].name, namelist[j], scale,
+			&mp[i].ivalues[k], PM_TYPE_DOUBLE, &mp[i].istss[k]);
+	    if (sts == PM_ERR_INST_LOG)
+		continue;	/* not at the start or the end of the archive */
+	    if (sts < 0) {
+		fprintf(stderr, "pmExtendFetchGroup_item(%s[%s]): %s\n",
+			mp[i].name, namelist[j], pmErrStr(sts));
+		exit(1);
+	    }
+	    namelist[k] = namelist[j];
+	    mp[i].nitem++;
+	}
+	nitem += mp[i].nitem;
+	free(instlist);
+    }
+
+    for (n = 0; n < iter; n++) {
+	pmUseContext(pmGetFetchGroupContext(fg));
+	if ((sts = pmSetModeHighRes(PM_MODE_FORW, &label.start, NULL)) < 0) {
+	    fprintf(stderr, "pmSetModeHighRes: %s\n", pmErrStr(sts));
+	    exit(1);
+	}
+	for (m = 0; samples < 0 || m < samples; m++) {
+	    start = now();
+	    sts = pmFetchGroup(fg);
+	    elapsed += now() - start;
+	    if (sts < 0)
+		break;
+	    nfetch++;
+	    if (bench || n > 0)
+		continue;
+	    printf("fetch %d\n", nfetch);
+	    for (i = 0; i < nmetric; i++) {
+		printf("%s:", mp[i].name);
+		if (mp[i].sts < 0) {
+		    printf(" %s\n", pmErrStr(mp[i].sts));
+		    continue;
+		}
+		printf(" %u values\n", mp[i].num);
+		for (j = 0; j < mp[i].num; j++) {
+		    pmsprintf(tag, sizeof(tag), "    [%d or \"%s\"]", mp[i].codes[j],
+				mp[i].names[j] ? mp[i].names[j] : "???");
+		    report(tag, &mp[i].values[j], mp[i].stss[j]);
+		}
+		for (j = 0; j < mp[i].nitem; j++) {
+		    pmsprintf(tag, sizeof(tag), "    item \"%s\"", mp[i].inames[j]);
+		    report(tag, &mp[i].ivalues[j], mp[i].istss[j]);
+		}
+	    }
+	}
+	if (sts < 0 && sts != PM_ERR_EOL) {
+	    fprintf(stderr, "pmFetchGroup: %s\n", pmErrStr(sts));
+	    exit(1);
+	}
+    }
+
+    if (bench)
+	fprintf(stderr, "%d fetches of %d metrics, %d items: %.2f usec per fetch\n",
+		nfetch, nmetric, nitem, nfetch ? 1e6 * elapsed / nfetch : 0.0);
+
+    pmDestroyFetchGroup(fg);
+    exit(0);
+}
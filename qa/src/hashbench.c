@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * Compare the chained and open addressing (PM_HASH_OPEN) __pmHash*
+ * implementations, for correctness and speed, using PMID-like and
+ * instance-like key distributions.
+ *
+ * Usage: hashbench [-b] [-n nkeys] [-r rounds]
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+
+static int	nkeys = 50000;
+static int	rounds = 20;
+static int	bench;
+
+enum { PMIDS, INSTS, PIDS, NDIST };
+static const char *distname[] = { "pmid", "inst", "pid" };
+
+/*
+ * PMIDs: a few domains, clusters with runs of items.
+ * Instances: dense 0 .. n-1, as for most indoms.
+ * PIDs: sparse and increasing with gaps, as for proc.
+ */
+static void
+makekeys(int dist, unsigned int *keys, int n)
+{
+    unsigned int	seed = 1;
+    unsigned int	pid = 1;
+    int			i;
+
+    for (i = 0; i < n; i++) {
+	switch (dist) {
+	case PMIDS:
+	    keys[i] = pmID_build(60 + i / 20000, (i / 500) % 4096, i % 500);
+	    break;
+	case INSTS:
+	    keys[i] = i;
+	    break;
+	case PIDS:
+	    pid += 1 + rand_r(&seed) % 32;
+	    keys[i] = pid;
+	    break;
+	}
+    }
+}
+
+static double
+now(void)
+{
+    struct timeval	tv;
+
+    gettimeofday(&tv, NULL);
+    return pmtimevalToReal(&tv);
+}
+
+static __pmHashWalkState
+counter(const __pmHashNode *hp, void *arg)
+{
+    (*(int *)arg)++;
+    return PM_HASH_WALK_NEXT;
+}
+
+static __pmHashWalkState
+oddone(const __pmHashNode *hp, void *arg)
+{
+    return (hp->key & 1) ? PM_HASH_WALK_DELETE_NEXT : PM_HASH_WALK_NEXT;
+}
+
+/*
+ * Run one mix of operations, returning the number of errors found;
+ * elapsed time for adds, searches (hits in key order, hits in random
+ * order, misses) and deletes is returned in t[].
+ */
+static int
+run(unsigned int flags, unsigned int *keys, int *order, int n, double *t)
+{
+    __pmHashCtl		hc;
+    __pmHashNode	*hp;
+    double		start;
+    int			errors = 0;
+    int			count;
+    int			i, r;
+
+    __pmHashInitFlags(&hc, flags);
+
+    start = now();
+    for (i = 0; i < n; i++) {
+	if (__pmHashAdd(keys[i], (void *)&keys[i], &hc) < 0) {
+	    fprintf(stderr, "__pmHashAdd(%u) failed\n", keys[i]);
+	    return 1;
+	}
+    }
+    t[0] += now() - start;
+
+    start = now();
+    for (r = 0; r < rounds; r++) {
+	for (i = 0; i < n; i++) {
+	    hp = __pmHashSearch(keys[i], &hc);
+	    if (hp == NULL || hp->data != (void *)&keys[i])
+		errors++;
+	}
+    }
+    t[1] += now() - start;
+
+    /* and the same again, in no particular order */
+    start = now();
+    for (r = 0; r < rounds; r++) {
+	for (i = 0; i < n; i++) {
+	    hp = __pmHashSearch(keys[order[i]], &hc);
+	    if (hp == NULL || hp->data != (void *)&keys[order[i]])
+		errors++;
+	}
+    }
+    t[2] += now() - start;
+
+    start = now();
+    for (r = 0; r < rounds; r++) {
+	for (i = 0; i < n; i++) {
+	    if (__pmHashSearch(keys[i] ^ 0x80000000, &hc) != NULL)
+		errors++;
+	}
+    }
+    t[3] += now() - start;
+
+    /* delete every second key, then check and put them back */
+    start = now();
+    for (i = 0; i < n; i += 2) {
+	if (__pmHashDel(keys[i], (void *)&keys[i], &hc) != 1)
+	    errors++;
+    }
+    for (i = 0; i < n; i += 2) {
+	if (__pmHashAdd(keys[i], (void *)&keys[i], &hc) < 0)
+	    errors++;
+    }
+    t[4] += now() - start;
+    for (i = 0; i < n; i++) {
+	hp = __pmHashSearch(keys[i], &hc);
+	if (hp == NULL || hp->data != (void *)&keys[i])
+	    errors++;
+    }
+
+    count = 0;
+    __pmHashWalkCB(counter, &count, &hc);
+    if (count != n || hc.nodes != n)
+	errors++;
+    count = 0;
+    for (hp = __pmHashWalk(&hc, PM_HASH_WALK_START); hp != NULL;
+	 hp = __pmHashWalk(&hc, PM_HASH_WALK_NEXT))
+	count++;
+    if (count != n)
+	errors++;
+
+    /* remove odd keys via the walk callback */
+    __pmHashWalkCB(oddone, NULL, &hc);
+    for (i = 0; i < n; i++) {
+	hp = __pmHashSearch(keys[i], &hc);
+	if ((keys[i] & 1) ? hp != NULL : hp == NULL)
+	    errors++;
+    }
+
+    __pmHashFree(&hc);
+    return errors;
+}
+
+int
+main(int argc, char **argv)
+{
+    static const char	*impl[] = { "chained", "open" };
+    unsigned int	*keys;
+    unsigned int	seed = 1;
+    int			*order;
+    double		t[2][5];
+    int			c, d, i, j, m;
+    int			errflag = 0;
+    int			errors, sts = 0;
+    char		*endnum;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "bn:r:")) != EOF) {
+	switch (c) {
+
+	case 'b':	/* report timing */
+	    bench = 1;
+	    break;
+
+	case 'n':	/* number of keys */
+	    nkeys = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || nkeys < 2) {
+		fprintf(stderr, "%s: -n requires a numeric argument > 1\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'r':	/* search rounds */
+	    rounds = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || rounds < 1) {
+		fprintf(stderr, "%s: -r requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc) {
+	fprintf(stderr, "Usage: %s [-b] [-n nkeys] [-r rounds]\n", pmGetProgname());
+	exit(1);
+    }
+
+    if ((keys = (unsigned int *)malloc(nkeys * sizeof(unsigned int))) == NULL ||
+	(order = (int *)malloc(nkeys * sizeof(int))) == NULL) {
+	fprintf(stderr, "keys malloc failed\n");
+	exit(1);
+    }
+    for (i = 0; i < nkeys; i++)
+	order[i] = i;
+    for (i = nkeys - 1; i > 0; i--) {
+	j = rand_r(&seed) % (i + 1);
+	c = order[i];
+	order[i] = order[j];
+	order[j] = c;
+    }
+
+    if (bench)
+	fprintf(stderr, "%-6s %-8s %8s %8s %8s %8s %8s  (nsec/op)\n",
+		"keys", "impl", "add", "hit", "hit-rnd", "miss", "del+add");
+    for (d = 0; d < NDIST; d++) {
+	makekeys(d, keys, nkeys);
+	for (m = 0; m < 2; m++) {
+	    memset(t[m], 0, sizeof(t[m]));
+	    errors = run(m ? PM_HASH_OPEN : 0, keys, order, nkeys, t[m]);
+	    printf("%s keys, %s: %s\n", distname[d], impl[m],
+		    errors ? "failed" : "ok");
+	    if (errors)
+		sts = 1;
+	    if (bench)
+		fprintf(stderr, "%-6s %-8s %8.1f %8.1f %8.1f %8.1f %8.1f\n",
+			distname[d], impl[m],
+			t[m][0] * 1e9 / nkeys,
+			t[m][1] * 1e9 / ((double)nkeys * rounds),
+			t[m][2] * 1e9 / ((double)nkeys * rounds),
+			t[m][3] * 1e9 / ((double)nkeys * rounds),
+			t[m][4] * 1e9 / nkeys);
+	}
+    }
+
+    free(keys);
+    free(order);
+    exit(sts);
+}
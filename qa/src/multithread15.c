@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * exercise multi-threaded __pmFindPDUBuf(), __pmPinPDUBuf() and
+ * __pmUnpinPDUBuf() services
+ *
+ * Usage: multithread15 [-b] [-i iter] [-t nthreads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pcp/pmapi.h>
+#include <pthread.h>
+#include "libpcp.h"
+
+#ifndef HAVE_PTHREAD_BARRIER_T
+#include "pthread_barrier.h"
+#endif
+
+#define NHOLD	64
+
+static pthread_barrier_t barrier;
+static int	iter = 100000;
+static int	bench;
+static __pmPDU	*shared[NHOLD];		/* pinned by all threads */
+static int	sharedsize[NHOLD];
+
+static int
+pick_size(unsigned int *seed)
+{
+    int		r = rand_r(seed);
+
+    /* mostly small PDUs, some large, a few bigger than any size class */
+    switch (r % 16) {
+	case 0:
+	    return 65536 + r % 65536;
+	case 1: case 2: case 3:
+	    return 4096 + r % 32768;
+	default:
+	    return sizeof(int) + r % 2048;
+    }
+}
+
+static void *
+func(void *arg)
+{
+    int			iam = *((int *)arg);
+    unsigned int	seed = iam + 1;
+    __pmPDU		*hold[NHOLD];
+    int			size[NHOLD];
+    char		*p;
+    int			i, j, k, n;
+    int			sts;
+    int			bad = 0;
+
+    memset(hold, 0, sizeof(hold));
+    pthread_barrier_wait(&barrier);
+
+    for (i = 0; i < iter; i++) {
+	j = rand_r(&seed) % NHOLD;
+	if (hold[j] != NULL) {
+	    /* check for trampling, then release via an interior pointer */
+	    p = (char *)hold[j];
+	    for (k = 0; k < size[j]; k += 512) {
+		if (p[k] != (char)(iam + j)) {
+		    fprintf(stderr, "thread %d: buf[%d] %p[%d] trampled\n",
+			    iam, j, p, k);
+		    bad++;
+		    break;
+		}
+	    }
+	    n = (size[j] - 1) & ~(sizeof(int) - 1);
+	    if ((sts = __pmUnpinPDUBuf(&p[n])) != 1) {
+		fprintf(stderr, "thread %d: unpin %p[%d] -> %d\n", iam, p, n, sts);
+		bad++;
+	    }
+	    hold[j] = NULL;
+	}
+	size[j] = pick_size(&seed);
+	if ((hold[j] = __pmFindPDUBuf(size[j])) == NULL) {
+	    fprintf(stderr, "thread %d: __pmFindPDUBuf(%d) failed\n", iam, size[j]);
+	    bad++;
+	    continue;
+	}
+	p = (char *)hold[j];
+	for (k = 0; k < size[j]; k += 512)
+	    p[k] = (char)(iam + j);
+
+	/* pin and unpin a buffer that other threads are also pinning */
+	k = rand_r(&seed) % NHOLD;
+	__pmPinPDUBuf(shared[k]);
+	if (__pmUnpinPDUBuf(&((char *)shared[k])[sharedsize[k] - sizeof(int)]) != 1) {
+	    fprintf(stderr, "thread %d: shared unpin %d failed\n", iam, k);
+	    bad++;
+	}
+    }
+
+    for (j = 0; j < NHOLD; j++) {
+	if (hold[j] != NULL)
+	    __pmUnpinPDUBuf(hold[j]);
+    }
+
+    pthread_exit(bad ? "botch" : NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+    pthread_t		tid[64];
+    int			id[64];
+    int			nthread = 4;
+    int			alloc, nfree;
+    int			c, i;
+    int			errflag = 0;
+    int			sts;
+    struct timeval	start, end;
+    void		*ret;
+    char		*endnum;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "bD:i:t:")) != EOF) {
+	switch (c) {
+
+	case 'b':	/* report timing */
+	    bench = 1;
+	    break;
+
+	case 'D':	/* debug options */
+	    sts = pmSetDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'i':	/* iterations per thread */
+	    iter = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || iter < 1) {
+		fprintf(stderr, "%s: -i requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 't':	/* number of threads */
+	    nthread = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || nthread < 1 || nthread > 64) {
+		fprintf(stderr, "%s: -t requires a numeric argument between 1 and 64\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc) {
+	fprintf(stderr, "Usage: %s [-b] [-D debug] [-i iter] [-t nthreads]\n", pmGetProgname());
+	exit(1);
+    }
+
+    for (i = 0; i < NHOLD; i++) {
+	sharedsize[i] = (i + 1) * 256;
+	if ((shared[i] = __pmFindPDUBuf(sharedsize[i])) == NULL) {
+	    fprintf(stderr, "__pmFindPDUBuf(%d) failed\n", sharedsize[i]);
+	    exit(1);
+	}
+    }
+
+    sts = pthread_barrier_init(&barrier, NULL, nthread);
+    if (sts != 0) {
+	printf("pthread_barrier_init: sts=%d\n", sts);
+	exit(1);
+    }
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nthread; i++) {
+	id[i] = i;
+	sts = pthread_create(&tid[i], NULL, func, &id[i]);
+	if (sts != 0) {
+	    printf("thread_create: %d: sts=%d\n", i, sts);
+	    exit(1);
+	}
+    }
+
+    sts = 0;
+    for (i = 0; i < nthread; i++) {
+	pthread_join(tid[i], &ret);
+	if (ret != NULL) {
+	    printf("thread %d: %s\n", i, (char *)ret);
+	    sts = 1;
+	}
+    }
+    gettimeofday(&end, NULL);
+
+    for (i = 0; i < NHOLD; i++) {
+	if (__pmUnpinPDUBuf(shared[i]) != 1) {
+	    printf("shared[%d]: final unpin failed\n", i);
+	    sts = 1;
+	}
+	if (__pmUnpinPDUBuf(shared[i]) != 0) {
+	    printf("shared[%d]: unpin after free succeeded\n", i);
+	    sts = 1;
+	}
+    }
+
+    __pmCountPDUBuf(0, &alloc, &nfree);
+    printf("%d threads, %d iterations: %s, %d buffers in use\n",
+	    nthread, iter, sts ? "failed" : "ok", alloc);
+    if (bench)
+	fprintf(stderr, "elapsed %.3f sec, %.0f buffers/sec\n",
+		pmtimevalSub(&end, &start),
+		(double)nthread * iter / pmtimevalSub(&end, &start));
+
+    exit(sts);
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * exercise multi-threaded __pmAllocResult() and the pmFreeResult()
+ * family, including results freed by a different thread to the one
+ * that allocated them, and results not from __pmAllocResult()
+ *
+ * Usage: multithread16 [-b] [-D debug] [-i iter] [-t nthreads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pcp/pmapi.h>
+#include <pthread.h>
+#include "libpcp.h"
+
+#ifndef HAVE_PTHREAD_BARRIER_T
+#include "pthread_barrier.h"
+#endif
+
+#define NHOLD	64
+
+static pthread_barrier_t barrier;
+static pthread_mutex_t	shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static int	iter = 100000;
+static int	bench;
+static __pmResult *shared[NHOLD];	/* handed between threads */
+
+static __pmResult *
+alloc_result(unsigned int *seed)
+{
+    __pmResult	*rp;
+    int		numpmid = 1 + rand_r(seed) % 8;
+
+    if ((rp = __pmAllocResult(numpmid)) != NULL) {
+	rp->numpmid = 0;	/* no vsets to free */
+	rp->timestamp.sec = numpmid;
+	rp->timestamp.nsec = 0;
+    }
+    return rp;
+}
+
+/* release via each of the free routines in turn */
+static void
+free_result(__pmResult *rp, int how)
+{
+    switch (how % 3) {
+	case 0:
+	    __pmFreeResult(rp);
+	    break;
+	case 1:
+	    pmFreeResult(__pmOffsetResult(rp));
+	    break;
+	case 2:
+	    pmFreeHighResResult(__pmOffsetHighResResult(rp));
+	    break;
+    }
+}
+
+static void *
+func(void *arg)
+{
+    int			iam = *((int *)arg);
+    unsigned int	seed = iam + 1;
+    __pmResult		*hold[NHOLD];
+    __pmResult		*rp;
+    __pmResult		onstack;
+    pmResult		*xp;
+    int			i, j;
+    int			bad = 0;
+
+    memset(hold, 0, sizeof(hold));
+    pthread_barrier_wait(&barrier);
+
+    for (i = 0; i < iter; i++) {
+	j = rand_r(&seed) % NHOLD;
+	if (hold[j] != NULL) {
+	    if (hold[j]->numpmid != 0 || hold[j]->timestamp.nsec != 0) {
+		fprintf(stderr, "thread %d: result[%d] %p trampled\n",
+			iam, j, hold[j]);
+		bad++;
+	    }
+	    free_result(hold[j], i);
+	    hold[j] = NULL;
+	}
+	if ((hold[j] = alloc_result(&seed)) == NULL) {
+	    fprintf(stderr, "thread %d: __pmAllocResult failed\n", iam);
+	    bad++;
+	    continue;
+	}
+
+	switch (rand_r(&seed) % 16) {
+	    case 0:
+		/* swap with a result that another thread may have made */
+		pthread_mutex_lock(&shared_lock);
+		rp = shared[j];
+		shared[j] = hold[j];
+		pthread_mutex_unlock(&shared_lock);
+		hold[j] = rp;
+		break;
+	    case 1:
+		/* neither of these are in the pool */
+		onstack.numpmid = 0;
+		__pmFreeResult(&onstack);
+		if ((xp = (pmResult *)malloc(sizeof(pmResult))) == NULL) {
+		    fprintf(stderr, "thread %d: malloc failed\n", iam);
+		    bad++;
+		    break;
+		}
+		xp->numpmid = 0;
+		pmFreeResult(xp);
+		break;
+	}
+    }
+
+    for (j = 0; j < NHOLD; j++) {
+	if (hold[j] != NULL)
+	    free_result(hold[j], j);
+    }
+
+    pthread_exit(bad ? "botch" : NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+    pthread_t		tid[64];
+    int			id[64];
+    int			nthread = 4;
+    int			c, i;
+    int			errflag = 0;
+    int			sts;
+    struct timeval	start, end;
+    void		*ret;
+    char		*endnum;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "bD:i:t:")) != EOF) {
+	switch (c) {
+
+	case 'b':	/* report timing */
+	    bench = 1;
+	    break;
+
+	case 'D':	/* debug options */
+	    sts = pmSetDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'i':	/* iterations per thread */
+	    iter = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || iter < 1) {
+		fprintf(stderr, "%s: -i requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 't':	/* number of threads */
+	    nthread = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || nthread < 1 || nthread > 64) {
+		fprintf(stderr, "%s: -t requires a numeric argument between 1 and 64\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc) {
+	fprintf(stderr, "Usage: %s [-b] [-D debug] [-i iter] [-t nthreads]\n", pmGetProgname());
+	exit(1);
+    }
+
+    sts = pthread_barrier_init(&barrier, NULL, nthread);
+    if (sts != 0) {
+	printf("pthread_barrier_init: sts=%d\n", sts);
+	exit(1);
+    }
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nthread; i++) {
+	id[i] = i;
+	sts = pthread_create(&tid[i], NULL, func, &id[i]);
+	if (sts != 0) {
+	    printf("thread_create: %d: sts=%d\n", i, sts);
+	    exit(1);
+	}
+    }
+
+    sts = 0;
+    for (i = 0; i < nthread; i++) {
+	pthread_join(tid[i], &ret);
+	if (ret != NULL) {
+	    printf("thread %d: %s\n", i, (char *)ret);
+	    sts = 1;
+	}
+    }
+    gettimeofday(&end, NULL);
+
+    for (i = 0; i < NHOLD; i++) {
+	if (shared[i] != NULL)
+	    free_result(shared[i], i);
+    }
+
+    printf("%d threads, %d iterations: %s\n",
+	    nthread, iter, sts ? "failed" : "ok");
+    if (bench)
+	fprintf(stderr, "elapsed %.3f sec, %.0f results/sec\n",
+		pmtimevalSub(&end, &start),
+		(double)nthread * iter / pmtimevalSub(&end, &start));
+
+    /* with -Dalloc, reports the pool is empty */
+    pmFreeResult(NULL);
+
+    exit(sts);
+}
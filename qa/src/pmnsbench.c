@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * Load the default PMNS (see $PMNS_DEFAULT) iter times, to measure the
+ * client startup cost of loading the ASCII or compiled PMNS (compare
+ * with $PCP_PMNS_COMPILED=0).
+ *
+ * Without -b, after the last load walk the PMNS below each name given
+ * on the command line (default the whole PMNS), reporting the children
+ * of each non-leaf node, and the PMID and any other names for each leaf.
+ *
+ * Usage: pmnsbench [-b] [-D debug] [-i iter] [name ...]
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+
+static void
+dometric(const char *name)
+{
+    pmID	pmid;
+    char	**names;
+    char	strbuf[20];
+    int		i, n;
+    int		sts;
+
+    if ((sts = pmLookupName(1, &name, &pmid)) < 0) {
+	printf("%s: %s\n", name, pmErrStr(sts));
+	return;
+    }
+    printf("%s %s", name, pmIDStr_r(pmid, strbuf, sizeof(strbuf)));
+    if ((n = pmNameAll(pmid, &names)) < 0)
+	printf(" pmNameAll: %s", pmErrStr(n));
+    else {
+	for (i = 0; i < n; i++) {
+	    if (strcmp(names[i], name) != 0)
+		printf(" %s", names[i]);
+	}
+	free(names);
+    }
+    putchar('\n');
+}
+
+static void
+dochildren(const char *name)
+{
+    char	**offspring;
+    int		*status;
+    char	*path;
+    int		i, n;
+
+    if ((n = pmGetChildrenStatus(name, &offspring, &status)) < 0) {
+	printf("%s: %s\n", name, pmErrStr(n));
+	return;
+    }
+    if (n == 0) {
+	/* leaf */
+	dometric(name);
+	return;
+    }
+    printf("%s:", *name ? name : "root");
+    for (i = 0; i < n; i++)
+	printf(" %s%s", offspring[i], status[i] == PMNS_NONLEAF_STATUS ? "." : "");
+    putchar('\n');
+    for (i = 0; i < n; i++) {
+	if (*name == '\0')
+	    path = strdup(offspring[i]);
+	else if ((path = malloc(strlen(name) + strlen(offspring[i]) + 2)) != NULL)
+	    sprintf(path, "%s.%s", name, offspring[i]);
+	if (path == NULL) {
+	    fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	    exit(1);
+	}
+	dochildren(path);
+	free(path);
+    }
+    free(offspring);
+    free(status);
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			i, n;
+    int			sts;
+    int			errflag = 0;
+    int			bench = 0;
+    int			iter = 1;
+    char		*endnum;
+    struct timeval	start, end;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "bD:i:")) != EOF) {
+	switch (c) {
+
+	case 'b':	/* report timing */
+	    bench = 1;
+	    break;
+
+	case 'D':	/* debug options */
+	    sts = pmSetDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'i':	/* number of loads */
+	    iter = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || iter < 1) {
+		fprintf(stderr, "%s: -i requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag) {
+	fprintf(stderr, "Usage: %s [-b] [-D debug] [-i iter] [name ...]\n", pmGetProgname());
+	exit(1);
+    }
+
+    gettimeofday(&start, NULL);
+    for (n = 0; n < iter; n++) {
+	if (n > 0)
+	    pmUnloadNameSpace();
+	if ((sts = pmLoadNameSpace(PM_NS_DEFAULT)) < 0) {
+	    fprintf(stderr, "pmLoadNameSpace: %s\n", pmErrStr(sts));
+	    exit(1);
+	}
+    }
+    gettimeofday(&end, NULL);
+
+    if (bench)
+	fprintf(stderr, "%d loads: %.1f usec per load\n",
+		iter, 1e6 * pmtimevalSub(&end, &start) / iter);
+    else if (optind == argc)
+	dochildren("");
+    else {
+	for (i = optind; i < argc; i++)
+	    dochildren(argv[i]);
+    }
+
+    pmUnloadNameSpace();
+    exit(0);
+}
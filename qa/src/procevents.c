@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * Check that the proc PMDA all-processes instance domain follows the
+ * creation, exit and reaping of processes (and threads, with -t) between
+ * fetches from one local context - e.g. when it is maintained from kernel
+ * process events ($PROC_EVENTS) rather than a scan of /proc each time.
+ *
+ * Usage: procevents [-t] [-D debug] [-i iter] -K spec [-K spec ...]
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+
+#define NCHILD	3
+
+static pmID	pmid;
+static int	errors;
+
+/* is the given pid an instance of proc.psinfo.pid in a new fetch? */
+static int
+present(int pid)
+{
+    pmResult	*rp;
+    int		i, sts, found = 0;
+
+    if ((sts = pmFetch(1, &pmid, &rp)) < 0) {
+	fprintf(stderr, "pmFetch: %s\n", pmErrStr(sts));
+	exit(1);
+    }
+    for (i = 0; i < rp->vset[0]->numval; i++) {
+	if (rp->vset[0]->vlist[i].inst == pid) {
+	    found = 1;
+	    break;
+	}
+    }
+    pmFreeResult(rp);
+    return found;
+}
+
+static void
+check(const char *what, int pid, int expect)
+{
+    int		found = present(pid);
+
+    if (found != expect) {
+	printf("%s: pid %d %s, expected %s\n", what, pid,
+		found ? "present" : "absent", expect ? "present" : "absent");
+	errors++;
+    }
+}
+
+/*
+ * A joined thread can linger in /proc for a moment, as the kernel
+ * reaps it after waking pthread_join - allow it up to a second.
+ */
+static void
+check_gone(const char *what, int pid)
+{
+    int		i;
+
+    for (i = 0; i < 20 && present(pid); i++)
+	usleep(50000);
+    check(what, pid, 0);
+}
+
+static int		ready[2];	/* thread to main */
+static int		release[2];	/* main to thread */
+static int		threadid;
+
+static void *
+thread(void *arg)
+{
+    char	c;
+
+#ifdef SYS_gettid
+    threadid = syscall(SYS_gettid);
+#endif
+    write(ready[1], "x", 1);
+    read(release[0], &c, 1);
+    return arg;
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			i, n;
+    int			sts;
+    int			errflag = 0;
+    int			threads = 0;
+    int			iter = 3;
+    char		*endnum;
+    char		*msg;
+    char		*name = "proc.psinfo.pid";
+    char		x;
+    siginfo_t		info;
+    pid_t		child[NCHILD];
+    pthread_t		tid;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:i:K:t")) != EOF) {
+	switch (c) {
+
+	case 'D':	/* debug options */
+	    sts = pmSetDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'i':	/* number of iterations */
+	    iter = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || iter < 1) {
+		fprintf(stderr, "%s: -i requires a positive numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'K':	/* local PMDA specification */
+	    if ((msg = pmSpecLocalPMDA(optarg)) != NULL) {
+		fprintf(stderr, "%s: pmSpecLocalPMDA(%s): %s\n",
+		    pmGetProgname(), optarg, msg);
+		errflag++;
+	    }
+	    break;
+
+	case 't':	/* threads are instances too */
+	    threads = 1;
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc) {
+	fprintf(stderr, "Usage: %s [-t] [-D debug] [-i iter] -K spec [-K spec ...]\n", pmGetProgname());
+	exit(1);
+    }
+
+    if ((sts = pmNewContext(PM_CONTEXT_LOCAL, NULL)) < 0) {
+	fprintf(stderr, "pmNewContext: %s\n", pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmLookupName(1, (const char **)&name, &pmid)) < 0) {
+	fprintf(stderr, "pmLookupName: %s\n", pmErrStr(sts));
+	exit(1);
+    }
+    if (pipe(ready) < 0 || pipe(release) < 0) {
+	perror("pipe");
+	exit(1);
+    }
+
+    check("self", getpid(), 1);
+
+    for (n = 0; n < iter; n++) {
+	for (i = 0; i < NCHILD; i++) {
+	    if ((child[i] = fork()) == 0) {
+		pause();
+		_exit(0);
+	    }
+	}
+	for (i = 0; i < NCHILD; i++)
+	    check("created", child[i], 1);
+
+	/* an exited child is a zombie, until it is reaped */
+	kill(child[0], SIGKILL);
+	while (waitid(P_PID, child[0], &info, WEXITED|WNOWAIT) < 0 && errno == EINTR)
+	    ;
+	check("zombie", child[0], 1);
+	waitpid(child[0], NULL, 0);
+	check("reaped", child[0], 0);
+	check("sibling", child[1], 1);
+
+	for (i = 1; i < NCHILD; i++) {
+	    kill(child[i], SIGKILL);
+	    waitpid(child[i], NULL, 0);
+	}
+	for (i = 1; i < NCHILD; i++)
+	    check("exited", child[i], 0);
+
+	/* created and exited between two fetches */
+	if ((child[0] = fork()) == 0)
+	    _exit(0);
+	waitpid(child[0], NULL, 0);
+	check("short-lived", child[0], 0);
+
+	if (pthread_create(&tid, NULL, thread, NULL) != 0) {
+	    perror("pthread_create");
+	    exit(1);
+	}
+	read(ready[0], &x, 1);
+	if (threadid > 0)
+	    check("thread", threadid, threads);
+	write(release[1], "x", 1);
+	pthread_join(tid, NULL);
+	if (threadid > 0)
+	    check_gone("thread exited", threadid);
+    }
+    check("self", getpid(), 1);
+
+    printf("%d iterations, %d errors\n", iter, errors);
+    exit(errors != 0);
+}
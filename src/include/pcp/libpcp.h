@@ -166,6 +166,8 @@ typedef struct __pmnsTree {
     __pmnsNode		**htab; /* hash table of nodes keyed on pmid */
     int			htabsize;     /* number of nodes in the table */
     int			mark_state;   /* the total mark value for trimming */
+    void		*map;	      /* compiled PMNS mapping, else NULL */
+    size_t		maplen;	      /* length of map */
 } __pmnsTree;
 
 /* used by pmnsmerge/pmnsdel */
@@ -519,6 +521,13 @@ typedef struct __pmHashCtl {
     __pmHashNode	*next;
     unsigned int	index;
 } __pmHashCtl;
+/*
+ * PM_HASH_OPEN tables use open addressing; these are marked by a
+ * negative hsize (so never walked by code indexing hash[] directly),
+ * hash is private to the implementation and all access must be via
+ * the __pmHash* routines below.
+ */
+#define PM_HASH_OPEN	0x1
 typedef enum {
     PM_HASH_WALK_START = 0,
     PM_HASH_WALK_NEXT,
@@ -527,6 +536,7 @@ typedef enum {
     PM_HASH_WALK_DELETE_STOP,
 } __pmHashWalkState;
 PCP_CALL extern void __pmHashInit(__pmHashCtl *);
+PCP_CALL extern void __pmHashInitFlags(__pmHashCtl *, unsigned int);
 PCP_CALL extern int __pmHashPreAlloc(int, __pmHashCtl *);
 typedef __pmHashWalkState(*__pmHashWalkCallback)(const __pmHashNode *, void *);
 PCP_CALL extern void __pmHashWalkCB(__pmHashWalkCallback, void *, const __pmHashCtl *);
@@ -784,6 +794,21 @@ typedef struct {
     off_t		off_data;	/* end of data file */
 } __pmLogTI;
 
+/*
+ * Sparse seek index, built lazily (when reading) for the records
+ * between two adjacent temporal index entries in the same volume
+ */
+typedef struct {
+    __pmTimestamp	stamp;		/* timestamp of record */
+    off_t		off;		/* start of record in data volume */
+} __pmLogSeekEnt;
+
+typedef struct {
+    int			built;		/* 1 once the interval has been scanned */
+    int			nent;		/* no. of entries */
+    __pmLogSeekEnt	*ent;		/* entries, in offset order */
+} __pmLogSeek;
+
 /*
  * Log/Archive Control
  */
@@ -815,6 +840,7 @@ typedef struct {
     __pmLogTI	*ti;		/* (when reading) temporal index */
     struct __pmnsTree *pmns;	/* namespace from meta data */
     int		multi;		/* part of a multi-archive context */
+    __pmLogSeek	*seek;		/* (when reading) seek index, one per ti[] */
 } __pmLogCtl;
 
 /* state values */
@@ -26,6 +26,9 @@
 #endif
 #define SOCKET_INTERNAL
 #include "internal.h"
+#if defined(HAVE_POLL_H)
+#include <poll.h>
+#endif
 
 /* default connect timeout is 5 seconds */
 static struct timeval	conn_wait = { 5, 0 };
@@ -1629,14 +1632,27 @@ __pmRecv(int socket, void *buffer, size_t length, int flags)
 int
 __pmSocketReady(int fd, struct timeval *timeout)
 {
+#if defined(HAVE_POLL_H)
+    struct pollfd	onefd;
+#else
     __pmFdSet	onefd;
+#endif
 
     if (fd < 0)
 	return -EBADF;
 
+#if defined(HAVE_POLL_H)
+    /* no FD_SETSIZE limit, pmcd may have many client connections */
+    onefd.fd = fd;
+    onefd.events = POLLIN;
+    onefd.revents = 0;
+    return poll(&onefd, 1, timeout == NULL ? -1 :
+		timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000);
+#else
     FD_ZERO(&onefd);
     FD_SET(fd, &onefd);
     return select(fd+1, &onefd, NULL, NULL, timeout);
+#endif
 }
 
 #endif /* !HAVE_SECURE_SOCKETS */
@@ -557,6 +557,11 @@ extern const char *compress_suffix_list(void);
 #else
 #define LZMA_DECOMPRESS		disabled
 #endif
+#if defined(HAVE_ZSTD_DECOMPRESSION)
+#define ZSTD_DECOMPRESS		enabled
+#else
+#define ZSTD_DECOMPRESS		disabled
+#endif
 #if defined(HAVE_TRANSPARENT_DECOMPRESSION)
 #define TRANSPARENT_DECOMPRESS	enabled
 #else
@@ -590,6 +595,7 @@ static struct {
 	{ "compress_suffixes",	compress_suffix_list },		/* from pcp-4.0.1 */
 	{ "v3_archives",	enabled },			/* from pcp-6.0.0 */
 	{ "archive_features",	myfeatures },			/* from pcp-6.0.0 */
+	{ "zstd_decompress",	ZSTD_DECOMPRESS },		/* from pcp-6.1.0 */
 };
 
 void
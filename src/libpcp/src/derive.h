@@ -34,6 +34,7 @@ typedef struct {		/* dynamic information for an expression node */
     int			mul_scale;	/* scale multiplier */
     int			div_scale;	/* scale divisor */
     val_t		*ivlist;	/* instance-value pairs */
+    int			maxval;		/* allocated length of ivlist[] if reused */
     struct timespec	stamp;		/* timestamp from current fetch */
     double		time_scale;	/* time utilization scaling for rate() */
     int			last_numval;	/* length of last_ivlist[] */
@@ -71,6 +72,34 @@ typedef struct node {		/* expression tree node */
     } data;
 } node_t;
 
+/*
+ * Compiled form of a bound expression tree, see __dmcompile().
+ * The nodes are flattened in post-order (operands before operators)
+ * so evaluation is a single pass over insn[] with no recursion.
+ */
+typedef void (*vecop_t)(val_t *, const pmAtomValue *, size_t, const pmAtomValue *, size_t, int);
+typedef void (*vecconv_t)(pmAtomValue *, const val_t *, int, int, int);
+
+typedef struct {
+    node_t	*np;		/* node evaluated by this instruction */
+    int		op;		/* OP_* below */
+    int		skip;		/* on error resume at insn[skip], -1 => give up */
+    int		hint;		/* OP_LOAD: vset[] index seen last time */
+    vecop_t	vecop;		/* OP_VECTOR: operator kernel */
+    vecconv_t	lconv;		/* OP_VECTOR: left operand conversion, or NULL */
+    vecconv_t	rconv;		/* OP_VECTOR: right operand conversion, or NULL */
+} insn_t;
+
+/* insn_t op codes */
+#define OP_NODE		0	/* evaluate np as the tree walker would */
+#define OP_LOAD		1	/* N_NAME, values from the pmResult */
+#define OP_VECTOR	2	/* binary operator over whole ivlist[]s */
+
+typedef struct {
+    int		ninsn;
+    insn_t	insn[1];	/* actually ninsn entries */
+} prog_t;
+
 /* bit-fields for flags below */
 #define DM_BIND		1	/* 0/1 if bind expr() has been called */
 #define DM_GLOBAL	2	/* 0 => per-context, 1 => global */
@@ -83,6 +112,7 @@ typedef struct {		/* one derived metric */
     pmID	pmid;
     int		flags;		/* bit-field flags, see DM_* macros above */
     node_t	*expr;		/* NULL => invalid, e.g. dup or missing operands */
+    prog_t	*prog;		/* compiled expr, NULL => walk the expr tree */
     const char	*oneline;	/* help text for PM_TEXT_ONELINE */
     const char	*helptext;	/* help text for PM_TEXT_HELP */
 } dm_t;
@@ -162,6 +192,7 @@ extern int __dmdesc(__pmContext *, int, pmID, pmDesc *) _PCP_HIDDEN;
 extern int __dmprefetch(__pmContext *, int, const pmID *, pmID **) _PCP_HIDDEN;
 extern void __dmpostfetch(__pmContext *, __pmResult **) _PCP_HIDDEN;
 extern void __dmdumpexpr(node_t *, int) _PCP_HIDDEN;
+extern prog_t *__dmcompile(node_t *) _PCP_HIDDEN;
 extern char *__dmnode_type_str(int) _PCP_HIDDEN;
 extern int __dmhelptext(pmID, int, char **) _PCP_HIDDEN;
 
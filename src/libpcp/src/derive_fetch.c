@@ -180,6 +180,7 @@ free_ivlist(node_t *np)
 	np->data.info->last_numval = np->data.info->numval;
 	np->data.info->last_ivlist = np->data.info->ivlist;
 	np->data.info->ivlist = NULL;
+	np->data.info->maxval = 0;
     }
     else {
 	/* no history */
@@ -203,9 +204,32 @@ free_ivlist(node_t *np)
 	free(np->data.info->ivlist);
 	np->data.info->numval = 0;
 	np->data.info->ivlist = NULL;
+	np->data.info->maxval = 0;
     }
 }
 
+/*
+ * Allocate ivlist[] for numval numeric values, reusing the previous
+ * fetch's ivlist[] if it is big enough ... not possible when saving
+ * history for delta() or rate().
+ */
+static val_t *
+reuse_ivlist(node_t *np, int numval)
+{
+    info_t	*ip = np->data.info;
+
+    if (np->save_last || ip->ivlist == NULL || ip->maxval < numval) {
+	free_ivlist(np);
+	if ((ip->ivlist = (val_t *)malloc(numval*sizeof(val_t))) == NULL) {
+	    pmNoMem("reuse_ivlist: ivlist", numval*sizeof(val_t), PM_FATAL_ERR);
+	    /*NOTREACHED*/
+	}
+	ip->maxval = numval;
+    }
+    ip->numval = numval;
+    return ip->ivlist;
+}
+
 /*
  * Binary arithmetic.
  *
@@ -675,46 +699,141 @@ regex_inst_gc(pattern_t *pp)
 }
 
 /*
- * Walk an expression tree, filling in operand values from the
- * pmResult at the leaf nodes and propagating the computed values
- * towards the root node of the tree.
+ * count() is special, errors from the operand are mapped to a value
+ * of 0 rather than propagated up the expression tree.
  */
 static int
-eval_expr(__pmContext *ctxp, node_t *np, struct timespec *stamp, int numpmid,
-		pmValueSet **vset, int level)
+count_error(node_t *np)
 {
-    int		sts;
+    if (np->data.info->ivlist == NULL) {
+	/* initialize ivlist[] for singular instance first time through */
+	if ((np->data.info->ivlist = (val_t *)malloc(sizeof(val_t))) == NULL) {
+	    pmNoMem("eval_expr: count ivlist", sizeof(val_t), PM_FATAL_ERR);
+	    /*NOTREACHED*/
+	}
+	np->data.info->ivlist[0].inst = PM_IN_NULL;
+    }
+    np->data.info->numval = 1;
+    np->data.info->ivlist[0].value.l = 0;
+    return 1;
+}
+
+/*
+ * Extract instance-values for an N_NAME node from the pmValueSet
+ * and store them in ivlist[] as <int, pmAtomValue> pairs.
+ * If reuse is set, the previous fetch's ivlist[] may be recycled for
+ * numeric types.
+ */
+static int
+load_vset(node_t *np, pmValueSet *vsp, int reuse)
+{
+    val_t	*ivlist;
+    int		numval;
     int		i;
-    int		j;
-    int		k;
     size_t	need;
-    char	strbuf[20];
 
-    assert(np != NULL);
-    if (np->left != NULL) {
-	sts = eval_expr(ctxp, np->left, stamp, numpmid, vset, level+1);
-	if (sts < 0) {
-	    if (np->type == N_COUNT) {
-		/* count() ... special case, map errors to 0 */
-		if (np->data.info->ivlist == NULL) {
-		    /* initialize ivlist[] for singular instance first time through */
-		    if ((np->data.info->ivlist = (val_t *)malloc(sizeof(val_t))) == NULL) {
-			pmNoMem("eval_expr: count ivlist", sizeof(val_t), PM_FATAL_ERR);
-			/*NOTREACHED*/
-		    }
-		    np->data.info->ivlist[0].inst = PM_IN_NULL;
-		}
-		np->data.info->numval = 1;
-		np->data.info->ivlist[0].value.l = 0;
-		sts = 1;
-	    }
-	    return sts;
+    if (reuse && vsp->numval > 0 &&
+	np->desc.type >= PM_TYPE_32 && np->desc.type <= PM_TYPE_DOUBLE)
+	reuse_ivlist(np, vsp->numval);
+    else {
+	free_ivlist(np);
+	np->data.info->numval = vsp->numval;
+	if (np->data.info->numval <= 0)
+	    return np->data.info->numval;
+	if ((np->data.info->ivlist = (val_t *)malloc(np->data.info->numval*sizeof(val_t))) == NULL) {
+	    pmNoMem("eval_expr: metric ivlist", np->data.info->numval*sizeof(val_t), PM_FATAL_ERR);
+	    /*NOTREACHED*/
 	}
     }
-    if (np->right != NULL) {
-	sts = eval_expr(ctxp, np->right, stamp, numpmid, vset, level+1);
-	if (sts < 0) return sts;
+    ivlist = np->data.info->ivlist;
+    numval = np->data.info->numval;
+    for (i = 0; i < numval; i++)
+	ivlist[i].inst = vsp->vlist[i].inst;
+    switch (np->desc.type) {
+	case PM_TYPE_32:
+	case PM_TYPE_U32:
+	    for (i = 0; i < numval; i++)
+		ivlist[i].value.l = vsp->vlist[i].value.lval;
+	    break;
+	case PM_TYPE_64:
+	case PM_TYPE_U64:
+	    if (vsp->valfmt != PM_VAL_DPTR && vsp->valfmt != PM_VAL_SPTR)
+		return PM_ERR_LOGREC;
+	    for (i = 0; i < numval; i++)
+		memcpy((void *)&ivlist[i].value.ll, (void *)vsp->vlist[i].value.pval->vbuf, sizeof(__int64_t));
+	    break;
+	case PM_TYPE_FLOAT:
+	    if (vsp->valfmt == PM_VAL_INSITU) {
+		/* old style insitu float */
+		for (i = 0; i < numval; i++)
+		    ivlist[i].value.l = vsp->vlist[i].value.lval;
+	    }
+	    else if (vsp->valfmt == PM_VAL_DPTR || vsp->valfmt == PM_VAL_SPTR) {
+		for (i = 0; i < numval; i++) {
+		    assert(vsp->vlist[i].value.pval->vtype == PM_TYPE_FLOAT);
+		    memcpy((void *)&ivlist[i].value.f, (void *)vsp->vlist[i].value.pval->vbuf, sizeof(float));
+		}
+	    }
+	    else
+		return PM_ERR_LOGREC;
+	    break;
+	case PM_TYPE_DOUBLE:
+	    if (vsp->valfmt != PM_VAL_DPTR && vsp->valfmt != PM_VAL_SPTR)
+		return PM_ERR_LOGREC;
+	    for (i = 0; i < numval; i++)
+		memcpy((void *)&ivlist[i].value.d, (void *)vsp->vlist[i].value.pval->vbuf, sizeof(double));
+	    break;
+	case PM_TYPE_STRING:
+	    if (vsp->valfmt != PM_VAL_DPTR && vsp->valfmt != PM_VAL_SPTR)
+		return PM_ERR_LOGREC;
+	    for (i = 0; i < numval; i++) {
+		need = vsp->vlist[i].value.pval->vlen-PM_VAL_HDR_SIZE;
+		if ((ivlist[i].value.cp = (char *)malloc(need)) == NULL) {
+		    pmNoMem("eval_expr: string value", vsp->vlist[i].value.pval->vlen, PM_FATAL_ERR);
+		    /*NOTREACHED*/
+		}
+		memcpy((void *)ivlist[i].value.cp, (void *)vsp->vlist[i].value.pval->vbuf, need);
+		ivlist[i].vlen = need;
+	    }
+	    break;
+	case PM_TYPE_AGGREGATE:
+	case PM_TYPE_AGGREGATE_STATIC:
+	case PM_TYPE_EVENT:
+	case PM_TYPE_HIGHRES_EVENT:
+	    if (vsp->valfmt != PM_VAL_DPTR && vsp->valfmt != PM_VAL_SPTR)
+		return PM_ERR_LOGREC;
+	    for (i = 0; i < numval; i++) {
+		if ((ivlist[i].value.vbp = (pmValueBlock *)malloc(vsp->vlist[i].value.pval->vlen)) == NULL) {
+		    pmNoMem("eval_expr: aggregate value", vsp->vlist[i].value.pval->vlen, PM_FATAL_ERR);
+		    /*NOTREACHED*/
+		}
+		memcpy(ivlist[i].value.vbp, (void *)vsp->vlist[i].value.pval, vsp->vlist[i].value.pval->vlen);
+		ivlist[i].vlen = vsp->vlist[i].value.pval->vlen;
+	    }
+	    break;
+	default:
+	    /*
+	     * really only PM_TYPE_NOSUPPORT should
+	     * end up here
+	     */
+	    return PM_ERR_TYPE;
     }
+    return np->data.info->numval;
+}
+
+/*
+ * Evaluate one node of an expression tree, the operand values (if
+ * any) have already been computed in the left and right nodes.
+ */
+static int
+eval_node(__pmContext *ctxp, node_t *np, struct timespec *stamp, int numpmid,
+		pmValueSet **vset)
+{
+    int		sts;
+    int		i;
+    int		j;
+    int		k;
+    char	strbuf[20];
 
     /* mostly, np->left is not NULL ... */
     assert (np->type == N_INTEGER || np->type == N_DOUBLE ||
@@ -1387,84 +1506,9 @@ eval_expr(__pmContext *ctxp, node_t *np, struct timespec *stamp, int numpmid,
 	    return np->data.info->numval;
 
 	case N_NAME:
-	    /*
-	     * Extract instance-values from pmResult and store them in
-	     * ivlist[] as <int, pmAtomValue> pairs
-	     */
 	    for (j = 0; j < numpmid; j++) {
-		if (np->data.info->pmid == vset[j]->pmid) {
-		    free_ivlist(np);
-		    np->data.info->numval = vset[j]->numval;
-		    if (np->data.info->numval <= 0)
-			return np->data.info->numval;
-		    if ((np->data.info->ivlist = (val_t *)malloc(np->data.info->numval*sizeof(val_t))) == NULL) {
-			pmNoMem("eval_expr: metric ivlist", np->data.info->numval*sizeof(val_t), PM_FATAL_ERR);
-			/*NOTREACHED*/
-		    }
-		    for (i = 0; i < np->data.info->numval; i++) {
-			np->data.info->ivlist[i].inst = vset[j]->vlist[i].inst;
-			switch (np->desc.type) {
-			    case PM_TYPE_32:
-			    case PM_TYPE_U32:
-				np->data.info->ivlist[i].value.l = vset[j]->vlist[i].value.lval;
-				break;
-			    case PM_TYPE_64:
-			    case PM_TYPE_U64:
-				if (vset[j]->valfmt != PM_VAL_DPTR && vset[j]->valfmt != PM_VAL_SPTR)
-				    return PM_ERR_LOGREC;
-				memcpy((void *)&np->data.info->ivlist[i].value.ll, (void *)vset[j]->vlist[i].value.pval->vbuf, sizeof(__int64_t));
-				break;
-			    case PM_TYPE_FLOAT:
-				if (vset[j]->valfmt == PM_VAL_INSITU) {
-				    /* old style insitu float */
-				    np->data.info->ivlist[i].value.l = vset[j]->vlist[i].value.lval;
-				}
-				else if (vset[j]->valfmt == PM_VAL_DPTR || vset[j]->valfmt == PM_VAL_SPTR) {
-				    assert(vset[j]->vlist[i].value.pval->vtype == PM_TYPE_FLOAT);
-				    memcpy((void *)&np->data.info->ivlist[i].value.f, (void *)vset[j]->vlist[i].value.pval->vbuf, sizeof(float));
-				}
-				else
-				    return PM_ERR_LOGREC;
-				break;
-			    case PM_TYPE_DOUBLE:
-				if (vset[j]->valfmt != PM_VAL_DPTR && vset[j]->valfmt != PM_VAL_SPTR)
-				    return PM_ERR_LOGREC;
-				memcpy((void *)&np->data.info->ivlist[i].value.d, (void *)vset[j]->vlist[i].value.pval->vbuf, sizeof(double));
-				break;
-			    case PM_TYPE_STRING:
-				if (vset[j]->valfmt != PM_VAL_DPTR && vset[j]->valfmt != PM_VAL_SPTR)
-				    return PM_ERR_LOGREC;
-				need = vset[j]->vlist[i].value.pval->vlen-PM_VAL_HDR_SIZE;
-				if ((np->data.info->ivlist[i].value.cp = (char *)malloc(need)) == NULL) {
-				    pmNoMem("eval_expr: string value", vset[j]->vlist[i].value.pval->vlen, PM_FATAL_ERR);
-				    /*NOTREACHED*/
-				}
-				memcpy((void *)np->data.info->ivlist[i].value.cp, (void *)vset[j]->vlist[i].value.pval->vbuf, need);
-				np->data.info->ivlist[i].vlen = need;
-				break;
-			    case PM_TYPE_AGGREGATE:
-			    case PM_TYPE_AGGREGATE_STATIC:
-			    case PM_TYPE_EVENT:
-			    case PM_TYPE_HIGHRES_EVENT:
-				if (vset[j]->valfmt != PM_VAL_DPTR && vset[j]->valfmt != PM_VAL_SPTR)
-				    return PM_ERR_LOGREC;
-				if ((np->data.info->ivlist[i].value.vbp = (pmValueBlock *)malloc(vset[j]->vlist[i].value.pval->vlen)) == NULL) {
-				    pmNoMem("eval_expr: aggregate value", vset[j]->vlist[i].value.pval->vlen, PM_FATAL_ERR);
-				    /*NOTREACHED*/
-				}
-				memcpy(np->data.info->ivlist[i].value.vbp, (void *)vset[j]->vlist[i].value.pval, vset[j]->vlist[i].value.pval->vlen);
-				np->data.info->ivlist[i].vlen = vset[j]->vlist[i].value.pval->vlen;
-				break;
-			    default:
-				/*
-				 * really only PM_TYPE_NOSUPPORT should
-				 * end up here
-				 */
-				return PM_ERR_TYPE;
-			}
-		    }
-		    return np->data.info->numval;
-		}
+		if (np->data.info->pmid == vset[j]->pmid)
+		    return load_vset(np, vset[j], 0);
 	    }
 	    if (pmDebugOptions.derive)
 		fprintf(stderr, "eval_expr: botch: operand %s not in the extended pmResult\n", pmIDStr_r(np->data.info->pmid, strbuf, sizeof(strbuf)));
@@ -1783,6 +1827,434 @@ eval_expr(__pmContext *ctxp, node_t *np, struct timespec *stamp, int numpmid,
     /*NOTREACHED*/
 }
 
+/*
+ * Walk an expression tree, filling in operand values from the
+ * pmResult at the leaf nodes and propagating the computed values
+ * towards the root node of the tree.
+ */
+static int
+eval_expr(__pmContext *ctxp, node_t *np, struct timespec *stamp, int numpmid,
+		pmValueSet **vset, int level)
+{
+    int		sts;
+
+    assert(np != NULL);
+    if (np->left != NULL) {
+	sts = eval_expr(ctxp, np->left, stamp, numpmid, vset, level+1);
+	if (sts < 0) {
+	    if (np->type == N_COUNT)
+		sts = count_error(np);
+	    return sts;
+	}
+    }
+    if (np->right != NULL) {
+	sts = eval_expr(ctxp, np->right, stamp, numpmid, vset, level+1);
+	if (sts < 0) return sts;
+    }
+
+    return eval_node(ctxp, np, stamp, numpmid, vset);
+}
+
+/*
+ * Compiled expressions.
+ *
+ * At bind time the expression tree for each derived metric is
+ * flattened into a prog_t, see __dmcompile(), and at fetch time
+ * eval_prog() makes a single pass over the instructions.
+ *
+ * The arithmetic, relational and boolean operators are evaluated
+ * over the whole ivlist[] of each operand with a kernel chosen at
+ * bind time for the operator and the (promoted) operand type, so
+ * there is no per-value switching as in bin_op().  Operands that
+ * need type promotion or units scaling are converted in chunks of
+ * VEC_CHUNK values into a contiguous buffer first, otherwise the
+ * kernels read the operand's ivlist[] in place.
+ *
+ * Anything else, and the binary operators when the operand instances
+ * are not aligned, is evaluated by eval_node() exactly as for the
+ * tree walk.
+ */
+
+#define VEC_CHUNK	256
+
+static int	treewalk = -1;		/* PCP_DERIVED_TREEWALK=1 => no compile */
+
+#define VEC_CONV(name, dfield, sfield) \
+static void \
+name(pmAtomValue *dst, const val_t *src, int n, int mul, int div) \
+{ \
+    int		k; \
+    for (k = 0; k < n; k++) \
+	dst[k].dfield = src[k].value.sfield; \
+}
+
+/* conversion to double includes units scaling, see bin_op() */
+#define VEC_CONV_D(name, sfield) \
+static void \
+name(pmAtomValue *dst, const val_t *src, int n, int mul, int div) \
+{ \
+    int		k; \
+    for (k = 0; k < n; k++) { \
+	dst[k].d = src[k].value.sfield; \
+	dst[k].d = (dst[k].d / div) * mul; \
+    } \
+}
+
+VEC_CONV(conv_32_64, ll, l)
+VEC_CONV(conv_u32_64, ll, ul)
+VEC_CONV(conv_32_float, f, l)
+VEC_CONV(conv_u32_float, f, ul)
+VEC_CONV(conv_64_float, f, ll)
+VEC_CONV(conv_u64_float, f, ull)
+VEC_CONV_D(conv_32_double, l)
+VEC_CONV_D(conv_u32_double, ul)
+VEC_CONV_D(conv_64_double, ll)
+VEC_CONV_D(conv_u64_double, ull)
+VEC_CONV_D(conv_float_double, f)
+VEC_CONV_D(conv_double_double, d)
+
+/*
+ * Conversion for an operand to type ... mirrors the promotion in
+ * bin_op(), NULL means the operand values are used as is.
+ */
+static vecconv_t
+vec_conv(node_t *np, int type)
+{
+    switch (type) {
+	case PM_TYPE_64:
+	case PM_TYPE_U64:
+	    if (np->desc.type == PM_TYPE_32)
+		return conv_32_64;
+	    if (np->desc.type == PM_TYPE_U32)
+		return conv_u32_64;
+	    break;
+	case PM_TYPE_FLOAT:
+	    switch (np->desc.type) {
+		case PM_TYPE_32:
+		    return conv_32_float;
+		case PM_TYPE_U32:
+		    return conv_u32_float;
+		case PM_TYPE_64:
+		    return conv_64_float;
+		case PM_TYPE_U64:
+		    return conv_u64_float;
+	    }
+	    break;
+	case PM_TYPE_DOUBLE:
+	    switch (np->desc.type) {
+		case PM_TYPE_32:
+		    return conv_32_double;
+		case PM_TYPE_U32:
+		    return conv_u32_double;
+		case PM_TYPE_64:
+		    return conv_64_double;
+		case PM_TYPE_U64:
+		    return conv_u64_double;
+		case PM_TYPE_FLOAT:
+		    return conv_float_double;
+		case PM_TYPE_DOUBLE:
+		    if (np->data.info->mul_scale != 1 ||
+			np->data.info->div_scale != 1)
+			return conv_double_double;
+		    break;
+	    }
+	    break;
+    }
+    return NULL;
+}
+
+/*
+ * Operator kernels, res[k] = a[k] <op> b[k] for k in 0 .. n-1 where
+ * the operand strides are in bytes, 0 for a singular operand.
+ */
+#define VEC_OP(name, rfield, expr) \
+static void \
+name(val_t *res, const pmAtomValue *a, size_t as, const pmAtomValue *b, size_t bs, int n) \
+{ \
+    int		k; \
+    for (k = 0; k < n; k++) { \
+	res[k].value.rfield = (expr); \
+	a = (const pmAtomValue *)((const char *)a + as); \
+	b = (const pmAtomValue *)((const char *)b + bs); \
+    } \
+}
+
+/* relational and boolean operators always produce a U32 result */
+#define VEC_OPS(t, f) \
+VEC_OP(vec_plus_##t, f, a->f + b->f) \
+VEC_OP(vec_minus_##t, f, a->f - b->f) \
+VEC_OP(vec_star_##t, f, a->f * b->f) \
+VEC_OP(vec_lt_##t, ul, a->f < b->f) \
+VEC_OP(vec_leq_##t, ul, a->f <= b->f) \
+VEC_OP(vec_eq_##t, ul, a->f == b->f) \
+VEC_OP(vec_geq_##t, ul, a->f >= b->f) \
+VEC_OP(vec_gt_##t, ul, a->f > b->f) \
+VEC_OP(vec_neq_##t, ul, a->f != b->f) \
+VEC_OP(vec_and_##t, ul, (a->f != 0) && (b->f != 0)) \
+VEC_OP(vec_or_##t, ul, (a->f != 0) || (b->f != 0))
+
+VEC_OPS(32, l)
+VEC_OPS(u32, ul)
+VEC_OPS(64, ll)
+VEC_OPS(u64, ull)
+VEC_OPS(float, f)
+VEC_OPS(double, d)
+/* semantics enforce no N_SLASH for integer or float results */
+VEC_OP(vec_slash_double, d, a->d == 0 ? 0 : a->d / b->d)
+
+#define VEC_ROW(t, slash) { vec_plus_##t, vec_minus_##t, vec_star_##t, slash, \
+	vec_lt_##t, vec_leq_##t, vec_eq_##t, vec_geq_##t, vec_gt_##t, \
+	vec_neq_##t, vec_and_##t, vec_or_##t }
+
+/* indexed by PM_TYPE_* and vec_column() */
+static const vecop_t vecop_tab[PM_TYPE_DOUBLE+1][12] = {
+    VEC_ROW(32, NULL),
+    VEC_ROW(u32, NULL),
+    VEC_ROW(64, NULL),
+    VEC_ROW(u64, NULL),
+    VEC_ROW(float, NULL),
+    VEC_ROW(double, vec_slash_double),
+};
+
+static int
+vec_column(int op)
+{
+    if (op >= N_PLUS && op <= N_SLASH)
+	return op - N_PLUS;
+    if (op >= N_LT && op <= N_OR)
+	return 4 + op - N_LT;
+    return -1;
+}
+
+static const pmAtomValue *
+vec_operand(vecconv_t conv, info_t *ip, int isvec, int i, int n,
+		pmAtomValue *buf, size_t *stride)
+{
+    const val_t	*vp = isvec ? &ip->ivlist[i] : &ip->ivlist[0];
+
+    if (conv == NULL) {
+	*stride = isvec ? sizeof(val_t) : 0;
+	return &vp->value;
+    }
+    conv(buf, vp, isvec ? n : 1, ip->mul_scale, ip->div_scale);
+    *stride = isvec ? sizeof(pmAtomValue) : 0;
+    return buf;
+}
+
+/*
+ * Binary operator for a compiled expression ... same semantics as
+ * the binary operator case in eval_node(), which is used when either
+ * operand has no values or both operands have an instance domain and
+ * the instances are not the same (and in the same order).
+ */
+static int
+eval_vector(__pmContext *ctxp, insn_t *ip, struct timespec *stamp,
+		int numpmid, pmValueSet **vset)
+{
+    node_t		*np = ip->np;
+    info_t		*left = np->left->data.info;
+    info_t		*right = np->right->data.info;
+    int			lvec = (np->left->desc.indom != PM_INDOM_NULL);
+    int			rvec = (np->right->desc.indom != PM_INDOM_NULL);
+    pmAtomValue		lbuf[VEC_CHUNK];
+    pmAtomValue		rbuf[VEC_CHUNK];
+    const pmAtomValue	*a;
+    const pmAtomValue	*b;
+    size_t		as;
+    size_t		bs;
+    val_t		*res;
+    int			numval;
+    int			i;
+    int			n;
+
+    if (left->numval <= 0 || right->numval <= 0)
+	return eval_node(ctxp, np, stamp, numpmid, vset);
+    if (lvec && rvec) {
+	if (left->numval != right->numval)
+	    return eval_node(ctxp, np, stamp, numpmid, vset);
+	for (i = 0; i < left->numval; i++) {
+	    if (left->ivlist[i].inst != right->ivlist[i].inst)
+		return eval_node(ctxp, np, stamp, numpmid, vset);
+	}
+    }
+    numval = lvec ? left->numval : right->numval;
+
+    res = reuse_ivlist(np, numval);
+    for (i = 0; i < numval; i += n) {
+	n = numval - i < VEC_CHUNK ? numval - i : VEC_CHUNK;
+	a = vec_operand(ip->lconv, left, lvec, i, n, lbuf, &as);
+	b = vec_operand(ip->rconv, right, rvec, i, n, rbuf, &bs);
+	ip->vecop(&res[i], a, as, b, bs, n);
+    }
+    if (lvec) {
+	for (i = 0; i < numval; i++)
+	    res[i].inst = left->ivlist[i].inst;
+    }
+    else if (rvec) {
+	for (i = 0; i < numval; i++)
+	    res[i].inst = right->ivlist[i].inst;
+    }
+    else {
+	for (i = 0; i < numval; i++)
+	    res[i].inst = right->ivlist[0].inst;
+    }
+    return numval;
+}
+
+/*
+ * Evaluate a compiled expression, the result is in the last node
+ * as for eval_expr().
+ */
+static int
+eval_prog(__pmContext *ctxp, prog_t *prog, struct timespec *stamp,
+		int numpmid, pmValueSet **vset)
+{
+    insn_t	*ip;
+    int		pc;
+    int		j;
+    int		sts = 0;
+
+    for (pc = 0; pc < prog->ninsn; pc++) {
+	ip = &prog->insn[pc];
+	switch (ip->op) {
+	    case OP_LOAD:
+		/* operands are usually in the same place in each pmResult */
+		j = ip->hint;
+		if (j >= numpmid || vset[j]->pmid != ip->np->data.info->pmid) {
+		    for (j = 0; j < numpmid; j++) {
+			if (vset[j]->pmid == ip->np->data.info->pmid)
+			    break;
+		    }
+		}
+		if (j < numpmid) {
+		    ip->hint = j;
+		    sts = load_vset(ip->np, vset[j], 1);
+		}
+		else
+		    /* botch, reported in eval_node() */
+		    sts = eval_node(ctxp, ip->np, stamp, numpmid, vset);
+		break;
+	    case OP_VECTOR:
+		sts = eval_vector(ctxp, ip, stamp, numpmid, vset);
+		break;
+	    default:
+		sts = eval_node(ctxp, ip->np, stamp, numpmid, vset);
+		break;
+	}
+	if (sts < 0) {
+	    /* unless this is below a count(), the error is the result */
+	    if (ip->skip < 0)
+		return sts;
+	    pc = ip->skip;
+	    sts = count_error(prog->insn[pc].np);
+	}
+    }
+    return sts;
+}
+
+static int
+compile_node(node_t *np, insn_t *insn, int n)
+{
+    insn_t	*ip;
+    int		first = n;
+    int		col;
+    int		type;
+    int		i;
+
+    if (np->left != NULL)
+	n = compile_node(np->left, insn, n);
+    if (np->right != NULL)
+	n = compile_node(np->right, insn, n);
+    if (insn == NULL)
+	/* sizing pass */
+	return n + 1;
+
+    ip = &insn[n];
+    ip->np = np;
+    ip->op = OP_NODE;
+    ip->skip = -1;
+    ip->hint = 0;
+    ip->vecop = NULL;
+    ip->lconv = ip->rconv = NULL;
+    if (np->type == N_NAME)
+	ip->op = OP_LOAD;
+    else if (np->type == N_COUNT) {
+	/* errors from the operand resume here */
+	for (i = first; i < n; i++) {
+	    if (insn[i].skip < 0)
+		insn[i].skip = n;
+	}
+    }
+    else if ((col = vec_column(np->type)) >= 0 &&
+	     np->left->desc.type >= PM_TYPE_32 &&
+	     np->left->desc.type <= PM_TYPE_DOUBLE &&
+	     np->right->desc.type >= PM_TYPE_32 &&
+	     np->right->desc.type <= PM_TYPE_DOUBLE) {
+	/* relational and boolean operators compare in the promoted type */
+	if (col >= 4)
+	    type = promote[np->left->desc.type][np->right->desc.type];
+	else
+	    type = np->desc.type;
+	if (type >= PM_TYPE_32 && type <= PM_TYPE_DOUBLE &&
+	    vecop_tab[type][col] != NULL) {
+	    ip->op = OP_VECTOR;
+	    ip->vecop = vecop_tab[type][col];
+	    ip->lconv = vec_conv(np->left, type);
+	    ip->rconv = vec_conv(np->right, type);
+	}
+    }
+    return n + 1;
+}
+
+/*
+ * Compile a bound and checked expression tree, returns NULL if the
+ * tree should be walked at fetch time instead.
+ */
+prog_t *
+__dmcompile(node_t *np)
+{
+    prog_t	*prog;
+    int		ninsn;
+    size_t	need;
+
+    if (treewalk == -1) {
+	/* one-trip initialization */
+	char	*str;
+
+	PM_LOCK(__pmLock_extcall);
+	str = getenv("PCP_DERIVED_TREEWALK");		/* THREADSAFE */
+	treewalk = (str != NULL && strcmp(str, "1") == 0);
+	PM_UNLOCK(__pmLock_extcall);
+    }
+    if (treewalk || np == NULL)
+	return NULL;
+
+    ninsn = compile_node(np, NULL, 0);
+    need = sizeof(prog_t) + (ninsn - 1) * sizeof(insn_t);
+    if ((prog = (prog_t *)malloc(need)) == NULL) {
+	/* not fatal, walk the tree instead */
+	pmNoMem("__dmcompile: prog", need, PM_RECOV_ERR);
+	return NULL;
+    }
+    prog->ninsn = compile_node(np, prog->insn, 0);
+    assert(prog->ninsn == ninsn);
+
+    if (pmDebugOptions.derive && pmDebugOptions.appl1) {
+	int	i;
+
+	fprintf(stderr, "__dmcompile: %d insns:", prog->ninsn);
+	for (i = 0; i < prog->ninsn; i++) {
+	    fprintf(stderr, " %s%s", __dmnode_type_str(prog->insn[i].np->type),
+		prog->insn[i].op == OP_VECTOR ? "[vec]" : "");
+	    if (prog->insn[i].skip >= 0)
+		fprintf(stderr, "->%d", prog->insn[i].skip);
+	}
+	fputc('\n', stderr);
+    }
+
+    return prog;
+}
+
 /*
  * Algorithm here is complicated by trying to re-write the pmValueSets
  * in a result structure (either pmResult or pmHighResResult).
@@ -1850,7 +2322,11 @@ __dmpostvalueset(__pmContext *ctxp, struct timespec *stamp, int vnumpmid,
 			else
 			    valfmt = PM_VAL_DPTR;
 
-			numval = eval_expr(ctxp, cp->mlist[m].expr,
+			if (cp->mlist[m].prog != NULL)
+			    numval = eval_prog(ctxp, cp->mlist[m].prog,
+						stamp, vnumpmid, vset);
+			else
+			    numval = eval_expr(ctxp, cp->mlist[m].expr,
 						stamp, vnumpmid, vset, 1);
 			if (numval == PM_ERR_PMID)
 			    fails++;
@@ -43,6 +43,14 @@ __pmUpdateProfile(int fd, __pmContext *ctxp, int timeout)
     return 0;
 }
 
+/*
+ * If $PCP_FETCH_ARENA is set to 1, results from pmcd are decoded into
+ * a single allocation (see __pmDecodeResultArena_ctx()), which suits
+ * clients fetching many metrics or large instance domains, provided
+ * they only ever release results with pmFreeResult() et al.
+ */
+static int	fetch_arena = -1;
+
 static int
 __pmRecvFetchPDU(int fd, __pmContext *ctxp, int timeout, int pdutype,
 		__pmResult **result)
@@ -50,12 +58,26 @@ __pmRecvFetchPDU(int fd, __pmContext *ctxp, int timeout, int pdutype,
     __pmPDU	*pb;
     int		sts, pinpdu, changed = 0;
 
+    if (fetch_arena == -1) {
+	/* one-trip initialization */
+	char	*str;
+
+	PM_LOCK(__pmLock_extcall);
+	str = getenv("PCP_FETCH_ARENA");		/* THREADSAFE */
+	fetch_arena = (str != NULL && strcmp(str, "1") == 0);
+	PM_UNLOCK(__pmLock_extcall);
+    }
+
     do {
 	sts = pinpdu = __pmGetPDU(fd, ANY_SIZE, timeout, &pb);
 	if (sts == PDU_HIGHRES_RESULT && pdutype == PDU_HIGHRES_FETCH)
-	    sts = __pmDecodeHighResResult_ctx(ctxp, pb, result);
+	    sts = fetch_arena ?
+		__pmDecodeHighResResultArena_ctx(ctxp, pb, result) :
+		__pmDecodeHighResResult_ctx(ctxp, pb, result);
 	else if (sts == PDU_RESULT && pdutype == PDU_FETCH)
-	    sts = __pmDecodeResult_ctx(ctxp, pb, result);
+	    sts = fetch_arena ?
+		__pmDecodeResultArena_ctx(ctxp, pb, result) :
+		__pmDecodeResult_ctx(ctxp, pb, result);
 	else if (sts == PDU_ERROR) {
 	    __pmDecodeError(pb, &sts);
 	    if (sts > 0)
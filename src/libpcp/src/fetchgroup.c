@@ -28,7 +28,7 @@
  */
 struct __pmInDomCache {
    pmInDom	indom;
-   int		*codes;	/* saved from pmGetInDom */
+   int		*codes;	/* saved from pmGetInDom, then sorted */
    char		**names;
    unsigned int	size;
    int		refreshed;
@@ -48,6 +48,7 @@ struct __pmFetchGroup {
     pmID *unique_pmids;
     size_t num_unique_pmids;
     size_t num_unique_indoms;
+    __pmHashCtl pmid_index;	/* pmID -> position in unique_pmids */
 };
 
 /*
@@ -76,6 +77,8 @@ struct __pmFetchGroupItem {
 	    pmID metric_pmid;
 	    pmDesc metric_desc;
 	    int metric_inst;	/* unused if metric_desc.indom == PM_INDOM_NULL */
+	    int metric_vset;	/* position in unique_pmids, see pmfg_add_pmid */
+	    int metric_vlist;	/* position of metric_inst in the last result */
 	    struct __pmFetchGroupConversionSpec conv;
 	    pmAtomValue *output_value;	/* NB: may be NULL */
 	    int output_type;	/* PM_TYPE_* */
@@ -84,6 +87,8 @@ struct __pmFetchGroupItem {
 	struct {
 	    pmID metric_pmid;
 	    pmDesc metric_desc;
+	    int metric_vset;	/* position in unique_pmids, see pmfg_add_pmid */
+	    int metric_cache;	/* position in unique_indoms, or -1 */
 	    struct __pmFetchGroupConversionSpec conv;
 	    int *output_inst_codes;	/* NB: may be NULL */
 	    char **output_inst_names;	/* NB: may be NULL */
@@ -98,6 +103,8 @@ struct __pmFetchGroupItem {
 	    pmID metric_pmid;
 	    pmDesc metric_desc;
 	    int metric_inst;
+	    int metric_vset;	/* position in unique_pmids, see pmfg_add_pmid */
+	    int metric_vlist;	/* position of metric_inst in the last result */
 	    pmID field_pmid;
 	    pmDesc field_desc;
 	    struct __pmFetchGroupConversionSpec conv;
@@ -131,31 +138,89 @@ pmfg_timespec_from_timeval(const struct timeval *tv, struct timespec *ts)
 
 /*
  * Update the accumulated set of unique pmIDs sought by given pmFG, so
- * as to precalculate the data pmFetch() will need.
+ * as to precalculate the data pmFetch() will need.  Returns the position
+ * of pmid in unique_pmids - which is also the position of its pmValueSet
+ * in each pmFetch() result - or a negative error code.
  */
 static int
 pmfg_add_pmid(pmFG pmfg, pmID pmid)
 {
-    size_t i;
+    __pmHashNode *hp;
+    size_t i, size;
+    pmID *new_unique_pmids;
+    int sts;
 
     if (pmfg == NULL)
 	return -EINVAL;
 
-    for (i = 0; i < pmfg->num_unique_pmids; i++) {
-	if (pmfg->unique_pmids[i] == pmid)
-	    break;
-    }
+    if ((hp = __pmHashSearch(pmid, &pmfg->pmid_index)) != NULL)
+	return (int)(uintptr_t)hp->data;
+
+    /* not found */
+    i = pmfg->num_unique_pmids;
+    size = sizeof(pmID) * (i + 1);
+    new_unique_pmids = realloc(pmfg->unique_pmids, size);
+    if (new_unique_pmids == NULL)
+	return -ENOMEM;
+    pmfg->unique_pmids = new_unique_pmids;
 
-    if (i >= pmfg->num_unique_pmids) {	/* not found */
-	size_t size = sizeof(pmID) * (pmfg->num_unique_pmids + 1);
-	pmID *new_unique_pmids = realloc(pmfg->unique_pmids, size);
+    sts = __pmHashAdd(pmid, (void *)(uintptr_t)i, &pmfg->pmid_index);
+    if (sts < 0)
+	return sts;
+    pmfg->unique_pmids[pmfg->num_unique_pmids++] = pmid;
+    return (int)i;
+}
 
-	if (new_unique_pmids == NULL)
-	    return -ENOMEM;
-	pmfg->unique_pmids = new_unique_pmids;
-	pmfg->unique_pmids[pmfg->num_unique_pmids++] = pmid;
+/*
+ * Find the pmValueSet for pmid in a result.  Since pmFetch() returns
+ * a pmValueSet for each requested pmID in request order, the position
+ * noted by pmfg_add_pmid is checked first, falling back to a search
+ * for results that do not match the request (e.g. the empty result
+ * made up after a failed pmFetch()).
+ */
+static pmValueSet *
+pmfg_find_vset(pmID pmid, int vset, pmValueSet **vsets, int numpmid)
+{
+    int i;
+
+    if (vset >= 0 && vset < numpmid && vsets[vset]->pmid == pmid)
+	return vsets[vset];
+    for (i = 0; i < numpmid; i++) {
+	if (vsets[i]->pmid == pmid)
+	    return vsets[i];
     }
-    return 0;
+    return NULL;
+}
+
+/*
+ * Find the position of an instance in a pmValueSet, first checking
+ * the position *vlist where it was found last time (and updating that).
+ * Relies on pmFetchGroup() having sorted the instances in each result.
+ */
+static int
+pmfg_find_inst(const pmValueSet *vsp, int inst, int *vlist)
+{
+    int lo, hi, mid;
+
+    if (*vlist >= 0 && *vlist < vsp->numval && vsp->vlist[*vlist].inst == inst)
+	return *vlist;
+
+    lo = 0;
+    hi = vsp->numval - 1;
+    while (lo <= hi) {
+	mid = lo + (hi - lo) / 2;
+	if (vsp->vlist[mid].inst < inst)
+	    lo = mid + 1;
+	else if (vsp->vlist[mid].inst > inst)
+	    hi = mid - 1;
+	else {
+	    /* first of any duplicates, as a linear search would find */
+	    while (mid > 0 && vsp->vlist[mid-1].inst == inst)
+		mid--;
+	    return *vlist = mid;
+	}
+    }
+    return -1;
 }
 
 /*
@@ -215,6 +280,7 @@ pmfg_lookup_indom(pmFG pmfg, const char *metric, pmFGI item)
 	return sts;
 
     /* As a convenience to users, we also accept non-indom'd metrics */
+    item->u.indom.metric_cache = -1;
     if ((indom = item->u.indom.metric_desc.indom) == PM_INDOM_NULL)
 	return 0;
 
@@ -222,8 +288,10 @@ pmfg_lookup_indom(pmFG pmfg, const char *metric, pmFGI item)
      * Insert into the instance domain cache if not seen previously
      */
     for (i = 0; i < pmfg->num_unique_indoms; i++) {
-	if (pmfg->unique_indoms[i].indom == indom)
+	if (pmfg->unique_indoms[i].indom == indom) {
+	    item->u.indom.metric_cache = i;
 	    return 0;
+	}
     }
 
     size = sizeof(struct __pmInDomCache) * (pmfg->num_unique_indoms + 1);
@@ -236,7 +304,7 @@ pmfg_lookup_indom(pmFG pmfg, const char *metric, pmFGI item)
     pmfg->unique_indoms[pmfg->num_unique_indoms].codes = NULL;
     pmfg->unique_indoms[pmfg->num_unique_indoms].names = NULL;
     pmfg->unique_indoms[pmfg->num_unique_indoms].refreshed = 0;
-    pmfg->num_unique_indoms++;
+    item->u.indom.metric_cache = pmfg->num_unique_indoms++;
 
     /*
      * Add all instances; this will override any other past or future
@@ -653,9 +721,14 @@ pmfg_reinit_event(pmFGI item)
  * Find the pmValue corresponding to the item within the given
  * valueset.  Convert it to given output type, including possible
  * string<->number conversions.
+ *
+ * The pmValueSet at position vset (if at or after first_vset) and the
+ * pmValue at position *vlist are tried first - see pmfg_find_vset and
+ * pmfg_find_inst - before searching.
  */
 static int
-pmfg_extract_item(pmID metric_pmid, int metric_inst, int first_vset,
+pmfg_extract_item(pmID metric_pmid, int metric_inst, int vset,
+		  int *vlist, int first_vset,
 		  const pmDesc *metric_desc, pmValueSet **vsets,
 		  int numpmid, pmAtomValue *value, int otype)
 {
@@ -664,6 +737,24 @@ pmfg_extract_item(pmID metric_pmid, int metric_inst, int first_vset,
     assert(metric_desc != NULL);
     assert(vsets != NULL);
     assert(value != NULL);
+    assert(vlist != NULL);
+
+    if (vset >= first_vset && vset < numpmid &&
+	vsets[vset]->pmid == metric_pmid) {
+	const pmValueSet *iv = vsets[vset];
+	int j;
+
+	if (iv->numval < 0)	/* Pass error code, if any. */
+	    return iv->numval;
+	if (metric_desc->indom == PM_INDOM_NULL)
+	    j = iv->numval > 0 ? 0 : -1;
+	else
+	    j = pmfg_find_inst(iv, metric_inst, vlist);
+	if (j < 0)
+	    return PM_ERR_VALUE;
+	return __pmExtractValue2(iv->valfmt, &iv->vlist[j],
+				metric_desc->type, value, otype);
+    }
 
     for (i = first_vset; i < numpmid; i++) {
 	const pmValueSet *iv = vsets[i];
@@ -732,7 +823,8 @@ pmfg_unwrap_counter(pmFG pmfg, int type, double *value)
 
 static int
 pmfg_extract_convert_item(pmFG pmfg, pmID metric_pmid, int metric_inst,
-			  int first_vset, const pmDesc *desc, const pmFGC conv,
+			  int vset, int *vlist, int first_vset,
+			  const pmDesc *desc, const pmFGC conv,
 			  pmValueSet **vsets, int numpmid,
 			  const struct timespec *timestamp,
 			  pmAtomValue *oval, int otype)
@@ -743,8 +835,9 @@ pmfg_extract_convert_item(pmFG pmfg, pmID metric_pmid, int metric_inst,
 
     assert(oval != NULL);
 
-    sts = pmfg_extract_item(metric_pmid, metric_inst, first_vset, desc,
-			    vsets, numpmid, &v, PM_TYPE_DOUBLE);
+    sts = pmfg_extract_item(metric_pmid, metric_inst, vset, vlist,
+			    first_vset, desc, vsets, numpmid,
+			    &v, PM_TYPE_DOUBLE);
     if (sts)
 	return sts;
 
@@ -752,6 +845,7 @@ pmfg_extract_convert_item(pmFG pmfg, pmID metric_pmid, int metric_inst,
 	if (pmfg->prevResult) {
 	    pmHighResResult *prev_r;
 	    pmAtomValue prev_v;
+	    int prev_vlist = *vlist;	/* usually unchanged */
 	    double deltaT, delta;
 	    const double epsilon = 0.000000001;	/* 1 nanosecond */
 
@@ -761,8 +855,9 @@ pmfg_extract_convert_item(pmFG pmfg, pmID metric_pmid, int metric_inst,
 	    if (deltaT < epsilon)	/* avoid division by zero */
 		deltaT = epsilon;	/* (chose not to PM_ERR_CONV here) */
 
-	    sts = pmfg_extract_item(metric_pmid, metric_inst, first_vset,
-				    desc, prev_r->vset, prev_r->numpmid,
+	    sts = pmfg_extract_item(metric_pmid, metric_inst, vset,
+				    &prev_vlist, first_vset, desc,
+				    prev_r->vset, prev_r->numpmid,
 				    &prev_v, PM_TYPE_DOUBLE);
 	    if (sts)
 		return sts;
@@ -811,7 +906,7 @@ pmfg_fetch_item(pmFG pmfg, pmFGI item, pmHighResResult *newResult)
 {
     int sts;
     pmAtomValue v;
-    int i;
+    const pmValueSet *iv;
 
     assert(item != NULL);
     assert(item->type == pmfg_item);
@@ -822,21 +917,20 @@ pmfg_fetch_item(pmFG pmfg, pmFGI item, pmHighResResult *newResult)
      * be cleared now.
      */
     if (item->u.item.metric_desc.sem == PM_SEM_DISCRETE) {
-	for (i = 0; i < newResult->numpmid; i++) {
-	    if (newResult->vset[i]->pmid == item->u.item.metric_pmid) {
-		if (newResult->vset[i]->numval > 0) {
-		    pmfg_reinit_item(item);
-		    break;
-		} else if (newResult->vset[i]->numval == 0) {
-		    return; /* NB: leave outputs alone. */
-		}
-	    }
+	iv = pmfg_find_vset(item->u.item.metric_pmid, item->u.item.metric_vset,
+			    newResult->vset, newResult->numpmid);
+	if (iv != NULL) {
+	    if (iv->numval > 0)
+		pmfg_reinit_item(item);
+	    else if (iv->numval == 0)
+		return; /* NB: leave outputs alone. */
 	}
     }
 
     if (item->u.item.conv.rate_convert || item->u.item.conv.unit_convert) {
 	sts = pmfg_extract_convert_item(pmfg,
-			item->u.item.metric_pmid, item->u.item.metric_inst, 0,
+			item->u.item.metric_pmid, item->u.item.metric_inst,
+			item->u.item.metric_vset, &item->u.item.metric_vlist, 0,
 		 	&item->u.item.metric_desc, &item->u.item.conv,
 			newResult->vset, newResult->numpmid, &newResult->timestamp,
 			&v, item->u.item.output_type);
@@ -845,7 +939,8 @@ pmfg_fetch_item(pmFG pmfg, pmFGI item, pmHighResResult *newResult)
     }
     else {
 	sts = pmfg_extract_item(item->u.item.metric_pmid,
-			item->u.item.metric_inst, 0,
+			item->u.item.metric_inst, item->u.item.metric_vset,
+			&item->u.item.metric_vlist, 0,
 			&item->u.item.metric_desc,
 			newResult->vset, newResult->numpmid,
 			&v, item->u.item.output_type);
@@ -887,11 +982,74 @@ pmfg_fetch_timeval(pmFG pmfg, pmFGI item, pmHighResResult *newResult)
     }
 }
 
+/*
+ * Instance domain cache entries are kept sorted by instance identifier,
+ * so each instance in a result can be looked up by binary search.
+ */
+struct __pmInDomCacheEntry {
+    int		code;
+    char	*name;
+};
+
+static int
+pmfg_compare_inst(const void *a, const void *b)
+{
+    const struct __pmInDomCacheEntry *ap = a;
+    const struct __pmInDomCacheEntry *bp = b;
+
+    return (ap->code > bp->code) - (ap->code < bp->code);
+}
+
+static int
+pmfg_sort_cache(struct __pmInDomCache *cache)
+{
+    struct __pmInDomCacheEntry *entries;
+    unsigned int k;
+
+    for (k = 1; k < cache->size; k++) {
+	if (cache->codes[k-1] > cache->codes[k])
+	    break;
+    }
+    if (k >= cache->size)	/* already sorted, the common case */
+	return 0;
+
+    if ((entries = malloc(cache->size * sizeof(*entries))) == NULL)
+	return -ENOMEM;
+    for (k = 0; k < cache->size; k++) {
+	entries[k].code = cache->codes[k];
+	entries[k].name = cache->names[k];
+    }
+    qsort(entries, cache->size, sizeof(*entries), pmfg_compare_inst);
+    for (k = 0; k < cache->size; k++) {
+	cache->codes[k] = entries[k].code;
+	cache->names[k] = entries[k].name;
+    }
+    free(entries);
+    return 0;
+}
+
+static int
+pmfg_find_cache(const struct __pmInDomCache *cache, int inst)
+{
+    unsigned int lo = 0, hi = cache->size, mid;
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (cache->codes[mid] < inst)
+	    lo = mid + 1;
+	else if (cache->codes[mid] > inst)
+	    hi = mid;
+	else
+	    return mid;
+    }
+    return -1;
+}
+
 static void
 pmfg_fetch_indom(pmFG pmfg, pmFGI item, pmHighResResult *newResult)
 {
     int i, sts = 0;
-    unsigned int j, k;
+    unsigned int j;
     struct __pmInDomCache *cache;
     const pmValueSet *iv;
     pmInDom indom;
@@ -905,15 +1063,12 @@ pmfg_fetch_indom(pmFG pmfg, pmFGI item, pmHighResResult *newResult)
      * find the corresponding pmid (and each instance) anew in the previous
      * result.
      */
-    for (i = 0; i < newResult->numpmid; i++) {
-	if (newResult->vset[i]->pmid == item->u.indom.metric_pmid)
-	    break;
-    }
-    if (i >= newResult->numpmid) {
+    iv = pmfg_find_vset(item->u.indom.metric_pmid, item->u.indom.metric_vset,
+			newResult->vset, newResult->numpmid);
+    if (iv == NULL) {
 	sts = PM_ERR_VALUE;
 	goto out;
     }
-    iv = newResult->vset[i];
 
     /* Pass error code, if any. */
     if (iv->numval < 0) {
@@ -938,19 +1093,14 @@ pmfg_fetch_indom(pmFG pmfg, pmFGI item, pmHighResResult *newResult)
      */
     cache = NULL;
     indom = item->u.indom.metric_desc.indom;
-    for (j = 0; j < pmfg->num_unique_indoms; j++) {
-	if (indom != pmfg->unique_indoms[j].indom)
-	    continue;
-	cache = &pmfg->unique_indoms[j];
-	break;
+    if (item->u.indom.metric_cache >= 0) {
+	cache = &pmfg->unique_indoms[item->u.indom.metric_cache];
+	assert(cache->indom == indom);
     }
     if (cache && cache->refreshed &&
 	item->u.indom.output_inst_names) {	/* Caller interested at all? */
 	for (j = 0; j < (unsigned int)iv->numval; j++) {
-	    for (k = 0; k < cache->size; k++)
-		if (cache->codes[k] == iv->vlist[j].inst)
-		    break;
-	    if (k >= cache->size) {
+	    if (pmfg_find_cache(cache, iv->vlist[j].inst) < 0) {
 		cache->refreshed = 0;
 		break;
 	    }
@@ -972,6 +1122,14 @@ pmfg_fetch_indom(pmFG pmfg, pmFGI item, pmHighResResult *newResult)
 	}
 	else {
 	    cache->size = sts;
+	    if (pmfg_sort_cache(cache) < 0) {
+		free(cache->codes);
+		free(cache->names);
+		cache->codes = NULL;
+		cache->names = NULL;
+		cache->refreshed = 0;
+		cache->size = 0;
+	    }
 	}
 	/*
 	 * NB: Even if the pmGetInDom failed, we can proceed with
@@ -1008,26 +1166,26 @@ pmfg_fetch_indom(pmFG pmfg, pmFGI item, pmHighResResult *newResult)
 	if (item->u.indom.output_inst_names) {
 	    if (cache == NULL)
 		item->u.indom.output_inst_names[j] = NULL;
-	    else {
-	        for (k = 0; k < cache->size; k++) {
-		    if (cache->codes[k] == jv->inst) {
-			/*
-			 * NB: copy the indom name char* by value.
-			 * User may not modify / free this pointer,
-			 * nor use it after subsequent fetch / delete.
-			 */
-			item->u.indom.output_inst_names[j] = cache->names[k];
-			break;
-		    }
-		}
+	    else if ((i = pmfg_find_cache(cache, jv->inst)) >= 0) {
+		/*
+		 * NB: copy the indom name char* by value.
+		 * User may not modify / free this pointer,
+		 * nor use it after subsequent fetch / delete.
+		 */
+		item->u.indom.output_inst_names[j] = cache->names[i];
 	    }
 	}
 
-	/* Fetch & convert the actual value. */
+	/*
+	 * Fetch & convert the actual value.  This instance is at
+	 * position j in newResult, and likely the previous result.
+	 */
+	i = j;
 	if (item->u.indom.conv.rate_convert ||
 	    item->u.indom.conv.unit_convert) {
 	    stss = pmfg_extract_convert_item(pmfg, item->u.indom.metric_pmid,
-				jv->inst, 0, &item->u.indom.metric_desc,
+				jv->inst, item->u.indom.metric_vset, &i, 0,
+				&item->u.indom.metric_desc,
 				&item->u.indom.conv,
 				newResult->vset, newResult->numpmid,
 				&newResult->timestamp,
@@ -1037,7 +1195,8 @@ pmfg_fetch_indom(pmFG pmfg, pmFGI item, pmHighResResult *newResult)
 	}
 	else {
 	    stss = pmfg_extract_item(item->u.indom.metric_pmid, jv->inst,
-				0, &item->u.indom.metric_desc,
+				item->u.indom.metric_vset, &i, 0,
+				&item->u.indom.metric_desc,
 				newResult->vset, newResult->numpmid, &v,
 				item->u.indom.output_type);
 	    if (stss < 0)
@@ -1072,6 +1231,7 @@ pmfg_fetch_event_field(pmFG pmfg, pmFGI item, unsigned int *output_num,
 	const pmValueSet *field = vsets[i];
 	pmAtomValue v;
 	int stss = 0;
+	int vlist = 0;
 
 	/*
 	 * Is this our field of interest?
@@ -1104,7 +1264,7 @@ pmfg_fetch_event_field(pmFG pmfg, pmFGI item, unsigned int *output_num,
 	if (item->u.event.conv.rate_convert ||
 	    item->u.event.conv.unit_convert) {
 	    stss = pmfg_extract_convert_item(pmfg,
-				item->u.event.field_pmid, -1, i,
+				item->u.event.field_pmid, -1, i, &vlist, i,
 				&item->u.event.field_desc, &item->u.event.conv,
 				vsets, numpmid, timestamp,
 				&v, item->u.event.output_type);
@@ -1113,7 +1273,8 @@ pmfg_fetch_event_field(pmFG pmfg, pmFGI item, unsigned int *output_num,
 	}
 	else {
 	    stss = pmfg_extract_item(item->u.event.field_pmid, -1,
-				i, &item->u.event.field_desc, vsets, numpmid,
+				i, &vlist, i, &item->u.event.field_desc,
+				vsets, numpmid,
 				&v, item->u.event.output_type);
 	    if (stss < 0)
 		goto out;
@@ -1152,15 +1313,12 @@ pmfg_fetch_event(pmFG pmfg, pmFGI item, pmHighResResult *newResult)
     assert(newResult != NULL);
 
     /* Find our pmid in the newResult. */
-    for (i = 0; i < newResult->numpmid; i++) {
-	if (newResult->vset[i]->pmid == item->u.event.metric_pmid)
-	    break;
-    }
-    if (i >= newResult->numpmid) {
+    iv = pmfg_find_vset(item->u.event.metric_pmid, item->u.event.metric_vset,
+			newResult->vset, newResult->numpmid);
+    if (iv == NULL) {
 	sts = PM_ERR_VALUE;
 	goto out;
     }
-    iv = newResult->vset[i];
 
     /* Pass error code, if any. */
     if (iv->numval < 0) {
@@ -1169,12 +1327,12 @@ pmfg_fetch_event(pmFG pmfg, pmFGI item, pmHighResResult *newResult)
     }
 
     /* Locate the event record for the requested instance (if any). */
-    for (i = 0; i < iv->numval; i++) {
-	if ((item->u.event.metric_desc.indom == PM_INDOM_NULL) ||
-	    (iv->vlist[i].inst == item->u.event.metric_inst))
-	    break;
-    }
-    if (i >= iv->numval) {
+    if (item->u.event.metric_desc.indom == PM_INDOM_NULL)
+	i = iv->numval > 0 ? 0 : -1;
+    else
+	i = pmfg_find_inst(iv, item->u.event.metric_inst,
+			   &item->u.event.metric_vlist);
+    if (i < 0) {
 	sts = 0; /* No events => no problem. */
 	goto out;
     }
@@ -1279,6 +1437,7 @@ pmCreateFetchGroup(pmFG *ptr, int type, const char *name)
     pmfg = calloc(1, sizeof(*pmfg));
     if (pmfg == NULL)
 	return -ENOMEM;
+    __pmHashInitFlags(&pmfg->pmid_index, PM_HASH_OPEN);
 
     sts = pmNewContext(type, name);
     if (sts < 0) {
@@ -1392,8 +1551,9 @@ pmExtendFetchGroup_item(pmFG pmfg,
 	goto out;
 
     sts = pmfg_add_pmid(pmfg, item->u.item.metric_pmid);
-    if (sts != 0)
+    if (sts < 0)
 	goto out;
+    item->u.item.metric_vset = sts;
 
     item->u.item.output_value = out_value;
     item->u.item.output_type = out_type;
@@ -1507,6 +1667,7 @@ pmExtendFetchGroup_indom(pmFG pmfg,
     sts = pmfg_add_pmid(pmfg, item->u.indom.metric_pmid);
     if (sts < 0)
 	goto out;
+    item->u.indom.metric_vset = sts;
 
     item->u.indom.output_inst_codes = out_inst_codes;
     item->u.indom.output_inst_names = out_inst_names;
@@ -1630,6 +1791,7 @@ pmExtendFetchGroup_event(pmFG pmfg,
     sts = pmfg_add_pmid(pmfg, item->u.event.metric_pmid);
     if (sts < 0)
 	goto out;
+    item->u.event.metric_vset = sts;
 
     item->u.event.output_values = out_values;
     item->u.event.output_times = out_times;
@@ -1803,6 +1965,7 @@ pmClearFetchGroup(pmFG pmfg)
 	free(pmfg->unique_pmids);
     pmfg->unique_pmids = NULL;
     pmfg->num_unique_pmids = 0;
+    __pmHashFree(&pmfg->pmid_index);
 
     for (n = 0; n < pmfg->num_unique_indoms; n++) {
 	free(pmfg->unique_indoms[n].codes);
@@ -1,6 +1,6 @@
 /*
  * Copyright (c) 1995-2002 Silicon Graphics, Inc.  All Rights Reserved.
- * Copyright (c) 2013-2017 Red Hat, Inc.
+ * Copyright (c) 2013-2017,2026 Red Hat, Inc.
  * 
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
@@ -25,6 +25,344 @@ __pmHashInit(__pmHashCtl *hcp)
        initialization for .bss / .data-resident __pmHashCtl structs. */
 }
 
+/*
+ * Open addressing tables are marked by a negative hsize - every chained
+ * table initialization (__pmHashInit, calloc, or clearing the nodes and
+ * hsize fields) sets it to zero, and loops over hash[0..hsize) in code
+ * outside this file skip it - and the table itself hangs off hash.
+ */
+#define HOPEN_HSIZE	(-1)
+#define IS_HOPEN(hcp)	((hcp)->hsize == HOPEN_HSIZE)
+#define HOPEN(hcp)	((hopen_t *)(hcp)->hash)
+
+/*
+ * As for __pmHashInit, but select an alternative implementation;
+ * PM_HASH_OPEN for open addressing.
+ */
+void
+__pmHashInitFlags(__pmHashCtl *hcp, unsigned int flags)
+{
+    __pmHashInit(hcp);
+    if (flags & PM_HASH_OPEN)
+	hcp->hsize = HOPEN_HSIZE;
+}
+
+/*
+ * Open addressing (PM_HASH_OPEN) tables.
+ *
+ * Keys and node pointers are kept together in a power-of-two sized
+ * array, with linear probing from a mixed hash of the key, so a search
+ * touches one or two cache lines and only dereferences the node that
+ * matches.  Nodes are allocated in chunks owned by the table, so that
+ * pointers returned to callers remain valid as the table is resized;
+ * nodes of deleted entries are reused.
+ *
+ * Deleted slots are marked with a tombstone, and growth is triggered
+ * by live plus deleted slots exceeding half of the table.  Rehashing is
+ * incremental: the previous table is retained and a few of its slots
+ * are moved to the new table on each add or delete, with searches
+ * looking in both until the move is complete.
+ */
+typedef struct {
+    unsigned int	key;
+    __pmHashNode	*node;		/* NULL if empty, else node or TOMB */
+} hslot_t;
+
+typedef struct hchunk {
+    struct hchunk	*next;
+    unsigned int	used;
+    unsigned int	count;
+    __pmHashNode	node[1];
+} hchunk_t;
+
+typedef struct {
+    hslot_t		*slot;
+    unsigned int	mask;		/* table size - 1 */
+    unsigned int	used;		/* live plus deleted slots */
+    hslot_t		*old;		/* previous table, while rehashing */
+    unsigned int	oldmask;
+    unsigned int	oldnext;	/* next old slot to move */
+    hchunk_t		*chunk;		/* node allocation, newest first */
+    __pmHashNode	*free;		/* nodes of deleted entries */
+} hopen_t;
+
+static __pmHashNode	tombstone;
+#define TOMB		(&tombstone)
+#define HOPEN_MIN	16		/* smallest table */
+#define HOPEN_STEP	16		/* old slots moved per update */
+#define HOPEN_CHUNK	1024		/* largest node chunk */
+
+/* finalization mix from MurmurHash3, spreads PMID and indom fields */
+static inline unsigned int
+hmix(unsigned int key)
+{
+    key ^= key >> 16;
+    key *= 0x85ebca6b;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35;
+    key ^= key >> 16;
+    return key;
+}
+
+static inline hslot_t *
+hopen_find(hslot_t *slot, unsigned int mask, unsigned int key, void *data, int match)
+{
+    unsigned int	i;
+    __pmHashNode	*hp;
+
+    for (i = hmix(key) & mask; (hp = slot[i].node) != NULL; i = (i + 1) & mask) {
+	if (slot[i].key == key && hp != TOMB && (!match || hp->data == data))
+	    return &slot[i];
+    }
+    return NULL;
+}
+
+static __pmHashNode *
+hopen_node(hopen_t *hop)
+{
+    hchunk_t		*cp = hop->chunk;
+    __pmHashNode	*hp;
+    unsigned int	count;
+
+    if ((hp = hop->free) != NULL) {
+	hop->free = hp->next;
+	return hp;
+    }
+    if (cp == NULL || cp->used == cp->count) {
+	count = cp ? cp->count * 2 : HOPEN_MIN;
+	if (count > HOPEN_CHUNK)
+	    count = HOPEN_CHUNK;
+	cp = (hchunk_t *)malloc(sizeof(hchunk_t) + (count - 1) * sizeof(__pmHashNode));
+	if (cp == NULL)
+	    return NULL;
+	cp->used = 0;
+	cp->count = count;
+	cp->next = hop->chunk;
+	hop->chunk = cp;
+    }
+    return &cp->node[cp->used++];
+}
+
+static void
+hopen_unlink(__pmHashCtl *hcp, hslot_t *sp)
+{
+    hopen_t		*hop = HOPEN(hcp);
+    __pmHashNode	*hp = sp->node;
+
+    sp->node = TOMB;
+    hp->data = NULL;
+    hp->next = hop->free;
+    hop->free = hp;
+    hcp->nodes--;
+}
+
+static void
+hopen_insert(hopen_t *hop, __pmHashNode *hp)
+{
+    unsigned int	i;
+
+    for (i = hmix(hp->key) & hop->mask; ; i = (i + 1) & hop->mask) {
+	if (hop->slot[i].node == NULL) {
+	    hop->used++;
+	    break;
+	}
+	if (hop->slot[i].node == TOMB)
+	    break;
+    }
+    hop->slot[i].key = hp->key;
+    hop->slot[i].node = hp;
+}
+
+/* move up to n slots from the old table, all of them if n is zero */
+static void
+hopen_migrate(hopen_t *hop, unsigned int n)
+{
+    hslot_t	*sp;
+
+    while (hop->old != NULL) {
+	if (hop->oldnext > hop->oldmask) {
+	    free(hop->old);
+	    hop->old = NULL;
+	    break;
+	}
+	sp = &hop->old[hop->oldnext++];
+	if (sp->node != NULL && sp->node != TOMB) {
+	    hopen_insert(hop, sp->node);
+	    sp->node = TOMB;
+	}
+	if (n != 0 && --n == 0)
+	    break;
+    }
+}
+
+static int
+hopen_resize(__pmHashCtl *hcp, unsigned int need)
+{
+    hopen_t		*hop = HOPEN(hcp);
+    hslot_t		*slot;
+    unsigned int	size = HOPEN_MIN;
+
+    while (size / 4 <= need)
+	size <<= 1;
+    if ((slot = (hslot_t *)calloc(size, sizeof(hslot_t))) == NULL)
+	return -oserror();
+    if (hop == NULL) {
+	if ((hop = (hopen_t *)calloc(1, sizeof(hopen_t))) == NULL) {
+	    free(slot);
+	    return -oserror();
+	}
+	hcp->hash = (__pmHashNode **)hop;
+    }
+    else {
+	/* complete any rehash in progress before starting another */
+	hopen_migrate(hop, 0);
+	hop->old = hop->slot;
+	hop->oldmask = hop->mask;
+	hop->oldnext = 0;
+    }
+    hop->slot = slot;
+    hop->mask = size - 1;
+    hop->used = 0;
+    return 0;
+}
+
+static __pmHashNode *
+hopen_search(unsigned int key, __pmHashCtl *hcp)
+{
+    hopen_t	*hop = HOPEN(hcp);
+    hslot_t	*sp;
+
+    if (hop == NULL)
+	return NULL;
+    if ((sp = hopen_find(hop->slot, hop->mask, key, NULL, 0)) != NULL)
+	return sp->node;
+    if (hop->old != NULL &&
+	(sp = hopen_find(hop->old, hop->oldmask, key, NULL, 0)) != NULL)
+	return sp->node;
+    return NULL;
+}
+
+static int
+hopen_add(unsigned int key, void *data, __pmHashCtl *hcp)
+{
+    hopen_t	*hop = HOPEN(hcp);
+    __pmHashNode *hp;
+    int		sts;
+
+    if (hop == NULL || hop->used + 1 > (hop->mask + 1) / 2) {
+	if ((sts = hopen_resize(hcp, hcp->nodes + 1)) < 0)
+	    return sts;
+	hop = HOPEN(hcp);
+    }
+    if ((hp = hopen_node(hop)) == NULL)
+	return -oserror();
+    hp->next = NULL;
+    hp->key = key;
+    hp->data = data;
+    hopen_insert(hop, hp);
+    hcp->nodes++;
+    hopen_migrate(hop, HOPEN_STEP);
+    return 1;
+}
+
+static int
+hopen_del(unsigned int key, void *data, __pmHashCtl *hcp)
+{
+    hopen_t	*hop = HOPEN(hcp);
+    hslot_t	*sp;
+
+    if (hop == NULL)
+	return 0;
+    if ((sp = hopen_find(hop->slot, hop->mask, key, data, 1)) == NULL &&
+	(hop->old == NULL ||
+	 (sp = hopen_find(hop->old, hop->oldmask, key, data, 1)) == NULL))
+	return 0;
+    hopen_unlink(hcp, sp);
+    hopen_migrate(hop, HOPEN_STEP);
+    return 1;
+}
+
+/* map walk position to a slot, old table first while rehashing */
+static hslot_t *
+hopen_slot(hopen_t *hop, unsigned int n)
+{
+    if (hop->old != NULL) {
+	if (n <= hop->oldmask)
+	    return &hop->old[n];
+	n -= hop->oldmask + 1;
+    }
+    return n <= hop->mask ? &hop->slot[n] : NULL;
+}
+
+static void
+hopen_walkcb(__pmHashWalkCallback cb, void *cdata, const __pmHashCtl *hcp)
+{
+    hopen_t		*hop = HOPEN(hcp);
+    hslot_t		*sp;
+    unsigned int	n;
+
+    if (hop == NULL)
+	return;
+    for (n = 0; (sp = hopen_slot(hop, n)) != NULL; n++) {
+	if (sp->node == NULL || sp->node == TOMB)
+	    continue;
+	switch ((*cb)(sp->node, cdata)) {
+	case PM_HASH_WALK_DELETE_STOP:
+	    hopen_unlink((__pmHashCtl *)hcp, sp);
+	    return;
+
+	case PM_HASH_WALK_NEXT:
+	    break;
+
+	case PM_HASH_WALK_DELETE_NEXT:
+	    hopen_unlink((__pmHashCtl *)hcp, sp);
+	    break;
+
+	case PM_HASH_WALK_STOP:
+	default:
+	    return;
+	}
+    }
+}
+
+static __pmHashNode *
+hopen_walk(__pmHashCtl *hcp, __pmHashWalkState state)
+{
+    hopen_t	*hop = HOPEN(hcp);
+    hslot_t	*sp;
+
+    if (hop == NULL)
+	return NULL;
+    if (state == PM_HASH_WALK_START)
+	hcp->index = 0;
+    while ((sp = hopen_slot(hop, hcp->index)) != NULL) {
+	hcp->index++;
+	if (sp->node != NULL && sp->node != TOMB)
+	    return sp->node;
+    }
+    return NULL;
+}
+
+/* nodes belong to the table, so are released here too */
+static void
+hopen_clear(__pmHashCtl *hcp)
+{
+    hopen_t		*hop = HOPEN(hcp);
+    hchunk_t		*cp;
+
+    if (hop == NULL)
+	return;
+    while ((cp = hop->chunk) != NULL) {
+	hop->chunk = cp->next;
+	free(cp);
+    }
+    free(hop->old);
+    free(hop->slot);
+    free(hop);
+    hcp->hash = NULL;
+    hcp->nodes = 0;
+}
+
 /*
  * Used to preallocate the hash table when the size is known ahead of time.
  * This avoids the overhead of growing and relinking the hash chains.
@@ -32,6 +370,9 @@ __pmHashInit(__pmHashCtl *hcp)
 int
 __pmHashPreAlloc(int hsize, __pmHashCtl *hcp)
 {
+    if (IS_HOPEN(hcp))
+	return hcp->hash ? 0 : hopen_resize(hcp, hsize);
+
     if ((hcp->hash = (__pmHashNode **)calloc(hsize, sizeof(__pmHashNode *))) == NULL)
 	return -oserror();
 
@@ -44,6 +385,9 @@ __pmHashSearch(unsigned int key, __pmHashCtl *hcp)
 {
     __pmHashNode	*hp;
 
+    if (IS_HOPEN(hcp))
+	return hopen_search(key, hcp);
+
     if (hcp->hsize == 0)
 	return NULL;
 
@@ -60,6 +404,9 @@ __pmHashAdd(unsigned int key, void *data, __pmHashCtl *hcp)
     __pmHashNode    *hp;
     int		k;
 
+    if (IS_HOPEN(hcp))
+	return hopen_add(key, data, hcp);
+
     hcp->nodes++;
 
     if (hcp->hsize == 0) {
@@ -116,6 +463,9 @@ __pmHashDel(unsigned int key, void *data, __pmHashCtl *hcp)
     __pmHashNode    *hp;
     __pmHashNode    *lhp = NULL;
 
+    if (IS_HOPEN(hcp))
+	return hopen_del(key, data, hcp);
+
     if (hcp->hsize == 0)
 	return 0;
 
@@ -138,6 +488,10 @@ __pmHashDel(unsigned int key, void *data, __pmHashCtl *hcp)
 void
 __pmHashClear(__pmHashCtl *hcp)
 {
+    if (IS_HOPEN(hcp)) {
+	hopen_clear(hcp);
+	return;
+    }
     if (hcp->hsize != 0) {
 	free(hcp->hash);
 	hcp->hash = NULL;
@@ -156,6 +510,11 @@ __pmHashWalkCB(__pmHashWalkCallback cb, void *cdata, const __pmHashCtl *hcp)
 {
     int n;
 
+    if (IS_HOPEN(hcp)) {
+	hopen_walkcb(cb, cdata, hcp);
+	return;
+    }
+
     for (n = 0; n < hcp->hsize; n++) {
         __pmHashNode *tp = hcp->hash[n];
         __pmHashNode **tpp = & hcp->hash[n];
@@ -199,6 +558,9 @@ __pmHashWalk(__pmHashCtl *hcp, __pmHashWalkState state)
 {
     __pmHashNode	*node;
 
+    if (IS_HOPEN(hcp))
+	return hopen_walk(hcp, state);
+
     if (hcp->hsize == 0)
 	return NULL;
 
@@ -232,6 +594,11 @@ __pmHashFree(__pmHashCtl *hcp)
     __pmHashNode	*lhp = NULL;
     int			i;
 
+    if (IS_HOPEN(hcp)) {
+	hopen_clear(hcp);
+	return;
+    }
+
     if (hcp->hsize == 0)
 	return;
 
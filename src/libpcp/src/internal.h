@@ -335,6 +335,9 @@ extern int __pmSendHighResResult_ctx(__pmContext *, int, int, const __pmResult *
 extern void __pmDumpResult_ctx(__pmContext *, FILE *, const pmResult *) _PCP_HIDDEN;
 extern void __pmDumpHighResResult_ctx(__pmContext *, FILE *, const pmHighResResult *) _PCP_HIDDEN;
 extern void __pmPrintResult_ctx(__pmContext *, FILE *, const __pmResult *) _PCP_HIDDEN;
+extern __pmResult *__pmAllocResultArena(int, size_t, void **) _PCP_HIDDEN;
+extern int __pmDecodeResultArena_ctx(__pmContext *, __pmPDU *, __pmResult **) _PCP_HIDDEN;
+extern int __pmDecodeHighResResultArena_ctx(__pmContext *, __pmPDU *, __pmResult **) _PCP_HIDDEN;
 extern int pmGetArchiveEnd_ctx(__pmContext *, __pmTimestamp *) _PCP_HIDDEN;
 extern int __pmGetArchiveEnd_ctx(__pmContext *, __pmTimestamp *) _PCP_HIDDEN;
 extern int __pmLogGenerateMark_ctx(__pmContext *, int, __pmResult **) _PCP_HIDDEN;
@@ -408,6 +411,7 @@ extern void __pmArchCtlFree(__pmArchCtl *) _PCP_HIDDEN;
 extern int __pmLogChangeArchive(__pmContext *, int) _PCP_HIDDEN;
 extern int __pmLogChangeToNextArchive(__pmLogCtl **) _PCP_HIDDEN;
 extern int __pmLogChangeToPreviousArchive(__pmLogCtl **) _PCP_HIDDEN;
+extern __pmFILE *__pmFopenMap(const char *) _PCP_HIDDEN;
 
 /* DSO PMDA helpers */
 struct __pmDSO;			/* opaque, real definition in pmda.h */
@@ -81,6 +81,16 @@ typedef union {				/* value from pmResult */
 #define IS_VALUE(state) ((state & S_VALUE) == S_VALUE)
 #define IS_SCANNED(state) ((state & S_SCANNED) == S_SCANNED)
 
+/*
+ * Limits for searching for an instance ... no records before T_FIRST()
+ * or after T_LAST(), using the instance lifetime from time_caliper()
+ * (if known) in addition to what we've learnt from earlier searches.
+ * -1 means no limit.
+ */
+#define T_FIRST(icp) ((icp)->t_birth > (icp)->t_first ? (icp)->t_birth : (icp)->t_first)
+#define T_LAST(icp) ((icp)->t_death < 0 ? (icp)->t_last : \
+	((icp)->t_last < 0 || (icp)->t_death < (icp)->t_last) ? (icp)->t_death : (icp)->t_last)
+
 typedef struct instcntl {		/* metric-instance control */
     struct instcntl	*want;		/* ones of interest */
     struct instcntl	*unbound;	/* not yet bound above [or below] */
@@ -376,6 +386,28 @@ dumpicp(const char *tag, instcntl_t *icp)
     fputc('\n', stderr);
 }
 
+/*
+ * Keep a private copy of a non-insitu value from a record read from
+ * the archive.  Pinning the PDU buffer instead would hold the whole
+ * record in memory for as long as any one instance's prior or next
+ * value came from it, and with lots of instance churn (think proc
+ * metrics over a long archive) that is most of the records read.
+ */
+static void
+keep_value(value *dst, const pmValueBlock *src)
+{
+    size_t	need;
+
+    if (dst->pval == NULL || dst->pval->vlen != src->vlen) {
+	need = src->vlen < sizeof(pmValueBlock) ? sizeof(pmValueBlock) : src->vlen;
+	if ((dst->pval = (pmValueBlock *)realloc(dst->pval, need)) == NULL) {
+	    pmNoMem("update_bounds.keep_value", need, PM_FATAL_ERR);
+	    /*NOTREACHED*/
+	}
+    }
+    memcpy((void *)dst->pval, (void *)src, src->vlen);
+}
+
 /*
  * Update the upper (next) and lower (prior) bounds.
  * Parameters do_mark and done control the context in which this is
@@ -612,10 +644,8 @@ check:
 		}
 
 		if (icp->metric->valfmt != PM_VAL_INSITU) {
-		    if (icp->v_prior.pval != NULL) {
-			__pmUnpinPDUBuf((void *)icp->v_prior.pval);
-			icp->v_prior.pval = NULL;
-		    }
+		    free(icp->v_prior.pval);
+		    icp->v_prior.pval = NULL;
 		}
 		if (pmDebugOptions.interp)
 		    dumpicp("update_bounds: mark@prior", icp);
@@ -644,10 +674,8 @@ check:
 		}
 
 		if (icp->metric->valfmt != PM_VAL_INSITU) {
-		    if (icp->v_next.pval != NULL) {
-			__pmUnpinPDUBuf((void *)icp->v_next.pval);
-			icp->v_next.pval = NULL;
-		    }
+		    free(icp->v_next.pval);
+		    icp->v_next.pval = NULL;
 		}
 		if (pmDebugOptions.interp)
 		    dumpicp("update_bounds: mark@next", icp);
@@ -736,21 +764,17 @@ check:
 		    if (pcp->valfmt == PM_VAL_INSITU)
 			icp->v_next.lval = icp->v_prior.lval;
 		    else {
-			if (icp->v_next.pval != NULL)
-			    __pmUnpinPDUBuf((void *)icp->v_next.pval);
+			free(icp->v_next.pval);
 			icp->v_next.pval = icp->v_prior.pval;
+			icp->v_prior.pval = NULL;
 		    }
 		}
 		icp->t_prior = t_this;
 		SET_VALUE(icp->s_prior);
 		if (pcp->valfmt == PM_VAL_INSITU)
 		    icp->v_prior.lval = logrp->vset[k]->vlist[i].value.lval;
-		else {
-		    if (icp->v_prior.pval != NULL)
-			__pmUnpinPDUBuf((void *)icp->v_prior.pval);
-		    icp->v_prior.pval = logrp->vset[k]->vlist[i].value.pval;
-		    __pmPinPDUBuf((void *)icp->v_prior.pval);
-		}
+		else
+		    keep_value(&icp->v_prior, logrp->vset[k]->vlist[i].value.pval);
 		if (do_mark == UPD_MARK_BACK && icp->search && done != NULL) {
 		    /* one we were looking for */
 		    changed |= 2;
@@ -775,21 +799,17 @@ check:
 		    if (pcp->valfmt == PM_VAL_INSITU)
 			icp->v_prior.lval = icp->v_next.lval;
 		    else {
-			if (icp->v_prior.pval != NULL)
-			    __pmUnpinPDUBuf((void *)icp->v_prior.pval);
+			free(icp->v_prior.pval);
 			icp->v_prior.pval = icp->v_next.pval;
+			icp->v_next.pval = NULL;
 		    }
 		}
 		icp->t_next = t_this;
 		SET_VALUE(icp->s_next);
 		if (pcp->valfmt == PM_VAL_INSITU)
 		    icp->v_next.lval = logrp->vset[k]->vlist[i].value.lval;
-		else {
-		    if (icp->v_next.pval != NULL)
-			__pmUnpinPDUBuf((void *)icp->v_next.pval);
-		    icp->v_next.pval = logrp->vset[k]->vlist[i].value.pval;
-		    __pmPinPDUBuf((void *)icp->v_next.pval);
-		}
+		else
+		    keep_value(&icp->v_next, logrp->vset[k]->vlist[i].value.pval);
 		if (do_mark == UPD_MARK_FORW && icp->search && done != NULL) {
 		    /* one we were looking for */
 		    changed |= 2;
@@ -924,7 +944,7 @@ time_caliper(__pmContext *ctxp, instcntl_t *icp)
 	    pmNoMem("time_caliper.__pmLogTrimInDom", sizeof(__pmLogTrimInDom), PM_FATAL_ERR);
 	    /*NOTREACHED*/
 	}
-	indomp->hashinst.nodes = indomp->hashinst.hsize = 0;
+	__pmHashInit(&indomp->hashinst);
 	sts = __pmHashAdd((unsigned int)icp->metric->desc.indom, (void *)indomp, &lcp->trimindom);
 	if (sts < 0) {
 	    char	strbuf[20];
@@ -1341,13 +1361,13 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], __pmResult *
 	    (IS_MARK(icp->s_next) && icp->t_prior == t_req)) {
 	    back++;
 	    icp->search = 1;
-	    /* Add it to the unbound list in descending order of t_first */
+	    /* Add it to the unbound list in descending order of T_FIRST() */
 	    ub_prev = NULL;
 	    for (ub = (instcntl_t *)ctxp->c_archctl->ac_unbound;
 		 ub != NULL;
 		 ub = ub->unbound) {
 		nuis[NUIS_FIRST]++;
-		if (icp->t_first >= ub->t_first)
+		if (T_FIRST(icp) >= T_FIRST(ub))
 		    break;
 		ub_prev = ub;
 	    }
@@ -1404,18 +1424,23 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], __pmResult *
 	    /*
 	     * Forget about those that can never be found from here
 	     * in this direction. The unbound list is sorted in order of
-	     * descending t_first. We can abandon the traversal once t_first is
-	     * less than t_this. Trim the list as instances are resolved.
+	     * descending T_FIRST(). We can abandon the traversal once
+	     * T_FIRST() is less than t_this. Trim the list as instances
+	     * are resolved.
 	     */
 	    ub_prev = NULL;
 	    for (icp = (instcntl_t *)ctxp->c_archctl->ac_unbound; icp != NULL; icp = icp->unbound) {
 		nuis[NUIS_FIRST_FORGET]++;
-		if (icp->t_first < t_this)
+		if (T_FIRST(icp) < t_this)
 		    break;
 		if (icp->search) {
 		    icp->search = 0;
 		    SET_SCANNED(icp->s_prior);
 		    done++;
+		    /* nothing before t_req, remember that for next time */
+		    if ((IS_UNDEFINED(icp->s_prior) || icp->t_prior > t_req) &&
+			icp->t_first < t_req)
+			icp->t_first = t_req;
 		    /* Remove this item from the list. */
 		    if (ub_prev)
 			ub_prev->unbound = icp->unbound;
@@ -1487,13 +1512,13 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], __pmResult *
 	    forw++;
 	    icp->search = 1;
 
-	    /* Add it to the unbound list in ascending order of t_last */
+	    /* Add it to the unbound list in ascending order of T_LAST() */
 	    ub_prev = NULL;
 	    for (ub = (instcntl_t *)ctxp->c_archctl->ac_unbound;
 		 ub != NULL;
 		 ub = ub->unbound) {
 		nuis[NUIS_LAST]++;
-		if (icp->t_last <= ub->t_last)
+		if (T_LAST(icp) <= T_LAST(ub))
 		    break;
 		ub_prev = ub;
 	    }
@@ -1550,19 +1575,23 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], __pmResult *
 	    /*
 	     * Forget about those that can never be found from here
 	     * in this direction. The unbound list is sorted in order of
-	     * ascending t_last. We can abandon the traversal once t_last
+	     * ascending T_LAST(). We can abandon the traversal once T_LAST()
 	     * is greater than than t_this. Trim the list as instances are
 	     * resolved.
 	     */
 	    ub_prev = NULL;
 	    for (icp = (instcntl_t *)ctxp->c_archctl->ac_unbound; icp != NULL; icp = icp->unbound) {
 		nuis[NUIS_LAST_FORGET]++;
-		if (icp->t_last > t_this)
+		if (T_LAST(icp) > t_this)
 		    break;
-		if (icp->search && icp->t_last >= 0) {
+		if (icp->search && T_LAST(icp) >= 0) {
 		    icp->search = 0;
 		    SET_SCANNED(icp->s_next);
 		    done++;
+		    /* nothing after t_req, remember that for next time */
+		    if (icp->t_next < t_req &&
+			(icp->t_last < 0 || t_req < icp->t_last))
+			icp->t_last = t_req;
 		    /* Remove this item from the list. */
 		    if (ub_prev)
 			ub_prev->unbound = icp->unbound;
@@ -2172,10 +2201,8 @@ __pmLogResetInterp(__pmContext *ctxp)
 			SET_UNDEFINED(icp->s_prior);
 			SET_UNDEFINED(icp->s_next);
 			if (pcp->valfmt != PM_VAL_INSITU) {
-			    if (icp->v_prior.pval != NULL)
-				__pmUnpinPDUBuf((void *)icp->v_prior.pval);
-			    if (icp->v_next.pval != NULL)
-				__pmUnpinPDUBuf((void *)icp->v_next.pval);
+			    free(icp->v_prior.pval);
+			    free(icp->v_next.pval);
 			}
 			icp->v_prior.pval = icp->v_next.pval = NULL;
 		    }
@@ -2187,7 +2214,7 @@ __pmLogResetInterp(__pmContext *ctxp)
 
 /*
  * Free interp data when context is closed ...
- * - pinned PDU buffers holding values used for interpolation
+ * - copies of values used for interpolation
  * - hash structures for finding metrics and instances
  * - read_cache contents
  *
@@ -2220,18 +2247,14 @@ __pmFreeInterpData(__pmContext *ctxp)
 		    for (ihp = pcp->hc.hash[i]; ihp != NULL; ihp = ihp->next) {
 			icp = (instcntl_t *)ihp->data;
 			if (pcp->valfmt != PM_VAL_INSITU) {
-			    /*
-			     * Held values may be in PDU buffers, unpin the PDU
-			     * buffers just in case (__pmUnpinPDUBuf is a NOP if
-			     * the value is not in a PDU buffer)
-			     */
+			    /* held values are private copies from keep_value() */
 			    if (icp->v_prior.pval != NULL) {
 				if (pmDebugOptions.interp && pmDebugOptions.desperate) {
 				    char	strbuf[20];
 				    fprintf(stderr, "release pmid %s inst %d prior\n",
 					    pmIDStr_r(pcp->desc.pmid, strbuf, sizeof(strbuf)), icp->inst);
 				}
-				__pmUnpinPDUBuf((void *)icp->v_prior.pval);
+				free(icp->v_prior.pval);
 			    }
 			    if (icp->v_next.pval != NULL) {
 				if (pmDebugOptions.interp && pmDebugOptions.desperate) {
@@ -2239,7 +2262,7 @@ __pmFreeInterpData(__pmContext *ctxp)
 				    fprintf(stderr, "release pmid %s inst %d next\n",
 					    pmIDStr_r(pcp->desc.pmid, strbuf, sizeof(strbuf)), icp->inst);
 				}
-				__pmUnpinPDUBuf((void *)icp->v_next.pval);
+				free(icp->v_next.pval);
 			    }
 			}
 			if (last_ihp != NULL) {
@@ -25,9 +25,13 @@
 #include "internal.h"
 
 extern __pm_fops __pm_stdio;
+extern __pm_fops __pm_mmap;
 #if HAVE_TRANSPARENT_DECOMPRESSION && HAVE_LZMA_DECOMPRESSION
 extern __pm_fops __pm_xz;
 #endif
+#if HAVE_TRANSPARENT_DECOMPRESSION && HAVE_ZSTD_DECOMPRESSION
+extern __pm_fops __pm_zstd;
+#endif
 
 /*
  * Suffixes and associated compresssion application for compressed filenames.
@@ -39,12 +43,18 @@ extern __pm_fops __pm_xz;
 #define	USE_BZIP2	1
 #define USE_GZIP	2
 #define USE_XZ		3
+#define USE_ZSTD	4
 
 #if HAVE_TRANSPARENT_DECOMPRESSION && HAVE_LZMA_DECOMPRESSION
 #define TRANSPARENT_XZ (&__pm_xz)
 #else
 #define TRANSPARENT_XZ NULL
 #endif
+#if HAVE_TRANSPARENT_DECOMPRESSION && HAVE_ZSTD_DECOMPRESSION
+#define TRANSPARENT_ZSTD (&__pm_zstd)
+#else
+#define TRANSPARENT_ZSTD NULL
+#endif
 
 static const struct {
     const char	*suffix;
@@ -53,6 +63,7 @@ static const struct {
 } compress_ctl[] = {
     { ".xz",	USE_XZ,	 	TRANSPARENT_XZ },
     { ".lzma",	USE_XZ,		NULL },
+    { ".zst",	USE_ZSTD,	TRANSPARENT_ZSTD },
     { ".bz2",	USE_BZIP2,	NULL },
     { ".bz",	USE_BZIP2,	NULL },
     { ".gz",	USE_GZIP,	NULL },
@@ -252,6 +263,10 @@ fopen_compress(const char *fname, int compress_ix)
 	cmd = "xz";
 	arg = "-dc";
     }
+    else if (compress_ctl[compress_ix].appl == USE_ZSTD) {
+	cmd = "zstd";
+	arg = "-dcq";
+    }
     else if (compress_ctl[compress_ix].appl == USE_BZIP2) {
 	cmd = "bzip2";
 	arg = "-dc";
@@ -409,6 +424,7 @@ __pmAccess(const char *path, int amode)
 	    if (compress_ctl[compress_ix].appl == USE_BZIP2) use = "bzip2";
 	    else if (compress_ctl[compress_ix].appl == USE_GZIP) use = "gzip";
 	    else if (compress_ctl[compress_ix].appl == USE_XZ) use = "xz";
+	    else if (compress_ctl[compress_ix].appl == USE_ZSTD) use = "zstd";
 	    else use = "???";
 	    fprintf(stderr, "__pmAccess(\"%s\", \"%d\"): decompress: %s", path, amode, use);
 	    if (compress_ctl[compress_ix].handler != NULL)
@@ -428,12 +444,13 @@ __pmAccess(const char *path, int amode)
 /*
  * Open a PCP file with given mode and return a __pmFILE. An i/o
  * handler is automatically chosen based on filename suffix, e.g. .xz, .gz,
- * etc. The stdio pass-thru handler will be chosen for other files.
+ * etc. The plain handler (stdio pass-thru, or mmap from __pmFopenMap())
+ * will be chosen for other files.
  * The stdio handler is the only handler currently supporting write operations.
  * Return a valid __pmFILE pointer on success or NULL on failure.
  */
-__pmFILE *
-__pmFopen(const char *path, const char *mode)
+static __pmFILE *
+fopen_handler(const char *path, const char *mode, __pm_fops *plain)
 {
     __pmFILE	*f;
     __pm_fops	*handler;
@@ -458,6 +475,7 @@ __pmFopen(const char *path, const char *mode)
 	    if (compress_ctl[compress_ix].appl == USE_BZIP2) use = "bzip2";
 	    else if (compress_ctl[compress_ix].appl == USE_GZIP) use = "gzip";
 	    else if (compress_ctl[compress_ix].appl == USE_XZ) use = "xz";
+	    else if (compress_ctl[compress_ix].appl == USE_ZSTD) use = "zstd";
 	    else use = "???";
 	    fprintf(stderr, "__pmFopen(\"%s\", \"%s\"): decompress: %s", path, mode, use);
 	    if (compress_ctl[compress_ix].handler != NULL)
@@ -488,10 +506,10 @@ __pmFopen(const char *path, const char *mode)
 
     if (handler == NULL) {
 	/*
-	 * The file is either not compressed, or we can not decompress it
-	 * directly. Default to the stdio handler.
+	 * The file is not compressed.  Use the caller's handler, which
+	 * is the stdio handler unless called from __pmFopenMap().
 	 */
-	handler = &__pm_stdio;
+	handler = plain;
     }
 
     /* Now allocate and open the __pmFile. */
@@ -508,6 +526,16 @@ __pmFopen(const char *path, const char *mode)
      */
     if (f->fops->__pmopen(f, path, mode) == NULL) {
 	free(f);
+	if (compress_ix >= 0 && oserror() == EOPNOTSUPP) {
+	    /*
+	     * The on-the-fly handler cannot cope with the layout of
+	     * this file, decompress it externally instead.
+	     */
+	    if (pmDebugOptions.log)
+		fprintf(stderr, "__pmFopen(\"%s\", \"%s\"): on-the-fly not supported, decompress externally\n", path, mode);
+	    f = fopen_compress(path, compress_ix);
+	    goto done;
+	}
     	return NULL;
     }
 
@@ -531,6 +559,45 @@ done:
     return f;
 }
 
+__pmFILE *
+__pmFopen(const char *path, const char *mode)
+{
+    return fopen_handler(path, mode, &__pm_stdio);
+}
+
+/*
+ * Open a PCP archive data volume for reading.  Like __pmFopen(path, "r")
+ * except that an uncompressed file is memory mapped (see io_mmap.c),
+ * unless $PCP_LOG_MMAP is set to 0 or the mapping fails, in which case
+ * the stdio handler is used.
+ */
+static int	use_mmap = -1;
+
+__pmFILE *
+__pmFopenMap(const char *path)
+{
+    __pmFILE	*f;
+
+    if (use_mmap == -1) {
+	/* one-trip initialization */
+	char	*str;
+
+	PM_LOCK(__pmLock_extcall);
+	str = getenv("PCP_LOG_MMAP");		/* THREADSAFE */
+	use_mmap = (str == NULL || strcmp(str, "0") != 0);
+	PM_UNLOCK(__pmLock_extcall);
+    }
+    if (use_mmap) {
+	if ((f = fopen_handler(path, "r", &__pm_mmap)) != NULL)
+	    return f;
+	if (oserror() == ENOENT)
+	    return NULL;
+	if (pmDebugOptions.log)
+	    fprintf(stderr, "__pmFopenMap(\"%s\"): mmap failed, using stdio\n", path);
+    }
+    return fopen_handler(path, "r", &__pm_stdio);
+}
+
 __pmFILE *
 __pmFdopen(int fd, const char *mode)
 {
@@ -638,6 +705,7 @@ __pmStat(const char *path, struct stat *buf)
 	    if (compress_ctl[compress_ix].appl == USE_BZIP2) use = "bzip2";
 	    else if (compress_ctl[compress_ix].appl == USE_GZIP) use = "gzip";
 	    else if (compress_ctl[compress_ix].appl == USE_XZ) use = "xz";
+	    else if (compress_ctl[compress_ix].appl == USE_ZSTD) use = "zstd";
 	    else use = "???";
 	    fprintf(stderr, "__pmStat(\"%s\"): decompress: %s", path, use);
 	    if (compress_ctl[compress_ix].handler != NULL)
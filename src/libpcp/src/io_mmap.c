@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * Read-only memory mapped i/o handler, used for uncompressed archive
+ * data volumes (see __pmFopenMap() in io.c).
+ *
+ * Reads are satisfied by copying directly from the mapping, avoiding
+ * the read(2) system call and the stdio buffer.  Copying from a mapping
+ * raises SIGBUS if the file has been truncated underneath it, so each
+ * read first checks the file with fstat(2).  A volume that has changed
+ * in size or modification time since it was mapped is still being
+ * written (pmlogger's current volume) or rewritten in place, so it is
+ * unmapped and read with pread(2) from then on, which returns a short
+ * read or end of file rather than faulting.
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include "pmapi.h"
+#include "libpcp.h"
+#include "internal.h"
+
+typedef struct {
+    int		fd;
+    char	*base;		/* mapping, NULL if not mapped */
+    size_t	maplen;		/* bytes mapped */
+    time_t	mtime;		/* modification time when mapped */
+    int		live;		/* changed since opened, use pread(2) */
+    int		eof;
+    int		err;
+} mmap_priv_t;
+
+/*
+ * Check if the file has changed since it was mapped, and if so drop
+ * the mapping and switch to pread(2) for the rest of its life.
+ * Return the current file size, or -1 on error.
+ */
+static off_t
+mmap_check(__pmFILE *f)
+{
+    mmap_priv_t	*mp = (mmap_priv_t *)f->priv;
+    struct stat	sbuf;
+
+    if (fstat(mp->fd, &sbuf) < 0) {
+	mp->err = 1;
+	return -1;
+    }
+    if (!mp->live &&
+	(sbuf.st_size != (off_t)mp->maplen || sbuf.st_mtime != mp->mtime)) {
+	if (pmDebugOptions.log)
+	    fprintf(stderr, "mmap_check: fd=%d size %zu -> %lld, unmapped\n",
+			mp->fd, mp->maplen, (long long)sbuf.st_size);
+	if (mp->base != NULL)
+	    __pmMemoryUnmap(mp->base, mp->maplen);
+	mp->base = NULL;
+	mp->maplen = 0;
+	mp->live = 1;
+    }
+    return sbuf.st_size;
+}
+
+static void *
+mmap_open(__pmFILE *f, const char *path, const char *mode)
+{
+    mmap_priv_t	*mp;
+    struct stat	sbuf;
+    int		fd;
+    int		sts;
+
+    if (mode[0] != 'r' || mode[1] != '\0') {
+	setoserror(EINVAL);
+	return NULL;
+    }
+    if ((fd = open(path, O_RDONLY)) < 0)
+	return NULL;
+    if (fstat(fd, &sbuf) < 0 || !S_ISREG(sbuf.st_mode)) {
+	sts = oserror() ? oserror() : EINVAL;
+	close(fd);
+	setoserror(sts);
+	return NULL;
+    }
+    if ((mp = (mmap_priv_t *)calloc(1, sizeof(*mp))) == NULL) {
+	sts = oserror();
+	close(fd);
+	setoserror(sts);
+	return NULL;
+    }
+    mp->fd = fd;
+    if (sbuf.st_size == 0) {
+	/* nothing written yet */
+	mp->live = 1;
+    }
+    else if ((mp->base = __pmMemoryMap(fd, sbuf.st_size, 0)) == NULL) {
+	sts = oserror() ? oserror() : ENOMEM;
+	close(fd);
+	free(mp);
+	setoserror(sts);
+	return NULL;
+    }
+    mp->maplen = mp->base ? sbuf.st_size : 0;
+    mp->mtime = sbuf.st_mtime;
+    f->priv = (void *)mp;
+    f->position = 0;
+
+    return f;
+}
+
+static void *
+mmap_fdopen(__pmFILE *f, int fd, const char *mode)
+{
+    /* not supported, __pmFdopen() always uses stdio */
+    setoserror(EOPNOTSUPP);
+    return NULL;
+}
+
+static int
+mmap_seek(__pmFILE *f, off_t offset, int whence)
+{
+    mmap_priv_t	*mp = (mmap_priv_t *)f->priv;
+    off_t	pos;
+
+    switch (whence) {
+	case SEEK_SET:
+	    pos = offset;
+	    break;
+	case SEEK_CUR:
+	    pos = f->position + offset;
+	    break;
+	case SEEK_END:
+	    if ((pos = mmap_check(f)) < 0)
+		return -1;
+	    pos += offset;
+	    break;
+	default:
+	    setoserror(EINVAL);
+	    return -1;
+    }
+    if (pos < 0) {
+	setoserror(EINVAL);
+	return -1;
+    }
+    f->position = pos;
+    mp->eof = 0;
+    return 0;
+}
+
+static void
+mmap_rewind(__pmFILE *f)
+{
+    mmap_priv_t	*mp = (mmap_priv_t *)f->priv;
+
+    f->position = 0;
+    mp->eof = mp->err = 0;
+}
+
+static off_t
+mmap_tell(__pmFILE *f)
+{
+    return f->position;
+}
+
+static size_t
+mmap_read(void *ptr, size_t size, size_t nmemb, __pmFILE *f)
+{
+    mmap_priv_t	*mp = (mmap_priv_t *)f->priv;
+    size_t	want = size * nmemb;
+    size_t	avail;
+    ssize_t	bytes;
+    off_t	end;
+
+    if (want == 0)
+	return 0;
+    if ((end = mmap_check(f)) < 0)
+	return 0;
+    if (f->position >= end)
+	avail = 0;
+    else
+	avail = end - f->position;
+    if (avail < want) {
+	mp->eof = 1;
+	want = avail;
+    }
+    if (want == 0)
+	return 0;
+    if (mp->live) {
+	if ((bytes = pread(mp->fd, ptr, want, f->position)) < 0) {
+	    mp->err = 1;
+	    return 0;
+	}
+	if ((size_t)bytes < want) {
+	    mp->eof = 1;
+	    want = bytes;
+	}
+    }
+    else {
+	memcpy(ptr, &mp->base[f->position], want);
+    }
+    f->position += want;
+    return want / size;
+}
+
+static int
+mmap_getc(__pmFILE *f)
+{
+    unsigned char	c;
+
+    if (mmap_read(&c, 1, 1, f) != 1)
+	return EOF;
+    return c;
+}
+
+static size_t
+mmap_write(void *ptr, size_t size, size_t nmemb, __pmFILE *f)
+{
+    mmap_priv_t	*mp = (mmap_priv_t *)f->priv;
+
+    mp->err = 1;
+    setoserror(EBADF);
+    return 0;
+}
+
+static int
+mmap_flush(__pmFILE *f)
+{
+    return 0;
+}
+
+static int
+mmap_fsync(__pmFILE *f)
+{
+    return 0;
+}
+
+static int
+mmap_fileno(__pmFILE *f)
+{
+    mmap_priv_t	*mp = (mmap_priv_t *)f->priv;
+    return mp->fd;
+}
+
+static off_t
+mmap_lseek(__pmFILE *f, off_t offset, int whence)
+{
+    mmap_priv_t	*mp = (mmap_priv_t *)f->priv;
+    return lseek(mp->fd, offset, whence);
+}
+
+static int
+mmap_fstat(__pmFILE *f, struct stat *buf)
+{
+    mmap_priv_t	*mp = (mmap_priv_t *)f->priv;
+    return fstat(mp->fd, buf);
+}
+
+static int
+mmap_feof(__pmFILE *f)
+{
+    mmap_priv_t	*mp = (mmap_priv_t *)f->priv;
+    return mp->eof;
+}
+
+static int
+mmap_ferror(__pmFILE *f)
+{
+    mmap_priv_t	*mp = (mmap_priv_t *)f->priv;
+    return mp->err;
+}
+
+static void
+mmap_clearerr(__pmFILE *f)
+{
+    mmap_priv_t	*mp = (mmap_priv_t *)f->priv;
+    mp->eof = mp->err = 0;
+}
+
+static int
+mmap_setvbuf(__pmFILE *f, char *buf, int mode, size_t size)
+{
+    /* no buffering to control */
+    return 0;
+}
+
+static int
+mmap_close(__pmFILE *f)
+{
+    mmap_priv_t	*mp = (mmap_priv_t *)f->priv;
+    int		sts;
+
+    if (mp->base != NULL)
+	__pmMemoryUnmap(mp->base, mp->maplen);
+    sts = close(mp->fd);
+    free(mp);
+    f->priv = NULL;
+    return sts;
+}
+
+__pm_fops __pm_mmap = {
+    /*
+     * mmap - read-only, no compression
+     */
+    .__pmopen = mmap_open,
+    .__pmfdopen = mmap_fdopen,
+    .__pmseek = mmap_seek,
+    .__pmrewind = mmap_rewind,
+    .__pmtell = mmap_tell,
+    .__pmfgetc = mmap_getc,
+    .__pmread = mmap_read,
+    .__pmwrite = mmap_write,
+    .__pmflush = mmap_flush,
+    .__pmfsync = mmap_fsync,
+    .__pmfileno = mmap_fileno,
+    .__pmlseek = mmap_lseek,
+    .__pmfstat = mmap_fstat,
+    .__pmfeof = mmap_feof,
+    .__pmferror = mmap_ferror,
+    .__pmclearerr = mmap_clearerr,
+    .__pmsetvbuf = mmap_setvbuf,
+    .__pmclose = mmap_close
+};
@@ -0,0 +1,683 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * Read-only i/o handler for zstd compressed files, with random access.
+ *
+ * A zstd file is a sequence of independently decompressible frames.
+ * When the file is in the zstd "seekable" format (as produced by
+ * pmlogcompress(1)), the frame sizes come from the seek table stored
+ * in a skippable frame at the end of the file.  Otherwise the frame
+ * headers and block headers are walked to find the frame boundaries,
+ * which requires each frame to record its content size (as zstd(1)
+ * always does for regular files).
+ *
+ * Decompressed frames are kept in a small MRU cache, so that the
+ * common pattern of small reads working forwards (or backwards)
+ * through an archive volume decompresses each frame only once.
+ *
+ * Files that cannot be handled here (frames without a content size,
+ * or frames too large to sensibly cache) fail with EOPNOTSUPP, and
+ * __pmFopen() then falls back to decompression via zstd(1) into a
+ * temporary file.
+ */
+#include "config.h"
+#if HAVE_ZSTD_DECOMPRESSION
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <zstd.h>
+#include "pmapi.h"
+#include "libpcp.h"
+#include "internal.h"
+
+#ifndef PCP_ZSTD_CACHE_FRAMES
+#define PCP_ZSTD_CACHE_FRAMES 4
+#endif
+#define ZSTD_MAX_FRAME		(64*1024*1024)	/* largest frame we will cache */
+
+#define ZSTD_FRAME_MAGIC	0xFD2FB528U
+#define SKIPPABLE_MAGIC		0x184D2A50U	/* low 4 bits are ignored */
+#define SKIPPABLE_MASK		0xFFFFFFF0U
+#define SEEKABLE_TABLE_MAGIC	0x184D2A5EU
+#define SEEKABLE_FOOTER_MAGIC	0x8F92EAB1U
+#define SEEKABLE_FOOTER_SIZE	9
+#define FRAME_HEADER_MAX	18
+
+typedef struct {
+    __uint64_t	coff;		/* offset of compressed frame in file */
+    __uint64_t	uoff;		/* offset of frame in uncompressed data */
+    __uint32_t	csize;		/* compressed size */
+    __uint32_t	usize;		/* uncompressed size */
+} zstd_frame_t;
+
+typedef struct {
+    int		frame;		/* index into frames[], -1 for empty slot */
+    char	*data;		/* uncompressed frame */
+    size_t	len;		/* allocated size of data */
+} zstd_slot_t;
+
+typedef struct {
+    int			fd;
+    zstd_frame_t	*frames;
+    int			nframes;
+    __uint64_t		size;		/* total uncompressed size */
+    __uint64_t		offset;		/* current uncompressed offset */
+    ZSTD_DCtx		*dctx;
+    char		*cbuf;		/* compressed frame buffer */
+    size_t		cbuflen;
+    int			err;
+    zstd_slot_t		cache[PCP_ZSTD_CACHE_FRAMES];
+} zstdfile_t;
+
+static void
+zstd_debug(const char *fmt, ...)
+{
+    va_list	ap;
+
+    if (pmDebugOptions.compress) {
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	fputc('\n', stderr);
+	va_end(ap);
+    }
+}
+
+static __uint32_t
+le32(const unsigned char *p)
+{
+    return (__uint32_t)p[0] | ((__uint32_t)p[1] << 8) |
+	   ((__uint32_t)p[2] << 16) | ((__uint32_t)p[3] << 24);
+}
+
+static int
+readat(int fd, void *buf, size_t len, __uint64_t off)
+{
+    ssize_t	n;
+
+    if ((n = pread(fd, buf, len, (off_t)off)) != (ssize_t)len) {
+	if (n >= 0)
+	    setoserror(-PM_ERR_LOGREC);	/* truncated */
+	return -1;
+    }
+    return 0;
+}
+
+static int
+add_frame(zstdfile_t *zf, int *maxframes,
+		__uint64_t coff, __uint64_t csize, __uint64_t usize)
+{
+    zstd_frame_t	*fp;
+
+    if (usize > ZSTD_MAX_FRAME || csize > ZSTD_MAX_FRAME) {
+	zstd_debug("%s(%d): frame at %llu too large (%llu bytes)",
+		__func__, zf->fd, (unsigned long long)coff,
+		(unsigned long long)usize);
+	setoserror(EOPNOTSUPP);
+	return -1;
+    }
+    if (usize == 0)
+	return 0;	/* no data, never need to visit this one */
+    if (zf->nframes == *maxframes) {
+	*maxframes = *maxframes == 0 ? 16 : 2 * *maxframes;
+	fp = (zstd_frame_t *)realloc(zf->frames, *maxframes * sizeof(*fp));
+	if (fp == NULL) {
+	    pmNoMem("zstd frames", *maxframes * sizeof(*fp), PM_RECOV_ERR);
+	    return -1;
+	}
+	zf->frames = fp;
+    }
+    fp = &zf->frames[zf->nframes++];
+    fp->coff = coff;
+    fp->uoff = zf->size;
+    fp->csize = (__uint32_t)csize;
+    fp->usize = (__uint32_t)usize;
+    zf->size += usize;
+    return 0;
+}
+
+/*
+ * Seekable format: the last frame is a skippable frame holding the
+ * seek table, with one entry per data frame (compressed size,
+ * decompressed size, optional checksum) and a 9 byte footer.
+ * Return 1 if a seek table was found and loaded, 0 if not present,
+ * -1 on error.
+ */
+static int
+load_seek_table(zstdfile_t *zf, __uint64_t fsize)
+{
+    unsigned char	footer[SEEKABLE_FOOTER_SIZE];
+    unsigned char	hdr[8];
+    unsigned char	*table;
+    __uint64_t		nframes;
+    __uint64_t		tabsize;
+    __uint64_t		coff;
+    size_t		entsize;
+    int			maxframes = 0;
+    int			i;
+
+    if (fsize < 8 + SEEKABLE_FOOTER_SIZE)
+	return 0;
+    if (readat(zf->fd, footer, sizeof(footer), fsize - sizeof(footer)) < 0)
+	return -1;
+    if (le32(&footer[5]) != SEEKABLE_FOOTER_MAGIC)
+	return 0;
+    if ((footer[4] & 0x7c) != 0) {
+	/* reserved bits must be zero */
+	setoserror(-PM_ERR_LOGREC);
+	return -1;
+    }
+    nframes = le32(&footer[0]);
+    entsize = (footer[4] & 0x80) ? 12 : 8;
+    tabsize = nframes * entsize;
+    if (8 + tabsize + SEEKABLE_FOOTER_SIZE > fsize) {
+	setoserror(-PM_ERR_LOGREC);
+	return -1;
+    }
+    if (readat(zf->fd, hdr, sizeof(hdr),
+		fsize - tabsize - SEEKABLE_FOOTER_SIZE - 8) < 0)
+	return -1;
+    if (le32(&hdr[0]) != SEEKABLE_TABLE_MAGIC ||
+	le32(&hdr[4]) != tabsize + SEEKABLE_FOOTER_SIZE) {
+	setoserror(-PM_ERR_LOGREC);
+	return -1;
+    }
+    if (tabsize == 0)
+	return 1;
+    if ((table = (unsigned char *)malloc(tabsize)) == NULL) {
+	pmNoMem("zstd seek table", tabsize, PM_RECOV_ERR);
+	return -1;
+    }
+    if (readat(zf->fd, table, tabsize,
+		fsize - tabsize - SEEKABLE_FOOTER_SIZE) < 0) {
+	free(table);
+	return -1;
+    }
+    for (coff = 0, i = 0; i < nframes; i++) {
+	__uint32_t	csize = le32(&table[i * entsize]);
+	__uint32_t	usize = le32(&table[i * entsize + 4]);
+
+	if (add_frame(zf, &maxframes, coff, csize, usize) < 0) {
+	    free(table);
+	    return -1;
+	}
+	coff += csize;
+    }
+    free(table);
+    if (coff != fsize - tabsize - SEEKABLE_FOOTER_SIZE - 8) {
+	zstd_debug("%s(%d): seek table does not match file size",
+		__func__, zf->fd);
+	setoserror(-PM_ERR_LOGREC);
+	return -1;
+    }
+    return 1;
+}
+
+/*
+ * No seek table, so find the frame boundaries by walking the frame
+ * and block headers.  Skippable frames are stepped over.
+ */
+static int
+scan_frames(zstdfile_t *zf, __uint64_t fsize)
+{
+    unsigned char	hdr[FRAME_HEADER_MAX];
+    unsigned long long	usize;
+    __uint64_t		coff = 0;
+    __uint64_t		off;
+    __uint32_t		magic;
+    __uint32_t		bhdr;
+    size_t		len;
+    int			maxframes = 0;
+    int			fhd;
+    int			single;
+
+    while (coff < fsize) {
+	len = fsize - coff < sizeof(hdr) ? fsize - coff : sizeof(hdr);
+	if (len < 8 || readat(zf->fd, hdr, len, coff) < 0) {
+	    setoserror(-PM_ERR_LOGREC);
+	    return -1;
+	}
+	magic = le32(hdr);
+	if ((magic & SKIPPABLE_MASK) == SKIPPABLE_MAGIC) {
+	    coff += 8 + (__uint64_t)le32(&hdr[4]);
+	    continue;
+	}
+	if (magic != ZSTD_FRAME_MAGIC) {
+	    zstd_debug("%s(%d): bad frame magic at %llu",
+		    __func__, zf->fd, (unsigned long long)coff);
+	    setoserror(-PM_ERR_LOGREC);
+	    return -1;
+	}
+	usize = ZSTD_getFrameContentSize(hdr, len);
+	if (usize == ZSTD_CONTENTSIZE_ERROR) {
+	    setoserror(-PM_ERR_LOGREC);
+	    return -1;
+	}
+	if (usize == ZSTD_CONTENTSIZE_UNKNOWN) {
+	    zstd_debug("%s(%d): frame at %llu has no content size",
+		    __func__, zf->fd, (unsigned long long)coff);
+	    setoserror(EOPNOTSUPP);
+	    return -1;
+	}
+	/* frame header length, from the frame header descriptor */
+	fhd = hdr[4];
+	single = (fhd >> 5) & 1;
+	off = coff + 5 + (single ? 0 : 1) + ((fhd & 3) == 3 ? 4 : (fhd & 3));
+	off += (fhd >> 6) == 0 ? single : 1 << (fhd >> 6);
+	/* then the blocks, each with a 3 byte header */
+	for ( ; ; ) {
+	    unsigned char	b[3];
+
+	    if (readat(zf->fd, b, sizeof(b), off) < 0)
+		return -1;
+	    bhdr = b[0] | (b[1] << 8) | (b[2] << 16);
+	    off += 3;
+	    switch ((bhdr >> 1) & 3) {
+		case 0:		/* raw */
+		case 2:		/* compressed */
+		    off += bhdr >> 3;
+		    break;
+		case 1:		/* RLE */
+		    off += 1;
+		    break;
+		default:
+		    setoserror(-PM_ERR_LOGREC);
+		    return -1;
+	    }
+	    if (bhdr & 1)
+		break;	/* last block */
+	}
+	if ((fhd >> 2) & 1)
+	    off += 4;	/* content checksum */
+	if (off > fsize) {
+	    setoserror(-PM_ERR_LOGREC);
+	    return -1;
+	}
+	if (add_frame(zf, &maxframes, coff, off - coff, usize) < 0)
+	    return -1;
+	coff = off;
+    }
+    return 0;
+}
+
+static void *
+zstd_init(__pmFILE *f, int fd)
+{
+    zstdfile_t	*zf;
+    struct stat	sbuf;
+    int		sts;
+    int		i;
+
+    if (fstat(fd, &sbuf) < 0)
+	return NULL;
+    if ((zf = (zstdfile_t *)calloc(1, sizeof(*zf))) == NULL) {
+	pmNoMem("zstd_init", sizeof(*zf), PM_RECOV_ERR);
+	return NULL;
+    }
+    zf->fd = fd;
+    for (i = 0; i < PCP_ZSTD_CACHE_FRAMES; i++)
+	zf->cache[i].frame = -1;
+    if ((sts = load_seek_table(zf, sbuf.st_size)) == 0)
+	sts = scan_frames(zf, sbuf.st_size);
+    if (sts < 0)
+	goto fail;
+    if ((zf->dctx = ZSTD_createDCtx()) == NULL) {
+	setoserror(ENOMEM);
+	goto fail;
+    }
+    zstd_debug("%s(%d): %d frames, %llu bytes uncompressed%s", __func__, fd,
+		zf->nframes, (unsigned long long)zf->size,
+		sts == 1 ? " (seekable)" : "");
+    f->priv = zf;
+    return zf;
+
+fail:
+    sts = oserror();
+    free(zf->frames);
+    free(zf);
+    setoserror(sts);
+    return NULL;
+}
+
+static void *
+zstd_open(__pmFILE *f, const char *path, const char *mode)
+{
+    void	*zf;
+    int		fd;
+    int		sts;
+
+    if (mode[0] != 'r' || mode[1] != '\0') {
+	setoserror(EINVAL);
+	return NULL;
+    }
+    if ((fd = open(path, O_RDONLY)) < 0) {
+	zstd_debug("%s(..., %s, ...): open: %s", __func__, path, osstrerror());
+	return NULL;
+    }
+    if ((zf = zstd_init(f, fd)) == NULL) {
+	sts = oserror();
+	close(fd);
+	setoserror(sts);
+    }
+    return zf;
+}
+
+static void *
+zstd_fdopen(__pmFILE *f, int fd, const char *mode)
+{
+    if (mode[0] != 'r' || mode[1] != '\0') {
+	setoserror(EINVAL);
+	return NULL;
+    }
+    return zstd_init(f, fd);
+}
+
+static int
+zstd_seek(__pmFILE *f, off_t offset, int whence)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+    __int64_t	pos;
+
+    switch (whence) {
+	case SEEK_SET:
+	    pos = offset;
+	    break;
+	case SEEK_CUR:
+	    pos = zf->offset + offset;
+	    break;
+	case SEEK_END:
+	    pos = zf->size + offset;
+	    break;
+	default:
+	    setoserror(EINVAL);
+	    return -1;
+    }
+    if (pos < 0) {
+	setoserror(EINVAL);
+	return -1;
+    }
+    /* decompression is deferred until the next read */
+    zf->offset = pos;
+    return 0;
+}
+
+static off_t
+zstd_lseek(__pmFILE *f, off_t offset, int whence)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+
+    if (zstd_seek(f, offset, whence) < 0)
+	return -1;
+    return zf->offset;
+}
+
+static void
+zstd_rewind(__pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+
+    zf->offset = 0;
+    zf->err = 0;
+}
+
+static off_t
+zstd_tell(__pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+
+    return zf->offset;
+}
+
+/*
+ * Return the cache slot holding the frame containing the current
+ * offset, decompressing the frame if needed.  The slot found is
+ * moved to the front of the cache.
+ */
+static zstd_slot_t *
+reposition(zstdfile_t *zf)
+{
+    zstd_frame_t	*fp;
+    zstd_slot_t		slot;
+    size_t		sts;
+    int			lo, hi, mid;
+    int			i;
+
+    if (zf->offset >= zf->size)
+	return NULL;
+
+    /* most recently used frame first */
+    for (i = 0; i < PCP_ZSTD_CACHE_FRAMES; i++) {
+	if (zf->cache[i].frame < 0)
+	    break;
+	fp = &zf->frames[zf->cache[i].frame];
+	if (zf->offset >= fp->uoff && zf->offset < fp->uoff + fp->usize)
+	    goto found;
+    }
+
+    /* binary search for the last frame starting at or before offset */
+    lo = 0;
+    hi = zf->nframes - 1;
+    while (lo < hi) {
+	mid = (lo + hi + 1) / 2;
+	if (zf->frames[mid].uoff <= zf->offset)
+	    lo = mid;
+	else
+	    hi = mid - 1;
+    }
+    fp = &zf->frames[lo];
+
+    /* reuse the least recently used slot */
+    i = PCP_ZSTD_CACHE_FRAMES - 1;
+    zf->cache[i].frame = -1;
+    if (fp->usize > zf->cache[i].len) {
+	char	*data;
+
+	if ((data = (char *)realloc(zf->cache[i].data, fp->usize)) == NULL) {
+	    pmNoMem("zstd frame", fp->usize, PM_RECOV_ERR);
+	    goto fail;
+	}
+	zf->cache[i].data = data;
+	zf->cache[i].len = fp->usize;
+    }
+    if (fp->csize > zf->cbuflen) {
+	char	*cbuf;
+
+	if ((cbuf = (char *)realloc(zf->cbuf, fp->csize)) == NULL) {
+	    pmNoMem("zstd cbuf", fp->csize, PM_RECOV_ERR);
+	    goto fail;
+	}
+	zf->cbuf = cbuf;
+	zf->cbuflen = fp->csize;
+    }
+    if (readat(zf->fd, zf->cbuf, fp->csize, fp->coff) < 0)
+	goto fail;
+    sts = ZSTD_decompressDCtx(zf->dctx, zf->cache[i].data, fp->usize,
+				zf->cbuf, fp->csize);
+    if (ZSTD_isError(sts) || sts != fp->usize) {
+	zstd_debug("%s(%d): frame %d at %llu: %s", __func__, zf->fd,
+		(int)(fp - zf->frames), (unsigned long long)fp->coff,
+		ZSTD_isError(sts) ? ZSTD_getErrorName(sts) : "short frame");
+	setoserror(-PM_ERR_LOGREC);
+	goto fail;
+    }
+    zf->cache[i].frame = fp - zf->frames;
+
+found:
+    if (i != 0) {
+	slot = zf->cache[i];
+	memmove(&zf->cache[1], &zf->cache[0], i * sizeof(slot));
+	zf->cache[0] = slot;
+    }
+    return &zf->cache[0];
+
+fail:
+    zf->err = 1;
+    return NULL;
+}
+
+static int
+zstd_getc(__pmFILE *f)
+{
+    zstdfile_t		*zf = (zstdfile_t *)f->priv;
+    zstd_slot_t		*sp;
+    zstd_frame_t	*fp;
+    int			c;
+
+    if ((sp = reposition(zf)) == NULL)
+	return EOF;
+    fp = &zf->frames[sp->frame];
+    c = (unsigned char)sp->data[zf->offset - fp->uoff];
+    zf->offset++;
+    return c;
+}
+
+static size_t
+zstd_read(void *ptr, size_t size, size_t nmemb, __pmFILE *f)
+{
+    zstdfile_t		*zf = (zstdfile_t *)f->priv;
+    zstd_slot_t		*sp;
+    zstd_frame_t	*fp;
+    size_t		want = size * nmemb;
+    size_t		copied = 0;
+    size_t		n;
+
+    if (want == 0)
+	return 0;
+    while (copied < want) {
+	if ((sp = reposition(zf)) == NULL)
+	    break;
+	fp = &zf->frames[sp->frame];
+	n = fp->uoff + fp->usize - zf->offset;
+	if (n > want - copied)
+	    n = want - copied;
+	memcpy((char *)ptr + copied, &sp->data[zf->offset - fp->uoff], n);
+	zf->offset += n;
+	copied += n;
+    }
+    return copied / size;
+}
+
+static size_t
+zstd_write(void *ptr, size_t size, size_t nmemb, __pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+
+    zf->err = 1;
+    setoserror(EBADF);
+    return 0;
+}
+
+static int
+zstd_flush(__pmFILE *f)
+{
+    return 0;
+}
+
+static int
+zstd_fsync(__pmFILE *f)
+{
+    return 0;
+}
+
+static int
+zstd_fileno(__pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+
+    return zf->fd;
+}
+
+static int
+zstd_fstat(__pmFILE *f, struct stat *buf)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+    int		sts;
+
+    /* What the caller really wants for st_size is the uncompressed size. */
+    if ((sts = fstat(zf->fd, buf)) == 0)
+	buf->st_size = zf->size;
+    return sts;
+}
+
+static int
+zstd_feof(__pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+
+    return zf->offset >= zf->size;
+}
+
+static int
+zstd_ferror(__pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+
+    return zf->err;
+}
+
+static void
+zstd_clearerr(__pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+
+    zf->err = 0;
+}
+
+static int
+zstd_setvbuf(__pmFILE *f, char *buf, int mode, size_t size)
+{
+    /* no buffering to control */
+    return 0;
+}
+
+static int
+zstd_close(__pmFILE *f)
+{
+    zstdfile_t	*zf = (zstdfile_t *)f->priv;
+    int		sts;
+    int		i;
+
+    for (i = 0; i < PCP_ZSTD_CACHE_FRAMES; i++)
+	free(zf->cache[i].data);
+    ZSTD_freeDCtx(zf->dctx);
+    free(zf->cbuf);
+    free(zf->frames);
+    sts = close(zf->fd);
+    free(zf);
+    f->priv = NULL;
+    return sts;
+}
+
+__pm_fops __pm_zstd = {
+    /*
+     * zstd decompression, random access by frame
+     */
+    .__pmopen = zstd_open,
+    .__pmfdopen = zstd_fdopen,
+    .__pmseek = zstd_seek,
+    .__pmrewind = zstd_rewind,
+    .__pmtell = zstd_tell,
+    .__pmfgetc = zstd_getc,
+    .__pmread = zstd_read,
+    .__pmwrite = zstd_write,
+    .__pmflush = zstd_flush,
+    .__pmfsync = zstd_fsync,
+    .__pmfileno = zstd_fileno,
+    .__pmlseek = zstd_lseek,
+    .__pmfstat = zstd_fstat,
+    .__pmfeof = zstd_feof,
+    .__pmferror = zstd_ferror,
+    .__pmclearerr = zstd_clearerr,
+    .__pmsetvbuf = zstd_setvbuf,
+    .__pmclose = zstd_close
+};
+#endif /* HAVE_ZSTD_DECOMPRESSION */
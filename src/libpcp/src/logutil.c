@@ -17,11 +17,16 @@
  * __pmLogReads is a diagnostic counter that is maintained with
  * non-atomic updates ... we've decided that it is acceptable for the
  * value to be subject to possible (but unlikely) missed updates
+ *
+ * the one-trip initializations of seek_stride and prefetch_size are
+ * guarded by the __pmLock_extcall mutex (for getenv()), and the same
+ * values would result from concurrent repeated execution
  */
 
 #include <inttypes.h>
 #include <assert.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include "pmapi.h"
 #include "libpcp.h"
 #include "internal.h"
@@ -51,6 +56,7 @@ static __pmHashCtl	pc_hc;
 static int LogCheckForNextArchive(__pmContext *, int, __pmResult **);
 static int LogChangeToNextArchive(__pmContext *);
 static int LogChangeToPreviousArchive(__pmContext *);
+static void logFreeSeek(__pmLogCtl *);
 
 #ifdef PM_MULTI_THREAD
 static pthread_mutex_t	logutil_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -196,7 +202,7 @@ __pmLogChangeVol(__pmArchCtl *acp, int vol)
     pmsprintf(fname, sizeof(fname), "%s.%d", lcp->name, vol);
     /* need mutual exclusion here to avoid race with a concurrent uncompress */
     PM_LOCK(logutil_lock);
-    if ((acp->ac_mfp = __pmFopen(fname, "r")) == NULL) {
+    if ((acp->ac_mfp = __pmFopenMap(fname)) == NULL) {
 	PM_UNLOCK(logutil_lock);
 	return -oserror();
     }
@@ -295,11 +301,11 @@ __pmLogCreate(const char *host, const char *base, int log_version,
     char	fname[MAXPATHLEN];
 
     lcp->minvol = lcp->maxvol = acp->ac_curvol = 0;
-    lcp->hashpmid.nodes = lcp->hashpmid.hsize = 0;
-    lcp->hashindom.nodes = lcp->hashindom.hsize = 0;
-    lcp->trimindom.nodes = lcp->trimindom.hsize = 0;
-    lcp->hashlabels.nodes = lcp->hashlabels.hsize = 0;
-    lcp->hashtext.nodes = lcp->hashtext.hsize = 0;
+    __pmHashInit(&lcp->hashpmid);
+    __pmHashInit(&lcp->hashindom);
+    __pmHashInit(&lcp->trimindom);
+    __pmHashInit(&lcp->hashlabels);
+    __pmHashInit(&lcp->hashtext);
     lcp->tifp = lcp->mdfp = acp->ac_mfp = NULL;
 
     if ((lcp->tifp = __pmLogNewFile(base, PM_LOG_VOL_TI)) != NULL) {
@@ -605,6 +611,7 @@ __pmLogClose(__pmArchCtl *acp)
 	lcp->seen = NULL;
 	lcp->numseen = 0;
     }
+    logFreeSeek(lcp);
     if (lcp->ti != NULL)
 	free(lcp->ti);
 }
@@ -693,6 +700,7 @@ __pmLogFindOpen(__pmArchCtl *acp, const char *name)
     lcp->minvol = -1;
     lcp->tifp = lcp->mdfp = acp->ac_mfp = NULL;
     lcp->ti = NULL;
+    lcp->seek = NULL;
     lcp->numseen = 0; lcp->seen = NULL;
 
     blen = (int)strlen(base);
@@ -2084,6 +2092,216 @@ func_return:
     return sts;
 }
 
+/*
+ * Sparse seek index ...
+ *
+ * The temporal index may be many records apart (pmlogger only adds an
+ * entry at volume switch and each time the data volume has grown by
+ * another flush interval), so positioning within an interval used to
+ * mean reading records one at a time from the nearest ti[] entry.
+ *
+ * The first time __pmLogSetTime() lands between ti[j-1] and ti[j] in
+ * the same volume, the record headers in that interval are scanned
+ * (length and timestamp only, no decoding) and every seek_stride-th
+ * record is remembered in lcp->seek[j].  This and any later positioning
+ * in the interval is then a binary search to within seek_stride records
+ * of the requested time.
+ *
+ * seek_stride comes from $PCP_LOG_SEEK_STRIDE (default 8), and 0
+ * disables the seek index.
+ */
+#define SEEK_STRIDE	8
+
+static int	seek_stride = -1;
+
+static int
+logSeekStride(void)
+{
+    if (seek_stride == -1) {
+	/* one-trip initialization */
+	char	*str;
+	char	*end;
+	long	val;
+
+	PM_LOCK(__pmLock_extcall);
+	str = getenv("PCP_LOG_SEEK_STRIDE");		/* THREADSAFE */
+	if (str != NULL && str[0] != '\0') {
+	    val = strtol(str, &end, 10);
+	    if (*end != '\0' || val < 0 || val > INT_MAX) {
+		fprintf(stderr, "%s: Warning: bad $PCP_LOG_SEEK_STRIDE: %s\n",
+			pmGetProgname(), str);
+		val = SEEK_STRIDE;
+	    }
+	}
+	else
+	    val = SEEK_STRIDE;
+	seek_stride = (int)val;
+	PM_UNLOCK(__pmLock_extcall);
+    }
+    return seek_stride;
+}
+
+static void
+logFreeSeek(__pmLogCtl *lcp)
+{
+    int		j;
+
+    if (lcp->seek == NULL)
+	return;
+    for (j = 0; j < lcp->numti; j++) {
+	if (lcp->seek[j].ent != NULL)
+	    free(lcp->seek[j].ent);
+    }
+    free(lcp->seek);
+    lcp->seek = NULL;
+}
+
+/*
+ * Scan the records between ti[j-1] and ti[j] in the current volume
+ * and build lcp->seek[j].  Entries are added in offset order, and as
+ * the records are in time order the timestamps are non-decreasing.
+ *
+ * Errors just terminate the scan, leaving whatever has been found so
+ * far, as the caller falls back to the temporal index in any case.
+ */
+static void
+logBuildSeek(__pmArchCtl *acp, int j, int stride)
+{
+    __pmLogCtl		*lcp = acp->ac_log;
+    __pmLogSeek		*sp = &lcp->seek[j];
+    __pmFILE		*f = acp->ac_mfp;
+    __pmLogSeekEnt	*tmp;
+    __int32_t		buf[3];
+    size_t		need;
+    off_t		off = lcp->ti[j-1].off_data;
+    off_t		end = lcp->ti[j].off_data;
+    int			head;
+    int			maxent = 0;
+    int			nrec = 0;
+    int			v3 = (__pmLogVersion(lcp) == PM_LOG_VERS03);
+
+    /* <head> then the timestamp as written by __pmEncodeResult */
+    need = v3 ? 3 * sizeof(__int32_t) : 2 * sizeof(__int32_t);
+
+    sp->built = 1;
+    while (off < end) {
+	__pmFseek(f, (long)off, SEEK_SET);
+	if (__pmFread(&head, 1, sizeof(head), f) != sizeof(head) ||
+	    __pmFread(buf, 1, need, f) != need)
+	    break;
+	head = ntohl(head);
+	if (head < (int)(2 * sizeof(head) + need) || off + head > end) {
+	    if (pmDebugOptions.log)
+		fprintf(stderr, "logBuildSeek: ti[%d] bad record len=%d @ %ld\n",
+			j, head, (long)off);
+	    break;
+	}
+	if ((nrec % stride) == 0) {
+	    if (sp->nent == maxent) {
+		maxent = maxent == 0 ? 16 : 2 * maxent;
+		tmp = (__pmLogSeekEnt *)realloc(sp->ent, maxent * sizeof(sp->ent[0]));
+		if (tmp == NULL) {
+		    pmNoMem("logBuildSeek", maxent * sizeof(sp->ent[0]), PM_RECOV_ERR);
+		    break;
+		}
+		sp->ent = tmp;
+	    }
+	    if (v3)
+		__pmLoadTimestamp(buf, &sp->ent[sp->nent].stamp);
+	    else
+		__pmLoadTimeval(buf, &sp->ent[sp->nent].stamp);
+	    sp->ent[sp->nent].off = off;
+	    sp->nent++;
+	}
+	nrec++;
+	off += head;
+    }
+    __pmClearerr(f);
+
+    if (pmDebugOptions.log)
+	fprintf(stderr, " [seek ti[%d] %d records %d entries]", j, nrec, sp->nent);
+}
+
+/*
+ * Position within the ti[j-1] ... ti[j] interval using the seek index,
+ * building it first if needed.  Called with lcp->ti[j-1].stamp <
+ * c_origin < lcp->ti[j].stamp.
+ *
+ * For PM_MODE_FORW, leave the file at the start of the last indexed
+ * record before c_origin, so reading forward reaches c_origin within
+ * stride records; for PM_MODE_BACK, at the start of the first indexed
+ * record after c_origin.  In both cases this is a valid place to start
+ * serial access.
+ *
+ * Return 0 if positioned, else < 0 and the caller uses the temporal
+ * index instead.
+ */
+static int
+logSeekSet(__pmContext *ctxp, int j, int mode)
+{
+    __pmArchCtl		*acp = ctxp->c_archctl;
+    __pmLogCtl		*lcp = acp->ac_log;
+    __pmLogSeek		*sp;
+    off_t		off;
+    int			stride;
+    int			lo, hi, mid;
+    int			sts = -1;
+
+    if ((stride = logSeekStride()) == 0)
+	return -1;
+    if (lcp->ti[j-1].vol != lcp->ti[j].vol)
+	return -1;
+    if (__pmLogChangeVol(acp, lcp->ti[j].vol) < 0)
+	return -1;
+
+    PM_LOCK(lcp->lc_lock);
+    if (lcp->seek == NULL) {
+	if ((lcp->seek = (__pmLogSeek *)calloc(lcp->numti, sizeof(lcp->seek[0]))) == NULL) {
+	    pmNoMem("logSeekSet", lcp->numti * sizeof(lcp->seek[0]), PM_RECOV_ERR);
+	    goto done;
+	}
+    }
+    sp = &lcp->seek[j];
+    if (!sp->built)
+	logBuildSeek(acp, j, stride);
+    if (sp->nent == 0)
+	goto done;
+
+    /* lo = no. of entries with stamp < c_origin */
+    lo = 0;
+    hi = sp->nent;
+    while (lo < hi) {
+	mid = (lo + hi) / 2;
+	if (__pmTimestampSub(&sp->ent[mid].stamp, &ctxp->c_origin) < 0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    if (mode == PM_MODE_FORW) {
+	if (lo == 0)
+	    goto done;
+	off = sp->ent[lo-1].off;
+    }
+    else {
+	/* skip entries with stamp == c_origin */
+	while (lo < sp->nent &&
+	       __pmTimestampSub(&sp->ent[lo].stamp, &ctxp->c_origin) == 0)
+	    lo++;
+	off = lo < sp->nent ? sp->ent[lo].off : lcp->ti[j].off_data;
+    }
+    __pmFseek(acp->ac_mfp, (long)off, SEEK_SET);
+    acp->ac_serial = 1;
+    if (pmDebugOptions.log) {
+	fprintf(stderr, " seek ti[%d] entry %d/%d @ %ld", j,
+		mode == PM_MODE_FORW ? lo-1 : lo, sp->nent, (long)off);
+    }
+    sts = 0;
+
+done:
+    PM_UNLOCK(lcp->lc_lock);
+    return sts;
+}
+
 /*
  * error handling wrappers around __pmLogChangeVol() to deal with
  * missing volumes ... return lcp->ti[] index for entry matching
@@ -2285,6 +2503,10 @@ __pmLogSetTime(__pmContext *ctxp)
 		__pmPrintTimestamp(stderr, &lcp->ti[j].stamp);
 	    }
 	}
+	else if (!toobig && logSeekSet(ctxp, j, mode) == 0) {
+	    /* positioned using the seek index */
+	    ;
+	}
 	else {
 	    /*
 	     *    [j-1]             [origin]           [j]
@@ -2849,6 +3071,88 @@ pmGetArchiveEnd_ctx(__pmContext *ctxp, __pmTimestamp *tsp)
     return sts;
 }
 
+/*
+ * Read-ahead for multi-archive contexts ...
+ *
+ * When replay moves on to the next (or previous) archive in the context,
+ * ask the kernel to read ahead the start of the .meta, .index and first
+ * data volume of the archive beyond that one, so these are already in
+ * the page cache when __pmLogOpen() and __pmLogLoadMeta() need them at
+ * the following archive boundary.  posix_fadvise() only queues the I/O,
+ * so this costs the caller an open() and close() for each file.
+ *
+ * prefetch_size comes from $PCP_LOG_PREFETCH, in Mbytes to be read from
+ * each file (default 16), and 0 disables read-ahead.
+ */
+#define PREFETCH_SIZE	16
+#define PREFETCH_NFILES	3
+
+static int	prefetch_size = -1;
+
+static int
+logPrefetchSize(void)
+{
+    if (prefetch_size == -1) {
+	/* one-trip initialization */
+	char	*str;
+	char	*end;
+	long	val;
+
+	PM_LOCK(__pmLock_extcall);
+	str = getenv("PCP_LOG_PREFETCH");		/* THREADSAFE */
+	if (str != NULL && str[0] != '\0') {
+	    val = strtol(str, &end, 10);
+	    if (*end != '\0' || val < 0 || val > 1024) {
+		fprintf(stderr, "%s: Warning: bad $PCP_LOG_PREFETCH: %s\n",
+			pmGetProgname(), str);
+		val = PREFETCH_SIZE;
+	    }
+	}
+	else
+	    val = PREFETCH_SIZE;
+	prefetch_size = (int)val;
+	PM_UNLOCK(__pmLock_extcall);
+    }
+    return prefetch_size;
+}
+
+/*
+ * Start read-ahead for archive arch in the context, if any.
+ */
+static void
+logPrefetch(__pmArchCtl *acp, int arch)
+{
+#ifdef POSIX_FADV_WILLNEED
+    const char	*suffix[PREFETCH_NFILES] = { "meta", "index", "0" };
+    char	fname[MAXPATHLEN];
+    off_t	size;
+    int		fd;
+    int		i;
+
+    if (arch < 0 || arch >= acp->ac_num_logs || logPrefetchSize() == 0)
+	return;
+
+    size = (off_t)prefetch_size * 1024 * 1024;
+    for (i = 0; i < PREFETCH_NFILES; i++) {
+	pmsprintf(fname, sizeof(fname), "%s.%s",
+		acp->ac_log_list[arch]->name, suffix[i]);
+	if (access(fname, R_OK) != 0 &&
+	    __pmCompressedFileIndex(fname, sizeof(fname)) < 0)
+	    continue;
+	if ((fd = open(fname, O_RDONLY)) < 0)
+	    continue;
+	(void)posix_fadvise(fd, 0, size, POSIX_FADV_WILLNEED);
+	close(fd);
+    }
+    if (pmDebugOptions.log)
+	fprintf(stderr, "logPrefetch: read-ahead for archive %s\n",
+		acp->ac_log_list[arch]->name);
+#else
+    (void)acp;
+    (void)arch;
+#endif
+}
+
 int
 __pmLogChangeArchive(__pmContext *ctxp, int arch)
 {
@@ -2991,6 +3295,9 @@ LogChangeToNextArchive(__pmContext *ctxp)
     acp->ac_offset = __pmLogLabelSize(lcp);
     acp->ac_vol = acp->ac_curvol;
 
+    /* and get the archive after this one on its way */
+    logPrefetch(acp, acp->ac_cur_log + 1);
+
     /*
      * Check for temporal overlap here. Do this last in case the API client
      * chooses to keep reading anyway.
@@ -3076,6 +3383,9 @@ LogChangeToPreviousArchive(__pmContext *ctxp)
     ctxp->c_origin = save_origin;
     ctxp->c_mode = save_mode;
 
+    /* and get the archive before this one on its way */
+    logPrefetch(acp, acp->ac_cur_log - 1);
+
     /*
      * We need the current end time of the new archive in order to compare
      * with the start time of the previous one.
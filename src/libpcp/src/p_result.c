@@ -30,6 +30,12 @@
  * pointers back into the input PDU buffer, this will be pinned _twice_
  * so the pmFreeResult() and __pmUnpinPDUBuf() calls will still be
  * required.
+ *
+ * The arena variants, __pmDecodeResultArena_ctx() and
+ * __pmDecodeHighResResultArena_ctx(), instead copy the pmValueSets and
+ * pmValueBlocks into the same allocation as the __pmResult (on 64-bit
+ * pointer platforms), so no second PDU buffer is pinned and the caller
+ * only needs pmFreeResult() and __pmUnpinPDUBuf() for the input buffer.
  */
 
 #include <ctype.h>
@@ -324,9 +330,15 @@ __pmSendHighResResult(int fd, int from, const __pmResult *result)
 }
 
 #if defined(HAVE_64BIT_PTR)
-int
-__pmDecodeValueSet(__pmPDU *pdubuf, int pdulen, __pmPDU *data, char *pduend,
-		int numpmid, int preamble, int unaligned, pmValueSet **vset)
+/*
+ * If arenap is not NULL, the __pmResult is allocated here, sized to
+ * hold the decoded pmValueSets and pmValueBlocks as well, and vset
+ * is ignored.
+ */
+static int
+decode_valueset(__pmPDU *pdubuf, int pdulen, __pmPDU *data, char *pduend,
+		int numpmid, int preamble, int unaligned, pmValueSet **vset,
+		__pmResult **arenap)
 {
     char	*newbuf;
     int		valfmt;
@@ -505,8 +517,14 @@ __pmDecodeValueSet(__pmPDU *pdubuf, int pdulen, __pmPDU *data, char *pduend,
 	return PM_ERR_IPC;
     }
 
+    if (arenap != NULL) {
+	/* one allocation for the result, pmValueSets and pmValueBlocks */
+	if ((*arenap = __pmAllocResultArena(numpmid, need, (void **)&newbuf)) == NULL)
+	    return -oserror();
+	vset = (*arenap)->vset;
+    }
     /* the original pdubuf is already pinned so we won't allocate that again */
-    if ((newbuf = (char *)__pmFindPDUBuf(need)) == NULL)
+    else if ((newbuf = (char *)__pmFindPDUBuf(need)) == NULL)
 	return -oserror();
 
     /*
@@ -601,11 +619,19 @@ __pmDecodeValueSet(__pmPDU *pdubuf, int pdulen, __pmPDU *data, char *pduend,
 	    fputc('\n', stderr);
 	}
     }
-    if (numpmid == 0)
+    if (numpmid == 0 && arenap == NULL)
 	__pmUnpinPDUBuf(newbuf);
     return 0;
 }
 
+int
+__pmDecodeValueSet(__pmPDU *pdubuf, int pdulen, __pmPDU *data, char *pduend,
+		int numpmid, int preamble, int unaligned, pmValueSet **vset)
+{
+    return decode_valueset(pdubuf, pdulen, data, pduend, numpmid,
+			   preamble, unaligned, vset, NULL);
+}
+
 #elif defined(HAVE_32BIT_PTR)
 
 int
@@ -751,15 +777,60 @@ __pmDecodeValueSet(__pmPDU *pdubuf, int pdulen, __pmPDU *data, char *pduend,
 #error Bozo - unexpected sizeof pointer!! - commented for static checking
 #endif
 
+/*
+ * Allocate a __pmResult and decode numpmid pmValueSets into it ... as
+ * one arena if requested, except on 32-bit pointer platforms where the
+ * pmValueSets are decoded in place in the PDU buffer anyway.
+ */
+static int
+decode_result_vsets(__pmPDU *pdubuf, int pdulen, __pmPDU *data, char *pduend,
+		int numpmid, int preamble, int unaligned, int arena,
+		__pmResult **result)
+{
+    __pmResult	*pr = NULL;
+    int		sts;
+
+#if defined(HAVE_64BIT_PTR)
+    if (arena) {
+	if ((sts = decode_valueset(pdubuf, pdulen, data, pduend, numpmid,
+				   preamble, unaligned, NULL, &pr)) < 0) {
+	    if (pr != NULL) {
+		pr->numpmid = 0;
+		__pmFreeResult(pr);
+	    }
+	    return sts;
+	}
+	pr->numpmid = numpmid;
+	*result = pr;
+	return 0;
+    }
+#else
+    (void)arena;
+#endif
+
+    if ((pr = __pmAllocResult(numpmid)) == NULL)
+	return -oserror();
+    pr->numpmid = numpmid;
+
+    if ((sts = __pmDecodeValueSet(pdubuf, pdulen, data, pduend,
+				  numpmid, preamble, unaligned, pr->vset)) < 0) {
+	pr->numpmid = 0;	/* force no pmValueSet's to free */
+	__pmFreeResult(pr);
+	return sts;
+    }
+    *result = pr;
+    return 0;
+}
+
 /*
  * Internal variant of __pmDecodeResult() with current context and
  * internal result structure format.
  *
  * Enter here with pdubuf already pinned ... result may point into
- * _another_ pdu buffer that is pinned on exit
+ * _another_ pdu buffer that is pinned on exit, unless arena is set
  */
-int
-__pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, __pmResult **result)
+static int
+decode_result_ctx(__pmContext *ctxp, __pmPDU *pdubuf, __pmResult **result, int arena)
 {
     int			sts;
     int			numpmid;	/* number of metrics */
@@ -821,17 +892,10 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, __pmResult **result)
 	return PM_ERR_IPC;
     }
 
-    if ((pr = __pmAllocResult(numpmid)) == NULL)
-	return -oserror();
-    pr->numpmid = numpmid;
-    pr->timestamp = stamp;		/* struct asssignment */
-
-    if ((sts = __pmDecodeValueSet(pdubuf, len, vset, pduend,
-				  numpmid, bytes, nopad, pr->vset)) < 0) {
-	pr->numpmid = 0;	/* force no pmValueSet's to free */
-	__pmFreeResult(pr);
+    if ((sts = decode_result_vsets(pdubuf, len, vset, pduend,
+			     numpmid, bytes, nopad, arena, &pr)) < 0)
 	return sts;
-    }
+    pr->timestamp = stamp;		/* struct asssignment */
 
     if (pmDebugOptions.pdu)
 	__pmPrintResult_ctx(ctxp, stderr, pr);
@@ -845,6 +909,18 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, __pmResult **result)
     return 0;
 }
 
+int
+__pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, __pmResult **result)
+{
+    return decode_result_ctx(ctxp, pdubuf, result, 0);
+}
+
+int
+__pmDecodeResultArena_ctx(__pmContext *ctxp, __pmPDU *pdubuf, __pmResult **result)
+{
+    return decode_result_ctx(ctxp, pdubuf, result, 1);
+}
+
 int
 __pmDecodeResult(__pmPDU *pdubuf, __pmResult **result)
 {
@@ -855,10 +931,10 @@ __pmDecodeResult(__pmPDU *pdubuf, __pmResult **result)
  * Internal variant of __pmDecodeHighResResult() with current context.
  *
  * Enter here with pdubuf already pinned ... result may point into
- * _another_ pdu buffer that is pinned on exit
+ * _another_ pdu buffer that is pinned on exit, unless arena is set
  */
-int
-__pmDecodeHighResResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, __pmResult **result)
+static int
+decode_highres_result_ctx(__pmContext *ctxp, __pmPDU *pdubuf, __pmResult **result, int arena)
 {
     int			sts;
     int			numpmid;	/* number of metrics */
@@ -896,25 +972,18 @@ __pmDecodeHighResResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, __pmResult **res
 	return PM_ERR_IPC;
     }
 
-    if ((pr = __pmAllocResult(numpmid)) == NULL)
-	return -oserror();
+    bytes = sizeof(highres_result_t) - (sizeof(__pmPDU) * 2);
+    nopad = sizeof(pp->hdr) + sizeof(pp->numpmid) + sizeof(pp->timestamp);
+
+    if ((sts = decode_result_vsets(pdubuf, pp->hdr.len, pp->data, pduend,
+			     numpmid, bytes, nopad, arena, &pr)) < 0)
+	return sts;
 
-    pr->numpmid = numpmid;
     __ntohll((char *)&pp->timestamp.tv_sec);
     pr->timestamp.sec = pp->timestamp.tv_sec;
     __ntohll((char *)&pp->timestamp.tv_nsec);
     pr->timestamp.nsec = pp->timestamp.tv_nsec;
 
-    bytes = sizeof(highres_result_t) - (sizeof(__pmPDU) * 2);
-    nopad = sizeof(pp->hdr) + sizeof(pp->numpmid) + sizeof(pp->timestamp);
-
-    if ((sts = __pmDecodeValueSet(pdubuf, pp->hdr.len, pp->data, pduend,
-				  numpmid, bytes, nopad, pr->vset)) < 0) {
-	pr->numpmid = 0;	/* force no pmValueSet's to free */
-	__pmFreeResult(pr);
-	return sts;
-    }
-
     if (pmDebugOptions.pdu)
 	__pmPrintResult_ctx(ctxp, stderr, pr);
 
@@ -927,6 +996,18 @@ __pmDecodeHighResResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, __pmResult **res
     return 0;
 }
 
+int
+__pmDecodeHighResResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, __pmResult **result)
+{
+    return decode_highres_result_ctx(ctxp, pdubuf, result, 0);
+}
+
+int
+__pmDecodeHighResResultArena_ctx(__pmContext *ctxp, __pmPDU *pdubuf, __pmResult **result)
+{
+    return decode_highres_result_ctx(ctxp, pdubuf, result, 1);
+}
+
 int
 __pmDecodeHighResResult(__pmPDU *pdubuf, __pmResult **result)
 {
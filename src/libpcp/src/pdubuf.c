@@ -1,12 +1,12 @@
 /*
  * Copyright (c) 1995 Silicon Graphics, Inc.  All Rights Reserved.
- * Copyright (c) 2015 Red Hat, Inc.
- * 
+ * Copyright (c) 2015,2026 Red Hat, Inc.
+ *
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
  * by the Free Software Foundation; either version 2.1 of the License, or
  * (at your option) any later version.
- * 
+ *
  * This library is distributed in the hope that it will be useful, but
  * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
  * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
@@ -17,10 +17,24 @@
  * To avoid buffer trampling, on success __pmFindPDUBuf() now returns
  * a pinned PDU buffer.  It is the caller's responsibility to unpin the
  * PDU buffer when safe to do so.
+ *
+ * Buffers of up to PDUBUF_MAXCLASS bytes come from size-class slabs.
+ * Each slab is a PDUBUF_SLAB-aligned block holding equal sized slots,
+ * so any address within a buffer is mapped to its slab by masking and
+ * to its slot by division.  Slabs are recorded in an insert-only hash
+ * table that is read without locking, and pin counts are updated with
+ * atomic operations, so pinning and unpinning a slab buffer takes no
+ * locks.  Free slots are cached per-thread, with a shared depot per
+ * size class (protected by pdubuf_lock) that threads refill from and
+ * spill into in batches.  Slabs are retained once allocated.
+ *
+ * Larger buffers are individually allocated and kept in a tsearch()
+ * tree protected by pdubuf_lock, as before.
  */
 
 #include "pmapi.h"
 #include "libpcp.h"
+#include "internal.h"
 #include "compiler.h"
 #include <assert.h>
 #include <search.h>
@@ -54,6 +68,392 @@ __pmIsPdubufLock(void *lock)
 }
 #endif
 
+/*
+ * Atomic pin counts and statistics where the compiler supports them,
+ * otherwise these are serialized using pdubuf_lock.
+ */
+#if !defined(PM_MULTI_THREAD)
+#define PDUBUF_ADD(p, n)	(*(p) += (n))
+#define PDUBUF_LOAD(p)		(*(p))
+#define PDUBUF_STORE(p, v)	(*(p) = (v))
+#elif defined(__ATOMIC_ACQ_REL)
+#define PDUBUF_ADD(p, n)	__atomic_add_fetch((p), (n), __ATOMIC_ACQ_REL)
+#define PDUBUF_LOAD(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define PDUBUF_STORE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#define PDUBUF_LOCKED_ATOMICS 1
+static int
+pdubuf_add(int *p, int n)
+{
+    int		v;
+
+    PM_LOCK(pdubuf_lock);
+    v = (*p += n);
+    PM_UNLOCK(pdubuf_lock);
+    return v;
+}
+#define PDUBUF_ADD(p, n)	pdubuf_add((p), (n))
+#define PDUBUF_LOAD(p)		(*(volatile __typeof__(*(p)) *)(p))
+#define PDUBUF_STORE(p, v)	(*(p) = (v))
+#endif
+
+/* per-thread free slot caches, if thread private data is cheap */
+#if !defined(PM_MULTI_THREAD) || defined(HAVE___THREAD)
+#define PDUBUF_TCACHE 1
+#endif
+
+#define PDUBUF_SLAB	(256 * 1024)		/* slab size and alignment */
+#define PDUBUF_MINSHIFT	6			/* smallest class, 64 bytes */
+#define PDUBUF_NCLASS	11			/* 64 bytes ... 64 Kbytes */
+#define PDUBUF_MAXCLASS	(1 << (PDUBUF_MINSHIFT + PDUBUF_NCLASS - 1))
+#define PDUBUF_TCBYTES	(128 * 1024)		/* per-thread cache, per class */
+
+typedef struct slab {
+    int		sl_class;
+    int		sl_slotsize;
+    int		sl_nslot;
+    char	*sl_data;		/* first slot */
+    int		*sl_pincnt;		/* per-slot pin count */
+    int		*sl_size;		/* per-slot requested size */
+    /* pin counts, sizes and slots follow */
+} slab_t;
+
+typedef struct freeslot {
+    struct freeslot	*next;
+} freeslot_t;
+
+/*
+ * Slab lookup table, open addressing on the slab base address.  Only
+ * ever grows; a replaced table is not freed as readers may still be
+ * using it, but is chained from its replacement.
+ */
+typedef struct slabtab {
+    struct slabtab	*prev;
+    unsigned int	mask;
+    unsigned int	count;
+    slab_t		*slab[1];
+} slabtab_t;
+
+static slabtab_t	*slabtab;
+
+/* Shared depot and statistics per size class */
+typedef struct {
+    freeslot_t	*head;			/* protected by pdubuf_lock */
+    int		count;			/* protected by pdubuf_lock */
+    int		nslab;			/* protected by pdubuf_lock */
+    int		inuse;			/* pinned buffers, atomic */
+    int		avail;			/* free slots, atomic */
+} depot_t;
+
+static depot_t		depot[PDUBUF_NCLASS];
+
+#ifdef PDUBUF_TCACHE
+typedef struct {
+    freeslot_t	*head[PDUBUF_NCLASS];
+    int		count[PDUBUF_NCLASS];
+} tcache_t;
+
+#ifdef PM_MULTI_THREAD
+static __thread tcache_t	tcache;
+static __thread int		tcache_registered;
+static pthread_key_t		tcache_key;
+static pthread_once_t		tcache_once = PTHREAD_ONCE_INIT;
+#else
+static tcache_t			tcache;
+#endif
+#endif
+
+static inline int
+slot_class(int need)
+{
+    int		c = 0;
+
+    while ((1 << (PDUBUF_MINSHIFT + c)) < need)
+	c++;
+    return c;
+}
+
+static inline unsigned int
+slab_hash(uintptr_t base)
+{
+    return (unsigned int)((base / PDUBUF_SLAB) * 2654435761U);
+}
+
+/*
+ * Map an address to the slab containing it, without locking.
+ */
+static slab_t *
+slab_find(const void *handle)
+{
+    uintptr_t		base = (uintptr_t)handle & ~((uintptr_t)PDUBUF_SLAB - 1);
+    slabtab_t		*tp;
+    slab_t		*sp;
+    unsigned int	i;
+
+#ifdef PDUBUF_LOCKED_ATOMICS
+    PM_LOCK(pdubuf_lock);
+    tp = slabtab;
+    PM_UNLOCK(pdubuf_lock);
+#else
+    tp = PDUBUF_LOAD(&slabtab);
+#endif
+    if (tp == NULL)
+	return NULL;
+    for (i = slab_hash(base) & tp->mask; ; i = (i + 1) & tp->mask) {
+	if ((sp = PDUBUF_LOAD(&tp->slab[i])) == NULL)
+	    return NULL;
+	if ((uintptr_t)sp == base)
+	    return sp;
+    }
+}
+
+/* pdubuf_lock is held */
+static int
+slab_register(slab_t *sp)
+{
+    slabtab_t		*tp = slabtab, *ntp;
+    unsigned int	size, i, j;
+
+    if (tp == NULL || 2 * (tp->count + 1) > tp->mask + 1) {
+	size = tp ? 2 * (tp->mask + 1) : 64;
+	ntp = (slabtab_t *)calloc(1, sizeof(slabtab_t) + (size - 1) * sizeof(slab_t *));
+	if (ntp == NULL)
+	    return -ENOMEM;
+	ntp->mask = size - 1;
+	ntp->prev = tp;
+	for (j = 0; tp != NULL && j <= tp->mask; j++) {
+	    if (tp->slab[j] == NULL)
+		continue;
+	    for (i = slab_hash((uintptr_t)tp->slab[j]) & ntp->mask;
+		 ntp->slab[i] != NULL; i = (i + 1) & ntp->mask)
+		;
+	    ntp->slab[i] = tp->slab[j];
+	}
+	ntp->count = tp ? tp->count : 0;
+	PDUBUF_STORE(&slabtab, ntp);
+	tp = ntp;
+    }
+    for (i = slab_hash((uintptr_t)sp) & tp->mask;
+	 tp->slab[i] != NULL; i = (i + 1) & tp->mask)
+	;
+    PDUBUF_STORE(&tp->slab[i], sp);
+    tp->count++;
+    return 0;
+}
+
+/*
+ * Allocate a new slab for class c and put its slots in the depot.
+ * pdubuf_lock is held.
+ */
+static int
+slab_alloc(int c)
+{
+    depot_t	*dp = &depot[c];
+    slab_t	*sp;
+    void	*mem;
+    size_t	hdr;
+    int		slotsize = 1 << (PDUBUF_MINSHIFT + c);
+    int		nslot, i;
+
+#if defined(HAVE_POSIX_MEMALIGN)
+    if (posix_memalign(&mem, PDUBUF_SLAB, PDUBUF_SLAB) != 0)
+	return -ENOMEM;
+#else
+    /* over-allocate and align by hand; the excess is never used */
+    if ((mem = malloc(2 * PDUBUF_SLAB)) == NULL)
+	return -ENOMEM;
+    mem = (void *)(((uintptr_t)mem + PDUBUF_SLAB - 1) & ~((uintptr_t)PDUBUF_SLAB - 1));
+#endif
+    sp = (slab_t *)mem;
+    nslot = (PDUBUF_SLAB - sizeof(slab_t)) / (slotsize + 2 * sizeof(int));
+    for (;;) {
+	hdr = sizeof(slab_t) + 2 * nslot * sizeof(int);
+	hdr = (hdr + 63) & ~(size_t)63;
+	if (hdr + (size_t)nslot * slotsize <= PDUBUF_SLAB)
+	    break;
+	nslot--;
+    }
+    sp->sl_class = c;
+    sp->sl_slotsize = slotsize;
+    sp->sl_nslot = nslot;
+    sp->sl_pincnt = (int *)&sp[1];
+    sp->sl_size = &sp->sl_pincnt[nslot];
+    sp->sl_data = (char *)sp + hdr;
+    memset(sp->sl_pincnt, 0, 2 * nslot * sizeof(int));
+
+    if (slab_register(sp) < 0) {
+#if defined(HAVE_POSIX_MEMALIGN)
+	free(mem);
+#endif
+	return -ENOMEM;
+    }
+    for (i = nslot - 1; i >= 0; i--) {
+	freeslot_t	*fp = (freeslot_t *)&sp->sl_data[i * slotsize];
+
+	fp->next = dp->head;
+	dp->head = fp;
+    }
+    dp->count += nslot;
+    dp->nslab++;
+    PDUBUF_ADD(&dp->avail, nslot);
+    return 0;
+}
+
+#ifdef PDUBUF_TCACHE
+static inline int
+tcache_limit(int c)
+{
+    int		n = PDUBUF_TCBYTES >> (PDUBUF_MINSHIFT + c);
+
+    return n < 4 ? 4 : n;
+}
+
+/* Return half (or all) of this thread's cached slots for class c */
+static void
+tcache_spill(int c, int all)
+{
+    depot_t	*dp = &depot[c];
+    freeslot_t	*fp, *last = NULL;
+    int		n = all ? tcache.count[c] : tcache.count[c] / 2;
+    int		i;
+
+    if (n == 0)
+	return;
+    fp = tcache.head[c];
+    for (i = 0; i < n; i++) {
+	last = fp;
+	fp = fp->next;
+    }
+    PM_LOCK(pdubuf_lock);
+    last->next = dp->head;
+    dp->head = tcache.head[c];
+    dp->count += n;
+    PM_UNLOCK(pdubuf_lock);
+    tcache.head[c] = fp;
+    tcache.count[c] -= n;
+}
+
+#ifdef PM_MULTI_THREAD
+static void
+tcache_exit(void *arg)
+{
+    int		c;
+
+    (void)arg;
+    for (c = 0; c < PDUBUF_NCLASS; c++)
+	tcache_spill(c, 1);
+}
+
+static void
+tcache_init(void)
+{
+    pthread_key_create(&tcache_key, tcache_exit);
+}
+
+/*
+ * Flush this thread's cache back to the depot at thread exit; needed
+ * before the first slot is cached, whether by slot_get() or slot_put().
+ */
+static inline void
+tcache_register(void)
+{
+    if (!tcache_registered) {
+	pthread_once(&tcache_once, tcache_init);
+	pthread_setspecific(tcache_key, &tcache);
+	tcache_registered = 1;
+    }
+}
+#endif
+#endif
+
+static void *
+slot_get(int c)
+{
+    depot_t	*dp = &depot[c];
+    freeslot_t	*fp;
+#ifdef PDUBUF_TCACHE
+    int		n;
+
+    if ((fp = tcache.head[c]) != NULL) {
+	tcache.head[c] = fp->next;
+	tcache.count[c]--;
+	return fp;
+    }
+#ifdef PM_MULTI_THREAD
+    tcache_register();
+#endif
+#endif
+
+    PM_LOCK(pdubuf_lock);
+    if (dp->head == NULL && slab_alloc(c) < 0) {
+	PM_UNLOCK(pdubuf_lock);
+	return NULL;
+    }
+    fp = dp->head;
+    dp->head = fp->next;
+    dp->count--;
+#ifdef PDUBUF_TCACHE
+    /* and move a batch into this thread's cache */
+    for (n = tcache_limit(c) / 2; n > 0 && dp->head != NULL; n--) {
+	freeslot_t	*np = dp->head;
+
+	dp->head = np->next;
+	dp->count--;
+	np->next = tcache.head[c];
+	tcache.head[c] = np;
+	tcache.count[c]++;
+    }
+#endif
+    PM_UNLOCK(pdubuf_lock);
+    return fp;
+}
+
+static void
+slot_put(int c, void *buf)
+{
+    freeslot_t	*fp = (freeslot_t *)buf;
+#ifndef PDUBUF_TCACHE
+    depot_t	*dp = &depot[c];
+#endif
+
+    PDUBUF_ADD(&depot[c].inuse, -1);
+    PDUBUF_ADD(&depot[c].avail, 1);
+#ifdef PDUBUF_TCACHE
+#ifdef PM_MULTI_THREAD
+    tcache_register();
+#endif
+    fp->next = tcache.head[c];
+    tcache.head[c] = fp;
+    if (++tcache.count[c] > tcache_limit(c))
+	tcache_spill(c, 0);
+#else
+    PM_LOCK(pdubuf_lock);
+    fp->next = dp->head;
+    dp->head = fp;
+    dp->count++;
+    PM_UNLOCK(pdubuf_lock);
+#endif
+}
+
+/*
+ * Map handle to a pinned slot; returns the slot index or -1 if handle
+ * is not within the requested size of a buffer that is in use.
+ */
+static int
+slot_index(slab_t *sp, const void *handle)
+{
+    int		i;
+    int		off;
+
+    off = (int)((const char *)handle - sp->sl_data);
+    if (off < 0)
+	return -1;
+    i = off / sp->sl_slotsize;
+    if (i >= sp->sl_nslot || off - i * sp->sl_slotsize >= PDUBUF_LOAD(&sp->sl_size[i]))
+	return -1;
+    return i;
+}
+
 static void
 pdubufdump1(const void *nodep, const VISIT which, const int depth)
 {
@@ -68,16 +468,48 @@ pdubufdump1(const void *nodep, const VISIT which, const int depth)
 static void
 pdubufdump(void)
 {
+    slabtab_t	*tp;
+    slab_t	*sp;
+    char	*buf;
+    int		pinned = 0;
+    int		pincnt;
+    int		c;
+    unsigned	i, j;
+
     /*
-     * There is no longer a pdubuf free list, ergo no
-     * fprintf(stderr, "   free pdubuf[size]:\n");
+     * Free slab slots are not reported, just those in use
      */
     PM_LOCK(pdubuf_lock);
+    for (tp = slabtab, i = 0; tp != NULL && i <= tp->mask; i++) {
+	if ((sp = tp->slab[i]) == NULL)
+	    continue;
+	for (j = 0; j < (unsigned)sp->sl_nslot; j++) {
+	    if ((pincnt = PDUBUF_LOAD(&sp->sl_pincnt[j])) <= 0)
+		continue;
+	    if (pinned++ == 0)
+		fprintf(stderr, "   pinned pdubuf[size](pincnt):");
+	    buf = &sp->sl_data[j * sp->sl_slotsize];
+	    fprintf(stderr, " " PRINTF_P_PFX "%p...%p[%d](%d)",
+		    buf, &buf[sp->sl_size[j] - 1], sp->sl_size[j], pincnt);
+	}
+    }
     if (buf_tree != NULL) {
-	fprintf(stderr, "   pinned pdubuf[size](pincnt):");
+	if (pinned++ == 0)
+	    fprintf(stderr, "   pinned pdubuf[size](pincnt):");
 	/* THREADSAFE - no locks acquired in pdubufdump1() */
 	twalk(buf_tree, &pdubufdump1);
+    }
+    if (pinned)
 	fprintf(stderr, "\n");
+    if (pmDebugOptions.pdubuf) {
+	for (c = 0; c < PDUBUF_NCLASS; c++) {
+	    if (depot[c].nslab == 0)
+		continue;
+	    fprintf(stderr, "   class[%d] %d slabs, %d in use, %d free (%d in depot)\n",
+		    1 << (PDUBUF_MINSHIFT + c), depot[c].nslab,
+		    PDUBUF_LOAD(&depot[c].inuse), PDUBUF_LOAD(&depot[c].avail),
+		    depot[c].count);
+	}
     }
     PM_UNLOCK(pdubuf_lock);
 }
@@ -104,6 +536,9 @@ __pmFindPDUBuf(int need)
 {
     bufctl_t	*pcp;
     void	*bcp;
+    slab_t	*sp;
+    char	*buf;
+    int		c, i;
 
     if (unlikely(need < 0)) {
 	/* special diagnostic case ... dump buffer state */
@@ -112,6 +547,25 @@ __pmFindPDUBuf(int need)
 	return NULL;
     }
 
+    if (likely(need <= PDUBUF_MAXCLASS)) {
+	c = slot_class(need);
+	if ((buf = slot_get(c)) == NULL)
+	    return NULL;
+	sp = (slab_t *)((uintptr_t)buf & ~((uintptr_t)PDUBUF_SLAB - 1));
+	i = (int)(buf - sp->sl_data) / sp->sl_slotsize;
+	PDUBUF_STORE(&sp->sl_size[i], need > 0 ? need : 1);
+	PDUBUF_STORE(&sp->sl_pincnt[i], 1);
+	PDUBUF_ADD(&depot[c].avail, -1);
+	PDUBUF_ADD(&depot[c].inuse, 1);
+
+	if (unlikely(pmDebugOptions.pdubuf)) {
+	    fprintf(stderr, "__pmFindPDUBuf(%d) -> " PRINTF_P_PFX "%p\n",
+		    need, buf);
+	    pdubufdump();
+	}
+	return (__pmPDU *)buf;
+    }
+
     if ((pcp = (bufctl_t *)malloc(sizeof(*pcp) + need)) == NULL) {
 	return NULL;
     }
@@ -145,8 +599,28 @@ __pmPinPDUBuf(void *handle)
 {
     bufctl_t	*pcp, pcp_search;
     void	*bcp;
+    slab_t	*sp;
+    int		i, pincnt;
 
     assert(((__psint_t)handle % sizeof(int)) == 0);
+
+    if (likely((sp = slab_find(handle)) != NULL)) {
+	if ((i = slot_index(sp, handle)) < 0 ||
+	    (pincnt = PDUBUF_ADD(&sp->sl_pincnt[i], 1)) <= 1) {
+	    if (i >= 0)
+		PDUBUF_ADD(&sp->sl_pincnt[i], -1);
+	    pmNotifyErr(LOG_WARNING, "__pmPinPDUBuf: " PRINTF_P_PFX "%p not in pool!", handle);
+	    if (pmDebugOptions.pdubuf)
+		pdubufdump();
+	    return;
+	}
+	if (unlikely(pmDebugOptions.pdubuf))
+	    fprintf(stderr, "__pmPinPDUBuf(" PRINTF_P_PFX "%p) -> pdubuf="
+			    PRINTF_P_PFX "%p, pincnt=%d\n", handle,
+		    &sp->sl_data[i * sp->sl_slotsize], pincnt);
+	return;
+    }
+
     /*
      * Initialize a dummy bufctl_t to use only as search key;
      * only its bc_buf & bc_size fields need to be set, as that's
@@ -188,8 +662,36 @@ __pmUnpinPDUBuf(void *handle)
 {
     bufctl_t	*pcp, pcp_search;
     void	*bcp;
+    slab_t	*sp;
+    char	*buf;
+    int		i, pincnt;
 
     assert(((__psint_t)handle % sizeof(int)) == 0);
+
+    if (likely((sp = slab_find(handle)) != NULL)) {
+	if ((i = slot_index(sp, handle)) < 0 ||
+	    (pincnt = PDUBUF_ADD(&sp->sl_pincnt[i], -1)) < 0) {
+	    if (i >= 0)
+		PDUBUF_ADD(&sp->sl_pincnt[i], 1);
+	    if (pmDebugOptions.pdubuf) {
+		fprintf(stderr, "__pmUnpinPDUBuf(" PRINTF_P_PFX "%p) -> fails\n",
+			handle);
+		pdubufdump();
+	    }
+	    return 0;
+	}
+	buf = &sp->sl_data[i * sp->sl_slotsize];
+	if (unlikely(pmDebugOptions.pdubuf))
+	    fprintf(stderr, "__pmUnpinPDUBuf(" PRINTF_P_PFX "%p) -> pdubuf="
+			    PRINTF_P_PFX "%p, pincnt=%d\n", handle,
+		    buf, pincnt);
+	if (likely(pincnt == 0)) {
+	    PDUBUF_STORE(&sp->sl_size[i], 0);
+	    slot_put(sp->sl_class, buf);
+	}
+	return 1;
+    }
+
     PM_LOCK(pdubuf_lock);
 
     /*
@@ -256,9 +758,15 @@ pdubufcount(const void *nodep, const VISIT which, const int depth)
 	    pdu_bufcnt++;
 }
 
+/*
+ * Report the number of buffers of at least need bytes that are in use
+ * (pinned) and free (pooled slab slots, including per-thread caches).
+ */
 void
 __pmCountPDUBuf(int need, int *alloc, int *free)
 {
+    int		c;
+
     PM_LOCK(pdubuf_lock);
 
     pdu_bufcnt_need = need;
@@ -266,8 +774,14 @@ __pmCountPDUBuf(int need, int *alloc, int *free)
     /* THREADSAFE - no locks acquired in pdubufcount() */
     twalk(buf_tree, &pdubufcount);
     *alloc = pdu_bufcnt;
+    *free = 0;			/* large buffers are not retained */
 
-    *free = 0;			/* We don't retain freed nodes. */
+    for (c = 0; c < PDUBUF_NCLASS; c++) {
+	if ((1 << (PDUBUF_MINSHIFT + c)) < need)
+	    continue;
+	*alloc += PDUBUF_LOAD(&depot[c].inuse);
+	*free += PDUBUF_LOAD(&depot[c].avail);
+    }
 
     PM_UNLOCK(pdubuf_lock);
 }
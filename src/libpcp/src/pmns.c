@@ -20,6 +20,7 @@
  */
 
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <stddef.h>
 #include <assert.h>
 #include <ctype.h>
@@ -928,6 +929,8 @@ pass2(int dupok)
     main_pmns->htab = NULL;
     main_pmns->htabsize = 0;
     main_pmns->mark_state = UNKNOWN_MARK_STATE;
+    main_pmns->map = NULL;
+    main_pmns->maplen = 0;
 
     /* Get the root subtree out of the seen list */
     if ((main_pmns->root = findseen("root")) == NULL) {
@@ -1044,6 +1047,8 @@ __pmNewPMNS(__pmnsTree **pmns)
     t->htab = NULL;
     t->htabsize = 0;
     t->mark_state = UNKNOWN_MARK_STATE;
+    t->map = NULL;
+    t->maplen = 0;
 
     *pmns = t;
     return 0;
@@ -1465,11 +1470,470 @@ pmapi_return:
     return sts;
 }
 
+/*
+ * Compiled PMNS
+ *
+ * Loading the ASCII PMNS means lexing the whole file, building the
+ * tree one malloc'd node at a time and hashing the PMIDs.  When asked
+ * to (see below), the resulting tree is also saved in "<fname>.bin",
+ * along with the size, modification time and inode of the ASCII file
+ * it was built from.  Later loads of the default PMNS map the compiled
+ * file read-only and rebuild the tree from the node table in a single
+ * pass, with the names used in place from the mapping, so those pages
+ * are shared by all of the processes using the PMNS.
+ *
+ * The node order, and the order of the PMID hash chains, are exactly
+ * those of the tree built from the ASCII file, so pmGetChildren(),
+ * pmNameAll() and friends return the same answers either way.
+ *
+ * If the compiled file is missing or stale (the ASCII file has changed,
+ * as for __pmHasPMNSFileChanged()), or fails the consistency checks,
+ * the ASCII file is used.  The compiled file is only written when
+ * $PCP_PMNS_COMPILED is set to "save", in which case any ASCII PMNS
+ * that is loaded is saved ... Rebuild and pmnsadd do this with
+ * "pminfo -n" after installing a new PMNS, so other clients never
+ * write next to the PMNS they load.  Setting $PCP_PMNS_COMPILED to 0
+ * disables all of this.
+ */
+#define PMNS_BIN_MAGIC		"PCPPMNS"
+#define PMNS_BIN_VERSION	1
+#define PMNS_BIN_ORDER		0x01020304
+#define PMNS_BIN_NULL		0xffffffff
+
+typedef struct {
+    char	magic[8];	/* PMNS_BIN_MAGIC */
+    __uint32_t	version;	/* PMNS_BIN_VERSION */
+    __uint32_t	order;		/* PMNS_BIN_ORDER, native byte order */
+    __int64_t	size;		/* st_size of the ASCII PMNS */
+    __int64_t	sec;		/* st_mtime of the ASCII PMNS */
+    __int64_t	nsec;
+    __uint64_t	ino;		/* st_ino of the ASCII PMNS */
+    __uint32_t	nnode;		/* number of nodes, root is node 0 */
+    __uint32_t	htabsize;	/* number of PMID hash table entries */
+    __uint32_t	strsize;	/* bytes of names */
+    __uint32_t	dupids;		/* 1 if there are duplicate PMIDs */
+} pmns_bin_hdr_t;
+
+/*
+ * Followed by nnode node records, htabsize __uint32_t hash table
+ * entries (node index or PMNS_BIN_NULL) and strsize bytes of null
+ * terminated names.
+ */
+typedef struct {
+    __uint32_t	parent;		/* node indices, or PMNS_BIN_NULL */
+    __uint32_t	next;
+    __uint32_t	first;
+    __uint32_t	hash;
+    __uint32_t	name;		/* offset into names */
+    __uint32_t	pmid;
+} pmns_bin_node_t;
+
+#define PMNS_BIN_OFF		0	/* $PCP_PMNS_COMPILED=0 */
+#define PMNS_BIN_LOAD		1	/* default */
+#define PMNS_BIN_SAVE		2	/* $PCP_PMNS_COMPILED=save */
+
+static int	use_compiled = -1;
+
+static int
+compiled_pmns(void)
+{
+    if (use_compiled == -1) {
+	/* one-trip initialization */
+	char	*str;
+
+	PM_LOCK(__pmLock_extcall);
+	str = getenv("PCP_PMNS_COMPILED");		/* THREADSAFE */
+	if (str == NULL)
+	    use_compiled = PMNS_BIN_LOAD;
+	else if (strcmp(str, "0") == 0)
+	    use_compiled = PMNS_BIN_OFF;
+	else if (strcmp(str, "save") == 0)
+	    use_compiled = PMNS_BIN_SAVE;
+	else
+	    use_compiled = PMNS_BIN_LOAD;
+	PM_UNLOCK(__pmLock_extcall);
+    }
+    return use_compiled;
+}
+
+static void
+binhdr(pmns_bin_hdr_t *hp, const struct stat *sp)
+{
+    memset(hp, 0, sizeof(*hp));
+    memcpy(hp->magic, PMNS_BIN_MAGIC, sizeof(PMNS_BIN_MAGIC));
+    hp->version = PMNS_BIN_VERSION;
+    hp->order = PMNS_BIN_ORDER;
+    hp->size = sp->st_size;
+#if defined(HAVE_ST_MTIME_WITH_E)
+    hp->sec = sp->st_mtime;
+#elif defined(HAVE_ST_MTIME_WITH_SPEC)
+    hp->sec = sp->st_mtimespec.tv_sec;
+    hp->nsec = sp->st_mtimespec.tv_nsec;
+#else
+    hp->sec = sp->st_mtim.tv_sec;
+    hp->nsec = sp->st_mtim.tv_nsec;
+#endif
+    hp->ino = sp->st_ino;
+}
+
+static __pmnsNode *
+binnode(__pmnsNode *nodes, __uint32_t nnode, __uint32_t i, int *bad)
+{
+    if (i == PMNS_BIN_NULL)
+	return NULL;
+    if (i >= nnode) {
+	*bad = 1;
+	return NULL;
+    }
+    return &nodes[i];
+}
+
+/*
+ * Check the links of the compiled PMNS node table describe a tree
+ * (every node reached exactly once from the root, with the right
+ * parent) and PMID hash chains that visit each node at most once, so
+ * a corrupt file cannot send the PMNS code into a loop.
+ * Returns 0 if all is well, else -1.
+ */
+static int
+bincheck(const pmns_bin_node_t *bp, __uint32_t nnode,
+	 const __uint32_t *htab, __uint32_t htabsize)
+{
+    unsigned char	*visited;
+    __uint32_t		cur, c, i;
+    __uint32_t		n = 1;
+    int			sts = -1;
+
+    if (bp[0].parent != PMNS_BIN_NULL || bp[0].next != PMNS_BIN_NULL)
+	return -1;
+    if ((visited = (unsigned char *)calloc(nnode, 1)) == NULL)
+	return -1;
+    visited[0] = 1;
+
+    /* pre-order walk of the tree, down the first links then across */
+    cur = 0;
+    for (;;) {
+	if ((c = bp[cur].first) != PMNS_BIN_NULL) {
+	    if (c >= nnode || visited[c] || bp[c].parent != cur)
+		goto done;
+	}
+	else {
+	    /* parents of visited nodes are checked, so this terminates */
+	    while (cur != 0 && bp[cur].next == PMNS_BIN_NULL)
+		cur = bp[cur].parent;
+	    if (cur == 0)
+		break;
+	    c = bp[cur].next;
+	    if (c >= nnode || visited[c] || bp[c].parent != bp[cur].parent)
+		goto done;
+	}
+	visited[c] = 1;
+	n++;
+	cur = c;
+    }
+    if (n != nnode)
+	goto done;
+
+    for (i = 0; i < htabsize; i++) {
+	for (c = htab[i]; c != PMNS_BIN_NULL; c = bp[c].hash) {
+	    if (c >= nnode || (visited[c] & 2))
+		goto done;
+	    visited[c] |= 2;
+	}
+    }
+    sts = 0;
+
+done:
+    free(visited);
+    return sts;
+}
+
+/*
+ * Load the compiled PMNS for fname, if it matches the ASCII file
+ * described by sp.
+ *
+ * Returns 0 if main_pmns has been loaded, 1 if the compiled PMNS is
+ * missing or stale (so should be regenerated), else -1 (use the ASCII
+ * PMNS).
+ */
+static int
+loadbin(const struct stat *sp, int dupok)
+{
+    char		binname[MAXPATHLEN];
+    struct stat		sbuf;
+    pmns_bin_hdr_t	hdr;
+    pmns_bin_hdr_t	*hp;
+    pmns_bin_node_t	*bp;
+    __uint32_t		*htab;
+    char		*names;
+    char		*map;
+    size_t		len;
+    __pmnsTree		*tree;
+    __pmnsNode		*nodes;
+    __uint32_t		i;
+    int			bad = 0;
+    int			fd;
+
+    PM_ASSERT_IS_LOCKED(pmns_lock);
+
+    pmsprintf(binname, sizeof(binname), "%s.bin", fname);
+    if ((fd = open(binname, O_RDONLY)) < 0)
+	return 1;
+    if (fstat(fd, &sbuf) < 0 || sbuf.st_size < (off_t)sizeof(hdr) ||
+	(map = __pmMemoryMap(fd, sbuf.st_size, 0)) == NULL) {
+	close(fd);
+	return 1;
+    }
+    close(fd);
+
+    hp = (pmns_bin_hdr_t *)map;
+    binhdr(&hdr, sp);
+    if (memcmp(hp->magic, hdr.magic, sizeof(hdr.magic)) != 0 ||
+	hp->version != hdr.version || hp->order != hdr.order ||
+	hp->size != hdr.size || hp->sec != hdr.sec ||
+	hp->nsec != hdr.nsec || hp->ino != hdr.ino) {
+	if (pmDebugOptions.pmns)
+	    fprintf(stderr, "loadbin: %s is stale\n", binname);
+	goto stale;
+    }
+    len = sizeof(*hp) + (size_t)hp->nnode * sizeof(*bp) +
+	  (size_t)hp->htabsize * sizeof(*htab) + hp->strsize;
+    bp = (pmns_bin_node_t *)&hp[1];
+    htab = (__uint32_t *)&bp[hp->nnode];
+    names = (char *)&htab[hp->htabsize];
+    if (len != (size_t)sbuf.st_size || hp->nnode == 0 ||
+	hp->htabsize == 0 || hp->strsize == 0 ||
+	names[hp->strsize-1] != '\0') {
+	if (pmDebugOptions.pmns)
+	    fprintf(stderr, "loadbin: %s is corrupt\n", binname);
+	goto stale;
+    }
+    if (bincheck(bp, hp->nnode, htab, hp->htabsize) < 0) {
+	if (pmDebugOptions.pmns)
+	    fprintf(stderr, "loadbin: %s has bad node links\n", binname);
+	goto stale;
+    }
+    if (hp->dupids && dupok == NO_DUPS) {
+	/* let the ASCII loader report the duplicates */
+	__pmMemoryUnmap(map, sbuf.st_size);
+	return -1;
+    }
+
+    if ((tree = (__pmnsTree *)malloc(sizeof(*tree))) == NULL) {
+	__pmMemoryUnmap(map, sbuf.st_size);
+	return -1;
+    }
+    nodes = (__pmnsNode *)malloc(hp->nnode * sizeof(*nodes));
+    tree->htab = (__pmnsNode **)malloc(hp->htabsize * sizeof(__pmnsNode *));
+    if (nodes == NULL || tree->htab == NULL) {
+	free(nodes);
+	free(tree->htab);
+	free(tree);
+	__pmMemoryUnmap(map, sbuf.st_size);
+	return -1;
+    }
+    for (i = 0; i < hp->nnode; i++) {
+	nodes[i].parent = binnode(nodes, hp->nnode, bp[i].parent, &bad);
+	nodes[i].next = binnode(nodes, hp->nnode, bp[i].next, &bad);
+	nodes[i].first = binnode(nodes, hp->nnode, bp[i].first, &bad);
+	nodes[i].hash = binnode(nodes, hp->nnode, bp[i].hash, &bad);
+	if (bp[i].name >= hp->strsize)
+	    bad = 1;
+	else
+	    nodes[i].name = &names[bp[i].name];
+	nodes[i].pmid = bp[i].pmid;
+    }
+    for (i = 0; i < hp->htabsize; i++)
+	tree->htab[i] = binnode(nodes, hp->nnode, htab[i], &bad);
+    if (bad || nodes[0].parent != NULL) {
+	if (pmDebugOptions.pmns)
+	    fprintf(stderr, "loadbin: %s is corrupt\n", binname);
+	free(nodes);
+	free(tree->htab);
+	free(tree);
+	goto stale;
+    }
+
+    tree->root = nodes;
+    tree->htabsize = hp->htabsize;
+    tree->mark_state = 0;
+    tree->map = map;
+    tree->maplen = sbuf.st_size;
+    main_pmns = tree;
+
+    if (pmDebugOptions.pmns)
+	fprintf(stderr, "Loaded compiled PMNS %s: %u nodes\n", binname, hp->nnode);
+    return 0;
+
+stale:
+    __pmMemoryUnmap(map, sbuf.st_size);
+    return 1;
+}
+
+typedef struct {
+    const __pmnsNode	*np;
+    __uint32_t		i;
+} binidx_t;
+
+static int
+binidx_cmp(const void *a, const void *b)
+{
+    const __pmnsNode	*ap = ((const binidx_t *)a)->np;
+    const __pmnsNode	*bp = ((const binidx_t *)b)->np;
+
+    return (ap < bp) ? -1 : (ap > bp);
+}
+
+static __uint32_t
+binidx(const binidx_t *idx, __uint32_t nnode, const __pmnsNode *np)
+{
+    binidx_t	key;
+    binidx_t	*xp;
+
+    if (np == NULL)
+	return PMNS_BIN_NULL;
+    key.np = np;
+    xp = (binidx_t *)bsearch(&key, idx, nnode, sizeof(*idx), binidx_cmp);
+    return xp->i;
+}
+
+/* number the nodes of the tree in pre-order, root first */
+static void
+binorder(const __pmnsNode *np, binidx_t *idx, __uint32_t *n, size_t *strsize)
+{
+    const __pmnsNode	*xp;
+
+    if (idx != NULL) {
+	idx[*n].np = np;
+	idx[*n].i = *n;
+    }
+    (*n)++;
+    *strsize += strlen(np->name) + 1;
+    for (xp = np->first; xp != NULL; xp = xp->next)
+	binorder(xp, idx, n, strsize);
+}
+
+/*
+ * Save main_pmns, just loaded from the ASCII file described by sp,
+ * as the compiled PMNS for fname ($PCP_PMNS_COMPILED=save only).
+ * Failure is not an error, the compiled PMNS is just an optimization.
+ */
+static void
+savebin(const struct stat *sp)
+{
+#if HAVE_MKSTEMP
+    char		binname[MAXPATHLEN];
+    char		tmpname[MAXPATHLEN];
+    pmns_bin_hdr_t	*hp;
+    pmns_bin_node_t	*bp;
+    __uint32_t		*htab;
+    char		*names;
+    char		*buf = NULL;
+    binidx_t		*idx = NULL;
+    binidx_t		*order = NULL;
+    __uint32_t		nnode = 0;
+    __uint32_t		i;
+    const __pmnsNode	*np;
+    const __pmnsNode	*xp;
+    size_t		strsize = 0;
+    size_t		off;
+    size_t		len;
+    int			fd;
+
+    PM_ASSERT_IS_LOCKED(pmns_lock);
+
+    binorder(main_pmns->root, NULL, &nnode, &strsize);
+    if ((idx = (binidx_t *)malloc(nnode * sizeof(*idx))) == NULL ||
+	(order = (binidx_t *)malloc(nnode * sizeof(*order))) == NULL)
+	goto done;
+    nnode = 0;
+    strsize = 0;
+    binorder(main_pmns->root, order, &nnode, &strsize);
+    memcpy(idx, order, nnode * sizeof(*idx));
+    qsort(idx, nnode, sizeof(*idx), binidx_cmp);
+
+    len = sizeof(*hp) + nnode * sizeof(*bp) +
+	  main_pmns->htabsize * sizeof(*htab) + strsize;
+    if ((buf = (char *)malloc(len)) == NULL)
+	goto done;
+    hp = (pmns_bin_hdr_t *)buf;
+    bp = (pmns_bin_node_t *)&hp[1];
+    htab = (__uint32_t *)&bp[nnode];
+    names = (char *)&htab[main_pmns->htabsize];
+
+    binhdr(hp, sp);
+    hp->nnode = nnode;
+    hp->htabsize = main_pmns->htabsize;
+    hp->strsize = strsize;
+    for (off = 0, i = 0; i < nnode; i++) {
+	np = order[i].np;
+	bp[i].parent = binidx(idx, nnode, np->parent);
+	bp[i].next = binidx(idx, nnode, np->next);
+	bp[i].first = binidx(idx, nnode, np->first);
+	bp[i].hash = binidx(idx, nnode, np->hash);
+	bp[i].name = off;
+	bp[i].pmid = np->pmid;
+	strcpy(&names[off], np->name);
+	off += strlen(np->name) + 1;
+    }
+    for (i = 0; i < main_pmns->htabsize; i++) {
+	htab[i] = binidx(idx, nnode, main_pmns->htab[i]);
+	for (np = main_pmns->htab[i]; np != NULL; np = np->hash) {
+	    for (xp = np->hash; xp != NULL; xp = xp->hash) {
+		if (xp->pmid == np->pmid && !IS_DYNAMIC_ROOT(xp->pmid))
+		    hp->dupids = 1;
+	    }
+	}
+    }
+
+    pmsprintf(binname, sizeof(binname), "%s.bin", fname);
+    pmsprintf(tmpname, sizeof(tmpname), "%s.XXXXXX", binname);
+    if ((fd = mkstemp(tmpname)) < 0) {
+	if (pmDebugOptions.pmns) {
+	    char	errmsg[PM_MAXERRMSGLEN];
+	    fprintf(stderr, "savebin: mkstemp(%s): %s\n", tmpname, osstrerror_r(errmsg, sizeof(errmsg)));
+	}
+	goto done;
+    }
+    if (write(fd, buf, len) != (ssize_t)len) {
+	close(fd);
+	goto fail;
+    }
+#ifdef HAVE_FCHMOD
+    /* mkstemp() creates mode 0600, but everyone needs to read this */
+    (void)fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+#endif
+    if (close(fd) < 0 || rename(tmpname, binname) < 0)
+	goto fail;
+    if (pmDebugOptions.pmns)
+	fprintf(stderr, "savebin: %s: %u nodes\n", binname, nnode);
+
+    goto done;
+
+fail:
+    if (pmDebugOptions.pmns) {
+	char	errmsg[PM_MAXERRMSGLEN];
+	fprintf(stderr, "savebin: %s: %s\n", binname, osstrerror_r(errmsg, sizeof(errmsg)));
+    }
+    unlink(tmpname);
+
+done:
+    free(buf);
+    free(order);
+    free(idx);
+#else
+    (void)sp;
+#endif
+}
+
 static int
 load(const char *filename, int dupok, int use_cpp)
 {
     const char	*f;
     int 	i = 0;
+    int		sts;
+    int		havestat;
+    struct stat	statbuf;
 
     PM_ASSERT_IS_LOCKED(pmns_lock);
 
@@ -1499,19 +1963,15 @@ load(const char *filename, int dupok, int use_cpp)
 		filename, dupok, use_cpp, i, fname);
 
     /* Note size and modification time of pmns file */
-    {
-	struct stat statbuf;
-
-	if (stat(fname, &statbuf) == 0) {
-	    last_size = statbuf.st_size;
+    if ((havestat = (stat(fname, &statbuf) == 0))) {
+	last_size = statbuf.st_size;
 #if defined(HAVE_ST_MTIME_WITH_E)
-	    last_mtim = statbuf.st_mtime; /* possible struct assignment */
+	last_mtim = statbuf.st_mtime; /* possible struct assignment */
 #elif defined(HAVE_ST_MTIME_WITH_SPEC)
-	    last_mtim = statbuf.st_mtimespec; /* possible struct assignment */
+	last_mtim = statbuf.st_mtimespec; /* possible struct assignment */
 #else
-	    last_mtim = statbuf.st_mtim; /* possible struct assignment */
+	last_mtim = statbuf.st_mtim; /* possible struct assignment */
 #endif
-	}
     }
 
     /*
@@ -1523,9 +1983,20 @@ load(const char *filename, int dupok, int use_cpp)
 	use_cpp = NO_CPP;
 
     /*
-     * load ASCII PMNS
+     * compiled PMNS, if it is up to date, for the default PMNS
      */
-    return loadascii(dupok, use_cpp);
+    if (filename == PM_NS_DEFAULT && havestat && compiled_pmns() != PMNS_BIN_OFF) {
+	if (loadbin(&statbuf, dupok) == 0)
+	    return 0;
+    }
+
+    /*
+     * load ASCII PMNS, and save the compiled PMNS only if asked to
+     */
+    sts = loadascii(dupok, use_cpp);
+    if (sts == 0 && havestat && compiled_pmns() == PMNS_BIN_SAVE)
+	savebin(&statbuf);
+    return sts;
 }
 
 /*
@@ -1656,7 +2127,13 @@ __pmFreePMNS(__pmnsTree *pmns)
 {
     if (pmns != NULL) {
 	free(pmns->htab);
-	FreeTraversePMNS(pmns->root);
+	if (pmns->map != NULL) {
+	    /* compiled PMNS, one array of nodes with names in the mapping */
+	    free(pmns->root);
+	    __pmMemoryUnmap(pmns->map, pmns->maplen);
+	}
+	else
+	    FreeTraversePMNS(pmns->root);
 	free(pmns);
     }
 }
@@ -16,8 +16,9 @@
  *
  * Threadsafe notes.
  *
- * - result_pool (head of list => all of the list) is guarded by the
- *   result_lock mutex
+ * - result_pool[] is an array of independent ownership tables, each
+ *   guarded by its own lock mutex, so there is no process-wide lock
+ *   for result allocation and free
  */
 
 #include "pmapi.h"
@@ -26,50 +27,100 @@
 #include "fault.h"
 
 /*
- * Linked list of allocations made by __pmAllocResult(), but not
- * yet released by pmFreeResult().
+ * Allocations made by __pmAllocResult(), but not yet released by
+ * pmFreeResult(), are recorded in hash tables keyed by address, so the
+ * free routines can tell these from __pmResults on the stack and
+ * pmResults malloc'd elsewhere (e.g. by PMDAs) without looking outside
+ * the caller's struct.  Addresses are spread over RESULT_NPOOL tables
+ * to keep threads allocating and freeing results from contending for
+ * one lock.
+ *
+ * Arena results from __pmAllocResultArena() are recorded with the low
+ * bit of the address set, as their pmValueSets live in the same
+ * allocation and are released with it.
  */
-typedef struct result_pool_t {
-    struct result_pool_t	*next;
-    __pmResult			*rp;
-} result_pool_t;
-
-result_pool_t	*result_pool;
+#define RESULT_NPOOL	16
+#define RESULT_ARENA	1	/* tag in hash node data */
 
+typedef struct {
 #ifdef PM_MULTI_THREAD
-static pthread_mutex_t	result_lock;
+    pthread_mutex_t	lock;
 #else
-void			*result_lock;
+    void		*lock;
 #endif
+    __pmHashCtl		hc;
+} result_pool_t;
+
+static result_pool_t	result_pool[RESULT_NPOOL];
 
 #if defined(PM_MULTI_THREAD) && defined(PM_MULTI_THREAD_DEBUG)
 /*
- * return true if lock == result_lock
+ * return true if lock is one of the result_pool[] locks
  */
 int
 __pmIsresultLock(void *lock)
 {
-    return lock == (void *)&result_lock;
+    int		i;
+
+    for (i = 0; i < RESULT_NPOOL; i++) {
+	if (lock == (void *)&result_pool[i].lock)
+	    return 1;
+    }
+    return 0;
 }
 #endif
 
 void
 init_result_lock(void)
 {
+    int		i;
+
+    for (i = 0; i < RESULT_NPOOL; i++) {
 #ifdef PM_MULTI_THREAD
-    __pmInitMutex(&result_lock);
+	__pmInitMutex(&result_pool[i].lock);
 #endif
+	__pmHashInitFlags(&result_pool[i].hc, PM_HASH_OPEN);
+    }
 }
 
 /*
- * Allocate a __pmResult with enough space for numpmid metrics
- * ... return NULL on failure, and let caller decide what to do next
+ * Hash key for a __pmResult address, malloc() alignment means the
+ * low 4 bits carry no information.
  */
-__pmResult *
-__pmAllocResult(int numpmid)
+static inline unsigned int
+result_key(const void *rp)
+{
+    __uint64_t	addr = (__uint64_t)(uintptr_t)rp >> 4;
+
+    return (unsigned int)(addr ^ (addr >> 32));
+}
+
+static inline result_pool_t *
+result_pool_of(unsigned int key)
+{
+    return &result_pool[key % RESULT_NPOOL];
+}
+
+/* number of allocations in all pools, for diagnostics only */
+static size_t
+__pmSizeResultPool(void)
+{
+    size_t	size = 0;
+    int		i;
+
+    for (i = 0; i < RESULT_NPOOL; i++)
+	size += result_pool[i].hc.nodes;
+    return size;
+}
+
+static __pmResult *
+__pmAllocResultSpace(int numpmid, size_t extra, int flags, void **arenap)
 {
     size_t		need;
-    result_pool_t	*new;
+    unsigned int	key;
+    result_pool_t	*pool;
+    __pmResult		*rp;
+    int			sts;
 
     /*
      * set oserror() in case we take the fault return
@@ -81,39 +132,73 @@ PM_FAULT_RETURN(NULL);
 
     PM_INIT_LOCKS();
 
-    new = (result_pool_t *)malloc(sizeof(*new));
-    if (new == NULL) {
+    if (numpmid < 1)
+	numpmid = 1;
+    need = sizeof(__pmResult) + (numpmid - 1) * sizeof(pmValueSet *);
+    if (flags & RESULT_ARENA)
+	/* pmValueSets in the arena contain pointers, align for these */
+	need = (need + sizeof(__int64_t) - 1) & ~(sizeof(__int64_t) - 1);
+    rp = (__pmResult *)malloc(need + extra);
+    if (rp == NULL) {
 	if (pmDebugOptions.alloc)
-	    fprintf(stderr, "__pmAllocResult: new alloc failed\n");
+	    fprintf(stderr, "__pmAllocResult: __pmResult %zu failed\n", need + extra);
 	return NULL;
     }
 
-    if (numpmid < 1)
-	numpmid = 1;
-    need = sizeof(__pmResult) + (numpmid - 1) * sizeof(pmValueSet *);
-    new->rp = (__pmResult *)malloc(need);
-    if (new->rp == NULL) {
+    key = result_key(rp);
+    pool = result_pool_of(key);
+    PM_LOCK(pool->lock);
+    sts = __pmHashAdd(key, (char *)rp + flags, &pool->hc);
+    PM_UNLOCK(pool->lock);
+    if (sts < 0) {
 	if (pmDebugOptions.alloc)
-	    fprintf(stderr, "__pmAllocResult: __pmResult %zu failed\n", need);
-	free(new);
+	    fprintf(stderr, "__pmAllocResult: new alloc failed\n");
+	free(rp);
+	setoserror(-sts);
 	return NULL;
     }
 
-    PM_LOCK(result_lock);
-    new->next = result_pool;
-    result_pool = new;
+    if (pmDebugOptions.alloc)
+	fprintf(stderr, "__pmAllocResult ->" PRINTF_P_PFX "%p (%zu in pool)%s\n", rp, __pmSizeResultPool(), (flags & RESULT_ARENA) ? " arena" : "");
 
-    if (pmDebugOptions.alloc) {
-	int		n = 0;
-	result_pool_t	*pool;
-	for (pool = result_pool; pool != NULL; pool = pool->next)
-	    n++;
-	fprintf(stderr, "__pmAllocResult ->" PRINTF_P_PFX "%p (%d in pool)\n", new->rp, n);
-    }
+    if (arenap != NULL)
+	*arenap = (char *)rp + need;
+    return rp;
+}
+
+/*
+ * Allocate a __pmResult with enough space for numpmid metrics
+ * ... return NULL on failure, and let caller decide what to do next
+ */
+__pmResult *
+__pmAllocResult(int numpmid)
+{
+    return __pmAllocResultSpace(numpmid, 0, 0, NULL);
+}
+
+/*
+ * As for __pmAllocResult(), but with a further size bytes (returned
+ * via arenap) in the same allocation for the pmValueSets and
+ * pmValueBlocks of the result.  The pmFreeResult() family release
+ * all of this together, so the vset[] pointers must not be moved to
+ * another result, nor replaced by separately allocated pmValueSets.
+ */
+__pmResult *
+__pmAllocResultArena(int numpmid, size_t size, void **arenap)
+{
+    return __pmAllocResultSpace(numpmid, size, RESULT_ARENA, arenap);
+}
 
-    PM_UNLOCK(result_lock);
+static __pmHashWalkState
+__pmDumpResultNode(const __pmHashNode *hp, void *arg)
+{
+    size_t	*np = (size_t *)arg;
+    uintptr_t	data = (uintptr_t)hp->data;
 
-    return new->rp;
+    fprintf(stderr, "__pmResult [%zu] -> rp %p%s\n", *np,
+	    (void *)(data & ~RESULT_ARENA), (data & RESULT_ARENA) ? " arena" : "");
+    (*np)++;
+    return PM_HASH_WALK_NEXT;
 }
 
 /*
@@ -123,38 +208,48 @@ static void
 __pmDumpResultPool(void)
 {
     if (pmDebugOptions.alloc) {
-	result_pool_t	*pool;
-	size_t		n = 0;
+	size_t	n = 0;
+	int	i;
 
-	for (pool = result_pool; pool != NULL; pool = pool->next) {
-	    fprintf(stderr, "__pmResult [%zu] %p -> rp %p\n", n, pool, pool->rp);
-	    n++;
+	for (i = 0; i < RESULT_NPOOL; i++) {
+	    PM_LOCK(result_pool[i].lock);
+	    __pmHashWalkCB(__pmDumpResultNode, &n, &result_pool[i].hc);
+	    PM_UNLOCK(result_pool[i].lock);
 	}
 	if (n == 0)
 	    fprintf(stderr, "__pmResult pool is empty\n");
     }
 }
 
-static size_t
-__pmSizeResultPool(void)
-{
-    result_pool_t	*pool;
-    size_t		size = 0;
-
-    for (pool = result_pool; pool != NULL; pool = pool->next)
-	size++;
-    return size;
-}
+/*
+ * If rp came from __pmAllocResult() remove it from the pool and
+ * return 1, or 2 if it came from __pmAllocResultArena(), else return
+ * 0 (on-stack or malloc'd elsewhere).  Only the address is used, rp
+ * is not dereferenced.
+ */
+#define RELEASE_POOL	1
+#define RELEASE_ARENA	2
 
-static void
-__pmFreeResultFromPool(result_pool_t *pool, result_pool_t *prior)
+static int
+__pmReleaseResult(const __pmResult *rp)
 {
-    if (prior == NULL)
-	result_pool = pool->next;
-    else
-	prior->next = pool->next;
-    free(pool->rp);
-    free(pool);
+    unsigned int	key = result_key(rp);
+    result_pool_t	*pool = result_pool_of(key);
+    int			sts = 0;
+
+    PM_LOCK(pool->lock);
+    if (__pmHashDel(key, (void *)rp, &pool->hc))
+	sts = RELEASE_POOL;
+    else if (__pmHashDel(key, (char *)rp + RESULT_ARENA, &pool->hc))
+	sts = RELEASE_ARENA;
+    PM_UNLOCK(pool->lock);
+    if (pmDebugOptions.alloc) {
+	if (sts)
+	    fprintf(stderr, " [in " PRINTF_P_PFX "%p%s]", rp,
+		    sts == RELEASE_ARENA ? " arena" : "");
+	fputc('\n', stderr);
+    }
+    return sts;
 }
 
 static void
@@ -196,14 +291,12 @@ __pmFreeResultValueSets(pmValueSet **ppvstart, pmValueSet **ppvsend)
 void
 __pmFreeResult(__pmResult *result)
 {
-    result_pool_t	*pool, *prior = NULL;
+    int		pooled;
 
     PM_INIT_LOCKS();
-    PM_LOCK(result_lock);
 
     if (result == NULL) {
 	__pmDumpResultPool();
-	PM_UNLOCK(result_lock);
 	return;
     }
 
@@ -211,22 +304,12 @@ __pmFreeResult(__pmResult *result)
 	fprintf(stderr, "%s(" PRINTF_P_PFX "%p) (%zu in pool)",
 			"__pmFreeResult", result, __pmSizeResultPool());
 
-    for (pool = result_pool; pool != NULL; pool = pool->next) {
-	if (result == pool->rp) {
-	    if (pmDebugOptions.alloc)
-		fprintf(stderr, " [in " PRINTF_P_PFX "%p]", pool->rp);
-	    break;
-	}
-	prior = pool;
-    }
-    if (pmDebugOptions.alloc)
-	fputc('\n', stderr);
-    if (result->numpmid > 0)
+    pooled = __pmReleaseResult(result);
+    if (pooled != RELEASE_ARENA && result->numpmid > 0)
 	__pmFreeResultValueSets(result->vset, &result->vset[result->numpmid]);
-    if (pool != NULL)
-	__pmFreeResultFromPool(pool, prior);
+    if (pooled)
+	free(result);
     /* else on-stack */
-    PM_UNLOCK(result_lock);
 }
 
 void
@@ -249,17 +332,23 @@ __pmFreeHighResResultValues(pmHighResResult *result)
 	__pmFreeResultValueSets(result->vset, &result->vset[result->numpmid]);
 }
 
+/*
+ * Address of the __pmResult that pmResult or pmHighResResult result
+ * would be embedded in, if it came from __pmAllocResult()
+ */
+#define RESULT_BASE(result, type) ((const __pmResult *) \
+	((char *)(result) - (offsetof(__pmResult,numpmid) - offsetof(type,numpmid))))
+
 void
 pmFreeResult(pmResult *result)
 {
-    result_pool_t	*pool, *prior = NULL;
+    const __pmResult	*rp;
+    int			pooled;
 
     PM_INIT_LOCKS();
-    PM_LOCK(result_lock);
 
     if (result == NULL) {
 	__pmDumpResultPool();
-	PM_UNLOCK(result_lock);
 	return;
     }
 
@@ -267,35 +356,26 @@ pmFreeResult(pmResult *result)
 	fprintf(stderr, "%s(" PRINTF_P_PFX "%p) (%zu in pool)",
 			"pmFreeResult", result, __pmSizeResultPool());
 
-    for (pool = result_pool; pool != NULL; pool = pool->next) {
-	if (result == __pmOffsetResult(pool->rp)) {
-	    if (pmDebugOptions.alloc)
-		fprintf(stderr, " [in " PRINTF_P_PFX "%p]", pool->rp);
-	    break;
-	}
-	prior = pool;
-    }
-    if (pmDebugOptions.alloc)
-	fputc('\n', stderr);
-    __pmFreeResultValues(result);
-    if (pool != NULL)
-	__pmFreeResultFromPool(pool, prior);
+    rp = RESULT_BASE(result, pmResult);
+    pooled = __pmReleaseResult(rp);
+    if (pooled != RELEASE_ARENA)
+	__pmFreeResultValues(result);
+    if (pooled)
+	free((void *)rp);
     else
 	free(result);	/* not allocated by __pmAllocResult */
-    PM_UNLOCK(result_lock);
 }
 
 void
 __pmFreeHighResResult(pmHighResResult *result)
 {
-    result_pool_t	*pool, *prior = NULL;
+    const __pmResult	*rp;
+    int			pooled;
 
     PM_INIT_LOCKS();
-    PM_LOCK(result_lock);
 
     if (result == NULL) {
 	__pmDumpResultPool();
-	PM_UNLOCK(result_lock);
 	return;
     }
 
@@ -303,22 +383,14 @@ __pmFreeHighResResult(pmHighResResult *result)
 	fprintf(stderr, "%s(" PRINTF_P_PFX "%p) (%zu in pool)",
 			"pmFreeHighResResult", result, __pmSizeResultPool());
 
-    for (pool = result_pool; pool != NULL; pool = pool->next) {
-	if (result == __pmOffsetHighResResult(pool->rp)) {
-	    if (pmDebugOptions.alloc)
-		fprintf(stderr, " [in " PRINTF_P_PFX "%p]", pool->rp);
-	    break;
-	}
-	prior = pool;
-    }
-    if (pmDebugOptions.alloc)
-	fputc('\n', stderr);
-    __pmFreeHighResResultValues(result);
-    if (pool != NULL)
-	__pmFreeResultFromPool(pool, prior);
+    rp = RESULT_BASE(result, pmHighResResult);
+    pooled = __pmReleaseResult(rp);
+    if (pooled != RELEASE_ARENA)
+	__pmFreeHighResResultValues(result);
+    if (pooled)
+	free((void *)rp);
     else
 	free(result);	/* not allocated by __pmAllocResult */
-    PM_UNLOCK(result_lock);
 }
 
 void
@@ -17,6 +17,9 @@
 #include "libpcp.h"
 #define SOCKET_INTERNAL
 #include "internal.h"
+#if defined(HAVE_POLL_H)
+#include <poll.h>
+#endif
 #include <ctype.h>
 #include <assert.h>
 #include <openssl/opensslv.h>
@@ -1410,7 +1413,11 @@ int
 __pmSocketReady(int fd, struct timeval *timeout)
 {
     __pmSecureSocket ss;
+#if defined(HAVE_POLL_H)
+    struct pollfd onefd;
+#else
     __pmFdSet onefd;
+#endif
 
     if (fd < 0)
 	return -EBADF;
@@ -1419,7 +1426,16 @@ __pmSocketReady(int fd, struct timeval *timeout)
 	if (SSL_pending(ss.ssl) > 0)
 	    return 1;	/* proceed without blocking */
 
+#if defined(HAVE_POLL_H)
+    /* no FD_SETSIZE limit, pmcd may have many client connections */
+    onefd.fd = fd;
+    onefd.events = POLLIN;
+    onefd.revents = 0;
+    return poll(&onefd, 1, timeout == NULL ? -1 :
+		timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000);
+#else
     FD_ZERO(&onefd);
     FD_SET(fd, &onefd);
     return select(fd+1, &onefd, NULL, NULL, timeout);
+#endif
 }
@@ -513,6 +513,8 @@ pmdaRehash(pmdaExt *pmda, pmdaMetric *metrics, int nmetrics)
     pmda->e_nmetrics = nmetrics;
 
     pmdaHashDelete(hashp);
+    /* lookups arrive in no particular order, favouring open addressing */
+    __pmHashInitFlags(hashp, PM_HASH_OPEN);
     for (m = 0; m < pmda->e_nmetrics; m++) {
 	metric = &pmda->e_metrics[m];
 
@@ -15,6 +15,8 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <errno.h>
+#include <string.h>
 #include "encoding.h"
 
 static const char base64_decoding_table[] = {
@@ -109,3 +111,347 @@ unicode_encode(const char *p, size_t length)
     }
     return sdscatlen(s, "\"", 1);
 }
+
+#define COMPACT_FORMAT	1	/* version of the compact block layout */
+#define COMPACT_LIMIT	(1<<24)	/* sanity limit for decoded block sizes */
+
+typedef struct bitWriter {
+    sds			buffer;
+    unsigned int	free;		/* unused bits in the final byte */
+} bitWriter;
+
+typedef struct bitReader {
+    const unsigned char	*buffer;
+    size_t		length;		/* buffer length in bits */
+    size_t		offset;		/* next bit to be read */
+} bitReader;
+
+/* append the low order 'nbits' bits of 'value', most significant first */
+static void
+bits_write(bitWriter *w, __uint64_t value, unsigned int nbits)
+{
+    unsigned char	*last;
+    unsigned int	n;
+    __uint64_t		chunk;
+
+    while (nbits > 0) {
+	if (w->free == 0) {
+	    w->buffer = sdscatlen(w->buffer, "", 1);
+	    w->free = 8;
+	}
+	n = nbits < w->free ? nbits : w->free;
+	chunk = (value >> (nbits - n)) & ((1U << n) - 1);
+	last = (unsigned char *)w->buffer + sdslen(w->buffer) - 1;
+	*last |= chunk << (w->free - n);
+	w->free -= n;
+	nbits -= n;
+    }
+}
+
+static int
+bits_read(bitReader *r, unsigned int nbits, __uint64_t *value)
+{
+    unsigned int	n, avail;
+    unsigned char	byte;
+    __uint64_t		v = 0;
+
+    if (r->offset + nbits > r->length)
+	return -1;
+    while (nbits > 0) {
+	byte = r->buffer[r->offset / 8];
+	avail = 8 - r->offset % 8;
+	n = nbits < avail ? nbits : avail;
+	v = (v << n) | ((byte >> (avail - n)) & ((1U << n) - 1));
+	r->offset += n;
+	nbits -= n;
+    }
+    *value = v;
+    return 0;
+}
+
+static sds
+varint_write(sds s, __uint64_t value)
+{
+    unsigned char	byte;
+
+    do {
+	byte = value & 0x7f;
+	if ((value >>= 7) != 0)
+	    byte |= 0x80;
+	s = sdscatlen(s, (char *)&byte, 1);
+    } while (value);
+    return s;
+}
+
+static int
+varint_read(const unsigned char *buffer, size_t length, size_t *offset,
+		__uint64_t *value)
+{
+    unsigned int	shift = 0;
+    __uint64_t		v = 0;
+    unsigned char	byte;
+
+    do {
+	if (*offset >= length || shift > 63)
+	    return -1;
+	byte = buffer[(*offset)++];
+	v |= (__uint64_t)(byte & 0x7f) << shift;
+	shift += 7;
+    } while (byte & 0x80);
+    *value = v;
+    return 0;
+}
+
+static unsigned int
+leading_zeros(__uint64_t x)
+{
+    unsigned int	n = 0;
+
+    for (; n < 64 && !(x & (1ULL << 63)); x <<= 1)
+	n++;
+    return n;
+}
+
+static unsigned int
+trailing_zeros(__uint64_t x)
+{
+    unsigned int	n = 0;
+
+    for (; n < 64 && !(x & 1); x >>= 1)
+	n++;
+    return n;
+}
+
+/*
+ * Timestamp deltas-of-deltas (zigzag encoded) use a '0' bit for zero,
+ * else '10', '110', '1110' or '1111' prefixes for 8, 16, 32 or 64 bits.
+ */
+static void
+compact_encode_stamps(bitWriter *w, compactBlock *block)
+{
+    __int64_t		delta, prior = 0, dod;
+    __uint64_t		zz;
+    unsigned int	i;
+
+    bits_write(w, block->stamps[0], 64);
+    for (i = 1; i < block->nsamples; i++) {
+	delta = block->stamps[i] - block->stamps[i-1];
+	dod = delta - prior;
+	prior = delta;
+	zz = ((__uint64_t)dod << 1) ^ (__uint64_t)(dod >> 63);
+	if (zz == 0) {
+	    bits_write(w, 0x0, 1);
+	} else if (zz < (1ULL << 8)) {
+	    bits_write(w, 0x2, 2);
+	    bits_write(w, zz, 8);
+	} else if (zz < (1ULL << 16)) {
+	    bits_write(w, 0x6, 3);
+	    bits_write(w, zz, 16);
+	} else if (zz < (1ULL << 32)) {
+	    bits_write(w, 0xe, 4);
+	    bits_write(w, zz, 32);
+	} else {
+	    bits_write(w, 0xf, 4);
+	    bits_write(w, zz, 64);
+	}
+    }
+}
+
+static int
+compact_decode_stamps(bitReader *r, compactBlock *block)
+{
+    static const unsigned int	widths[] = { 8, 16, 32, 64 };
+    __int64_t		delta = 0;
+    __uint64_t		zz, bit;
+    unsigned int	i, n;
+
+    if (bits_read(r, 64, &block->stamps[0]) < 0)
+	return -1;
+    for (i = 1; i < block->nsamples; i++) {
+	for (n = 0; n < 4; n++) {
+	    if (bits_read(r, 1, &bit) < 0)
+		return -1;
+	    if (bit == 0)
+		break;
+	}
+	zz = 0;
+	if (n > 0 && bits_read(r, widths[n == 4 ? 3 : n - 1], &zz) < 0)
+	    return -1;
+	delta += (__int64_t)(zz >> 1) ^ -(__int64_t)(zz & 1);
+	block->stamps[i] = block->stamps[i-1] + delta;
+    }
+    return 0;
+}
+
+/*
+ * Values of each instance in turn - the first in full, then the XOR
+ * with the prior value: '0' if unchanged, '10' and the meaningful bits
+ * if within the prior leading and trailing zeros, else '11' then six
+ * bits each of leading zero count and meaningful bit length (less 1).
+ */
+static void
+compact_encode_values(bitWriter *w, compactBlock *block)
+{
+    unsigned int	i, j, lz, tz, lead, trail;
+    __uint64_t		prior, value, x;
+
+    for (j = 0; j < block->ninst; j++) {
+	prior = block->values[j];
+	bits_write(w, prior, 64);
+	lead = 64;
+	trail = 0;
+	for (i = 1; i < block->nsamples; i++) {
+	    value = block->values[i * block->ninst + j];
+	    x = value ^ prior;
+	    prior = value;
+	    if (x == 0) {
+		bits_write(w, 0x0, 1);
+		continue;
+	    }
+	    lz = leading_zeros(x);
+	    tz = trailing_zeros(x);
+	    if (lead < 64 && lz >= lead && tz >= trail) {
+		bits_write(w, 0x2, 2);
+		bits_write(w, x >> trail, 64 - lead - trail);
+	    } else {
+		bits_write(w, 0x3, 2);
+		bits_write(w, lz, 6);
+		bits_write(w, 64 - lz - tz - 1, 6);
+		bits_write(w, x >> tz, 64 - lz - tz);
+		lead = lz;
+		trail = tz;
+	    }
+	}
+    }
+}
+
+static int
+compact_decode_values(bitReader *r, compactBlock *block)
+{
+    unsigned int	i, j, lead, trail;
+    __uint64_t		prior, bit, x, lz, length;
+
+    for (j = 0; j < block->ninst; j++) {
+	if (bits_read(r, 64, &prior) < 0)
+	    return -1;
+	block->values[j] = prior;
+	lead = 64;
+	trail = 0;
+	for (i = 1; i < block->nsamples; i++) {
+	    if (bits_read(r, 1, &bit) < 0)
+		return -1;
+	    if (bit) {
+		if (bits_read(r, 1, &bit) < 0)
+		    return -1;
+		if (bit) {
+		    if (bits_read(r, 6, &lz) < 0 ||
+			bits_read(r, 6, &length) < 0)
+			return -1;
+		    lead = lz;
+		    if (lead + length + 1 > 64)
+			return -1;
+		    trail = 64 - lead - length - 1;
+		} else if (lead == 64) {
+		    return -1;
+		}
+		if (bits_read(r, 64 - lead - trail, &x) < 0)
+		    return -1;
+		prior ^= x << trail;
+	    }
+	    block->values[i * block->ninst + j] = prior;
+	}
+    }
+    return 0;
+}
+
+sds
+compact_encode(compactBlock *block)
+{
+    bitWriter		w;
+    unsigned int	i;
+    unsigned char	header[2];
+
+    header[0] = COMPACT_FORMAT;
+    header[1] = block->type;
+    w.buffer = sdsnewlen((char *)header, sizeof(header));
+    w.buffer = varint_write(w.buffer, block->nsamples);
+    w.buffer = varint_write(w.buffer, block->ninst);
+    for (i = 0; i < block->ninst; i++) {
+	w.buffer = varint_write(w.buffer, sdslen(block->names[i]));
+	w.buffer = sdscatsds(w.buffer, block->names[i]);
+    }
+    w.free = 0;
+
+    if (block->nsamples > 0) {
+	compact_encode_stamps(&w, block);
+	compact_encode_values(&w, block);
+    }
+    return w.buffer;
+}
+
+int
+compact_decode(const char *buffer, size_t length, compactBlock *block)
+{
+    const unsigned char	*p = (const unsigned char *)buffer;
+    bitReader		r;
+    size_t		offset = 2;
+    __uint64_t		nsamples, ninst, len;
+    unsigned int	i;
+
+    memset(block, 0, sizeof(*block));
+    if (length < 2 || p[0] != COMPACT_FORMAT)
+	return -EINVAL;
+    block->type = p[1];
+    if (varint_read(p, length, &offset, &nsamples) < 0 ||
+	varint_read(p, length, &offset, &ninst) < 0 ||
+	nsamples == 0 || ninst == 0 ||
+	nsamples > COMPACT_LIMIT || ninst > COMPACT_LIMIT ||
+	nsamples * ninst > COMPACT_LIMIT)
+	return -EINVAL;
+
+    if ((block->names = calloc(ninst, sizeof(sds))) == NULL)
+	return -ENOMEM;
+    block->ninst = ninst;
+    for (i = 0; i < ninst; i++) {
+	if (varint_read(p, length, &offset, &len) < 0 ||
+	    len > length - offset)
+	    goto invalid;
+	block->names[i] = sdsnewlen(p + offset, len);
+	offset += len;
+    }
+
+    block->stamps = calloc(nsamples, sizeof(__uint64_t));
+    block->values = calloc(nsamples * ninst, sizeof(__uint64_t));
+    if (block->stamps == NULL || block->values == NULL) {
+	compact_free(block);
+	return -ENOMEM;
+    }
+    block->nsamples = nsamples;
+
+    r.buffer = p + offset;
+    r.length = (length - offset) * 8;
+    r.offset = 0;
+    if (compact_decode_stamps(&r, block) < 0 ||
+	compact_decode_values(&r, block) < 0)
+	goto invalid;
+    return 0;
+
+invalid:
+    compact_free(block);
+    return -EINVAL;
+}
+
+void
+compact_free(compactBlock *block)
+{
+    unsigned int	i;
+
+    if (block->names) {
+	for (i = 0; i < block->ninst; i++)
+	    sdsfree(block->names[i]);
+	free(block->names);
+    }
+    free(block->stamps);
+    free(block->values);
+    memset(block, 0, sizeof(*block));
+}
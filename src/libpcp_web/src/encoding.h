@@ -14,6 +14,7 @@
 #ifndef ENCODING_H
 #define ENCODING_H
 
+#include "pmapi.h"
 #include "sds.h"
 
 extern sds base64_decode(const char *, size_t);
@@ -21,4 +22,23 @@ extern sds base64_encode(const char *, size_t);
 
 extern sds unicode_encode(const char *, size_t);
 
+/*
+ * Compact encoding of a block of time series samples - delta-of-delta
+ * timestamps and XOR-compressed 64-bit values (Gorilla-style) for each
+ * instance.  Values are the IEEE double bits for floating point types,
+ * and the (sign-extended) integer itself for integer types.
+ */
+typedef struct compactBlock {
+    int			type;		/* PM_TYPE of all values */
+    unsigned int	nsamples;	/* count of sample timestamps */
+    unsigned int	ninst;		/* count of instances per sample */
+    sds			*names;		/* instance names (hashes) */
+    __uint64_t		*stamps;	/* sample times (microseconds) */
+    __uint64_t		*values;	/* nsamples x ninst sample values */
+} compactBlock;
+
+extern sds compact_encode(compactBlock *);
+extern int compact_decode(const char *, size_t, compactBlock *);
+extern void compact_free(compactBlock *);
+
 #endif /* ENCODING_H */
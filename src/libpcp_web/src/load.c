@@ -45,6 +45,17 @@ server_cache_metric(seriesLoadBaton *baton,
     redis_series_metric(baton->slots, metric, timestamp, meta, data, baton);
 }
 
+/*
+ * cache partial rollup intervals and compact blocks from this source,
+ * then send any batched requests rather than waiting on the batch timer
+ */
+static void
+server_cache_flush(seriesLoadBaton *baton)
+{
+    redis_series_flush(baton->slots, &baton->pmapi.context, baton);
+    redisSlotsBatchFlush(baton->slots);
+}
+
 /* cache a mark record (discontinuity) for metrics from this source */
 static void
 server_cache_mark(seriesLoadBaton *baton, sds timestamp, int data)
@@ -587,6 +598,8 @@ fetch_archive_done(uv_work_t *req, int status)
     free(req);
     if (context->loaded) {
 	assert(context->result == NULL);
+	/* end of the archive was seen (and reported) in the meantime */
+	server_cache_flush(baton);
         doneSeriesGetContext(context, "fetch_archive_done");
     } else if (sts >= 0) {
 	if (finish->tv_sec > context->result->timestamp.tv_sec ||
@@ -607,6 +620,8 @@ fetch_archive_done(uv_work_t *req, int status)
     if (sts < 0) {
 	if (sts != PM_ERR_EOL)
 	    baton->error = sts;
+	else
+	    server_cache_flush(baton);
 	doneSeriesGetContext(context, "fetch_archive_done");
     }
 
@@ -1265,6 +1280,9 @@ pmSeriesDiscoverClosed(pmDiscoverEvent *event, void *arg)
 
     (void)arg;
 
+    if (baton && baton->slots && baton->slots->state == SLOTS_READY)
+	server_cache_flush(baton);
+
     /* release pmSeriesDiscoverSource reference on load and context batons */
     doneSeriesLoadBaton(baton, "pmSeriesDiscoverSource");
 }
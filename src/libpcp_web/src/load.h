@@ -16,6 +16,7 @@
 
 #include "pmapi.h"
 #include "pmwebapi.h"
+#include "encoding.h"
 
 #ifdef HAVE_LIBUV
 #include <uv.h>
@@ -120,6 +121,30 @@ typedef struct valuelist {
     value_t		value[0];
 } valuelist_t;
 
+#define MAX_ROLLUPS	8	/* configurable rollup resolutions */
+
+typedef struct rollup {
+    double		min;		/* smallest value in the interval */
+    double		max;		/* largest value in the interval */
+    double		sum;		/* sum of values, for the average */
+    double		last;		/* latest value in the interval */
+    unsigned int	count;		/* number of values in the interval */
+} rollup_t;
+
+typedef struct rollups {
+    __uint64_t		start[MAX_ROLLUPS];	/* interval start (msec) */
+    unsigned int	written[MAX_ROLLUPS];	/* rollup stream created */
+    unsigned int	size;		/* count of values per resolution */
+    rollup_t		*values[MAX_ROLLUPS];	/* by value list offset */
+} rollups_t;
+
+typedef struct compact {
+    __uint64_t		start;		/* block interval start (msec) */
+    unsigned int	written;	/* compact stream created */
+    unsigned int	maxsamples;	/* allocated samples in the block */
+    compactBlock	block;		/* samples not yet written out */
+} compact_t;
+
 typedef struct metric {
     pmDesc		desc;
     cluster_t		*cluster;
@@ -135,6 +160,9 @@ typedef struct metric {
     unsigned int	updated : 1;	/* last sample returned success */
     unsigned int	cached : 1;	/* metadata written into cache */
     int			error;		/* a PMAPI negative error code */
+    time_t		expire;		/* next stream expiry refresh time */
+    rollups_t		*rollups;	/* aggregates for rollup streams */
+    compact_t		*compact;	/* samples for compact encoding */
     union {
 	pmAtomValue	atom;		/* singleton value (PM_IN_NULL) */
 	valuelist_t	*vlist;		/* instance values and metadata */
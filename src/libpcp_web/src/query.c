@@ -24,12 +24,28 @@
 #include "schema.h"
 #include "slots.h"
 #include "maps.h"
+#include "encoding.h"
 #include <math.h>
 #include <fnmatch.h>
 
 #define SHA1SZ		20	/* internal sha1 hash buffer size in bytes */
-#define QUERY_PHASES	8
-
+#define QUERY_PHASES	10
+#define VALUE_STRLEN	32	/* decoded stream timestamp and value strings */
+
+typedef struct seriesBlock {
+    compactBlock	block;
+    redisReply		*replies;	/* entry, timestamp, pairs, values */
+    redisReply		**pointers;	/* element arrays of those replies */
+    char		*strings;	/* timestamp and value strings */
+} seriesBlock;
+
+typedef struct seriesEntries {
+    unsigned int	nelements;	/* count of entries, in stream order */
+    unsigned int	nselected;	/* entries from the leading selection */
+    redisReply		**elements;	/* text entries and decoded samples */
+    unsigned int	nblocks;
+    seriesBlock		*blocks;	/* decoded compact stream entries */
+} seriesEntries;
 
 typedef struct seriesGetLabelMap {
     seriesBatonMagic	header;		/* MAGIC_LABELMAP */
@@ -66,6 +82,7 @@ typedef struct seriesQueryBaton {
     int			error;
     seriesGetLookup	lookup;
     seriesGetQuery	query;
+    struct seriesStream	*stream;	/* paged time window evaluation */
 } seriesQueryBaton;
 
 static void series_pattern_match(seriesQueryBaton *, node_t *);
@@ -75,13 +92,23 @@ static int series_calculate(node_t *, int, void *);
 static void series_redis_hash_expression(seriesQueryBaton *, char *, int);
 static void series_node_get_metric_name(seriesQueryBaton *, seriesGetSID *, series_sample_set_t *);
 static void series_node_get_desc(seriesQueryBaton *, sds, series_sample_set_t *);
+static void series_values_decode(series_sample_set_t *);
+static int series_extract_type(char *);
+static int series_extract_value(int, sds, pmAtomValue *);
+static int series_pmAtomValue_conv_str(int, char *, pmAtomValue *, int);
 static void series_lookup_services(void *);
 static void series_lookup_mapping(void *);
 static void series_lookup_finished(void *);
 static void series_query_mapping(void *arg);
 static void series_instances_reply_callback(redisClusterAsyncContext *, void *, void *);
+static void series_node_values_report(seriesQueryBaton *, node_t *);
+static void series_instance_set_alloc(series_instance_set_t *, int);
+static void series_stream_free(seriesQueryBaton *);
 
 sds	cursorcount;	/* number of elements in each SCAN call */
+sds	streamcount;	/* number of elements in each XRANGE call */
+unsigned int	rollups[MAX_ROLLUPS];	/* rollup stream resolutions */
+unsigned int	nrollups;
 
 static void
 initSeriesGetQuery(seriesQueryBaton *baton, node_t *root, timing_t *timing)
@@ -91,6 +118,282 @@ initSeriesGetQuery(seriesQueryBaton *baton, node_t *root, timing_t *timing)
     baton->query.timing = *timing;
 }
 
+/* stream of raw values of a series, or of one of its rollups */
+static sds
+series_values_key(sds sid, unsigned int rollup)
+{
+    if (rollup)
+	return sdscatfmt(sdsempty(), "pcp:rollup:series:%S:%u", sid, rollup);
+    return sdscatfmt(sdsempty(), "pcp:values:series:%S", sid);
+}
+
+/*
+ * Start of a time window, from the start of its first rollup interval -
+ * or of its first compact block, which may hold earlier samples too.
+ */
+static const char *
+series_values_start(timing_t *tp, unsigned int rollup, char *buffer, int buflen)
+{
+    struct timespec	start = tp->start;
+    unsigned int	span = rollup ? rollup : COMPACT_SPAN;
+
+    start.tv_sec -= start.tv_sec % span;
+    start.tv_nsec = 0;
+    return timespec_stream_str(&start, buffer, buflen);
+}
+
+/*
+ * Values in rollup streams are followed by the minimum, maximum and
+ * count of the values in each interval - terminate them after the
+ * (average or latest) value itself, which is then decoded as usual.
+ */
+static void
+series_rollup_values(unsigned int nelements, redisReply **elements)
+{
+    redisReply		*entry, *pairs, *value;
+    unsigned int	i, j;
+    char		*p;
+
+    for (i = 0; i < nelements; i++) {
+	entry = elements[i];
+	if (entry->type != REDIS_REPLY_ARRAY || entry->elements < 2)
+	    continue;
+	pairs = entry->element[1];
+	if (pairs->type != REDIS_REPLY_ARRAY)
+	    continue;
+	for (j = 1; j < pairs->elements; j += 2) {
+	    value = pairs->element[j];
+	    if (value->type != REDIS_REPLY_STRING)
+		continue;
+	    if ((p = memchr(value->str, ' ', value->len)) != NULL) {
+		*p = '\0';
+		value->len = p - value->str;
+	    }
+	}
+    }
+}
+
+static int
+series_compact_entry(redisReply *entry)
+{
+    redisReply		*pairs, *field;
+
+    if (entry->type != REDIS_REPLY_ARRAY || entry->elements < 2)
+	return 0;
+    pairs = entry->element[1];
+    if (pairs->type != REDIS_REPLY_ARRAY || pairs->elements != 2)
+	return 0;
+    field = pairs->element[0];
+    return (field->type == REDIS_REPLY_STRING &&
+	    field->len == sizeof(COMPACT_FIELD)-1 &&
+	    memcmp(field->str, COMPACT_FIELD, field->len) == 0);
+}
+
+static __uint64_t
+series_entry_usec(redisReply *entry)
+{
+    redisReply		*stamp;
+    __uint64_t		usec;
+    char		*end;
+
+    if (entry->type != REDIS_REPLY_ARRAY || entry->elements < 1)
+	return 0;
+    stamp = entry->element[0];
+    if (stamp->type != REDIS_REPLY_STRING)
+	return 0;
+    usec = strtoull(stamp->str, &end, 10) * 1000;
+    if (*end == '-')
+	usec += strtoull(end + 1, NULL, 10);
+    return usec;
+}
+
+static void
+series_block_value(int type, __uint64_t bits, char *buffer, int buflen)
+{
+    double		value;
+
+    switch (type) {
+    case PM_TYPE_32:
+	pmsprintf(buffer, buflen, "%d", (int)(__int64_t)bits);
+	break;
+    case PM_TYPE_U32:
+	pmsprintf(buffer, buflen, "%u", (unsigned int)bits);
+	break;
+    case PM_TYPE_64:
+	pmsprintf(buffer, buflen, "%" FMT_INT64, (__int64_t)bits);
+	break;
+    case PM_TYPE_U64:
+	pmsprintf(buffer, buflen, "%" FMT_UINT64, bits);
+	break;
+    case PM_TYPE_FLOAT:
+    case PM_TYPE_DOUBLE:
+	memcpy(&value, &bits, sizeof(value));
+	pmsprintf(buffer, buflen, "%e", value);
+	break;
+    default:
+	pmsprintf(buffer, buflen, "%d", PM_ERR_NYI);
+	break;
+    }
+}
+
+/*
+ * Make stream entries from the samples of a compact block within the
+ * [start, end] time window (microseconds), as they would have been if
+ * added one at a time - with the same timestamp and value formats.
+ */
+static int
+series_block_expand(seriesBlock *bp, __uint64_t start, __uint64_t end,
+		int reverse, seriesEntries *ep)
+{
+    compactBlock	*block = &bp->block;
+    redisReply		*entry, *reply, **pointers;
+    unsigned int	i, j, k, nreplies = 3 + 2 * block->ninst;
+    __uint64_t		usec;
+    char		*buffer;
+
+    bp->replies = calloc(block->nsamples * nreplies, sizeof(redisReply));
+    bp->pointers = calloc(block->nsamples * (nreplies - 1), sizeof(redisReply *));
+    bp->strings = malloc(block->nsamples * (block->ninst + 1) * VALUE_STRLEN);
+    if (bp->replies == NULL || bp->pointers == NULL || bp->strings == NULL)
+	return -ENOMEM;
+
+    for (k = 0; k < block->nsamples; k++) {
+	i = reverse ? block->nsamples - k - 1 : k;
+	usec = block->stamps[i];
+	if (usec < start || usec > end)
+	    continue;
+	entry = &bp->replies[i * nreplies];
+	pointers = &bp->pointers[i * (nreplies - 1)];
+	buffer = &bp->strings[i * (block->ninst + 1) * VALUE_STRLEN];
+
+	entry->type = REDIS_REPLY_ARRAY;
+	entry->elements = 2;
+	entry->element = pointers;
+	pointers[0] = reply = entry + 1;
+	reply->type = REDIS_REPLY_STRING;
+	reply->str = buffer;
+	reply->len = pmsprintf(buffer, VALUE_STRLEN, "%" FMT_UINT64 "-%" FMT_UINT64,
+			usec / 1000, usec % 1000);
+	pointers[1] = reply = entry + 2;
+	reply->type = REDIS_REPLY_ARRAY;
+	reply->elements = 2 * block->ninst;
+	reply->element = pointers + 2;
+
+	for (j = 0; j < block->ninst; j++) {
+	    pointers[2 + 2*j] = reply = entry + 3 + 2*j;
+	    reply->type = REDIS_REPLY_STRING;
+	    reply->str = block->names[j];
+	    reply->len = sdslen(block->names[j]);
+	    pointers[3 + 2*j] = reply = entry + 4 + 2*j;
+	    buffer += VALUE_STRLEN;
+	    series_block_value(block->type,
+			block->values[i * block->ninst + j], buffer, VALUE_STRLEN);
+	    reply->type = REDIS_REPLY_STRING;
+	    reply->str = buffer;
+	    reply->len = strlen(buffer);
+	}
+	ep->elements[ep->nelements++] = entry;
+    }
+    return 0;
+}
+
+/*
+ * Prepare stream entries of a series for sampling - decoding any compact
+ * blocks into entries for each of their samples, and dropping samples
+ * outside of the time window (blocks may start earlier or end later).
+ * The first 'nselect' stream entries give the 'nselected' entries here.
+ */
+static int
+series_values_expand(seriesQueryBaton *baton, sds series, timing_t *tp,
+		unsigned int rollup, int reverse, unsigned int nselect,
+		unsigned int nelements, redisReply **elements, seriesEntries *ep)
+{
+    seriesBlock		*bp;
+    redisReply		*value;
+    __uint64_t		start = 0, end = UINT64_MAX, usec;
+    unsigned int	i, count = 0, nblocks = 0;
+    int			sts;
+    sds			msg;
+
+    memset(ep, 0, sizeof(*ep));
+    ep->nelements = nelements;
+    ep->nselected = nselect;
+    ep->elements = elements;
+
+    /* rollup streams are never compact, nor are time windows in reverse */
+    if (rollup)
+	return 0;
+    if (!reverse) {
+	start = (__uint64_t)tp->start.tv_sec * 1000000 + tp->start.tv_nsec / 1000;
+	if (tp->end.tv_sec)
+	    end = (__uint64_t)tp->end.tv_sec * 1000000 + tp->end.tv_nsec / 1000;
+    }
+    for (i = 0; i < nelements; i++) {
+	if (series_compact_entry(elements[i]))
+	    nblocks++;
+	else if (series_entry_usec(elements[i]) >= start)
+	    count++;
+    }
+    if (nblocks == 0 && count == nelements)
+	return 0;
+
+    ep->nelements = ep->nselected = 0;
+    ep->elements = NULL;
+    if (nblocks && (ep->blocks = calloc(nblocks, sizeof(seriesBlock))) == NULL)
+	return -ENOMEM;
+    for (i = 0; i < nelements; i++) {
+	if (!series_compact_entry(elements[i]))
+	    continue;
+	bp = &ep->blocks[ep->nblocks++];
+	value = elements[i]->element[1]->element[1];
+	if (value->type != REDIS_REPLY_STRING ||
+	    compact_decode(value->str, value->len, &bp->block) < 0) {
+	    /* an empty block remains in its place, with no samples */
+	    infofmt(msg, "invalid compact entry in series %s", series);
+	    batoninfo(baton, PMLOG_RESPONSE, msg);
+	    continue;
+	}
+	count += bp->block.nsamples;
+    }
+    if ((ep->elements = calloc(count + 1, sizeof(redisReply *))) == NULL)
+	return -ENOMEM;
+
+    for (i = nblocks = 0; i < nelements; i++) {
+	if (i == nselect)
+	    ep->nselected = ep->nelements;
+	if (!series_compact_entry(elements[i])) {
+	    usec = series_entry_usec(elements[i]);
+	    if (usec >= start)
+		ep->elements[ep->nelements++] = elements[i];
+	    continue;
+	}
+	bp = &ep->blocks[nblocks++];
+	if (bp->block.nsamples == 0)
+	    continue;	/* not decoded, reported above */
+	if ((sts = series_block_expand(bp, start, end, reverse, ep)) < 0)
+	    return sts;
+    }
+    if (nselect == nelements)
+	ep->nselected = ep->nelements;
+    return 0;
+}
+
+static void
+series_entries_free(seriesEntries *ep, redisReply **elements)
+{
+    unsigned int	i;
+
+    for (i = 0; i < ep->nblocks; i++) {
+	compact_free(&ep->blocks[i].block);
+	free(ep->blocks[i].replies);
+	free(ep->blocks[i].pointers);
+	free(ep->blocks[i].strings);
+    }
+    free(ep->blocks);
+    if (ep->elements != elements)
+	free(ep->elements);
+}
+
 static int
 skip_free_value_set(node_t *np)
 {
@@ -104,39 +407,56 @@ skip_free_value_set(node_t *np)
 }
 
 static void
-freeSeriesQueryNode(node_t *np)
+series_instance_set_free(series_instance_set_t *sp, int strings)
 {
-    int		n_samples;
+    int		k;
+
+    if (strings) {
+	for (k = 0; k < sp->num_instances; k++) {
+	    sdsfree(sp->series_instance[k].series);
+	    sdsfree(sp->series_instance[k].data);
+	}
+    }
+    free(sp->series_instance);
+    free(sp->values);
+    free(sp->novalue);
+    memset(sp, 0, sizeof(*sp));
+}
 
+static void
+series_value_set_free(series_value_set_t *vsp)
+{
+    series_sample_set_t	*set;
+    int			i, j, n_samples;
+
+    for (i = 0; i < vsp->num_series; i++) {
+	set = &vsp->series_values[i];
+	n_samples = set->num_samples;
+	if (n_samples < 0) n_samples = -n_samples;
+	for (j = 0; j < n_samples; j++)
+	    series_instance_set_free(&set->series_sample[j], !set->shared);
+	sdsfree(set->sid->name);
+	free(set->sid);
+	free(set->series_sample);
+	sdsfree(set->series_desc.indom);
+	sdsfree(set->series_desc.pmid);
+	sdsfree(set->series_desc.semantics);
+	sdsfree(set->series_desc.source);
+	sdsfree(set->series_desc.type);
+	sdsfree(set->series_desc.units);
+    }
+    free(vsp->series_values);
+    memset(vsp, 0, sizeof(*vsp));
+}
+
+static void
+freeSeriesQueryNode(node_t *np)
+{
     if (np == NULL)
 	return;
 
-    if (skip_free_value_set(np) != 0) {
-	int i, j, k;
-
-	for (i = 0; i < np->value_set.num_series; i++) {
-	    n_samples = np->value_set.series_values[i].num_samples;
-	    if (n_samples < 0) n_samples = -n_samples;
-	    for (j = 0; j < n_samples; j++) {
-		for (k = 0; k < np->value_set.series_values[i].series_sample[j].num_instances; k++) {
-		    sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].timestamp);
-		    sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].series);
-		    sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].data);
-		}
-		free(np->value_set.series_values[i].series_sample[j].series_instance);
-	    }
-	    sdsfree(np->value_set.series_values[i].sid->name);
-	    free(np->value_set.series_values[i].sid);
-	    free(np->value_set.series_values[i].series_sample);
-	    sdsfree(np->value_set.series_values[i].series_desc.indom);
-	    sdsfree(np->value_set.series_values[i].series_desc.pmid);
-	    sdsfree(np->value_set.series_values[i].series_desc.semantics);
-	    sdsfree(np->value_set.series_values[i].series_desc.source);
-	    sdsfree(np->value_set.series_values[i].series_desc.type);
-	    sdsfree(np->value_set.series_values[i].series_desc.units);
-	}
-	free(np->value_set.series_values);
-    }
+    if (skip_free_value_set(np) != 0)
+	series_value_set_free(&np->value_set);
     freeSeriesQueryNode(np->right);
     freeSeriesQueryNode(np->left);
     if (np->result.nseries)
@@ -151,6 +471,7 @@ freeSeriesGetQuery(seriesQueryBaton *baton)
 {
     seriesBatonCheckMagic(baton, MAGIC_QUERY, "freeSeriesGetQuery");
     seriesBatonCheckCount(baton, "freeSeriesGetQuery");
+    series_stream_free(baton);
     freeSeriesQueryNode(baton->query.root);
     memset(baton, 0, sizeof(seriesQueryBaton));
     free(baton);
@@ -557,6 +878,26 @@ typedef struct seriesSampling {
     sds			next_timestamp;	/* from the following sample */
 } seriesSampling;
 
+typedef struct seriesStream {
+    node_t		*leaf;		/* node with the series of values */
+    unsigned int	nseries;	/* number of series at the leaf */
+    unsigned int	current;	/* series being evaluated, index */
+    unsigned int	count;		/* stream entries in each request */
+    unsigned int	requested;	/* stream entries in this request */
+    unsigned int	reverse;	/* most recent 'count' values only */
+    unsigned int	final;		/* no entries beyond this request */
+    unsigned int	hashed;		/* function expression identifier */
+    unsigned int	evaluated;	/* pages evaluated for this series */
+    unsigned int	ncarry;		/* samples kept between pages */
+    unsigned int	ncarried;	/* samples kept from last page */
+    series_instance_set_t *carry;	/* copies of samples, for rate() */
+    series_sample_set_t	*sets;		/* descriptor and name of series */
+    seriesSampling	sampling;
+    sds			start;		/* stream ID range of next request */
+    sds			end;
+    char		hashbuf[42];
+} seriesStream;
+
 static int
 use_next_sample(seriesSampling *sampling)
 {
@@ -1546,6 +1887,15 @@ series_query_expr_reply(redisClusterAsyncContext *c, void *r, void *arg)
     series_query_end_phase(baton);
 }
 
+unsigned int
+series_value_count_only(timing_t *tp)
+{
+    if (tp->window.range || tp->window.delta ||
+	tp->window.start || tp->window.end)
+	return 0;
+    return tp->count;
+}
+
 static void
 series_prepare_time_reply(
 	redisClusterAsyncContext *c, void *r, void *arg)
@@ -1554,8 +1904,11 @@ series_prepare_time_reply(
     seriesQueryBaton	*baton = (seriesQueryBaton *)sid->baton;
     redisReply		*reply = r;
     seriesGetSID	*expr;
+    seriesEntries	entries;
+    timing_t		*tp = &baton->query.timing;
     sds			key, exprcmd;
     sds			msg;
+    int			sts;
 
     seriesBatonCheckMagic(sid, MAGIC_SID, "series_prepare_time_reply");
     seriesBatonCheckMagic(baton, MAGIC_QUERY, "series_prepare_time_reply");
@@ -1567,7 +1920,17 @@ series_prepare_time_reply(
     } else {
 	if (reply->elements > 0) {
 	    /* reply is a normal time series */
-	    series_values_reply(baton, sid->name, reply->elements, reply->element, arg);
+	    if (baton->query.root->rollup)
+		series_rollup_values(reply->elements, reply->element);
+	    if ((sts = series_values_expand(baton, sid->name, tp,
+				baton->query.root->rollup, series_value_count_only(tp),
+				reply->elements, reply->elements, reply->element,
+				&entries)) < 0)
+		baton->error = sts;
+	    else
+		series_values_reply(baton, sid->name,
+				entries.nelements, entries.elements, arg);
+	    series_entries_free(&entries, reply->element);
 	} else {
 	    /* Handle fabricated/expression SID in /series/values :
 	     * - get the expr for sid->name from redis. In the callback for that,
@@ -1595,15 +1958,6 @@ series_prepare_time_reply(
     series_query_end_phase(baton);
 }
 
-unsigned int
-series_value_count_only(timing_t *tp)
-{
-    if (tp->window.range || tp->window.delta ||
-	tp->window.start || tp->window.end)
-	return 0;
-    return tp->count;
-}
-
 static void
 series_prepare_time(seriesQueryBaton *baton, series_set_t *result)
 {
@@ -1619,7 +1973,8 @@ series_prepare_time(seriesQueryBaton *baton, series_set_t *result)
 	revlen = pmsprintf(revbuf, sizeof(revbuf), "%u", reverse);
 	start = sdsnew("+");
     } else {
-	start = sdsnew(timespec_stream_str(&tp->start, buffer, sizeof(buffer)));
+	start = sdsnew(series_values_start(tp, baton->query.root->rollup,
+				buffer, sizeof(buffer)));
     }
 
     if (pmDebugOptions.series)
@@ -1646,7 +2001,7 @@ series_prepare_time(seriesQueryBaton *baton, series_set_t *result)
 	initSeriesGetSID(sid, buffer, 1, baton);
 	seriesBatonReference(baton, "series_prepare_time");
 
-	key = sdscatfmt(sdsempty(), "pcp:values:series:%S", sid->name);
+	key = series_values_key(sid->name, baton->query.root->rollup);
 
 	/* X[REV]RANGE key t1 t2 [count N] */
 	if (reverse) {
@@ -1804,13 +2159,13 @@ series_query_expr(void *arg)
 
 static int
 series_instance_store_to_node(seriesQueryBaton *baton, sds series,
-	pmSeriesValue *value, int nelements, redisReply **elements, node_t *np, int idx_sample)
+	pmSeriesValue *value, int nelements, redisReply **elements,
+	series_instance_set_t *sample)
 {
     char		hashbuf[42];
     sds			inst;
     int			i, sts = 0;
     int			idx_instance = 0;
-    int			idx_series = np->value_set.num_series;
 
     for (i = 0; i < nelements; i += 2) {
 	inst = value->series;
@@ -1833,10 +2188,9 @@ series_instance_store_to_node(seriesQueryBaton *baton, sds series,
 	    sts = -EPROTO;
 	else {
 	    /* update value instance */
-	    pmSeriesValue *valinst = &np->value_set.series_values[idx_series].series_sample[idx_sample].series_instance[idx_instance];
+	    pmSeriesValue *valinst = &sample->series_instance[idx_instance];
 
 	    valinst->ts = value->ts; /* struct pmTimespec assign */
-	    valinst->timestamp = sdsnew(value->timestamp);
 	    valinst->series = sdsnew(value->series);
 	    valinst->data = sdsnew(value->data);
 	    ++idx_instance;
@@ -1943,15 +2297,17 @@ series_values_store_to_node(seriesQueryBaton *baton, sds series,
 	if (tp->count && sampling.count++ >= tp->count)
 	    break;
 	
-	idx_sample = i;
 	np->value_set.series_values[idx_series].series_sample[idx_sample].num_instances = reply->elements/2;
 	if ((np->value_set.series_values[idx_series].series_sample[idx_sample].series_instance =
-		(pmSeriesValue *)calloc(reply->elements/2, sizeof(pmSeriesValue))) == NULL) {
+		(pmSeriesValue *)calloc(reply->elements/2, sizeof(pmSeriesValue))) == NULL ||
+	    (np->value_set.series_values[idx_series].series_sample[idx_sample].values =
+		(pmAtomValue *)calloc(reply->elements/2, sizeof(pmAtomValue))) == NULL) {
 	    /* TODO: error report here */
 	    baton->error = -ENOMEM;
 	}
 	if ((sts = series_instance_store_to_node(baton, series, &sampling.value,
-				reply->elements, reply->element, np, idx_sample)) < 0) {
+				reply->elements, reply->element,
+				&np->value_set.series_values[idx_series].series_sample[idx_sample++])) < 0) {
 	    baton->error = sts;
 	    goto last_sample;
 	}
@@ -1968,6 +2324,8 @@ next_sample:
     }
 
 last_sample:
+    /* samples skipped by interval sampling leave no gaps in the node */
+    np->value_set.series_values[idx_series].num_samples = idx_sample;
     if (sampling.setup)
 	sdsfree(sampling.next_timestamp);
     sdsfree(sampling.value.timestamp);
@@ -2067,6 +2425,8 @@ series_node_get_desc_reply(
     } else if ((sts = extract_series_node_desc(baton, sample_set->sid->name,
 			reply->elements, reply->element, desc)) < 0)
 	baton->error = sts;
+    else	/* samples are stored by now, decode them into typed values */
+	series_values_decode(sample_set);
 
     series_query_end_phase(baton);
 }
@@ -2179,8 +2539,10 @@ series_node_prepare_time_reply(
     node_t			*np = (node_t *)arg;
     seriesQueryBaton		*baton = (seriesQueryBaton *)np->baton;
     redisReply			*reply = r;
+    seriesEntries		entries;
     sds				msg;
     int				idx = np->value_set.num_series;
+    int				sts;
     seriesGetSID		*sid = np->value_set.series_values[idx].sid;
 
     /* 
@@ -2198,10 +2560,18 @@ series_node_prepare_time_reply(
 	batoninfo(baton, PMLOG_RESPONSE, msg);
 	baton->error = -EPROTO;
     } else {
+	if (np->rollup)
+	    series_rollup_values(reply->elements, reply->element);
+	if ((sts = series_values_expand(baton, sid->name, &np->time, np->rollup,
+				series_value_count_only(&np->time),
+				reply->elements, reply->elements, reply->element,
+				&entries)) < 0)
+	    baton->error = sts;
+
 	/* calloc space to store series samples */
-	np->value_set.series_values[idx].num_samples = reply->elements;
+	np->value_set.series_values[idx].num_samples = entries.nelements;
 	if ((np->value_set.series_values[idx].series_sample =
-	    (series_instance_set_t *)calloc(reply->elements, sizeof(series_instance_set_t))) == NULL) {
+	    (series_instance_set_t *)calloc(entries.nelements, sizeof(series_instance_set_t))) == NULL) {
 	    /* TODO: error report here */
 	    baton->error = -ENOMEM;
 	}
@@ -2210,7 +2580,9 @@ series_node_prepare_time_reply(
 	series_node_get_desc(baton, sid->name, &np->value_set.series_values[idx]);
 	series_node_get_metric_name(baton, sid, &np->value_set.series_values[idx]);
 	
-	series_values_store_to_node(baton, sid->name, reply->elements, reply->element, np);
+	series_values_store_to_node(baton, sid->name,
+				entries.nelements, entries.elements, np);
+	series_entries_free(&entries, reply->element);
 	np->value_set.num_series++;
     }
     series_query_end_phase(baton);
@@ -2232,7 +2604,8 @@ series_node_prepare_time(seriesQueryBaton *baton, series_set_t *query_series_set
 	revlen = pmsprintf(revbuf, sizeof(revbuf), "%u", reverse);
 	start = sdsnew("+");
     } else {
-	start = sdsnew(timespec_stream_str(&tp->start, buffer, sizeof(buffer)));
+	start = sdsnew(series_values_start(tp, np->rollup,
+				buffer, sizeof(buffer)));
     }
 
     if (pmDebugOptions.series)
@@ -2269,60 +2642,569 @@ series_node_prepare_time(seriesQueryBaton *baton, series_set_t *query_series_set
 	initSeriesGetSID(sid, buffer, 1, baton);
 	seriesBatonReference(baton, "series_prepare_time");
 
-	key = sdscatfmt(sdsempty(), "pcp:values:series:%S", sid->name);
+	key = series_values_key(sid->name, np->rollup);
 
 	/* X[REV]RANGE key t1 t2 [count N] */
 	if (reverse) {
 	    cmd = redis_command(6);
 	    cmd = redis_param_str(cmd, XREVRANGE, XREVRANGE_LEN);
 	} else {
-	    cmd = redis_command(4);
-	    cmd = redis_param_str(cmd, XRANGE, XRANGE_LEN);
-	}
-	cmd = redis_param_sds(cmd, key);
-	cmd = redis_param_sds(cmd, start);
-	cmd = redis_param_sds(cmd, end);
-	if (reverse) {
-	    cmd = redis_param_str(cmd, "COUNT", sizeof("COUNT")-1);
-	    cmd = redis_param_str(cmd, revbuf, revlen);
+	    cmd = redis_command(4);
+	    cmd = redis_param_str(cmd, XRANGE, XRANGE_LEN);
+	}
+	cmd = redis_param_sds(cmd, key);
+	cmd = redis_param_sds(cmd, start);
+	cmd = redis_param_sds(cmd, end);
+	if (reverse) {
+	    cmd = redis_param_str(cmd, "COUNT", sizeof("COUNT")-1);
+	    cmd = redis_param_str(cmd, revbuf, revlen);
+	}
+	sdsfree(key);
+	np->value_set.series_values[i].baton = baton;
+	np->value_set.series_values[i].sid = sid;
+	/* Note: np->series_set.num_series is not equal to nseries in this function */
+	redisSlotsRequest(baton->slots, cmd,
+				series_node_prepare_time_reply, np);
+	sdsfree(cmd);
+	
+    }
+    sdsfree(start);
+    sdsfree(end);
+}
+
+/* 
+ * When we encounter a data node (i.e. np->result.nseries!=0),
+ * query Redis for actual values and store them into this node
+ * because time series identifier will always be described in
+ * the top node of a subtree at the parser tree's bottom. 
+ */
+static int
+series_process_func(seriesQueryBaton *baton, node_t *np, int level)
+{
+    int		sts, nelements = 0;
+
+    if (np == NULL)
+	return 0;
+
+    if ((nelements = np->result.nseries) != 0) {
+	np->value_set.num_series = 0;
+	np->baton = baton;
+	series_node_prepare_time(baton, &np->result, np);
+	return baton->error;
+    }
+
+    if ((sts = series_process_func(baton, np->left, level+1)) < 0)
+	return sts;
+    return series_process_func(baton, np->right, level+1);
+}
+
+/*
+ * Streaming evaluation of time window queries.  Rather than storing
+ * every sample of every series in the leaf node before any function
+ * is applied, request pages of stream entries for one series at a
+ * time, evaluate each page through the functions above the leaf and
+ * report the results before requesting the next page.  Memory use is
+ * then bounded by the page size (stream.count) not the time window.
+ *
+ * This is possible for expressions where each function computes each
+ * sample independently of all others - rate() is the exception, and
+ * the last samples of each page are kept to start the next page with.
+ */
+static int
+series_stream_function(nodetype_t type)
+{
+    switch (type) {
+    case N_RATE:
+    case N_RESCALE:
+    case N_ABS:
+    case N_FLOOR:
+    case N_LOG:
+    case N_SQRT:
+    case N_ROUND:
+    case N_MAX_SAMPLE:
+    case N_MIN_SAMPLE:
+    case N_SUM_SAMPLE:
+    case N_AVG_SAMPLE:
+    case N_STDEV_SAMPLE:
+    case N_TOPK_SAMPLE:
+    case N_NTH_PERCENTILE_SAMPLE:
+	return 1;
+    default:
+	break;
+    }
+    return 0;
+}
+
+/* find the data node below a chain of per-sample functions, if any */
+static node_t *
+series_stream_leaf(node_t *np, unsigned int *nrates)
+{
+    for (*nrates = 0; np != NULL; np = np->left) {
+	if (np->result.nseries != 0)
+	    return np;
+	if (!series_stream_function(np->type))
+	    break;
+	if (np->type == N_RATE)
+	    (*nrates)++;
+    }
+    return NULL;
+}
+
+static void
+series_stream_sampling_free(seriesSampling *sampling)
+{
+    if (sampling->setup)
+	sdsfree(sampling->next_timestamp);
+    sdsfree(sampling->value.timestamp);
+    sdsfree(sampling->value.series);
+    sdsfree(sampling->value.data);
+    memset(sampling, 0, sizeof(*sampling));
+}
+
+static void
+series_stream_free(seriesQueryBaton *baton)
+{
+    seriesStream	*sp = baton->stream;
+    series_sample_set_t	*set;
+    unsigned int	i;
+
+    if (sp == NULL)
+	return;
+    for (i = 0; i < sp->nseries; i++) {
+	set = &sp->sets[i];
+	if (set->sid)
+	    freeSeriesGetSID(set->sid);
+	sdsfree(set->series_desc.indom);
+	sdsfree(set->series_desc.pmid);
+	sdsfree(set->series_desc.semantics);
+	sdsfree(set->series_desc.source);
+	sdsfree(set->series_desc.type);
+	sdsfree(set->series_desc.units);
+    }
+    for (i = 0; i < sp->ncarried; i++)
+	series_instance_set_free(&sp->carry[i], 1);
+    series_stream_sampling_free(&sp->sampling);
+    sdsfree(sp->start);
+    sdsfree(sp->end);
+    free(sp->carry);
+    free(sp->sets);
+    free(sp);
+    baton->stream = NULL;
+}
+
+/*
+ * Set up streaming evaluation if the query expression allows it, and
+ * request the descriptor and metric name of each series at the leaf -
+ * needed before any values can be evaluated.
+ */
+static int
+series_stream_setup(seriesQueryBaton *baton)
+{
+    seriesStream	*sp;
+    series_sample_set_t	*set;
+    node_t		*leaf;
+    unsigned char	*series;
+    unsigned int	i, count, nrates;
+    char		buffer[64];
+
+    if (streamcount == NULL || (count = strtoul(streamcount, NULL, 10)) == 0)
+	return 0;
+    if ((leaf = series_stream_leaf(baton->query.root, &nrates)) == NULL)
+	return 0;
+    if ((sp = calloc(1, sizeof(seriesStream))) == NULL)
+	return 0;
+    if ((sp->sets = calloc(leaf->result.nseries, sizeof(series_sample_set_t))) == NULL ||
+	(sp->carry = calloc(nrates + 1, sizeof(series_instance_set_t))) == NULL) {
+	free(sp->sets);
+	free(sp);
+	return 0;
+    }
+    sp->leaf = leaf;
+    sp->nseries = leaf->result.nseries;
+    sp->count = count < 2 ? 2 : count;	/* one entry is held back per page */
+    sp->reverse = series_value_count_only(&leaf->time);
+    sp->ncarry = nrates;
+    sp->start = sdsempty();
+    sp->end = sdsempty();
+    baton->stream = sp;
+
+    series = leaf->result.series;
+    for (i = 0; i < sp->nseries; i++, series += SHA1SZ) {
+	set = &sp->sets[i];
+	set->baton = baton;
+	set->sid = calloc(1, sizeof(seriesGetSID));
+	pmwebapi_hash_str(series, buffer, sizeof(buffer));
+	initSeriesGetSID(set->sid, buffer, 1, baton);
+	series_node_get_desc(baton, set->sid->name, set);
+	series_node_get_metric_name(baton, set->sid, set);
+    }
+    return 1;
+}
+
+/*
+ * Scale conversion between series of different units is performed
+ * on the complete result set (series_redis_hash_expression), so any
+ * function expression over such series cannot be evaluated by pages.
+ */
+static int
+series_stream_units(seriesQueryBaton *baton)
+{
+    seriesStream	*sp = baton->stream;
+    unsigned int	i;
+
+    if (sp->leaf == baton->query.root)
+	return 1;
+    for (i = 1; i < sp->nseries; i++)
+	if (strcmp(sp->sets[i].series_desc.units, sp->sets[0].series_desc.units) != 0)
+	    return 0;
+    return 1;
+}
+
+static void series_stream_reply(redisClusterAsyncContext *, void *, void *);
+
+static void
+series_stream_request(seriesQueryBaton *baton)
+{
+    seriesStream	*sp = baton->stream;
+    sds			cmd, key;
+    char		buffer[64];
+    unsigned int	count = sp->count;
+    int			len;
+
+    /* if only 'count' is requested, ask for no more than remain */
+    if (sp->reverse && sp->reverse - sp->sampling.count <= count) {
+	count = sp->reverse - sp->sampling.count;
+	sp->final = 1;
+    }
+    sp->requested = count;
+    len = pmsprintf(buffer, sizeof(buffer), "%u", count);
+
+    seriesBatonReference(baton, "series_stream_request");
+
+    key = series_values_key(sp->sets[sp->current].sid->name, sp->leaf->rollup);
+
+    /* X[REV]RANGE key t1 t2 COUNT N */
+    cmd = redis_command(6);
+    if (sp->reverse)
+	cmd = redis_param_str(cmd, XREVRANGE, XREVRANGE_LEN);
+    else
+	cmd = redis_param_str(cmd, XRANGE, XRANGE_LEN);
+    cmd = redis_param_sds(cmd, key);
+    cmd = redis_param_sds(cmd, sp->start);
+    cmd = redis_param_sds(cmd, sp->end);
+    cmd = redis_param_str(cmd, "COUNT", sizeof("COUNT")-1);
+    cmd = redis_param_str(cmd, buffer, len);
+    sdsfree(key);
+    redisSlotsRequest(baton->slots, cmd, series_stream_reply, baton);
+    sdsfree(cmd);
+}
+
+/* start (or move on to) evaluation of the current series */
+static void
+series_stream_series(seriesQueryBaton *baton)
+{
+    seriesStream	*sp = baton->stream;
+    timing_t		*tp = &sp->leaf->time;
+    char		buffer[64];
+
+    if (sp->current >= sp->nseries)
+	return;
+
+    series_stream_sampling_free(&sp->sampling);
+    sp->sampling.value.timestamp = sdsempty();
+    sp->sampling.value.series = sdsempty();
+    sp->sampling.value.data = sdsempty();
+    sp->final = sp->evaluated = 0;
+
+    /* if only 'count' is requested, work back from most recent value */
+    if (sp->reverse) {
+	sp->start = sdscpy(sp->start, "+");
+	sp->end = sdscpy(sp->end, "-");
+    } else {
+	sp->start = sdscpy(sp->start, series_values_start(tp,
+			sp->leaf->rollup, buffer, sizeof(buffer)));
+	if (tp->end.tv_sec)
+	    sp->end = sdscpy(sp->end,
+			timespec_stream_str(&tp->end, buffer, sizeof(buffer)));
+	else
+	    sp->end = sdscpy(sp->end, "+");
+    }
+    series_stream_request(baton);
+}
+
+/*
+ * Select samples from a page of stream entries as series_values_store_to_node
+ * does, but with sampling state kept from one page to the next.  Samples are
+ * selected from the first 'nsamples' entries, the entry following those (if
+ * any) is only used for timestamp comparison when subsampling.  Returns one
+ * once the requested number of samples is reached, else zero or an error.
+ */
+static int
+series_stream_store(seriesQueryBaton *baton, series_sample_set_t *set,
+		int nsamples, int nentries, redisReply **samples)
+{
+    seriesSampling	*sampling = &baton->stream->sampling;
+    timing_t		*tp = &baton->query.timing;
+    series_instance_set_t *sample;
+    redisReply		*reply, **elements;
+    sds			msg, save_timestamp, series = set->sid->name;
+    int			i, sts, next;
+
+    for (i = 0; i < nsamples; i++) {
+	if (samples[i]->elements == 0)
+	    continue;
+	elements = samples[i]->element;
+
+	/* expecting timestamp:valueset pairs, then instance:value pairs */
+	if (samples[i]->elements % 2) {
+	    infofmt(msg, "expected time:valueset pairs in %s XRANGE", series);
+	    batoninfo(baton, PMLOG_RESPONSE, msg);
+	    return -EPROTO;
+	}
+
+	/* verify the instance:value pairs array before proceeding */
+	reply = elements[1];
+	if (reply->type != REDIS_REPLY_ARRAY) {
+	    infofmt(msg, "expected value array for series %s %s (type=%s)",
+			series, XRANGE, redis_reply_type(reply));
+	    batoninfo(baton, PMLOG_RESPONSE, msg);
+	    return -EPROTO;
+	}
+
+	/* setup state variables used internally during selection process */
+	if (sampling->setup == 0 && (tp->delta.tv_sec || tp->delta.tv_nsec)) {
+	    sampling->delta.tv_sec = tp->delta.tv_sec;
+	    sampling->delta.tv_nsec = tp->delta.tv_nsec;
+	    if ((sts = extract_time(baton, series, elements[0],
+					&sampling->value.timestamp,
+					&sampling->value.ts)) < 0)
+		return sts;
+	    if (tp->start.tv_sec || tp->start.tv_nsec) {
+		sampling->goal.tv_sec = tp->start.tv_sec;
+		sampling->goal.tv_nsec = tp->start.tv_nsec;
+	    } else {
+		sampling->goal = sampling->value.ts;
+	    }
+	    sampling->next_timestamp = sdsempty();
+	    sampling->subsampling = 1;
+	}
+	sampling->setup = 1;
+
+	if (sampling->subsampling == 0) {
+	    if ((sts = extract_time(baton, series, elements[0],
+					&sampling->value.timestamp,
+					&sampling->value.ts)) < 0) {
+		baton->error = sts;
+		continue;
+	    }
+	} else if ((next = i + 1) < nentries) {
+	    elements = samples[next]->element;
+	    if ((sts = extract_time(baton, series, elements[0],
+					&sampling->next_timestamp,
+					&sampling->next_timespec)) < 0) {
+		baton->error = sts;
+		continue;
+	    } else if (use_next_sample(sampling) == 1) {
+		goto next_sample;
+	    }
+	}
+
+	sample = &set->series_sample[set->num_samples++];
+	series_instance_set_alloc(sample, reply->elements / 2);
+	if (sample->series_instance == NULL || sample->values == NULL)
+	    return -ENOMEM;
+	if ((sts = series_instance_store_to_node(baton, series, &sampling->value,
+				reply->elements, reply->element, sample)) < 0)
+	    return sts;
+
+	/* check whether a user-requested sample count has been reached */
+	if (tp->count && ++sampling->count >= tp->count)
+	    return 1;
+
+	if (sampling->subsampling == 0)
+	    continue;
+next_sample:
+	/* carefully swap time strings to avoid leaking memory */
+	save_timestamp = sampling->next_timestamp;
+	sampling->next_timestamp = sampling->value.timestamp;
+	sampling->value.timestamp = save_timestamp;
+	sampling->value.ts = sampling->next_timespec;
+    }
+    return 0;
+}
+
+/* a sample set for one page of the current series, after any kept samples */
+static series_sample_set_t *
+series_stream_page(seriesStream *sp, unsigned int nsamples)
+{
+    series_sample_set_t	*set, *sp_set = &sp->sets[sp->current];
+    unsigned int	i;
+
+    if ((set = calloc(1, sizeof(series_sample_set_t))) == NULL)
+	return NULL;
+    if ((set->series_sample = calloc(sp->ncarried + nsamples + 1,
+				sizeof(series_instance_set_t))) == NULL ||
+	(set->sid = calloc(1, sizeof(seriesGetSID))) == NULL) {
+	free(set->series_sample);
+	free(set);
+	return NULL;
+    }
+    set->sid->name = sdsdup(sp_set->sid->name);
+    set->baton = sp_set->baton;
+    set->metric_name = sp_set->metric_name;
+    set->series_desc.indom = sdsdup(sp_set->series_desc.indom);
+    set->series_desc.pmid = sdsdup(sp_set->series_desc.pmid);
+    set->series_desc.semantics = sdsdup(sp_set->series_desc.semantics);
+    set->series_desc.source = sdsdup(sp_set->series_desc.source);
+    set->series_desc.type = sdsdup(sp_set->series_desc.type);
+    set->series_desc.units = sdsdup(sp_set->series_desc.units);
+
+    for (i = 0; i < sp->ncarried; i++) {
+	set->series_sample[i] = sp->carry[i];
+	memset(&sp->carry[i], 0, sizeof(series_instance_set_t));
+    }
+    set->num_samples = sp->ncarried;
+    sp->ncarried = 0;
+    return set;
+}
+
+/* keep copies of the last samples of a page, to start the next page */
+static void
+series_stream_carry(seriesStream *sp, series_sample_set_t *set)
+{
+    series_instance_set_t	*src, *dst;
+    pmSeriesValue		*vp;
+    unsigned int		i, k, n;
+
+    n = sp->ncarry < set->num_samples ? sp->ncarry : set->num_samples;
+    for (i = 0; i < n; i++) {
+	src = &set->series_sample[set->num_samples - n + i];
+	dst = &sp->carry[i];
+	series_instance_set_alloc(dst, src->num_instances);
+	for (k = 0; k < src->num_instances; k++) {
+	    vp = &src->series_instance[k];
+	    dst->series_instance[k].ts = vp->ts;
+	    dst->series_instance[k].series = vp->series ? sdsdup(vp->series) : NULL;
+	    dst->series_instance[k].data = vp->data ? sdsdup(vp->data) : NULL;
+	}
+    }
+    sp->ncarried = n;
+}
+
+/* evaluate and report one page of samples, then release it */
+static void
+series_stream_evaluate(seriesQueryBaton *baton, series_sample_set_t *set)
+{
+    seriesStream	*sp = baton->stream;
+    node_t		*np, *root = baton->query.root;
+    int			i;
+
+    series_values_decode(set);
+    series_stream_carry(sp, set);
+
+    sp->leaf->value_set.num_series = 1;
+    sp->leaf->value_set.series_values = set;
+    if (series_calculate(root, 0, baton) != 0) {
+	/* store the canonical expression once, name later pages the same */
+	if (!sp->hashed) {
+	    series_redis_hash_expression(baton, sp->hashbuf, sizeof(sp->hashbuf));
+	    sp->hashed = 1;
+	} else {
+	    for (i = 0; i < root->value_set.num_series; i++) {
+		sdsfree(root->value_set.series_values[i].sid->name);
+		root->value_set.series_values[i].sid->name = sdsnew(sp->hashbuf);
+	    }
 	}
-	sdsfree(key);
-	np->value_set.series_values[i].baton = baton;
-	np->value_set.series_values[i].sid = sid;
-	/* Note: np->series_set.num_series is not equal to nseries in this function */
-	redisSlotsRequest(baton->slots, cmd,
-				series_node_prepare_time_reply, np);
-	sdsfree(cmd);
-	
     }
-    sdsfree(start);
-    sdsfree(end);
+    series_node_values_report(baton, root);
+
+    /* release the page, function nodes may share their input values */
+    for (np = root; np != sp->leaf; np = np->left) {
+	if (skip_free_value_set(np) != 0)
+	    series_value_set_free(&np->value_set);
+	else
+	    memset(&np->value_set, 0, sizeof(np->value_set));
+    }
+    series_value_set_free(&sp->leaf->value_set);
 }
 
-/* 
- * When we encounter a data node (i.e. np->result.nseries!=0),
- * query Redis for actual values and store them into this node
- * because time series identifier will always be described in
- * the top node of a subtree at the parser tree's bottom. 
- */
-static int
-series_process_func(seriesQueryBaton *baton, node_t *np, int level)
+static void
+series_stream_reply(redisClusterAsyncContext *c, void *r, void *arg)
 {
-    int		sts, nelements = 0;
+    seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
+    seriesStream	*sp = baton->stream;
+    series_value_set_t	page = {0};
+    series_sample_set_t	*set;
+    seriesEntries	entries;
+    redisReply		*reply = r, *entry;
+    unsigned int	nsamples, more = 0;
+    int			sts;
+    sds			msg;
 
-    if (np == NULL)
-	return 0;
+    seriesBatonCheckMagic(baton, MAGIC_QUERY, "series_stream_reply");
 
-    if ((nelements = np->result.nseries) != 0) {
-	np->value_set.num_series = 0;
-	np->baton = baton;
-	series_node_prepare_time(baton, &np->result, np);
-	return baton->error;
+    if (UNLIKELY(reply == NULL || reply->type != REDIS_REPLY_ARRAY)) {
+	infofmt(msg, "expected array from %s XSTREAM values (type=%s)",
+		sp->sets[sp->current].sid->name, redis_reply_type(reply));
+	batoninfo(baton, PMLOG_RESPONSE, msg);
+	baton->error = -EPROTO;
+    } else {
+	if (sp->leaf->rollup)
+	    series_rollup_values(reply->elements, reply->element);
+
+	/* a full page - hold back its last entry, the next page starts there */
+	nsamples = reply->elements;
+	if (nsamples == sp->requested && !sp->final) {
+	    entry = reply->element[nsamples - 1];
+	    if (entry->elements > 0 && entry->element[0]->type == REDIS_REPLY_STRING) {
+		sp->start = sdscpylen(sp->start, entry->element[0]->str,
+					entry->element[0]->len);
+		nsamples--;
+		more = 1;
+	    }
+	}
+
+	/* samples of compact entries are selected as separate entries */
+	if ((sts = series_values_expand(baton, sp->sets[sp->current].sid->name,
+				&sp->leaf->time, sp->leaf->rollup, sp->reverse,
+				nsamples, reply->elements, reply->element,
+				&entries)) < 0) {
+	    baton->error = sts;
+	} else if ((set = series_stream_page(sp, entries.nselected)) == NULL) {
+	    baton->error = -ENOMEM;
+	} else {
+	    if ((sts = series_stream_store(baton, set, entries.nselected,
+				entries.nelements, entries.elements)) != 0) {
+		if (sts < 0)
+		    baton->error = sts;
+		more = 0;
+	    }
+	    /*
+	     * Evaluate once there are more samples than rate() consumes,
+	     * and every series at least once - else keep them for later.
+	     */
+	    if (baton->error == 0 &&
+		(set->num_samples > sp->ncarry || (!more && !sp->evaluated))) {
+		series_stream_evaluate(baton, set);
+		sp->evaluated++;
+	    } else {
+		if (more)
+		    series_stream_carry(sp, set);
+		page.num_series = 1;
+		page.series_values = set;
+		series_value_set_free(&page);
+	    }
+	}
+	series_entries_free(&entries, reply->element);
     }
 
-    if ((sts = series_process_func(baton, np->left, level+1)) < 0)
-	return sts;
-    return series_process_func(baton, np->right, level+1);
+    if (baton->error == 0) {
+	if (more)
+	    series_stream_request(baton);
+	else if (++sp->current < sp->nseries)
+	    series_stream_series(baton);
+    }
+    series_query_end_phase(baton);
 }
 
 static sds
@@ -2591,23 +3473,213 @@ series_function_hash(unsigned char *hash, node_t *np, int idx)
 }
 
 /*
- * Report a timeseries result - timestamps and (instance) values from a node
+ * Decode stored sample values into the typed values column, once the
+ * descriptor is known.  Floating point values are held as doubles, as
+ * Redis holds both float and double values in "%e" form - values are
+ * passed through in that original form until a function changes them.
+ */
+static void
+series_values_decode(series_sample_set_t *set)
+{
+    series_instance_set_t	*sp;
+    int				type, j, k;
+
+    type = series_extract_type(set->series_desc.type);
+    if (type == PM_TYPE_FLOAT || type == PM_TYPE_UNKNOWN)
+	type = PM_TYPE_DOUBLE;
+    set->type = type;
+    set->format = SERIES_FORMAT_TEXT;
+
+    for (j = 0; j < set->num_samples; j++) {
+	sp = &set->series_sample[j];
+	for (k = 0; k < sp->num_instances; k++) {
+	    if (sp->series_instance[k].data != NULL)
+		series_extract_value(type, sp->series_instance[k].data, &sp->values[k]);
+	}
+    }
+}
+
+static double
+series_value_double(int type, pmAtomValue *val)
+{
+    switch (type) {
+    case PM_TYPE_32:
+	return val->l;
+    case PM_TYPE_U32:
+	return val->ul;
+    case PM_TYPE_64:
+	return val->ll;
+    case PM_TYPE_U64:
+	return val->ull;
+    case PM_TYPE_FLOAT:
+	return val->f;
+    case PM_TYPE_DOUBLE:
+	return val->d;
+    default:
+	break;
+    }
+    return 0.0;
+}
+
+static void
+series_value_convert(int itype, pmAtomValue *ival, int otype, pmAtomValue *oval)
+{
+    __int64_t	ll;
+    __uint64_t	ull;
+    double	d;
+
+    if (itype == otype) {
+	*oval = *ival;
+	return;
+    }
+
+    d = series_value_double(itype, ival);
+    switch (itype) {
+    case PM_TYPE_32:
+	ull = ll = ival->l;
+	break;
+    case PM_TYPE_U32:
+	ll = ull = ival->ul;
+	break;
+    case PM_TYPE_64:
+	ull = ll = ival->ll;
+	break;
+    case PM_TYPE_U64:
+	ll = ull = ival->ull;
+	break;
+    default:
+	ll = (__int64_t)d;
+	ull = (__uint64_t)ll;
+	break;
+    }
+
+    switch (otype) {
+    case PM_TYPE_32:
+	oval->l = (__int32_t)ll;
+	break;
+    case PM_TYPE_U32:
+	oval->ul = (__uint32_t)ull;
+	break;
+    case PM_TYPE_64:
+	oval->ll = ll;
+	break;
+    case PM_TYPE_U64:
+	oval->ull = ull;
+	break;
+    case PM_TYPE_FLOAT:
+	oval->f = (float)d;
+	break;
+    default:
+	oval->d = d;
+	break;
+    }
+}
+
+/* mark one value of a sample as having failed a calculation */
+static void
+series_value_novalue(series_instance_set_t *sp, int k)
+{
+    if (sp->novalue == NULL &&
+	(sp->novalue = calloc(sp->num_instances, sizeof(unsigned char))) == NULL)
+	return;
+    sp->novalue[k] = 1;
+}
+
+/*
+ * Pass one value through from the input set into a function result
+ * set - the series and data strings are shared with the input set.
+ */
+static void
+series_value_copy(series_instance_set_t *dst, int l,
+		series_instance_set_t *src, int k)
+{
+    dst->series_instance[l] = src->series_instance[k];
+    dst->values[l] = src->values[k];
+    if (src->novalue && src->novalue[k])
+	series_value_novalue(dst, l);
+}
+
+/*
+ * Allocate the instances (and values column) of one result sample
+ */
+static void
+series_instance_set_alloc(series_instance_set_t *sp, int ninstances)
+{
+    sp->num_instances = ninstances;
+    sp->series_instance = (pmSeriesValue *)calloc(ninstances, sizeof(pmSeriesValue));
+    sp->values = (pmAtomValue *)calloc(ninstances, sizeof(pmAtomValue));
+}
+
+/* value of instance k in sample j of a sample set, as a double */
+static inline double
+series_sample_double(series_sample_set_t *set, int j, int k)
+{
+    return series_value_double(set->type, &set->series_sample[j].values[k]);
+}
+
+/*
+ * Report a timeseries result - timestamps and (instance) values from a node.
+ * Function results are held in typed value columns, converted to text here.
  */
 static void
 series_node_values_report(seriesQueryBaton *baton, node_t *np)
 {
-    sds		series;
-    int		i, j, k;
+    series_sample_set_t		*set;
+    series_instance_set_t	*sp;
+    pmSeriesValue		value, *vp;
+    __uint64_t			millipart, fractions;
+    sds				series, timestamp, data, empty;
+    char			str[256];
+    int				i, j, k, len;
+
+    timestamp = sdsempty();
+    data = sdsempty();
+    empty = sdsempty();
 
     for (i = 0; i < np->value_set.num_series; i++) {
-	series = np->value_set.series_values[i].sid->name;
-	for (j = 0; j < np->value_set.series_values[i].num_samples; j++) {
-	    for (k = 0; k < np->value_set.series_values[i].series_sample[j].num_instances; k++) {
-		pmSeriesValue value = np->value_set.series_values[i].series_sample[j].series_instance[k];
+	set = &np->value_set.series_values[i];
+	series = set->sid->name;
+	for (j = 0; j < set->num_samples; j++) {
+	    sp = &set->series_sample[j];
+	    for (k = 0; k < sp->num_instances; k++) {
+		vp = &sp->series_instance[k];
+
+		/* stream timestamp, as in extract_time() */
+		millipart = (__uint64_t)vp->ts.tv_sec * 1000;
+		millipart += vp->ts.tv_nsec / 1000000;
+		fractions = vp->ts.tv_nsec % 1000000 / 1000;
+		sdsclear(timestamp);
+		timestamp = sdscatfmt(timestamp, "%U.%U",
+				(unsigned long long)millipart,
+				(unsigned long long)fractions);
+
+		if (sp->novalue && sp->novalue[k])
+		    len = 0;
+		else if (set->format == SERIES_FORMAT_RATE)
+		    len = pmsprintf(str, sizeof(str), "%.6lf",
+				series_value_double(set->type, &sp->values[k]));
+		else if (set->format == SERIES_FORMAT_ATOM)
+		    len = series_pmAtomValue_conv_str(set->type, str,
+				&sp->values[k], sizeof(str));
+		else
+		    len = -1;	/* stored text */
+
+		if (len < 0)
+		    value.data = vp->data ? vp->data : empty;
+		else if (len == 0)
+		    value.data = data = sdscpylen(data, "no value", 8);
+		else
+		    value.data = data = sdscpylen(data, str, len);
+		value.timestamp = timestamp;
+		value.series = vp->series ? vp->series : empty;
+		value.ts = vp->ts;
 		baton->callbacks->on_value(series, &value, baton->userdata);
 	    }
 	}
     }
+    sdsfree(timestamp);
+    sdsfree(data);
+    sdsfree(empty);
 }
 
 static int
@@ -2627,68 +3699,63 @@ static void
 series_calculate_rate(node_t *np, void *arg)
 {
     seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
-    pmSeriesValue	s_pmval, t_pmval;
+    series_sample_set_t	*set;
+    series_instance_set_t *s_set, *t_set;
+    pmSeriesValue	*s_pmval, *t_pmval;
     unsigned int	n_instances, n_samples, i, j, k;
     double		s_data, t_data, mult;
-    char		str[256];
     sds			msg, expr;
-    int			sts;
+    int			sts, type;
     pmUnits		units = {0};
 
     np->value_set = np->left->value_set;
     for (i = 0; i < np->value_set.num_series; i++) {
-	n_samples = np->value_set.series_values[i].num_samples;
-	if (series_rate_check(np->value_set.series_values[i].series_desc) == 0) {
-	    n_instances = (n_samples == 0) ? 0 :
-		np->value_set.series_values[i].series_sample[0].num_instances;
+	set = &np->value_set.series_values[i];
+	n_samples = set->num_samples;
+	type = set->type;
+	if (series_rate_check(set->series_desc) == 0) {
+	    n_instances = (n_samples == 0) ? 0 : set->series_sample[0].num_instances;
 	    for (j = 1; j < n_samples; j++) {
-		if (np->value_set.series_values[i].series_sample[j].num_instances != n_instances) {
+		if (set->series_sample[j].num_instances != n_instances) {
 		    if (pmDebugOptions.query && pmDebugOptions.desperate)
 			fprintf(stderr, "Error: number of instances in each sample are not equal %d != %d.\n",
-				np->value_set.series_values[i].series_sample[j].num_instances, n_instances);
+				set->series_sample[j].num_instances, n_instances);
 		    continue;
 		}
+		t_set = &set->series_sample[j-1];
+		s_set = &set->series_sample[j];
 		for (k = 0; k < n_instances; k++) {
-		    t_pmval = np->value_set.series_values[i].series_sample[j-1].series_instance[k];
-		    s_pmval = np->value_set.series_values[i].series_sample[j].series_instance[k];
-		    if (strcmp(s_pmval.series, t_pmval.series) != 0) {
+		    t_pmval = &t_set->series_instance[k];
+		    s_pmval = &s_set->series_instance[k];
+		    if (strcmp(s_pmval->series, t_pmval->series) != 0) {
 			/* TODO: two SIDs of the instances' names between samples are different, report error. */
 			if (pmDebugOptions.query) {
 			    fprintf(stderr, "TODO: two SIDs of the instances' names between samples are different, report error.");
-			    fprintf(stderr, "%s %s\n", s_pmval.series, t_pmval.series);
+			    fprintf(stderr, "%s %s\n", s_pmval->series, t_pmval->series);
 			}
 		    }
 
 		    /* compute rate/sec from delta value and delta timestamp */
-		    s_data = strtod(s_pmval.data, NULL);
-		    t_data = strtod(t_pmval.data, NULL);
-		    pmsprintf(str, sizeof(str), "%.6lf", (t_data - s_data) / pmTimespec_delta(&t_pmval.ts, &s_pmval.ts));
-
-		    sdsfree(np->value_set.series_values[i].series_sample[j-1].series_instance[k].data);
-		    sdsfree(np->value_set.series_values[i].series_sample[j-1].series_instance[k].timestamp);
-		    np->value_set.series_values[i].series_sample[j-1].series_instance[k].data = sdsnew(str);
-		    np->value_set.series_values[i].series_sample[j-1].series_instance[k].timestamp =
-		    	sdsnew(np->value_set.series_values[i].series_sample[j].series_instance[k].timestamp);
-		    np->value_set.series_values[i].series_sample[j-1].series_instance[k].ts =
-		    	np->value_set.series_values[i].series_sample[j].series_instance[k].ts;
+		    s_data = series_value_double(type, &s_set->values[k]);
+		    t_data = series_value_double(type, &t_set->values[k]);
+		    t_set->values[k].d = (t_data - s_data) / pmTimespec_delta(&t_pmval->ts, &s_pmval->ts);
+		    t_pmval->ts = s_pmval->ts;
 		}
 		if (j == n_samples-1) {
 		    /* Free the last sample */
-		    for (k = 0; k < n_instances; k++) {
-			sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].timestamp);
-			sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].series);
-			sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].data);
-		    }
-		    np->value_set.series_values[i].num_samples -= 1;
+		    series_instance_set_free(s_set, !set->shared);
+		    set->num_samples -= 1;
 		}
 	    }
+	    set->type = PM_TYPE_DOUBLE;
+	    set->format = SERIES_FORMAT_RATE;
 	} else {
 	    expr = series_expr_canonical(np->left, i);
 	    infofmt(msg, "Can't rate convert '%s', counter semantics required\n", expr);
 	    sdsfree(expr);
 	    batoninfo(baton, PMLOG_ERROR, msg);
 	    baton->error = -EPROTO;
-	    np->value_set.series_values[i].num_samples = -n_samples;
+	    set->num_samples = -n_samples;
 	}
 	sdsfree(np->value_set.series_values[i].series_desc.type);
 	sdsfree(np->value_set.series_values[i].series_desc.semantics);
@@ -2717,7 +3784,6 @@ series_calculate_time_domain_max(node_t *np, void *arg)
     double		max_data, data;
     int			max_pointer;
     sds			msg;
-    pmSeriesValue	inst;
 
     n_series = np->left->value_set.num_series;
     np->value_set.num_series = n_series;
@@ -2730,11 +3796,10 @@ series_calculate_time_domain_max(node_t *np, void *arg)
 	    n_instances = np->left->value_set.series_values[i].series_sample[0].num_instances;
 
 	    for (j = 0; j < n_samples; j++) {
-		np->value_set.series_values[i].series_sample[j].num_instances = 1;
-		np->value_set.series_values[i].series_sample[j].series_instance = (pmSeriesValue *)calloc(1, sizeof(pmSeriesValue));
+		series_instance_set_alloc(&np->value_set.series_values[i].series_sample[j], 1);
 
 		max_pointer = 0;
-		max_data = atof(np->left->value_set.series_values[i].series_sample[j].series_instance[0].data);
+		max_data = series_sample_double(&np->left->value_set.series_values[i], j, 0);
 		for (k = 1; k < n_instances; k++) {
 		    if (np->left->value_set.series_values[i].series_sample[j].num_instances != n_instances) {
 			if (pmDebugOptions.query && pmDebugOptions.desperate) {
@@ -2743,18 +3808,14 @@ series_calculate_time_domain_max(node_t *np, void *arg)
 			}
 			continue;
 		    }                
-		    data = atof(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data);
+		    data = series_sample_double(&np->left->value_set.series_values[i], j, k);
 		    if (max_data < data) {
 			max_data = data;
 			max_pointer = k;
 		    }
 		}
-		inst = np->left->value_set.series_values[i].series_sample[j].series_instance[max_pointer];
-
-		np->value_set.series_values[i].series_sample[j].series_instance[0].timestamp = sdsnew(inst.timestamp);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].series = sdsnew(inst.series);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].data = sdsnew(inst.data);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].ts = inst.ts;
+		series_value_copy(&np->value_set.series_values[i].series_sample[j], 0,
+				&np->left->value_set.series_values[i].series_sample[j], max_pointer);
 	    }
         } else {
 	    np->value_set.series_values[i].num_samples = 0;
@@ -2762,6 +3823,9 @@ series_calculate_time_domain_max(node_t *np, void *arg)
 	np->value_set.series_values[i].sid = (seriesGetSID *)calloc(1, sizeof(seriesGetSID));
 	np->value_set.series_values[i].sid->name = sdsnew(np->left->value_set.series_values[i].sid->name);
 	np->value_set.series_values[i].baton = np->left->value_set.series_values[i].baton;
+	np->value_set.series_values[i].type = np->left->value_set.series_values[i].type;
+	np->value_set.series_values[i].format = np->left->value_set.series_values[i].format;
+	np->value_set.series_values[i].shared = 1;
 	np->value_set.series_values[i].series_desc.indom = sdsnew(np->left->value_set.series_values[i].series_desc.indom);
 	np->value_set.series_values[i].series_desc.pmid = sdsnew(np->left->value_set.series_values[i].series_desc.pmid);
 	np->value_set.series_values[i].series_desc.semantics = sdsnew(np->left->value_set.series_values[i].series_desc.semantics);
@@ -2792,11 +3856,10 @@ series_calculate_max(node_t *np, void *arg)
 	    np->value_set.series_values[i].num_samples = 1;
 	    np->value_set.series_values[i].series_sample = (series_instance_set_t *)calloc(1, sizeof(series_instance_set_t));
 	    n_instances = np->left->value_set.series_values[i].series_sample[0].num_instances;
-	    np->value_set.series_values[i].series_sample[0].num_instances = n_instances;
-	    np->value_set.series_values[i].series_sample[0].series_instance = (pmSeriesValue *)calloc(n_instances, sizeof(pmSeriesValue));
+	    series_instance_set_alloc(&np->value_set.series_values[i].series_sample[0], n_instances);
 	    for (k = 0; k < n_instances; k++) {
 		max_pointer = 0;
-		max_data = atof(np->left->value_set.series_values[i].series_sample[0].series_instance[k].data);
+		max_data = series_sample_double(&np->left->value_set.series_values[i], 0, k);
 		for (j = 1; j < n_samples; j++) {
 		    if (np->left->value_set.series_values[i].series_sample[j].num_instances != n_instances) {
 			if (pmDebugOptions.query && pmDebugOptions.desperate) {
@@ -2805,20 +3868,14 @@ series_calculate_max(node_t *np, void *arg)
 			}
 			continue;
 		    }
-		    data = atof(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data);
+		    data = series_sample_double(&np->left->value_set.series_values[i], j, k);
 		    if (max_data < data) {
 			max_data = data;
 			max_pointer = j;
 		    }
 		}
-		np->value_set.series_values[i].series_sample[0].series_instance[k].timestamp = 
-			sdsnew(np->left->value_set.series_values[i].series_sample[max_pointer].series_instance[k].timestamp);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].series = 
-			sdsnew(np->left->value_set.series_values[i].series_sample[max_pointer].series_instance[k].series);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].data = 
-			sdsnew(np->left->value_set.series_values[i].series_sample[max_pointer].series_instance[k].data);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].ts = 
-			np->left->value_set.series_values[i].series_sample[max_pointer].series_instance[k].ts;
+		series_value_copy(&np->value_set.series_values[i].series_sample[0], k,
+				&np->left->value_set.series_values[i].series_sample[max_pointer], k);
 	    }
 	} else {
 	    np->value_set.series_values[i].num_samples = 0;
@@ -2826,6 +3883,9 @@ series_calculate_max(node_t *np, void *arg)
 	np->value_set.series_values[i].sid = (seriesGetSID *)calloc(1, sizeof(seriesGetSID));
 	np->value_set.series_values[i].sid->name = sdsnew(np->left->value_set.series_values[i].sid->name);
 	np->value_set.series_values[i].baton = np->left->value_set.series_values[i].baton;
+	np->value_set.series_values[i].type = np->left->value_set.series_values[i].type;
+	np->value_set.series_values[i].format = np->left->value_set.series_values[i].format;
+	np->value_set.series_values[i].shared = 1;
 	np->value_set.series_values[i].series_desc.indom = sdsnew(np->left->value_set.series_values[i].series_desc.indom);
 	np->value_set.series_values[i].series_desc.pmid = sdsnew(np->left->value_set.series_values[i].series_desc.pmid);
 	np->value_set.series_values[i].series_desc.semantics = sdsnew(np->left->value_set.series_values[i].series_desc.semantics);
@@ -2846,7 +3906,6 @@ series_calculate_time_domain_min(node_t *np, void *arg)
     double		min_data, data;
     int			min_pointer;
     sds			msg;
-    pmSeriesValue	inst;
 
     n_series = np->left->value_set.num_series;
     np->value_set.num_series = n_series;
@@ -2859,11 +3918,10 @@ series_calculate_time_domain_min(node_t *np, void *arg)
 	    n_instances = np->left->value_set.series_values[i].series_sample[0].num_instances;
 
 	    for (j = 0; j < n_samples; j++) {
-		np->value_set.series_values[i].series_sample[j].num_instances = 1;
-		np->value_set.series_values[i].series_sample[j].series_instance = (pmSeriesValue *)calloc(1, sizeof(pmSeriesValue));
+		series_instance_set_alloc(&np->value_set.series_values[i].series_sample[j], 1);
 
 		min_pointer = 0;
-		min_data = atof(np->left->value_set.series_values[i].series_sample[j].series_instance[0].data);
+		min_data = series_sample_double(&np->left->value_set.series_values[i], j, 0);
 		for (k = 1; k < n_instances; k++) {
 		    if (np->left->value_set.series_values[i].series_sample[j].num_instances != n_instances) {
 			if (pmDebugOptions.query && pmDebugOptions.desperate) {
@@ -2872,18 +3930,14 @@ series_calculate_time_domain_min(node_t *np, void *arg)
 			}
 			continue;
 		    }                
-		    data = atof(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data);
+		    data = series_sample_double(&np->left->value_set.series_values[i], j, k);
 		    if (min_data > data) {
 			min_data = data;
 			min_pointer = k;
 		    }
 		}
-		inst = np->left->value_set.series_values[i].series_sample[j].series_instance[min_pointer];
-
-		np->value_set.series_values[i].series_sample[j].series_instance[0].timestamp = sdsnew(inst.timestamp);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].series = sdsnew(inst.series);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].data = sdsnew(inst.data);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].ts = inst.ts;
+		series_value_copy(&np->value_set.series_values[i].series_sample[j], 0,
+				&np->left->value_set.series_values[i].series_sample[j], min_pointer);
 	    }
         } else {
 	    np->value_set.series_values[i].num_samples = 0;
@@ -2891,6 +3945,9 @@ series_calculate_time_domain_min(node_t *np, void *arg)
 	np->value_set.series_values[i].sid = (seriesGetSID *)calloc(1, sizeof(seriesGetSID));
 	np->value_set.series_values[i].sid->name = sdsnew(np->left->value_set.series_values[i].sid->name);
 	np->value_set.series_values[i].baton = np->left->value_set.series_values[i].baton;
+	np->value_set.series_values[i].type = np->left->value_set.series_values[i].type;
+	np->value_set.series_values[i].format = np->left->value_set.series_values[i].format;
+	np->value_set.series_values[i].shared = 1;
 	np->value_set.series_values[i].series_desc.indom = sdsnew(np->left->value_set.series_values[i].series_desc.indom);
 	np->value_set.series_values[i].series_desc.pmid = sdsnew(np->left->value_set.series_values[i].series_desc.pmid);
 	np->value_set.series_values[i].series_desc.semantics = sdsnew(np->left->value_set.series_values[i].series_desc.semantics);
@@ -2921,11 +3978,10 @@ series_calculate_min(node_t *np, void *arg)
 	    np->value_set.series_values[i].num_samples = 1;
 	    np->value_set.series_values[i].series_sample = (series_instance_set_t *)calloc(1, sizeof(series_instance_set_t));
 	    n_instances = np->left->value_set.series_values[i].series_sample[0].num_instances;
-	    np->value_set.series_values[i].series_sample[0].num_instances = n_instances;
-	    np->value_set.series_values[i].series_sample[0].series_instance = (pmSeriesValue *)calloc(n_instances, sizeof(pmSeriesValue));
+	    series_instance_set_alloc(&np->value_set.series_values[i].series_sample[0], n_instances);
 	    for (k = 0; k < n_instances; k++) {
 		min_pointer = 0;
-		min_data = atof(np->left->value_set.series_values[i].series_sample[0].series_instance[k].data);
+		min_data = series_sample_double(&np->left->value_set.series_values[i], 0, k);
 		for (j = 1; j < n_samples; j++) {
 		    if (np->left->value_set.series_values[i].series_sample[j].num_instances != n_instances) {
 			if (pmDebugOptions.query && pmDebugOptions.desperate) {
@@ -2934,20 +3990,14 @@ series_calculate_min(node_t *np, void *arg)
 			}
 			continue;
 		    }
-		    data = atof(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data);
+		    data = series_sample_double(&np->left->value_set.series_values[i], j, k);
 		    if (min_data > data) {
 			min_data = data;
 			min_pointer = j;
 		    }
 		}
-		np->value_set.series_values[i].series_sample[0].series_instance[k].timestamp = 
-			sdsnew(np->left->value_set.series_values[i].series_sample[min_pointer].series_instance[k].timestamp);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].series = 
-			sdsnew(np->left->value_set.series_values[i].series_sample[min_pointer].series_instance[k].series);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].data = 
-			sdsnew(np->left->value_set.series_values[i].series_sample[min_pointer].series_instance[k].data);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].ts = 
-			np->left->value_set.series_values[i].series_sample[min_pointer].series_instance[k].ts;
+		series_value_copy(&np->value_set.series_values[i].series_sample[0], k,
+				&np->left->value_set.series_values[i].series_sample[min_pointer], k);
 	    }
 	} else {
 	    np->value_set.series_values[i].num_samples = 0;
@@ -2955,6 +4005,9 @@ series_calculate_min(node_t *np, void *arg)
 	np->value_set.series_values[i].sid = (seriesGetSID *)calloc(1, sizeof(seriesGetSID));
 	np->value_set.series_values[i].sid->name = sdsnew(np->left->value_set.series_values[i].sid->name);
 	np->value_set.series_values[i].baton = np->left->value_set.series_values[i].baton;
+	np->value_set.series_values[i].type = np->left->value_set.series_values[i].type;
+	np->value_set.series_values[i].format = np->left->value_set.series_values[i].format;
+	np->value_set.series_values[i].shared = 1;
 	np->value_set.series_values[i].series_desc.indom = sdsnew(np->left->value_set.series_values[i].series_desc.indom);
 	np->value_set.series_values[i].series_desc.pmid = sdsnew(np->left->value_set.series_values[i].series_desc.pmid);
 	np->value_set.series_values[i].series_desc.semantics = sdsnew(np->left->value_set.series_values[i].series_desc.semantics);
@@ -2997,32 +4050,31 @@ series_extract_type(char *typeStr)
 static int
 series_extract_value(int type, sds str, pmAtomValue *oval) 
 {
-    int		sts;
+    char	*end;
 
     switch (type) {
     case PM_TYPE_32:
-	sts = sscanf(str, "%d", &oval->l);
+	oval->l = (__int32_t)strtol(str, &end, 10);
 	break;
     case PM_TYPE_U32:
-	sts = sscanf(str, "%u", &oval->ul);
+	oval->ul = (__uint32_t)strtoul(str, &end, 10);
 	break;
     case PM_TYPE_64:
-	sts = sscanf(str, "%" PRId64, &oval->ll);
+	oval->ll = strtoll(str, &end, 10);
 	break;
     case PM_TYPE_U64:
-	sts = sscanf(str, "%" PRIu64, &oval->ull);
+	oval->ull = strtoull(str, &end, 10);
 	break;
     case PM_TYPE_FLOAT:
-	sts = sscanf(str, "%f", &oval->f);
+	oval->f = strtof(str, &end);
 	break;
     case PM_TYPE_DOUBLE:
-	sts = sscanf(str, "%lf", &oval->d);
+	oval->d = strtod(str, &end);
 	break;
     default:
-	sts = 0;
-	break;
+	return PM_ERR_CONV;
     }
-    return (sts == 1) ? 0 : PM_ERR_CONV;
+    return (end == str) ? PM_ERR_CONV : 0;
 }
 
 static int
@@ -3066,9 +4118,9 @@ series_calculate_rescale(node_t *np, void *arg)
     seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
     double		mult;
     pmUnits		iunit;
-    char		*errmsg, str_val[256];
-    pmAtomValue		ival, oval;
-    int			type, sts, str_len, i, j, k;
+    char		*errmsg;
+    pmAtomValue		ival, *oval;
+    int			type, sts, i, j, k;
     sds			msg;
 
     np->value_set = np->left->value_set;
@@ -3096,24 +4148,18 @@ series_calculate_rescale(node_t *np, void *arg)
 	    np->value_set.series_values[i].num_samples = -np->value_set.series_values[i].num_samples;
 	    return;
 	}
-	type = PM_TYPE_DOUBLE;
+	type = np->value_set.series_values[i].type;
+	np->value_set.series_values[i].type = PM_TYPE_DOUBLE;
+	np->value_set.series_values[i].format = SERIES_FORMAT_ATOM;
 	for (j = 0; j < np->value_set.series_values[i].num_samples; j++) {
 	    for (k = 0; k < np->value_set.series_values[i].series_sample[j].num_instances; k++) {
-		if (series_extract_value(type, 
-			np->value_set.series_values[i].series_sample[j].series_instance[k].data, &ival) != 0 ) {
-		    /* TODO: error report for extracting values from string fail */
-		    fprintf(stderr, "Extract values from string fail\n");
-		    return;
-		}
-		if ((sts = pmConvScale(type, &ival, &iunit, &oval, &np->right->meta.units)) != 0) {
+		oval = &np->value_set.series_values[i].series_sample[j].values[k];
+		ival.d = series_value_double(type, oval);
+		if ((sts = pmConvScale(PM_TYPE_DOUBLE, &ival, &iunit, oval, &np->right->meta.units)) != 0) {
 		    /* TODO: rescale error report */
 		    fprintf(stderr, "rescale error\n");
 		    return;
 		}
-		if ((str_len = series_pmAtomValue_conv_str(type, str_val, &oval, sizeof(str_val))) == 0)
-		    return;
-		sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].data);
-		np->value_set.series_values[i].series_sample[j].series_instance[k].data = sdsnewlen(str_val, str_len);
 	    }
 	}
 	sdsfree(np->value_set.series_values[i].series_desc.units);
@@ -3159,9 +4205,8 @@ static void
 series_calculate_abs(node_t *np, void *arg)
 {
     seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
-    pmAtomValue		val;
-    int			type, sts, str_len, i, j, k;
-    char		str_val[256];
+    pmAtomValue		*val;
+    int			type, sts, i, j, k;
     sds			msg;
 
     np->value_set = np->left->value_set;
@@ -3172,26 +4217,19 @@ series_calculate_abs(node_t *np, void *arg)
 	    baton->error = -EPROTO;
 	    np->value_set.series_values[i].num_samples = -np->value_set.series_values[i].num_samples;
 	    return;
-	}	
+	}
+	type = np->value_set.series_values[i].type;
 	for (j = 0; j < np->value_set.series_values[i].num_samples; j++) {
 	    for (k = 0; k < np->value_set.series_values[i].series_sample[j].num_instances; k++) {
-		if (series_extract_value(type, 
-			np->value_set.series_values[i].series_sample[j].series_instance[k].data, &val) != 0 ) {
-		    /* TODO: error report for extracting values from string fail */
-		    fprintf(stderr, "Extract values from string fail\n");
-		    return;
-		}
-		if ((sts = series_abs_pmAtomValue(type, &val)) != 0) {
+		val = &np->value_set.series_values[i].series_sample[j].values[k];
+		if ((sts = series_abs_pmAtomValue(type, val)) != 0) {
 		    /* TODO: unsupported type */
 		    fprintf(stderr, "Unsupport type to take abs()\n");
 		    return;
 		}
-		if ((str_len = series_pmAtomValue_conv_str(type, str_val, &val, sizeof(str_val))) == 0)
-		    return;
-		sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].data);
-		np->value_set.series_values[i].series_sample[j].series_instance[k].data = sdsnewlen(str_val, str_len);
 	    }
 	}
+	np->value_set.series_values[i].format = SERIES_FORMAT_ATOM;
     }
 }
 
@@ -3204,7 +4242,6 @@ series_calculate_time_domain_topk(node_t *np, void *arg)
     seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
     unsigned int	n_series, n_samples, n_instances, i, j, k, l;
     sds			msg;
-    pmSeriesValue	inst;
     int			n, ind;
     double		data;
     double		*topk_data;
@@ -3227,8 +4264,7 @@ series_calculate_time_domain_topk(node_t *np, void *arg)
 		}
 		topk_data = (double*) calloc(n, sizeof(double));
 		topk_pointer = (int*) calloc(n, sizeof(int));
-		np->value_set.series_values[i].series_sample[j].num_instances = n;
-		np->value_set.series_values[i].series_sample[j].series_instance = (pmSeriesValue *)calloc(n, sizeof(pmSeriesValue));
+		series_instance_set_alloc(&np->value_set.series_values[i].series_sample[j], n);
 
 		for (k = 0; k < n_instances; k++){
 		    if (np->left->value_set.series_values[i].series_sample[j].num_instances != n_instances) {
@@ -3238,7 +4274,7 @@ series_calculate_time_domain_topk(node_t *np, void *arg)
 			}
 		    continue;
 		    }                
-		    data = strtod(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data, NULL);
+		    data = series_sample_double(&np->left->value_set.series_values[i], j, k);
 		    if (data > topk_data[n-1]){
 			for (l = 0; l < n; ++l){
 			    if (data > topk_data[l]){
@@ -3256,11 +4292,8 @@ series_calculate_time_domain_topk(node_t *np, void *arg)
 		}
 
 		for (l = 0; l < n; ++l){
-		    inst = np->left->value_set.series_values[i].series_sample[j].series_instance[topk_pointer[l]];
-		    np->value_set.series_values[i].series_sample[j].series_instance[l].timestamp = sdsnew(inst.timestamp);
-		    np->value_set.series_values[i].series_sample[j].series_instance[l].series = sdsnew(inst.series);
-		    np->value_set.series_values[i].series_sample[j].series_instance[l].data = sdsnew(inst.data);
-		    np->value_set.series_values[i].series_sample[j].series_instance[l].ts = inst.ts;       
+		    series_value_copy(&np->value_set.series_values[i].series_sample[j], l,
+				&np->left->value_set.series_values[i].series_sample[j], topk_pointer[l]);
 		}
 		free(topk_data);
 		free(topk_pointer);
@@ -3272,6 +4305,9 @@ series_calculate_time_domain_topk(node_t *np, void *arg)
 	np->value_set.series_values[i].sid = (seriesGetSID *)calloc(1, sizeof(seriesGetSID));
 	np->value_set.series_values[i].sid->name = sdsnew(np->left->value_set.series_values[i].sid->name);
 	np->value_set.series_values[i].baton = np->left->value_set.series_values[i].baton;
+	np->value_set.series_values[i].type = np->left->value_set.series_values[i].type;
+	np->value_set.series_values[i].format = np->left->value_set.series_values[i].format;
+	np->value_set.series_values[i].shared = 1;
 	np->value_set.series_values[i].series_desc.indom = sdsnew(np->left->value_set.series_values[i].series_desc.indom);
 	np->value_set.series_values[i].series_desc.pmid = sdsnew(np->left->value_set.series_values[i].series_desc.pmid);
 	np->value_set.series_values[i].series_desc.semantics = sdsnew("instance");
@@ -3294,7 +4330,6 @@ series_calculate_topk(node_t *np, void *arg)
     double		*topk_data;
     int			*topk_pointer;
     sds			msg;
-    pmSeriesValue	inst;
 
     n_series = np->left->value_set.num_series;
     np->value_set.num_series = n_series;
@@ -3312,8 +4347,7 @@ series_calculate_topk(node_t *np, void *arg)
 	    topk_data = (double*) calloc(n, sizeof(double));
 	    topk_pointer = (int*) calloc(n, sizeof(int));
 	    for (j = 0; j < n_instances; j++){
-		np->value_set.series_values[i].series_sample[j].num_instances = n;
-		np->value_set.series_values[i].series_sample[j].series_instance = (pmSeriesValue *)calloc(n, sizeof(pmSeriesValue));
+		series_instance_set_alloc(&np->value_set.series_values[i].series_sample[j], n);
 	    }
 	    for (k = 0; k < n_instances; k++) {
 		memset(topk_data, 0, sizeof(*topk_data));
@@ -3325,7 +4359,7 @@ series_calculate_topk(node_t *np, void *arg)
 			}
 			continue;
 		    }
-		    data = atof(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data);
+		    data = series_sample_double(&np->left->value_set.series_values[i], j, k);
 		    if (data > topk_data[n-1]){
 			for (l = 0; l < n; ++l){
 			    if (data > topk_data[l]){
@@ -3342,11 +4376,8 @@ series_calculate_topk(node_t *np, void *arg)
 		    }
 		}		
 		for (l = 0; l < n; ++l){
-		    inst = np->left->value_set.series_values[i].series_sample[topk_pointer[l]].series_instance[k];
-		    np->value_set.series_values[i].series_sample[k].series_instance[l].timestamp = sdsnew(inst.timestamp);
-		    np->value_set.series_values[i].series_sample[k].series_instance[l].series = sdsnew(inst.series);
-		    np->value_set.series_values[i].series_sample[k].series_instance[l].data = sdsnew(inst.data);
-		    np->value_set.series_values[i].series_sample[k].series_instance[l].ts = inst.ts;
+		    series_value_copy(&np->value_set.series_values[i].series_sample[k], l,
+				&np->left->value_set.series_values[i].series_sample[topk_pointer[l]], k);
 		}
 	    }
 	    free(topk_data);
@@ -3357,6 +4388,9 @@ series_calculate_topk(node_t *np, void *arg)
 	np->value_set.series_values[i].sid = (seriesGetSID *)calloc(1, sizeof(seriesGetSID));
 	np->value_set.series_values[i].sid->name = sdsnew(np->left->value_set.series_values[i].sid->name);
 	np->value_set.series_values[i].baton = np->left->value_set.series_values[i].baton;
+	np->value_set.series_values[i].type = np->left->value_set.series_values[i].type;
+	np->value_set.series_values[i].format = np->left->value_set.series_values[i].format;
+	np->value_set.series_values[i].shared = 1;
 	np->value_set.series_values[i].series_desc.indom = sdsnew(np->left->value_set.series_values[i].series_desc.indom);
 	np->value_set.series_values[i].series_desc.pmid = sdsnew(np->left->value_set.series_values[i].series_desc.pmid);
 	np->value_set.series_values[i].series_desc.semantics = sdsnew("instance");
@@ -3376,8 +4410,6 @@ series_calculate_time_domain_standard_deviation(node_t *np, void *arg)
     unsigned int	n_series, n_samples, n_instances, i, j, k;
     double		sum_data, mean, sd, data;
     sds			msg;
-    pmSeriesValue	inst;
-    char		stdev[64];
 
     n_series = np->left->value_set.num_series;
     np->value_set.num_series = n_series;
@@ -3390,8 +4422,7 @@ series_calculate_time_domain_standard_deviation(node_t *np, void *arg)
 	    n_instances = np->left->value_set.series_values[i].series_sample[0].num_instances;
 
 	    for (j = 0; j < n_samples; j++) {
-		np->value_set.series_values[i].series_sample[j].num_instances = 1;
-		np->value_set.series_values[i].series_sample[j].series_instance = (pmSeriesValue *)calloc(1, sizeof(pmSeriesValue));
+		series_instance_set_alloc(&np->value_set.series_values[i].series_sample[j], 1);
 		sum_data = 0.0;
 		for (k = 0; k < n_instances; k++) {
 		    if (np->left->value_set.series_values[i].series_sample[j].num_instances != n_instances) {
@@ -3401,23 +4432,20 @@ series_calculate_time_domain_standard_deviation(node_t *np, void *arg)
 			}
 		    continue;
 		    }
-		    data = strtod(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data, NULL);
+		    data = series_sample_double(&np->left->value_set.series_values[i], j, k);
 		    sum_data += data;
 		}
 
 		mean = sum_data/n_instances;
 		sd = 0.0;
 		for (k = 0; k < n_instances; k++) {
-		    data = strtod(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data, NULL);
+		    data = series_sample_double(&np->left->value_set.series_values[i], j, k);
 		    sd += pow(data - mean, 2);
 		}
 
-		pmsprintf(stdev, sizeof(stdev), "%le", sqrt(sd / n_instances));
-		inst = np->left->value_set.series_values[i].series_sample[j].series_instance[0];
-		np->value_set.series_values[i].series_sample[j].series_instance[0].timestamp = sdsnew(inst.timestamp);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].series = sdsnew(0);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].data = sdsnew(stdev);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].ts = inst.ts;
+		np->value_set.series_values[i].series_sample[j].values[0].d = sqrt(sd / n_instances);
+		np->value_set.series_values[i].series_sample[j].series_instance[0].ts =
+			np->left->value_set.series_values[i].series_sample[j].series_instance[0].ts;
 	    }
 	} else {
 	    np->value_set.series_values[i].num_samples = 0;
@@ -3425,6 +4453,9 @@ series_calculate_time_domain_standard_deviation(node_t *np, void *arg)
 	np->value_set.series_values[i].sid = (seriesGetSID *)calloc(1, sizeof(seriesGetSID));
 	np->value_set.series_values[i].sid->name = sdsnew(np->left->value_set.series_values[i].sid->name);
 	np->value_set.series_values[i].baton = np->left->value_set.series_values[i].baton;
+	np->value_set.series_values[i].type = PM_TYPE_DOUBLE;
+	np->value_set.series_values[i].format = SERIES_FORMAT_ATOM;
+	np->value_set.series_values[i].shared = 1;
 	np->value_set.series_values[i].series_desc.indom = sdsnew(np->left->value_set.series_values[i].series_desc.indom);
 	np->value_set.series_values[i].series_desc.pmid = sdsnew(np->left->value_set.series_values[i].series_desc.pmid);
 	np->value_set.series_values[i].series_desc.semantics = sdsnew("instance");
@@ -3443,9 +4474,7 @@ series_calculate_standard_deviation(node_t *np, void *arg)
     seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
     unsigned int	n_series, n_samples, n_instances, i, j, k;
     double		sum_data, data, sd, mean;
-    char		stdev[64];
     sds			msg;
-    pmSeriesValue       inst;
 
     n_series = np->left->value_set.num_series;
     np->value_set.num_series = n_series;
@@ -3456,8 +4485,7 @@ series_calculate_standard_deviation(node_t *np, void *arg)
 	    np->value_set.series_values[i].num_samples = 1;
 	    np->value_set.series_values[i].series_sample = (series_instance_set_t *)calloc(1, sizeof(series_instance_set_t));
 	    n_instances = np->left->value_set.series_values[i].series_sample[0].num_instances;
-	    np->value_set.series_values[i].series_sample[0].num_instances = n_instances;
-	    np->value_set.series_values[i].series_sample[0].series_instance = (pmSeriesValue *)calloc(n_instances, sizeof(pmSeriesValue));
+	    series_instance_set_alloc(&np->value_set.series_values[i].series_sample[0], n_instances);
 	    for (k = 0; k < n_instances; k++) {
 		sum_data = 0.0;
 		for (j = 0; j < n_samples; j++) {
@@ -3468,21 +4496,18 @@ series_calculate_standard_deviation(node_t *np, void *arg)
 			}
 			continue;
 		    }
-		    data = strtod(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data, NULL);
+		    data = series_sample_double(&np->left->value_set.series_values[i], j, k);
 		    sum_data += data;
 		}
 		mean = sum_data/n_samples;
 		sd = 0.0;
 		for (j = 0; j < n_samples; j++) {
-		    data = strtod(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data, NULL);
+		    data = series_sample_double(&np->left->value_set.series_values[i], j, k);
 		    sd += pow(data - mean, 2);
 		}
-		pmsprintf(stdev, sizeof(stdev), "%le", sqrt(sd / n_samples));
-		inst = np->left->value_set.series_values[i].series_sample[0].series_instance[k];
-		np->value_set.series_values[i].series_sample[0].series_instance[k].timestamp = sdsnew(inst.timestamp);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].series = sdsnew(inst.series);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].data = sdsnew(stdev);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].ts = inst.ts;
+		np->value_set.series_values[i].series_sample[0].values[k].d = sqrt(sd / n_samples);
+		np->value_set.series_values[i].series_sample[0].series_instance[k] =
+			np->left->value_set.series_values[i].series_sample[0].series_instance[k];
 	    }
 	} else {
 	    np->value_set.series_values[i].num_samples = 0;
@@ -3490,6 +4515,9 @@ series_calculate_standard_deviation(node_t *np, void *arg)
 	np->value_set.series_values[i].sid = (seriesGetSID *)calloc(1, sizeof(seriesGetSID));
 	np->value_set.series_values[i].sid->name = sdsnew(np->left->value_set.series_values[i].sid->name);
 	np->value_set.series_values[i].baton = np->left->value_set.series_values[i].baton;
+	np->value_set.series_values[i].type = PM_TYPE_DOUBLE;
+	np->value_set.series_values[i].format = SERIES_FORMAT_ATOM;
+	np->value_set.series_values[i].shared = 1;
 	np->value_set.series_values[i].series_desc.indom = sdsnew(np->left->value_set.series_values[i].series_desc.indom);
 	np->value_set.series_values[i].series_desc.pmid = sdsnew(np->left->value_set.series_values[i].series_desc.pmid);
 	np->value_set.series_values[i].series_desc.semantics = sdsnew("instance");
@@ -3510,7 +4538,6 @@ series_calculate_time_domain_nth_percentile(node_t *np, void *arg)
     int			n, instance_idx, rank, *n_pointer;
     double              *n_data, data, rank_d;
     sds			msg;
-    pmSeriesValue       inst;
 
     sscanf(np->right->value, "%d", &n);
     n_series = np->left->value_set.num_series;
@@ -3525,8 +4552,7 @@ series_calculate_time_domain_nth_percentile(node_t *np, void *arg)
 	    rank_d = ((double)n/100 * n_instances);
 	    rank = (int) rank_d;
 	    for (j = 0; j < n_samples; j++) {
-		np->value_set.series_values[i].series_sample[j].num_instances = 1;
-		np->value_set.series_values[i].series_sample[j].series_instance = (pmSeriesValue *)calloc(1, sizeof(pmSeriesValue));
+		series_instance_set_alloc(&np->value_set.series_values[i].series_sample[j], 1);
 		n_data = (double*) calloc(n_instances, sizeof(double));
 		n_pointer = (int*) calloc(n_instances, sizeof(int)); 
 
@@ -3538,7 +4564,7 @@ series_calculate_time_domain_nth_percentile(node_t *np, void *arg)
 			}
 			continue;
 		    }
-		    data = strtod(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data, NULL);
+		    data = series_sample_double(&np->left->value_set.series_values[i], j, k);
 		    for (l = 0; l < n_instances; ++l){
 			if (data > n_data[l]){
 			    for (m = n_instances - 1; m > l; --m){
@@ -3557,11 +4583,8 @@ series_calculate_time_domain_nth_percentile(node_t *np, void *arg)
 		} else {
 		    instance_idx = n_pointer[n_instances-1-rank];
 		}
-		inst = np->left->value_set.series_values[i].series_sample[j].series_instance[instance_idx];
-		np->value_set.series_values[i].series_sample[j].series_instance[0].timestamp = sdsnew(inst.timestamp);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].series = sdsnew(inst.series);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].data = sdsnew(inst.data);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].ts = inst.ts;
+		series_value_copy(&np->value_set.series_values[i].series_sample[j], 0,
+				&np->left->value_set.series_values[i].series_sample[j], instance_idx);
 		free(n_data);
 		free(n_pointer);
 	    }
@@ -3571,6 +4594,9 @@ series_calculate_time_domain_nth_percentile(node_t *np, void *arg)
 	np->value_set.series_values[i].sid = (seriesGetSID *)calloc(1, sizeof(seriesGetSID));
 	np->value_set.series_values[i].sid->name = sdsnew(np->left->value_set.series_values[i].sid->name);
 	np->value_set.series_values[i].baton = np->left->value_set.series_values[i].baton;
+	np->value_set.series_values[i].type = np->left->value_set.series_values[i].type;
+	np->value_set.series_values[i].format = np->left->value_set.series_values[i].format;
+	np->value_set.series_values[i].shared = 1;
 	np->value_set.series_values[i].series_desc.indom = sdsnew(np->left->value_set.series_values[i].series_desc.indom);
 	np->value_set.series_values[i].series_desc.pmid = sdsnew(np->left->value_set.series_values[i].series_desc.pmid);
 	np->value_set.series_values[i].series_desc.semantics = sdsnew(np->left->value_set.series_values[i].series_desc.semantics);
@@ -3591,7 +4617,6 @@ series_calculate_nth_percentile(node_t *np, void *arg)
     int			n, instance_idx, rank, *n_pointer;
     double              *n_data, data, rank_d;
     sds			msg;
-    pmSeriesValue       inst;
 
     sscanf(np->right->value, "%d", &n);
 
@@ -3604,8 +4629,7 @@ series_calculate_nth_percentile(node_t *np, void *arg)
 	    np->value_set.series_values[i].num_samples = 1;
 	    np->value_set.series_values[i].series_sample = (series_instance_set_t *)calloc(1, sizeof(series_instance_set_t));
 	    n_instances = np->left->value_set.series_values[i].series_sample[0].num_instances;
-	    np->value_set.series_values[i].series_sample[0].num_instances = n_instances;
-	    np->value_set.series_values[i].series_sample[0].series_instance = (pmSeriesValue *)calloc(n_instances, sizeof(pmSeriesValue));
+	    series_instance_set_alloc(&np->value_set.series_values[i].series_sample[0], n_instances);
 	    rank_d = ((double)n/100 * n_samples);
 	    rank = (int) rank_d;
 	    for (k = 0; k < n_instances; k++) {
@@ -3620,7 +4644,7 @@ series_calculate_nth_percentile(node_t *np, void *arg)
 			}
 			continue;
 		    }
-		    data = atof(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data);
+		    data = series_sample_double(&np->left->value_set.series_values[i], j, k);
 		    for (l = 0; l < n_samples; ++l){
 			if (data > n_data[l]) {
 			    for (m = n_samples - 1; m > l; --m){
@@ -3638,11 +4662,8 @@ series_calculate_nth_percentile(node_t *np, void *arg)
 		} else {
 		    instance_idx = n_pointer[n_samples-1-rank];
 		}
-		inst = np->left->value_set.series_values[i].series_sample[instance_idx].series_instance[k];
-		np->value_set.series_values[i].series_sample[0].series_instance[k].timestamp = sdsnew(inst.timestamp);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].series = sdsnew(inst.series);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].data = sdsnew(inst.data);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].ts = inst.ts;
+		series_value_copy(&np->value_set.series_values[i].series_sample[0], k,
+				&np->left->value_set.series_values[i].series_sample[instance_idx], k);
 		free(n_data);
 		free(n_pointer);
 	    }
@@ -3652,6 +4673,9 @@ series_calculate_nth_percentile(node_t *np, void *arg)
 	np->value_set.series_values[i].sid = (seriesGetSID *)calloc(1, sizeof(seriesGetSID));
 	np->value_set.series_values[i].sid->name = sdsnew(np->left->value_set.series_values[i].sid->name);
 	np->value_set.series_values[i].baton = np->left->value_set.series_values[i].baton;
+	np->value_set.series_values[i].type = np->left->value_set.series_values[i].type;
+	np->value_set.series_values[i].format = np->left->value_set.series_values[i].format;
+	np->value_set.series_values[i].shared = 1;
 	np->value_set.series_values[i].series_desc.indom = sdsnew(np->left->value_set.series_values[i].series_desc.indom);
 	np->value_set.series_values[i].series_desc.pmid = sdsnew(np->left->value_set.series_values[i].series_desc.pmid);
 	np->value_set.series_values[i].series_desc.semantics = sdsnew(np->left->value_set.series_values[i].series_desc.semantics);
@@ -3671,7 +4695,6 @@ series_calculate_time_domain_statistical(node_t *np, void *arg)
     nodetype_t		func = np->type;
     unsigned int	n_series, n_samples, n_instances, i, j, k;
     double		sum_data, data;
-    char		sum_data_str[64];
     sds			msg;
 
     assert(func == N_SUM_SAMPLE || func == N_AVG_SAMPLE);
@@ -3686,8 +4709,7 @@ series_calculate_time_domain_statistical(node_t *np, void *arg)
 	    np->value_set.series_values[i].series_sample = (series_instance_set_t *)calloc(n_samples, sizeof(series_instance_set_t));
 	    n_instances = np->left->value_set.series_values[i].series_sample[0].num_instances;
 	    for (j = 0; j < n_samples; j++) {
-		np->value_set.series_values[i].series_sample[j].num_instances = 1;
-		np->value_set.series_values[i].series_sample[j].series_instance = (pmSeriesValue *)calloc(1, sizeof(pmSeriesValue));
+		series_instance_set_alloc(&np->value_set.series_values[i].series_sample[j], 1);
 		
 		sum_data = 0.0;
 		for (k = 0; k < n_instances; k++) {
@@ -3698,28 +4720,22 @@ series_calculate_time_domain_statistical(node_t *np, void *arg)
 			}
 			continue;
 		    }
-		    data = strtod(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data, NULL);
+		    data = series_sample_double(&np->left->value_set.series_values[i], j, k);
 		    sum_data += data;
 		}
-		np->value_set.series_values[i].series_sample[j].series_instance[0].timestamp = 
-			sdsnew(np->left->value_set.series_values[i].series_sample[j].series_instance[0].timestamp);
-		np->value_set.series_values[i].series_sample[j].series_instance[0].series = 
-			sdsnew(0);
 		switch (func) {
 		case N_SUM_SAMPLE:
-		    pmsprintf(sum_data_str, sizeof(sum_data_str), "%le", sum_data);
 		    break;
 		case N_AVG_SAMPLE:
-		    pmsprintf(sum_data_str, sizeof(sum_data_str), "%le", sum_data / n_instances);
+		    sum_data /= n_instances;
 		    break;
 		default:
 		    /* .. TODO: standard deviation, variance, mode, median, etc */
-		    sum_data_str[0] = '\0';	/* for coverity */
 		    assert(0);
 		    break;
 		}
 
-		np->value_set.series_values[i].series_sample[j].series_instance[0].data = sdsnew(sum_data_str);
+		np->value_set.series_values[i].series_sample[j].values[0].d = sum_data;
 		np->value_set.series_values[i].series_sample[j].series_instance[0].ts = 
 		np->left->value_set.series_values[i].series_sample[j].series_instance[0].ts;
 	    }
@@ -3729,6 +4745,9 @@ series_calculate_time_domain_statistical(node_t *np, void *arg)
 	np->value_set.series_values[i].sid = (seriesGetSID *)calloc(1, sizeof(seriesGetSID));
 	np->value_set.series_values[i].sid->name = sdsnew(np->left->value_set.series_values[i].sid->name);
 	np->value_set.series_values[i].baton = np->left->value_set.series_values[i].baton;
+	np->value_set.series_values[i].type = PM_TYPE_DOUBLE;
+	np->value_set.series_values[i].format = SERIES_FORMAT_ATOM;
+	np->value_set.series_values[i].shared = 1;
 	np->value_set.series_values[i].series_desc.indom = sdsnew(np->left->value_set.series_values[i].series_desc.indom);
 	np->value_set.series_values[i].series_desc.pmid = sdsnew(np->left->value_set.series_values[i].series_desc.pmid);
 	np->value_set.series_values[i].series_desc.source = sdsnew(np->left->value_set.series_values[i].series_desc.source);
@@ -3753,7 +4772,6 @@ series_calculate_statistical(node_t *np, void *arg)
     nodetype_t		func = np->type;
     unsigned int	n_series, n_samples, n_instances, i, j, k;
     double		sum_data, data;
-    char		sum_data_str[64];
     sds			msg;
 
     assert(func == N_SUM || func == N_AVG || func == N_SUM_INST || func == N_AVG_INST);
@@ -3767,8 +4785,7 @@ series_calculate_statistical(node_t *np, void *arg)
 	    np->value_set.series_values[i].num_samples = 1;
 	    np->value_set.series_values[i].series_sample = (series_instance_set_t *)calloc(1, sizeof(series_instance_set_t));
 	    n_instances = np->left->value_set.series_values[i].series_sample[0].num_instances;
-	    np->value_set.series_values[i].series_sample[0].num_instances = n_instances;
-	    np->value_set.series_values[i].series_sample[0].series_instance = (pmSeriesValue *)calloc(n_instances, sizeof(pmSeriesValue));
+	    series_instance_set_alloc(&np->value_set.series_values[i].series_sample[0], n_instances);
 	    for (k = 0; k < n_instances; k++) {
 		sum_data = 0.0;
 		for (j = 0; j < n_samples; j++) {
@@ -3779,32 +4796,26 @@ series_calculate_statistical(node_t *np, void *arg)
 			}
 			continue;
 		    }
-		    data = strtod(np->left->value_set.series_values[i].series_sample[j].series_instance[k].data, NULL);
+		    data = series_sample_double(&np->left->value_set.series_values[i], j, k);
 		    sum_data += data;
 		}
-		np->value_set.series_values[i].series_sample[0].series_instance[k].timestamp = 
-			sdsnew(np->left->value_set.series_values[i].series_sample[0].series_instance[k].timestamp);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].series = 
-			sdsnew(np->left->value_set.series_values[i].series_sample[0].series_instance[k].series);
 		switch (func) {
 		case N_SUM:
 		case N_SUM_INST:
-		    pmsprintf(sum_data_str, sizeof(sum_data_str), "%le", sum_data);
 		    break;
 		case N_AVG:
 		case N_AVG_INST:
-		    pmsprintf(sum_data_str, sizeof(sum_data_str), "%le", sum_data / n_samples);
+		    sum_data /= n_samples;
 		    break;
 		default:
 		    /* .. TODO: standard deviation, variance, mode, median, etc */
-		    sum_data_str[0] = '\0';	/* for coverity */
 		    assert(0);
 		    break;
 		}
 
-		np->value_set.series_values[i].series_sample[0].series_instance[k].data = sdsnew(sum_data_str);
-		np->value_set.series_values[i].series_sample[0].series_instance[k].ts = 
-			np->left->value_set.series_values[i].series_sample[0].series_instance[k].ts;
+		np->value_set.series_values[i].series_sample[0].values[k].d = sum_data;
+		np->value_set.series_values[i].series_sample[0].series_instance[k] =
+			np->left->value_set.series_values[i].series_sample[0].series_instance[k];
 	    }
 	} else {
 	    np->value_set.series_values[i].num_samples = 0;
@@ -3812,6 +4823,9 @@ series_calculate_statistical(node_t *np, void *arg)
 	np->value_set.series_values[i].sid = (seriesGetSID *)calloc(1, sizeof(seriesGetSID));
 	np->value_set.series_values[i].sid->name = sdsnew(np->left->value_set.series_values[i].sid->name);
 	np->value_set.series_values[i].baton = np->left->value_set.series_values[i].baton;
+	np->value_set.series_values[i].type = PM_TYPE_DOUBLE;
+	np->value_set.series_values[i].format = SERIES_FORMAT_ATOM;
+	np->value_set.series_values[i].shared = 1;
 
 	np->value_set.series_values[i].series_desc.indom = sdsnew(np->left->value_set.series_values[i].series_desc.indom);
 	np->value_set.series_values[i].series_desc.pmid = sdsnew(np->left->value_set.series_values[i].series_desc.pmid);
@@ -3858,9 +4872,8 @@ static void
 series_calculate_floor(node_t *np, void *arg)
 {
     seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
-    pmAtomValue		val;
-    int			type, sts, str_len, i, j, k;
-    char		str_val[256];
+    pmAtomValue		*val;
+    int			type, sts, i, j, k;
     sds			msg;
 
     np->value_set = np->left->value_set;
@@ -3871,26 +4884,19 @@ series_calculate_floor(node_t *np, void *arg)
 	    baton->error = -EPROTO;
 	    np->value_set.series_values[i].num_samples = -np->value_set.series_values[i].num_samples;
 	    return;
-	}	
+	}
+	type = np->value_set.series_values[i].type;
 	for (j = 0; j < np->value_set.series_values[i].num_samples; j++) {
 	    for (k = 0; k < np->value_set.series_values[i].series_sample[j].num_instances; k++) {
-		if (series_extract_value(type, 
-			np->value_set.series_values[i].series_sample[j].series_instance[k].data, &val) != 0 ) {
-		    /* TODO: error report for extracting values from string fail */
-		    fprintf(stderr, "Extract values from string fail\n");
-		    return;
-		}
-		if ((sts = series_floor_pmAtomValue(type, &val)) != 0) {
+		val = &np->value_set.series_values[i].series_sample[j].values[k];
+		if ((sts = series_floor_pmAtomValue(type, val)) != 0) {
 		    /* TODO: unsupported type */
 		    fprintf(stderr, "Unsupport type to take abs()\n");
 		    return;
 		}
-		if ((str_len = series_pmAtomValue_conv_str(type, str_val, &val, sizeof(str_val))) == 0)
-		    return;
-		sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].data);
-		np->value_set.series_values[i].series_sample[j].series_instance[k].data = sdsnewlen(str_val, str_len);
 	    }
 	}
+	np->value_set.series_values[i].format = SERIES_FORMAT_ATOM;
     }
 }
 
@@ -3944,10 +4950,9 @@ series_calculate_log(node_t *np, void *arg)
 {
     seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
     double		base;
-    pmAtomValue		val;
+    pmAtomValue		*val;
     int			i, j, k, itype, otype=PM_TYPE_UNKNOWN;
-    int			sts, str_len, is_natural_log;
-    char		str_val[256];
+    int			sts, is_natural_log;
     sds			msg;
 
 
@@ -3966,25 +4971,19 @@ series_calculate_log(node_t *np, void *arg)
 	    np->value_set.series_values[i].num_samples = -np->value_set.series_values[i].num_samples;
 	    return;
 	}
+	itype = np->value_set.series_values[i].type;
 	for (j = 0; j < np->value_set.series_values[i].num_samples; j++) {
 	    for (k = 0; k < np->value_set.series_values[i].series_sample[j].num_instances; k++) {
-		if (series_extract_value(itype, 
-			np->value_set.series_values[i].series_sample[j].series_instance[k].data, &val) != 0 ) {
-		    /* TODO: error report for extracting values from string fail */
-		    fprintf(stderr, "Extract values from string fail\n");
-		    return;
-		}
-		if ((sts = series_log_pmAtomValue(itype, &otype, &val, is_natural_log, base)) != 0) {
+		val = &np->value_set.series_values[i].series_sample[j].values[k];
+		if ((sts = series_log_pmAtomValue(itype, &otype, val, is_natural_log, base)) != 0) {
 		    /* TODO: unsupported type */
 		    fprintf(stderr, "Unsupport type to take log()\n");
 		    return;
 		}
-		if ((str_len = series_pmAtomValue_conv_str(otype, str_val, &val, sizeof(str_val))) == 0)
-		    return;
-		sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].data);
-		np->value_set.series_values[i].series_sample[j].series_instance[k].data = sdsnewlen(str_val, str_len);
 	    }
 	}
+	np->value_set.series_values[i].type = PM_TYPE_DOUBLE;
+	np->value_set.series_values[i].format = SERIES_FORMAT_ATOM;
 	sdsfree(np->value_set.series_values[i].series_desc.type);
 	np->value_set.series_values[i].series_desc.type = sdsnew(pmTypeStr(otype));
     }
@@ -4023,6 +5022,7 @@ series_sqrt_pmAtomValue(int itype, int *otype, pmAtomValue *val)
 	val->d = sqrt(res);
 	break;
     case PM_TYPE_DOUBLE:
+	*otype = PM_TYPE_DOUBLE;
 	val->d = sqrt(val->d);
 	break;
     default:
@@ -4037,10 +5037,9 @@ static void
 series_calculate_sqrt(node_t *np, void *arg)
 {
     seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
-    pmAtomValue		val;
+    pmAtomValue		*val;
     int			i, j, k, itype, otype=PM_TYPE_UNKNOWN;
-    int			sts, str_len;
-    char		str_val[256];
+    int			sts;
     sds			msg;
 
     np->value_set = np->left->value_set;
@@ -4051,26 +5050,20 @@ series_calculate_sqrt(node_t *np, void *arg)
 	    baton->error = -EPROTO;
 	    np->value_set.series_values[i].num_samples = -np->value_set.series_values[i].num_samples;
 	    return;
-	}	
+	}
+	itype = np->value_set.series_values[i].type;
 	for (j = 0; j < np->value_set.series_values[i].num_samples; j++) {
 	    for (k = 0; k < np->value_set.series_values[i].series_sample[j].num_instances; k++) {
-		if (series_extract_value(itype, 
-			np->value_set.series_values[i].series_sample[j].series_instance[k].data, &val) != 0 ) {
-		    /* TODO: error report for extracting values from string fail */
-		    fprintf(stderr, "Extract values from string fail\n");
-		    return;
-		}
-		if ((sts = series_sqrt_pmAtomValue(itype, &otype, &val)) != 0) {
+		val = &np->value_set.series_values[i].series_sample[j].values[k];
+		if ((sts = series_sqrt_pmAtomValue(itype, &otype, val)) != 0) {
 		    /* TODO: unsupported type */
 		    fprintf(stderr, "Unsupport type to take sqrt()\n");
 		    return;
 		}
-		if ((str_len = series_pmAtomValue_conv_str(otype, str_val, &val, sizeof(str_val))) == 0)
-		    return;
-		sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].data);
-		np->value_set.series_values[i].series_sample[j].series_instance[k].data = sdsnewlen(str_val, str_len);
 	    }
 	}
+	np->value_set.series_values[i].type = PM_TYPE_DOUBLE;
+	np->value_set.series_values[i].format = SERIES_FORMAT_ATOM;
 	sdsfree(np->value_set.series_values[i].series_desc.type);
 	np->value_set.series_values[i].series_desc.type = sdsnew(pmTypeStr(otype));
     }
@@ -4092,7 +5085,7 @@ series_round_pmAtomValue(int type, pmAtomValue *val)
 	val->f = roundf(val->f);
 	break;
     case PM_TYPE_DOUBLE:
-	val->d = round(val->f);
+	val->d = round(val->d);
 	break;
     default:
 	/* Unsupported type */
@@ -4106,9 +5099,8 @@ static void
 series_calculate_round(node_t *np, void *arg)
 {
     seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
-    pmAtomValue		val;
-    int			i, j, k, type, sts, str_len;
-    char		str_val[256];
+    pmAtomValue		*val;
+    int			i, j, k, type, sts;
     sds			msg;
 
     np->value_set = np->left->value_set;
@@ -4120,25 +5112,18 @@ series_calculate_round(node_t *np, void *arg)
 	    np->value_set.series_values[i].num_samples = -np->value_set.series_values[i].num_samples;
 	    return;
 	}
+	type = np->value_set.series_values[i].type;
 	for (j = 0; j < np->value_set.series_values[i].num_samples; j++) {
 	    for (k = 0; k < np->value_set.series_values[i].series_sample[j].num_instances; k++) {
-		if (series_extract_value(type, 
-			np->value_set.series_values[i].series_sample[j].series_instance[k].data, &val) != 0 ) {
-		    /* TODO: error report for extracting values from string fail */
-		    fprintf(stderr, "Extract values from string fail\n");
-		    return;
-		}
-		if ((sts = series_round_pmAtomValue(type, &val)) != 0) {
+		val = &np->value_set.series_values[i].series_sample[j].values[k];
+		if ((sts = series_round_pmAtomValue(type, val)) != 0) {
 		    /* TODO: unsupported type */
 		    fprintf(stderr, "Unsupport type to take abs()\n");
 		    return;
 		}
-		if ((str_len = series_pmAtomValue_conv_str(type, str_val, &val, sizeof(str_val))) == 0)
-		    return;
-		sdsfree(np->value_set.series_values[i].series_sample[j].series_instance[k].data);
-		np->value_set.series_values[i].series_sample[j].series_instance[k].data = sdsnewlen(str_val, str_len);
 	    }
 	}
+	np->value_set.series_values[i].format = SERIES_FORMAT_ATOM;
 	
     }
 }
@@ -4427,13 +5412,13 @@ calculate_slash(int *type, pmAtomValue *l_val, pmAtomValue *r_val, pmAtomValue *
 static void
 series_calculate_order_binary(int ope_type, int l_type, int r_type, int *otype,
 	pmAtomValue *l_val, pmAtomValue *r_val,
-	pmSeriesValue *l_data, pmSeriesValue *r_data,
+	series_sample_set_t *l_set, series_sample_set_t *r_set, int j, int k,
 	pmUnits *l_units, pmUnits *r_units, pmUnits *large_units,
 	int (*operator)(int*, pmAtomValue*, pmAtomValue*, pmAtomValue*))
 {
-    pmAtomValue		res;
-    int			str_len;
-    char		str_val[256];
+    series_instance_set_t	*l_data = &l_set->series_sample[j];
+    series_instance_set_t	*r_data = &r_set->series_sample[j];
+    pmAtomValue			res;
 
     if (l_type == PM_TYPE_DOUBLE || r_type == PM_TYPE_DOUBLE) {
 	*otype = PM_TYPE_DOUBLE;
@@ -4451,9 +5436,9 @@ series_calculate_order_binary(int ope_type, int l_type, int r_type, int *otype,
 	*otype = PM_TYPE_32;
     }
 
-    /* Extract series values */
-    series_extract_value(*otype, r_data->data, r_val);
-    series_extract_value(*otype, l_data->data, l_val);
+    /* Convert series values to the result type */
+    series_value_convert(r_set->type, &r_data->values[k], *otype, r_val);
+    series_value_convert(l_set->type, &l_data->values[k], *otype, l_val);
 
     /* Convert scale to larger one */
     if (pmConvScale(*otype, l_val, l_units, l_val, large_units) < 0)
@@ -4461,13 +5446,12 @@ series_calculate_order_binary(int ope_type, int l_type, int r_type, int *otype,
     if (pmConvScale(*otype, r_val, r_units, r_val, large_units) < 0)
     	memset(large_units, 0, sizeof(*large_units));
 
-    if ((*operator)(otype, l_val, r_val, &res) != 0) {
-	sdsfree(l_data->data);
-	l_data->data = sdsnew("no value"); /* TODO - error handling */
+    if ((r_data->novalue && r_data->novalue[k]) ||
+	(*operator)(otype, l_val, r_val, &res) != 0) {
+	series_value_novalue(l_data, k); /* TODO - error handling */
+	memset(&l_data->values[k], 0, sizeof(pmAtomValue));
     } else {
-	sdsfree(l_data->data);
-	str_len = series_pmAtomValue_conv_str(*otype, str_val, &res, sizeof(str_val));
-	l_data->data = sdsnewlen(str_val, str_len);
+	l_data->values[k] = res;
     }
 }
 
@@ -4499,6 +5483,8 @@ series_binary_meta_update(node_t *left, pmUnits *large_units, int *l_sem, int *r
     if (*otype != PM_TYPE_UNKNOWN) {
 	sdsfree(left->value_set.series_values[0].series_desc.type);
 	left->value_set.series_values[0].series_desc.type = sdsnew(pmTypeStr(*otype));
+	left->value_set.series_values[0].type = *otype;
+	left->value_set.series_values[0].format = SERIES_FORMAT_ATOM;
     }
 
     /* Update semantics */
@@ -4541,8 +5527,7 @@ series_calculate_plus(node_t *np, void *arg)
 	for (k = 0; k < num_instances; k++) {
 	    series_calculate_order_binary(N_PLUS, l_type, r_type, &otype, 
 		&l_val, &r_val, 
-		left->value_set.series_values[0].series_sample[j].series_instance + k,
-		right->value_set.series_values[0].series_sample[j].series_instance + k,
+		&left->value_set.series_values[0], &right->value_set.series_values[0], j, k,
 		&l_units, &r_units, &large_units, calculate_plus);
 	}
     }
@@ -4593,8 +5578,7 @@ series_calculate_minus(node_t *np, void *arg)
 	for (k = 0; k < num_instances; k++) {
 	    series_calculate_order_binary(N_MINUS, l_type, r_type, &otype, 
 		&l_val, &r_val, 
-		left->value_set.series_values[0].series_sample[j].series_instance + k,
-		right->value_set.series_values[0].series_sample[j].series_instance + k,
+		&left->value_set.series_values[0], &right->value_set.series_values[0], j, k,
 		&l_units, &r_units, &large_units, calculate_minus);
 	}
     }
@@ -4613,16 +5597,16 @@ series_calculate_minus(node_t *np, void *arg)
 static void
 series_calculate_star(node_t *np, void *arg)
 {
-    seriesQueryBaton	*baton = (seriesQueryBaton *)np->baton;
+    seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
     node_t		*left = np->left, *right = np->right, *node;
     unsigned int	n_series, num_samples, num_instances, i, j, k;
     pmAtomValue		l_val, r_val;
     pmUnits		l_units = {0}, r_units = {0}, large_units = {0};
     int			l_type, r_type, otype=PM_TYPE_UNKNOWN;
-    int			l_sem, r_sem, int_operand, is_int;
+    int			l_sem, r_sem, int_operand, is_int, type;
     sds			msg;
     double		data, double_operand;
-    char		new_data[64];
+    pmAtomValue		*val;
 
     if (left->value_set.num_series == 0 || right->value_set.num_series == 0){
 	if (right->value_set.num_series == 0){
@@ -4647,22 +5631,22 @@ series_calculate_star(node_t *np, void *arg)
 	}
 	n_series = node->value_set.num_series;
 	for (i = 0; i < n_series; i++) {
+	    type = node->value_set.series_values[i].type;
 	    num_samples = node->value_set.series_values[i].num_samples;
 	    for (j = 0; j < num_samples; j++) {
 	    	num_instances = node->value_set.series_values[i].series_sample[j].num_instances;
 	    	for (k = 0; k < num_instances; k++) {
-		    data = atof(node->value_set.series_values[i].series_sample[j].series_instance[k].data);
-		    if (node->type == N_INTEGER && is_int) {
-			pmsprintf(new_data, sizeof(new_data), "%d", atoi(node->value_set.series_values[i].series_sample[j].series_instance[k].data) * int_operand);
-		    } else if (is_int) {
-			pmsprintf(new_data, sizeof(new_data), "%le", data * int_operand);
+		    val = &node->value_set.series_values[i].series_sample[j].values[k];
+		    data = series_value_double(type, val);
+		    if (is_int) {
+			val->d = data * int_operand;
 		    } else {
-			pmsprintf(new_data, sizeof(new_data), "%le", data * double_operand);
+			val->d = data * double_operand;
 		    }
-		    sdsfree(node->value_set.series_values[i].series_sample[j].series_instance[k].data);
-		    node->value_set.series_values[i].series_sample[j].series_instance[k].data = sdsnew(new_data);
 	    	}
 	    }
+	    node->value_set.series_values[i].type = PM_TYPE_DOUBLE;
+	    node->value_set.series_values[i].format = SERIES_FORMAT_ATOM;
 	    if (!is_int) {
 		sdsfree(node->value_set.series_values[i].series_desc.type);
 		sdsfree(node->value_set.series_values[i].series_desc.semantics);
@@ -4695,8 +5679,7 @@ series_calculate_star(node_t *np, void *arg)
 		for (k = 0; k < num_instances; k++) {
 		    series_calculate_order_binary(N_STAR, l_type, r_type, &otype, 
 			&l_val, &r_val, 
-			left->value_set.series_values[i].series_sample[j].series_instance + k,
-			right->value_set.series_values[i].series_sample[j].series_instance + k,
+			&left->value_set.series_values[i], &right->value_set.series_values[i], j, k,
 			&l_units, &r_units, &large_units, calculate_star);
 		}
 	    }
@@ -4709,6 +5692,10 @@ series_calculate_star(node_t *np, void *arg)
 	    large_units.dimTime = l_units.dimTime + r_units.dimTime;
 
 	    series_binary_meta_update(left, &large_units, &l_sem, &r_sem, &otype);
+	    if (otype != PM_TYPE_UNKNOWN) {
+		left->value_set.series_values[i].type = otype;
+		left->value_set.series_values[i].format = SERIES_FORMAT_ATOM;
+	    }
 	    np->value_set = left->value_set;
 	}
 
@@ -4750,8 +5737,7 @@ series_calculate_slash(node_t *np, void *arg)
 	for (k = 0; k < num_instances; k++) {
 	    series_calculate_order_binary(N_SLASH, l_type, r_type, &otype, 
 		&l_val, &r_val, 
-		left->value_set.series_values[0].series_sample[j].series_instance + k,
-		right->value_set.series_values[0].series_sample[j].series_instance + k,
+		&left->value_set.series_values[0], &right->value_set.series_values[0], j, k,
 		&l_units, &r_units, &large_units, calculate_slash);
 	}
     }
@@ -4883,9 +5869,8 @@ series_compatibility_convert(
 	series_sample_set_t *set0, series_sample_set_t *set1, pmUnits *units0, pmUnits *units1, pmUnits *large_units)
 {
     unsigned int	j, k;
-    int			type0, type1, str_len;
-    char		str_val[256];
-    pmAtomValue		val0, val1;
+    int			type0, type1;
+    pmAtomValue		*val0, *val1;
 
     large_units->scaleCount = units0->scaleCount > units1->scaleCount ? units0->scaleCount : units1->scaleCount;
     large_units->scaleSpace = units0->scaleSpace > units1->scaleSpace ? units0->scaleSpace : units1->scaleSpace;
@@ -4899,14 +5884,14 @@ series_compatibility_convert(
 	type0 = PM_TYPE_DOUBLE;
 	for (j = 0; j < set0->num_samples; j++) {
 	    for (k = 0; k < set0->series_sample[j].num_instances; k++) {
-		series_extract_value(type0, set0->series_sample[j].series_instance[k].data, &val0);
-		if (pmConvScale(type0, &val0, units0, &val0, large_units) < 0)
+		val0 = &set0->series_sample[j].values[k];
+		series_value_convert(set0->type, val0, type0, val0);
+		if (pmConvScale(type0, val0, units0, val0, large_units) < 0)
 		    memset(large_units, 0, sizeof(*large_units));
-		sdsfree(set0->series_sample[j].series_instance[k].data);
-		str_len = series_pmAtomValue_conv_str(type0, str_val, &val0, sizeof(str_val));
-		set0->series_sample[j].series_instance[k].data = sdsnewlen(str_val, str_len);
 	    }
 	}
+	set0->type = type0;
+	set0->format = SERIES_FORMAT_ATOM;
 	sdsfree(set0->series_desc.type);
 	sdsfree(set0->series_desc.units);
 	set0->series_desc.type = sdsnew(pmTypeStr(type0));
@@ -4918,14 +5903,14 @@ series_compatibility_convert(
 	type1 = PM_TYPE_DOUBLE;
 	for (j = 0; j < set1->num_samples; j++) {
 	    for (k = 0; k < set1->series_sample[j].num_instances; k++) {
-		series_extract_value(type1, set1->series_sample[j].series_instance[k].data, &val1);
-		if (pmConvScale(type1, &val1, units1, &val1, large_units) < 0)
+		val1 = &set1->series_sample[j].values[k];
+		series_value_convert(set1->type, val1, type1, val1);
+		if (pmConvScale(type1, val1, units1, val1, large_units) < 0)
 		    memset(large_units, 0, sizeof(*large_units));
-		sdsfree(set1->series_sample[j].series_instance[k].data);
-		str_len = series_pmAtomValue_conv_str(type1, str_val, &val1, sizeof(str_val));
-		set1->series_sample[j].series_instance[k].data = sdsnewlen(str_val, str_len);
 	    }
 	}
+	set1->type = type1;
+	set1->format = SERIES_FORMAT_ATOM;
 	sdsfree(set1->series_desc.type);
 	sdsfree(set1->series_desc.units);
 	set1->series_desc.type = sdsnew(pmTypeStr(type1));
@@ -5064,8 +6049,15 @@ series_query_funcs_report_values(void *arg)
 
     seriesBatonReference(baton, "series_query_funcs_report_values");
 
+    /* values evaluated a page at a time have been reported already */
+    if (baton->stream) {
+	series_stream_free(baton);
+	series_query_end_phase(baton);
+	return;
+    }
+
     /* For function-type nodes, calculate actual values */
-    has_function = series_calculate(baton->query.root, 0, baton->userdata);
+    has_function = series_calculate(baton->query.root, 0, baton);
 
     /*
      * Store the canonical query to Redis if this query statement has
@@ -5080,6 +6072,27 @@ series_query_funcs_report_values(void *arg)
     series_query_end_phase(baton);
 }
 
+static void
+series_query_funcs_stream(void *arg)
+{
+    seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
+
+    seriesBatonCheckMagic(baton, MAGIC_QUERY, "series_query_funcs_stream");
+    seriesBatonCheckCount(baton, "series_query_funcs_stream");
+
+    seriesBatonReference(baton, "series_query_funcs_stream");
+    if (baton->stream) {
+	if (series_stream_units(baton)) {
+	    /* evaluate and report values of each series, a page at a time */
+	    series_stream_series(baton);
+	} else {
+	    series_stream_free(baton);
+	    series_process_func(baton, baton->query.root, 0);
+	}
+    }
+    series_query_end_phase(baton);
+}
+
 static void
 series_query_funcs(void *arg)
 {
@@ -5089,8 +6102,106 @@ series_query_funcs(void *arg)
     seriesBatonCheckCount(baton, "series_query_funcs");
 
     seriesBatonReference(baton, "series_query_funcs");
-    /* Process function-type node */
-    series_process_func(baton, baton->query.root, 0);
+    /* Process function-type node, by pages of values where possible */
+    if (series_stream_setup(baton) == 0)
+	series_process_func(baton, baton->query.root, 0);
+    series_query_end_phase(baton);
+}
+
+static void
+series_rollup_exists_reply(
+	redisClusterAsyncContext *c, void *r, void *arg)
+{
+    node_t		*np = (node_t *)arg;
+    seriesQueryBaton	*baton = (seriesQueryBaton *)np->baton;
+    redisReply		*reply = r;
+
+    seriesBatonCheckMagic(baton, MAGIC_QUERY, "series_rollup_exists_reply");
+
+    /* fall back to the raw values unless every series has this rollup */
+    if (reply == NULL || reply->type != REDIS_REPLY_INTEGER ||
+	reply->integer == 0)
+	np->rollup = 0;
+    series_query_end_phase(baton);
+}
+
+/*
+ * Pick the coarsest rollup resolution no longer than the sampling
+ * interval requested for the values of this node, and check for the
+ * rollup streams of its series - the raw values are used otherwise.
+ */
+static void
+series_rollup_prepare(seriesQueryBaton *baton, node_t *np, timing_t *tp)
+{
+    unsigned char	*series = np->result.series;
+    char		hashbuf[42];
+    sds			cmd, key, name;
+    unsigned int	i, seconds;
+
+    np->rollup = 0;
+    if (series_value_count_only(tp) || tp->delta.tv_sec == 0)
+	return;
+    for (i = 0; i < nrollups; i++) {
+	seconds = rollups[i];
+	if (seconds <= tp->delta.tv_sec && seconds > np->rollup)
+	    np->rollup = seconds;
+    }
+    if (np->rollup == 0)
+	return;
+
+    np->baton = baton;
+    for (i = 0; i < np->result.nseries; i++, series += SHA1SZ) {
+	pmwebapi_hash_str(series, hashbuf, sizeof(hashbuf));
+	name = sdsnew(hashbuf);
+	key = series_values_key(name, np->rollup);
+	sdsfree(name);
+
+	seriesBatonReference(baton, "series_rollup_prepare");
+	cmd = redis_command(2);	/* EXISTS key */
+	cmd = redis_param_str(cmd, EXISTS, EXISTS_LEN);
+	cmd = redis_param_sds(cmd, key);
+	sdsfree(key);
+	redisSlotsRequest(baton->slots, cmd, series_rollup_exists_reply, np);
+	sdsfree(cmd);
+    }
+}
+
+static void
+series_rollup_nodes(seriesQueryBaton *baton, node_t *np)
+{
+    if (np == NULL)
+	return;
+    if (np->result.nseries != 0) {
+	series_rollup_prepare(baton, np, &np->time);
+	return;
+    }
+    series_rollup_nodes(baton, np->left);
+    series_rollup_nodes(baton, np->right);
+}
+
+static void
+series_query_rollups(void *arg)
+{
+    seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
+
+    seriesBatonCheckMagic(baton, MAGIC_QUERY, "series_query_rollups");
+    seriesBatonCheckCount(baton, "series_query_rollups");
+
+    seriesBatonReference(baton, "series_query_rollups");
+    series_rollup_nodes(baton, baton->query.root);
+    series_query_end_phase(baton);
+}
+
+static void
+series_values_rollups(void *arg)
+{
+    seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
+
+    seriesBatonCheckMagic(baton, MAGIC_QUERY, "series_values_rollups");
+    seriesBatonCheckCount(baton, "series_values_rollups");
+
+    seriesBatonReference(baton, "series_values_rollups");
+    series_rollup_prepare(baton, baton->query.root, &baton->query.timing);
     series_query_end_phase(baton);
 }
 
@@ -5185,8 +6296,12 @@ series_solve(pmSeriesSettings *settings,
 	/* Report matching series IDs, unless time windowing */
 	baton->phases[i++].func = series_query_report_matches;
     } else {
+	/* Choose rollups for sampled values of leaf nodes */
+	baton->phases[i++].func = series_query_rollups;
 	/* Store time series values into nodes */
 	baton->phases[i++].func = series_query_funcs;
+	/* Or evaluate and report them in pages */
+	baton->phases[i++].func = series_query_funcs_stream;
 	/* Report actual values */
 	baton->phases[i++].func = series_query_funcs_report_values;
     }
@@ -6473,6 +7588,7 @@ pmSeriesValues(pmSeriesSettings *settings, pmSeriesTimeWindow *timing,
 
     baton->current = &baton->phases[0];
     baton->phases[i++].func = series_lookup_services;
+    baton->phases[i++].func = series_values_rollups;
     baton->phases[i++].func = series_query_report_values;
     baton->phases[i++].func = series_lookup_finished;
     assert(i <= QUERY_PHASES);
@@ -121,10 +121,23 @@ typedef struct series_set {
     int			nseries;
 } series_set_t;
 
+/*
+ * Function operands carry their values as a typed column (values[],
+ * of the type in the sample set) - these are only converted to text
+ * when reported, in the form given by the sample set format.
+ */
+typedef enum series_format {
+    SERIES_FORMAT_TEXT,		/* pmSeriesValue data, as stored by Redis */
+    SERIES_FORMAT_ATOM,		/* pmAtomStr(3) of the column type */
+    SERIES_FORMAT_RATE,		/* fixed point, from rate conversion */
+} series_format_t;
+
 typedef struct series_instance_set {
     /* Number of series instances */
     int			num_instances;
     pmSeriesValue	*series_instance;
+    pmAtomValue		*values;
+    unsigned char	*novalue;	/* failed calculations, if any */
 } series_instance_set_t;
 
 typedef struct series_sample_set {
@@ -133,6 +146,10 @@ typedef struct series_sample_set {
     pmSeriesDesc		series_desc;
     void			*baton;
     int				compatibility;
+    int				type;	/* PM_TYPE_* of values column */
+    series_format_t		format;
+    /* series and data strings belong to the input set */
+    unsigned int		shared;
     /* Number of series samples */
     int				num_samples;
     series_instance_set_t	*series_sample;
@@ -185,6 +202,9 @@ typedef struct node {
 
     /* Corresponding time specifier */
     timing_t		time;
+
+    /* rollup stream resolution (seconds) used for values, if any */
+    unsigned int	rollup;
 } node_t;
 
 
@@ -12,6 +12,7 @@
  * License for more details.
  */
 #include <assert.h>
+#include <ctype.h>
 #include "pmapi.h"
 #include "pmda.h"
 #include "search.h"
@@ -23,12 +24,20 @@
 #define STRINGIFY(s)	#s
 #define TO_STRING(s)	STRINGIFY(s)
 #define SERIES_VERSION	2
+#define COMPACT_VERSION	3	/* stream values may also be compact blocks */
+#define COMPACT_SAMPLES	256	/* largest count of samples in a block */
 #define REDIS_VERSION	5
 
 extern sds		cursorcount;
+extern sds		streamcount;
+extern unsigned int	rollups[MAX_ROLLUPS];
+extern unsigned int	nrollups;
 static sds		maxstreamlen;
 static sds		streamexpire;
+static time_t		streamrefresh;
+static int		compactblocks;
 static sds		DEFAULT_CURSORCOUNT;
+static sds		DEFAULT_STREAMCOUNT;
 static sds		DEFAULT_MAXSTREAMLEN;
 static sds		DEFAULT_STREAMEXPIRE;
 
@@ -1060,7 +1069,7 @@ redis_series_timer_callback(
 
 static void
 redis_series_stream(redisSlots *slots, sds stamp, metric_t *metric,
-		const char *hash, void *arg)
+		const char *hash, int expire, void *arg)
 {
     seriesLoadBaton		*load = (seriesLoadBaton *)arg;
     redisStreamBaton		*baton;
@@ -1074,7 +1083,7 @@ redis_series_stream(redisSlots *slots, sds stamp, metric_t *metric,
 	return;
     }
     initRedisStreamBaton(baton, slots, stamp, hash, load);
-    seriesBatonReferences(load, 2, "redis_series_stream");
+    seriesBatonReferences(load, expire ? 2 : 1, "redis_series_stream");
 
     count = 6;	/* XADD key MAXLEN ~ len stamp */
     key = sdscatfmt(sdsempty(), "pcp:values:series:%s", hash);
@@ -1119,35 +1128,541 @@ redis_series_stream(redisSlots *slots, sds stamp, metric_t *metric,
     cmd = redis_param_sds(cmd, maxstreamlen);
     cmd = redis_param_sds(cmd, stamp);
     cmd = redis_param_raw(cmd, stream);
-    sdsfree(key);
     sdsfree(stream);
-    redisSlotsRequest(slots, cmd, redis_series_stream_callback, baton);
+    redisSlotsBatchRequest(slots, key, cmd, redis_series_stream_callback, baton);
     sdsfree(cmd);
 
-    key = sdscatfmt(sdsempty(), "pcp:values:series:%s", hash);
+    /* queued after the XADD, which may be creating the stream key */
+    if (expire) {
+	cmd = redis_command(3);	/* EXPIRE key timer */
+	cmd = redis_param_str(cmd, EXPIRE, EXPIRE_LEN);
+	cmd = redis_param_sds(cmd, key);
+	cmd = redis_param_sds(cmd, streamexpire);
+	redisSlotsBatchRequest(slots, key, cmd, redis_series_timer_callback, load);
+	sdsfree(cmd);
+    }
+    sdsfree(key);
+}
+
+static sds
+series_rollup_value(int type, int sem, rollup_t *rp)
+{
+    double		value;
+
+    /* counters keep their latest value, so rates can still be computed */
+    value = (sem == PM_SEM_COUNTER) ? rp->last : rp->sum / rp->count;
+
+    if (type == PM_TYPE_FLOAT || type == PM_TYPE_DOUBLE)
+	return sdscatprintf(sdsempty(), "%e %e %e %u",
+			value, rp->min, rp->max, rp->count);
+    return sdscatprintf(sdsempty(), "%.0f %.0f %.0f %u",
+			value, rp->min, rp->max, rp->count);
+}
+
+/* add one prepared entry (field/value pairs) to a rollup or compact stream */
+static void
+redis_series_entry(redisSlots *slots, sds key, sds stamp, const char *hash,
+		sds stream, unsigned int count, void *arg)
+{
+    seriesLoadBaton		*load = (seriesLoadBaton *)arg;
+    redisStreamBaton		*baton;
+    sds				cmd, msg;
+
+    if ((baton = malloc(sizeof(redisStreamBaton))) == NULL) {
+	infofmt(msg, "OOM creating stream entry baton");
+	batoninfo(load, PMLOG_ERROR, msg);
+	return;
+    }
+    initRedisStreamBaton(baton, slots, stamp, hash, load);
+    seriesBatonReference(load, "redis_series_entry");
+
+    cmd = redis_command(count + 6);	/* XADD key MAXLEN ~ len stamp */
+    cmd = redis_param_str(cmd, XADD, XADD_LEN);
+    cmd = redis_param_sds(cmd, key);
+    cmd = redis_param_str(cmd, "MAXLEN", sizeof("MAXLEN")-1);
+    cmd = redis_param_str(cmd, "~", 1);
+    cmd = redis_param_sds(cmd, maxstreamlen);
+    cmd = redis_param_sds(cmd, stamp);
+    cmd = redis_param_raw(cmd, stream);
+    redisSlotsBatchRequest(slots, key, cmd, redis_series_stream_callback, baton);
+    sdsfree(cmd);
+}
+
+static void
+redis_series_expire(redisSlots *slots, sds key, sds timer, void *arg)
+{
+    sds				cmd;
+
+    seriesBatonReference(arg, "redis_series_expire");
     cmd = redis_command(3);	/* EXPIRE key timer */
     cmd = redis_param_str(cmd, EXPIRE, EXPIRE_LEN);
     cmd = redis_param_sds(cmd, key);
-    cmd = redis_param_sds(cmd, streamexpire);
-    sdsfree(key);
-    redisSlotsRequest(slots, cmd, redis_series_timer_callback, load);
+    cmd = redis_param_sds(cmd, timer);
+    redisSlotsBatchRequest(slots, key, cmd, redis_series_timer_callback, arg);
     sdsfree(cmd);
 }
 
+/*
+ * Refresh the expiry time of the rollup streams of one resolution, at
+ * creation and then along with the raw stream (even with no interval
+ * ending) - these outlive the raw stream by their own resolution, as
+ * they may be added to only once in that time.
+ */
 static void
-redis_series_streamed(sds stamp, metric_t *metric, void *arg)
+redis_series_rollup_expire(redisSlots *slots, metric_t *metric,
+		unsigned int r, void *arg)
+{
+    char			hashbuf[42];
+    sds				key, timer;
+    int				i;
+
+    timer = sdscatfmt(sdsempty(), "%U",
+		(unsigned long long)strtoul(streamexpire, NULL, 10) + rollups[r]);
+    for (i = 0; i < metric->numnames; i++) {
+	pmwebapi_hash_str(metric->names[i].hash, hashbuf, sizeof(hashbuf));
+	key = sdscatfmt(sdsempty(), "pcp:rollup:series:%s:%u",
+			hashbuf, rollups[r]);
+	redis_series_expire(slots, key, timer, arg);
+	sdsfree(key);
+    }
+    sdsfree(timer);
+}
+
+/*
+ * Write out the aggregated values for the current interval of one
+ * rollup resolution to the rollup stream of each metric name, and
+ * begin the next interval.  Returns non-zero if anything was written.
+ */
+static int
+redis_series_rollup_flush(redisSlots *slots, metric_t *metric,
+		unsigned int r, void *arg)
+{
+    rollups_t			*rp = metric->rollups;
+    rollup_t			*values = rp->values[r];
+    instance_t			*inst;
+    unsigned int		i, count = 0;
+    char			hashbuf[42];
+    sds				key, name, stamp, stream = sdsempty();
+
+    name = sdsempty();
+    for (i = 0; i < rp->size; i++) {
+	if (values[i].count == 0)
+	    continue;
+	if (metric->desc.indom != PM_INDOM_NULL && metric->u.vlist != NULL) {
+	    if ((inst = dictFetchValue(metric->indom->insts,
+				&metric->u.vlist->value[i].inst)) == NULL)
+		continue;
+	    name = sdscpylen(name, (const char *)inst->name.hash,
+				sizeof(inst->name.hash));
+	}
+	stream = series_stream_append(stream, name, series_rollup_value(
+				metric->desc.type, metric->desc.sem, &values[i]));
+	count += 2;
+    }
+    sdsfree(name);
+    memset(values, 0, rp->size * sizeof(rollup_t));
+
+    if (count > 0) {
+	stamp = sdscatfmt(sdsempty(), "%U-0",
+			(unsigned long long)rp->start[r]);
+	for (i = 0; i < metric->numnames; i++) {
+	    pmwebapi_hash_str(metric->names[i].hash, hashbuf, sizeof(hashbuf));
+	    key = sdscatfmt(sdsempty(), "pcp:rollup:series:%s:%u",
+				hashbuf, rollups[r]);
+	    redis_series_entry(slots, key, stamp, hashbuf, stream, count, arg);
+	    sdsfree(key);
+	}
+	sdsfree(stamp);
+    }
+    sdsfree(stream);
+    return count > 0;
+}
+
+static int
+series_numeric_type(int type)
+{
+    switch (type) {
+    case PM_TYPE_32:
+    case PM_TYPE_U32:
+    case PM_TYPE_64:
+    case PM_TYPE_U64:
+    case PM_TYPE_FLOAT:
+    case PM_TYPE_DOUBLE:
+	return 1;
+    default:
+	break;
+    }
+    return 0;
+}
+
+static double
+series_rollup_atom(int type, pmAtomValue *avp)
+{
+    switch (type) {
+    case PM_TYPE_32:
+	return avp->l;
+    case PM_TYPE_U32:
+	return avp->ul;
+    case PM_TYPE_64:
+	return avp->ll;
+    case PM_TYPE_U64:
+	return avp->ull;
+    case PM_TYPE_FLOAT:
+	return avp->f;
+    case PM_TYPE_DOUBLE:
+	return avp->d;
+    default:
+	break;
+    }
+    return 0.0;
+}
+
+/*
+ * Accumulate the latest values of a numeric metric into each of the
+ * rollup resolutions, writing out the interval aggregates whenever a
+ * new interval is entered.
+ */
+static void
+redis_series_rollup_update(redisSlots *slots, sds stamp,
+		metric_t *metric, int expire, void *arg)
+{
+    rollups_t			*rp;
+    rollup_t			*values, *rollup;
+    pmAtomValue			*avp;
+    __uint64_t			msec, start;
+    unsigned int		i, r, size;
+    int				written;
+    double			value;
+    int				type = metric->desc.type;
+
+    if (!series_numeric_type(type))
+	return;
+
+    if (metric->desc.indom == PM_INDOM_NULL || metric->u.vlist == NULL)
+	size = 1;
+    else if ((size = metric->u.vlist->listcount) == 0)
+	return;
+
+    if ((rp = metric->rollups) == NULL) {
+	if ((rp = calloc(1, sizeof(rollups_t))) == NULL)
+	    return;
+	metric->rollups = rp;
+    }
+    if (size > rp->size) {
+	for (r = 0; r < nrollups; r++) {
+	    if ((values = realloc(rp->values[r], size * sizeof(rollup_t))) == NULL)
+		return;
+	    memset(values + rp->size, 0, (size - rp->size) * sizeof(rollup_t));
+	    rp->values[r] = values;
+	}
+	rp->size = size;
+    }
+
+    msec = strtoull(stamp, NULL, 10);
+    for (r = 0; r < nrollups; r++) {
+	start = msec - msec % (rollups[r] * 1000ULL);
+	written = 0;
+	if (start > rp->start[r])
+	    written = redis_series_rollup_flush(slots, metric, r, arg);
+	else if (start < rp->start[r])	/* time went backwards, start over */
+	    memset(rp->values[r], 0, rp->size * sizeof(rollup_t));
+	rp->start[r] = start;
+
+	if (written && !rp->written[r]) {
+	    rp->written[r] = 1;
+	    redis_series_rollup_expire(slots, metric, r, arg);
+	} else if (expire && rp->written[r]) {
+	    redis_series_rollup_expire(slots, metric, r, arg);
+	}
+
+	for (i = 0; i < size; i++) {
+	    if (metric->desc.indom == PM_INDOM_NULL || metric->u.vlist == NULL)
+		avp = &metric->u.atom;
+	    else
+		avp = &metric->u.vlist->value[i].atom;
+	    value = series_rollup_atom(type, avp);
+	    rollup = &rp->values[r][i];
+	    if (rollup->count == 0 || value < rollup->min)
+		rollup->min = value;
+	    if (rollup->count == 0 || value > rollup->max)
+		rollup->max = value;
+	    rollup->sum += value;
+	    rollup->last = value;
+	    rollup->count++;
+	}
+    }
+}
+
+/*
+ * Compact stream entries hold a block of samples from one interval of
+ * COMPACT_SPAN seconds, with delta-of-delta timestamps and XOR encoded
+ * values (see compact_encode) - in place of one entry for each sample.
+ */
+static void
+redis_series_compact_expire(redisSlots *slots, metric_t *metric, void *arg)
 {
-    seriesLoadBaton		*baton= (seriesLoadBaton *)arg;
-    redisSlots			*slots = baton->slots;
     char			hashbuf[42];
+    sds				key;
     int				i;
 
     for (i = 0; i < metric->numnames; i++) {
 	pmwebapi_hash_str(metric->names[i].hash, hashbuf, sizeof(hashbuf));
-	redis_series_stream(slots, stamp, metric, hashbuf, arg);
+	key = sdscatfmt(sdsempty(), "pcp:values:series:%s", hashbuf);
+	redis_series_expire(slots, key, streamexpire, arg);
+	sdsfree(key);
     }
 }
 
+static void
+redis_series_compact_flush(redisSlots *slots, metric_t *metric, void *arg)
+{
+    compact_t			*cp = metric->compact;
+    __uint64_t			usec;
+    char			hashbuf[42];
+    sds				key, field, stamp, stream;
+    int				i;
+
+    if (cp == NULL || cp->block.nsamples == 0)
+	return;
+
+    field = sdsnewlen(COMPACT_FIELD, sizeof(COMPACT_FIELD)-1);
+    stream = series_stream_append(sdsempty(), field, compact_encode(&cp->block));
+    sdsfree(field);
+    usec = cp->block.stamps[0];
+    stamp = sdscatfmt(sdsempty(), "%U-%U",
+		(unsigned long long)(usec / 1000), (unsigned long long)(usec % 1000));
+    for (i = 0; i < metric->numnames; i++) {
+	pmwebapi_hash_str(metric->names[i].hash, hashbuf, sizeof(hashbuf));
+	key = sdscatfmt(sdsempty(), "pcp:values:series:%s", hashbuf);
+	redis_series_entry(slots, key, stamp, hashbuf, stream, 2, arg);
+	sdsfree(key);
+    }
+    sdsfree(stamp);
+    sdsfree(stream);
+    cp->block.nsamples = 0;
+
+    /* queued after the first XADD, which creates the stream key */
+    if (!cp->written) {
+	cp->written = 1;
+	redis_series_compact_expire(slots, metric, arg);
+    }
+}
+
+static __uint64_t
+series_compact_atom(int type, pmAtomValue *avp)
+{
+    __uint64_t			bits;
+    double			value;
+
+    switch (type) {
+    case PM_TYPE_32:
+	return (__int64_t)avp->l;
+    case PM_TYPE_U32:
+	return avp->ul;
+    case PM_TYPE_64:
+	return avp->ll;
+    case PM_TYPE_U64:
+	return avp->ull;
+    case PM_TYPE_FLOAT:
+	value = avp->f;
+	break;
+    case PM_TYPE_DOUBLE:
+	value = avp->d;
+	break;
+    default:
+	return 0;
+    }
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+/* instance names of a sample - as for text entries, in value list order */
+static int
+series_compact_names(metric_t *metric, compactBlock *block, int update)
+{
+    instance_t			*inst;
+    value_t			*v;
+    unsigned int		i, n = 0;
+    sds				*names;
+
+    if (metric->desc.indom == PM_INDOM_NULL || metric->u.vlist == NULL) {
+	if (update) {
+	    if ((names = calloc(1, sizeof(sds))) == NULL)
+		return -ENOMEM;
+	    names[0] = sdsempty();
+	    block->names = names;
+	}
+	return 1;
+    }
+    if (update && (block->names = calloc(metric->u.vlist->listcount,
+					sizeof(sds))) == NULL)
+	return -ENOMEM;
+    for (i = 0; i < metric->u.vlist->listcount; i++) {
+	v = &metric->u.vlist->value[i];
+	if ((inst = dictFetchValue(metric->indom->insts, &v->inst)) == NULL)
+	    continue;
+	if (update)
+	    block->names[n] = sdsnewlen(inst->name.hash, sizeof(inst->name.hash));
+	else if (n >= block->ninst ||
+		 sdslen(block->names[n]) != sizeof(inst->name.hash) ||
+		 memcmp(block->names[n], inst->name.hash, sizeof(inst->name.hash)))
+	    return -1;
+	n++;
+    }
+    return n;
+}
+
+/*
+ * Add the latest values of a numeric metric to its compact block, first
+ * writing out the block if the interval or instances have changed or it
+ * is full.  Returns zero if the sample must be written as a text entry.
+ */
+static int
+redis_series_compact_update(redisSlots *slots, sds stamp,
+		metric_t *metric, int expire, void *arg)
+{
+    compact_t			*cp = metric->compact;
+    compactBlock		*block;
+    pmAtomValue			*avp;
+    __uint64_t			msec, usec, start, *values, *stamps;
+    unsigned int		i, maxsamples;
+    int				ninst;
+    char			*end;
+
+    if (metric->error < 0 || !series_numeric_type(metric->desc.type) ||
+	(metric->desc.indom != PM_INDOM_NULL && metric->u.vlist != NULL &&
+	 metric->u.vlist->listcount <= 0)) {
+	redis_series_compact_flush(slots, metric, arg);
+	return 0;
+    }
+    if (cp == NULL) {
+	if ((cp = calloc(1, sizeof(compact_t))) == NULL)
+	    return 0;
+	cp->block.type = metric->desc.type;
+	metric->compact = cp;
+    }
+    block = &cp->block;
+
+    msec = strtoull(stamp, &end, 10);
+    usec = msec * 1000 + (*end == '-' ? strtoull(end + 1, NULL, 10) : 0);
+    start = msec - msec % (COMPACT_SPAN * 1000ULL);
+
+    if ((ninst = series_compact_names(metric, block, 0)) == 0) {
+	redis_series_compact_flush(slots, metric, arg);
+	return 0;
+    }
+    if (block->nsamples > 0 &&
+	(start != cp->start || ninst != block->ninst ||
+	 usec <= block->stamps[block->nsamples - 1] ||
+	 block->nsamples >= COMPACT_SAMPLES))
+	redis_series_compact_flush(slots, metric, arg);
+    cp->start = start;
+
+    if (ninst != block->ninst || block->names == NULL) {
+	/* instances changed - begin again with the current instance names */
+	compact_free(block);
+	block->type = metric->desc.type;
+	cp->maxsamples = 0;
+	if ((ninst = series_compact_names(metric, block, 1)) <= 0)
+	    return 0;
+	block->ninst = ninst;
+    }
+    if (block->nsamples == cp->maxsamples) {
+	maxsamples = cp->maxsamples ? cp->maxsamples * 2 : 8;
+	if (maxsamples > COMPACT_SAMPLES)
+	    maxsamples = COMPACT_SAMPLES;
+	if ((stamps = realloc(block->stamps,
+			maxsamples * sizeof(__uint64_t))) == NULL)
+	    return 0;
+	block->stamps = stamps;
+	if ((values = realloc(block->values,
+			maxsamples * ninst * sizeof(__uint64_t))) == NULL)
+	    return 0;
+	block->values = values;
+	cp->maxsamples = maxsamples;
+    }
+
+    /* refresh expiry along with the text entries, once the stream exists */
+    if (expire && cp->written)
+	redis_series_compact_expire(slots, metric, arg);
+
+    values = &block->values[block->nsamples * ninst];
+    block->stamps[block->nsamples++] = usec;
+    if (metric->desc.indom == PM_INDOM_NULL || metric->u.vlist == NULL) {
+	values[0] = series_compact_atom(block->type, &metric->u.atom);
+	return 1;
+    }
+    for (i = 0; i < metric->u.vlist->listcount; i++) {
+	if (dictFetchValue(metric->indom->insts,
+			&metric->u.vlist->value[i].inst) == NULL)
+	    continue;
+	avp = &metric->u.vlist->value[i].atom;
+	*values++ = series_compact_atom(block->type, avp);
+    }
+    return 1;
+}
+
+/*
+ * Write out the partially complete intervals of all rollup resolutions,
+ * and any compact blocks, at the end of an archive or time window.
+ */
+void
+redis_series_flush(redisSlots *slots, context_t *cp, void *arg)
+{
+    dictIterator		*iterator;
+    dictEntry			*entry;
+    metric_t			*metric;
+    unsigned int		r;
+
+    if ((nrollups == 0 && !compactblocks) || cp->pmids == NULL)
+	return;
+
+    iterator = dictGetIterator(cp->pmids);
+    while ((entry = dictNext(iterator)) != NULL) {
+	metric = (metric_t *)dictGetVal(entry);
+	redis_series_compact_flush(slots, metric, arg);
+	if (metric->rollups == NULL)
+	    continue;
+	for (r = 0; r < nrollups; r++) {
+	    if (redis_series_rollup_flush(slots, metric, r, arg) &&
+		!metric->rollups->written[r]) {
+		metric->rollups->written[r] = 1;
+		redis_series_rollup_expire(slots, metric, r, arg);
+	    }
+	}
+    }
+    dictReleaseIterator(iterator);
+}
+
+static void
+redis_series_streamed(sds stamp, metric_t *metric, void *arg)
+{
+    seriesLoadBaton		*baton= (seriesLoadBaton *)arg;
+    redisSlots			*slots = baton->slots;
+    char			hashbuf[42];
+    time_t			now = time(NULL);
+    int				i, expire;
+
+    /*
+     * Only refresh the expiry time of the streams once the time
+     * remaining drops below the configured threshold, rather than
+     * with every value added.
+     */
+    if ((expire = (now >= metric->expire)) != 0)
+	metric->expire = now + streamrefresh;
+
+    if (!compactblocks ||
+	!redis_series_compact_update(slots, stamp, metric, expire, arg)) {
+	for (i = 0; i < metric->numnames; i++) {
+	    pmwebapi_hash_str(metric->names[i].hash, hashbuf, sizeof(hashbuf));
+	    redis_series_stream(slots, stamp, metric, hashbuf, expire, arg);
+	}
+    }
+
+    if (nrollups > 0 && metric->error >= 0)
+	redis_series_rollup_update(slots, stamp, metric, expire, arg);
+}
+
 void
 redis_series_mark(redisSlots *redis, sds timestamp, int data, void *arg)
 {
@@ -1172,10 +1687,9 @@ redis_update_version_callback(
 }
 
 static void
-redis_update_version(redisSlotsBaton *baton)
+redis_update_version(redisSlotsBaton *baton, const char *ver)
 {
     sds			cmd, key;
-    const char		ver[] = TO_STRING(SERIES_VERSION);
 
     seriesBatonReference(baton, "redis_update_version");
 
@@ -1183,7 +1697,7 @@ redis_update_version(redisSlotsBaton *baton)
     cmd = redis_command(3);
     cmd = redis_param_str(cmd, SETS, SETS_LEN);
     cmd = redis_param_sds(cmd, key);
-    cmd = redis_param_str(cmd, ver, sizeof(ver)-1);
+    cmd = redis_param_str(cmd, ver, strlen(ver));
     sdsfree(key);
     redisSlotsRequest(baton->slots, cmd, redis_update_version_callback, baton);
     sdsfree(cmd);
@@ -1195,7 +1709,7 @@ redis_load_series_version_callback(
 {
     redisSlotsBaton	*baton = (redisSlotsBaton *)arg;
     redisReply          *reply = r;
-    unsigned int	version = 0;
+    unsigned int	version = 0, wanted;
     sds			msg;
 
     seriesBatonCheckMagic(baton, MAGIC_SLOTS, "redis_load_series_version_callback");
@@ -1204,11 +1718,12 @@ redis_load_series_version_callback(
 	baton->version = 0;	/* NIL - no version key yet */
     } else if (reply->type == REDIS_REPLY_STRING) {
 	version = (unsigned int)atoi(reply->str);
-	if (version == 0 || version == SERIES_VERSION) {
+	if (version == 0 || version == SERIES_VERSION ||
+	    version == COMPACT_VERSION) {
 	    baton->version = version;
 	} else {
 	    infofmt(msg, "unsupported series schema (got v%u, expected v%u)",
-			version, SERIES_VERSION);
+			version, COMPACT_VERSION);
 	    batoninfo(baton, PMLOG_ERROR, msg);
 	}
     } else if (reply->type == REDIS_REPLY_ERROR) {
@@ -1222,11 +1737,17 @@ redis_load_series_version_callback(
 	baton->version = 0;	/* NIL - no version key yet */
     }
 
-    /* set the version when none found (first time through) */
-    if (version != SERIES_VERSION && baton->version != -1) {
+    /*
+     * Set the version when none found (first time through), or raise
+     * it once compact stream entries may be added - older versions of
+     * the query code cannot decode those.  It is never lowered again.
+     */
+    wanted = compactblocks ? COMPACT_VERSION : SERIES_VERSION;
+    if (version < wanted && baton->version != -1) {
 	/* drop reference from schema version request */
 	seriesBatonDereference(baton, "redis_load_series_version_callback");
-	redis_update_version(arg);
+	redis_update_version(arg, compactblocks ?
+		TO_STRING(COMPACT_VERSION) : TO_STRING(SERIES_VERSION));
     } else {
 	redis_slots_end_phase(baton);
     }
@@ -1524,6 +2045,10 @@ pmSeriesSetMetricRegistry(pmSeriesModule *module, mmv_registry_t *registry)
 static void
 redisSeriesInit(struct dict *config)
 {
+    long	expire, refresh;
+    unsigned long seconds;
+    const char	*spec;
+    char	*end;
     sds		option;
 
     if (!cursorcount) {
@@ -1533,6 +2058,13 @@ redisSeriesInit(struct dict *config)
 	    cursorcount = DEFAULT_CURSORCOUNT = sdsnew("256");
     }
 
+    if (!streamcount) {
+	if ((option = pmIniFileLookup(config, "pmseries", "stream.count")))
+	    streamcount = option;
+	else
+	    streamcount = DEFAULT_STREAMCOUNT = sdsnew("1024");
+    }
+
     if (!maxstreamlen) {
 	if ((option = pmIniFileLookup(config, "pmseries", "stream.maxlen")))
 	    maxstreamlen = option;
@@ -1545,7 +2077,34 @@ redisSeriesInit(struct dict *config)
 	    streamexpire = option;
 	else	/* default value: 1 day (without changes) */
 	    streamexpire = DEFAULT_STREAMEXPIRE = sdsnew("86400");
+
+	/* seconds between refreshes of each stream expiry time */
+	expire = strtol(streamexpire, NULL, 10);
+	if ((option = pmIniFileLookup(config, "pmseries", "stream.expire.threshold")))
+	    refresh = expire - strtol(option, NULL, 10);
+	else	/* default value: every 10 minutes, at most half the expiry */
+	    refresh = expire / 2 < 600 ? expire / 2 : 600;
+	streamrefresh = refresh < 0 ? 0 : refresh;
     }
+
+    /* default value: one minute, one hour and one day resolutions */
+    if ((option = pmIniFileLookup(config, "pmseries", "stream.rollups")))
+	spec = option;
+    else
+	spec = "60,3600,86400";
+    for (nrollups = 0; *spec && nrollups < MAX_ROLLUPS; ) {
+	seconds = strtoul(spec, &end, 10);
+	if (end == spec)
+	    break;
+	if (seconds > 0)
+	    rollups[nrollups++] = seconds;
+	for (spec = end; *spec == ',' || isspace((int)*spec); spec++)
+	    ;
+    }
+
+    /* default value: text, each sample is a separate stream entry */
+    option = pmIniFileLookup(config, "pmseries", "stream.encoding");
+    compactblocks = (option && strcmp(option, "compact") == 0);
 }
 
 static void
@@ -1555,6 +2114,10 @@ redisSeriesClose(void)
 	sdsfree(DEFAULT_CURSORCOUNT);
 	DEFAULT_CURSORCOUNT = NULL;
     }
+    if (DEFAULT_STREAMCOUNT) {
+	sdsfree(DEFAULT_STREAMCOUNT);
+	DEFAULT_STREAMCOUNT = NULL;
+    }
     if (DEFAULT_MAXSTREAMLEN) {
 	sdsfree(DEFAULT_MAXSTREAMLEN);
 	DEFAULT_MAXSTREAMLEN = NULL;
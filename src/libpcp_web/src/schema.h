@@ -30,6 +30,8 @@
 #define CLUSTER_LEN	(sizeof(CLUSTER)-1)
 #define EVALSHA		"EVALSHA"
 #define EVALSHA_LEN	(sizeof(EVALSHA)-1)
+#define EXISTS		"EXISTS"
+#define EXISTS_LEN	(sizeof(EXISTS)-1)
 #define EXPIRE		"EXPIRE"
 #define EXPIRE_LEN	(sizeof(EXPIRE)-1)
 #define GEOADD		"GEOADD"
@@ -109,12 +111,17 @@ redis_param_raw(sds cmd, sds param)
     return sdscatfmt(cmd, "%S\r\n", param);
 }
 
+/* compact stream encoding - blocks of the samples within each interval */
+#define COMPACT_FIELD	"@"	/* sole field name of compact stream entries */
+#define COMPACT_SPAN	60	/* seconds, interval spanned by each block */
+
 extern void redisGlobalsInit(struct dict *);
 extern void redisGlobalsClose(void);
 
 extern void redis_series_source(redisSlots *, void *);
 extern void redis_series_mark(redisSlots *, sds, int, void *);
 extern void redis_series_metric(redisSlots *, metric_t *, sds, int, int, void *);
+extern void redis_series_flush(redisSlots *, context_t *, void *);
 
 /*
  * Asynchronous schema load baton structures
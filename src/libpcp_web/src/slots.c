@@ -28,6 +28,9 @@ static int redisClusterLibuvAttach() { return REDIS_OK; }
 
 static char default_server[] = "localhost:6379";
 
+static void redis_slots_batch_init(redisSlots *, dict *);
+static void redis_slots_batch_free(redisSlots *);
+
 static void
 redis_connect_callback(const redisAsyncContext *redis, int status)
 {
@@ -121,6 +124,21 @@ redisSlotsSetupMetrics(redisSlots *slots)
 	"total bytes received in responses",
 	"Cumulative count of bytes received in Redis responses");
 
+    mmv_stats_add_metric(slots->registry, "batches.total", 10,
+	MMV_TYPE_U64, MMV_SEM_COUNTER, units_count, MMV_INDOM_NULL,
+	"number of request batches",
+	"Total number of batches of queued Redis requests sent together");
+
+    mmv_stats_add_metric(slots->registry, "batches.requests", 11,
+	MMV_TYPE_U64, MMV_SEM_COUNTER, units_count, MMV_INDOM_NULL,
+	"number of batched requests",
+	"Total number of Redis requests sent in batches of requests");
+
+    mmv_stats_add_metric(slots->registry, "batches.time", 12,
+	MMV_TYPE_U64, MMV_SEM_COUNTER, units_us, MMV_INDOM_NULL,
+	"total time for batch responses",
+	"Cumulative time taken to receive all responses to each batch");
+
     slots->map = map = mmv_stats_start(slots->registry);
 
     table = slots->metrics;
@@ -142,6 +160,12 @@ redisSlotsSetupMetrics(redisSlots *slots)
 					"requests.total_bytes", NULL);
     table[SLOT_RESPONSES_TOTAL_BYTES] = mmv_lookup_value_desc(map,
 					"responses.total_bytes", NULL);
+    table[SLOT_BATCHES_TOTAL] = mmv_lookup_value_desc(map,
+					"batches.total", NULL);
+    table[SLOT_BATCHES_REQUESTS] = mmv_lookup_value_desc(map,
+					"batches.requests", NULL);
+    table[SLOT_BATCHES_TIME] = mmv_lookup_value_desc(map,
+					"batches.time", NULL);
 }
 
 int
@@ -182,6 +206,8 @@ redisSlotsInit(dict *config, void *events)
 	return NULL;
     }
 
+    redis_slots_batch_init(slots, config);
+
     servers = pmIniFileLookup(config, "redis", "servers");
     if (servers == NULL)
 	servers = pmIniFileLookup(config, "pmseries", "servers");
@@ -391,6 +417,7 @@ redisSlotsConnect(dict *config, redisSlotsFlags flags,
 void
 redisSlotsFree(redisSlots *slots)
 {
+    redis_slots_batch_free(slots);
     redisClusterAsyncDisconnect(slots->acc);
     redisClusterAsyncFree(slots->acc);
     dictRelease(slots->keymap);
@@ -625,6 +652,244 @@ redisSlotsRequestFirstNode(redisSlots *slots, const sds cmd,
     return REDIS_OK;
 }
 
+/*
+ * Requests that may be delayed briefly (stream values) are queued and
+ * sent together, in one burst per event loop pass rather than one at a
+ * time as each is prepared.  A batch is sent when the queue is full or
+ * when the flush interval expires, whichever is first, and in cluster
+ * mode the queue is first grouped by hash slot so that each node gets
+ * its requests contiguously.  The order of requests for any one key is
+ * always preserved.
+ */
+typedef struct redisSlotsQueued {
+    unsigned int		slot;		/* cluster hash slot of the key */
+    unsigned int		order;		/* position in the queue */
+    sds				cmd;		/* formatted request */
+    redisClusterCallbackFn	*callback;	/* actual callback */
+    void			*arg;		/* actual callback args */
+} redisSlotsQueued;
+
+typedef struct redisSlotsBatch {
+#if defined(HAVE_LIBUV)
+    uv_timer_t			timer;		/* flush interval timer */
+#endif
+    redisSlots			*slots;
+    unsigned int		count;		/* number of queued requests */
+    unsigned int		size;		/* maximum queued requests */
+    unsigned int		interval;	/* milliseconds before a flush */
+    redisSlotsQueued		*queue;
+} redisSlotsBatch;
+
+/* a batch that has been sent, with responses outstanding */
+typedef struct redisSlotsFlush {
+    redisSlots			*slots;
+    uint64_t			start;		/* time the batch was sent */
+    unsigned int		pending;	/* outstanding responses */
+    struct redisSlotsFlushed {
+	struct redisSlotsFlush	*flush;
+	redisClusterCallbackFn	*callback;	/* actual callback */
+	void			*arg;		/* actual callback args */
+    }				requests[];
+} redisSlotsFlush;
+
+static void
+redis_slots_flush_done(redisSlotsFlush *flush)
+{
+    redisSlots		*slots = flush->slots;
+    uint64_t		delta;
+
+    if (--flush->pending > 0)
+	return;
+    if (slots->map) {
+	delta = gettimeusec();
+	delta = (delta < flush->start) ? 0 : delta - flush->start;
+	mmv_add(slots->map, slots->metrics[SLOT_BATCHES_TIME], &delta);
+    }
+    free(flush);
+}
+
+static void
+redis_slots_flush_callback(redisClusterAsyncContext *c, void *r, void *arg)
+{
+    struct redisSlotsFlushed	*request = arg;
+    redisSlotsFlush		*flush = request->flush;
+
+    request->callback(c, r, request->arg);
+    redis_slots_flush_done(flush);
+}
+
+static int
+redis_slots_queued_compare(const void *a, const void *b)
+{
+    const redisSlotsQueued	*qa = (const redisSlotsQueued *)a;
+    const redisSlotsQueued	*qb = (const redisSlotsQueued *)b;
+
+    if (qa->slot != qb->slot)
+	return qa->slot < qb->slot ? -1 : 1;
+    return qa->order < qb->order ? -1 : (qa->order > qb->order);
+}
+
+static void
+redis_slots_batch_flush(redisSlotsBatch *batch)
+{
+    redisSlots		*slots = batch->slots;
+    redisSlotsQueued	*queued;
+    redisSlotsFlush	*flush;
+    struct redisSlotsFlushed *request;
+    unsigned int	i, count = batch->count;
+    uint64_t		size = count;
+
+#if defined(HAVE_LIBUV)
+    uv_timer_stop(&batch->timer);
+#endif
+    if (count == 0)
+	return;
+    batch->count = 0;
+
+    if (slots->cluster && count > 1)
+	qsort(batch->queue, count, sizeof(redisSlotsQueued),
+			redis_slots_queued_compare);
+
+    flush = malloc(sizeof(redisSlotsFlush) + count * sizeof(*request));
+    if (flush == NULL) {
+	/* send each request individually instead */
+	for (i = 0; i < count; i++) {
+	    queued = &batch->queue[i];
+	    redisSlotsRequest(slots, queued->cmd, queued->callback, queued->arg);
+	    sdsfree(queued->cmd);
+	}
+	return;
+    }
+    flush->slots = slots;
+    flush->start = gettimeusec();
+    flush->pending = 1;	/* dropped once all requests are sent */
+
+    for (i = 0; i < count; i++) {
+	queued = &batch->queue[i];
+	request = &flush->requests[i];
+	request->flush = flush;
+	request->callback = queued->callback;
+	request->arg = queued->arg;
+	if (redisSlotsRequest(slots, queued->cmd,
+			redis_slots_flush_callback, request) == REDIS_OK)
+	    flush->pending++;
+	sdsfree(queued->cmd);
+    }
+
+    mmv_inc(slots->map, slots->metrics[SLOT_BATCHES_TOTAL]);
+    mmv_add(slots->map, slots->metrics[SLOT_BATCHES_REQUESTS], &size);
+    redis_slots_flush_done(flush);
+}
+
+#if defined(HAVE_LIBUV)
+static void
+redis_slots_batch_timer(uv_timer_t *handle)
+{
+    redis_slots_batch_flush((redisSlotsBatch *)handle->data);
+}
+
+static void
+redis_slots_batch_release(uv_handle_t *handle)
+{
+    redisSlotsBatch	*batch = (redisSlotsBatch *)handle->data;
+
+    free(batch->queue);
+    free(batch);
+}
+#endif
+
+static void
+redis_slots_batch_init(redisSlots *slots, dict *config)
+{
+#if defined(HAVE_LIBUV)
+    redisSlotsBatch	*batch;
+    unsigned int	size = 256, interval = 10;
+    sds			option;
+
+    if ((option = pmIniFileLookup(config, "pmseries", "stream.batch.size")))
+	size = (unsigned int)strtoul(option, NULL, 10);
+    if ((option = pmIniFileLookup(config, "pmseries", "stream.batch.interval")))
+	interval = (unsigned int)strtoul(option, NULL, 10);
+
+    if (size <= 1 || slots->events == NULL)
+	return;		/* requests are sent as soon as they are made */
+
+    if ((batch = calloc(1, sizeof(redisSlotsBatch))) == NULL ||
+	(batch->queue = calloc(size, sizeof(redisSlotsQueued))) == NULL) {
+	pmNotifyErr(LOG_ERR, "%s: failed to allocate request batch\n",
+			"redisSlotsInit");
+	free(batch);
+	return;
+    }
+    batch->slots = slots;
+    batch->size = size;
+    batch->interval = interval;
+    uv_timer_init(slots->events, &batch->timer);
+    batch->timer.data = batch;
+    slots->batch = batch;
+#else
+    (void)slots;
+    (void)config;
+#endif
+}
+
+static void
+redis_slots_batch_free(redisSlots *slots)
+{
+    redisSlotsBatch	*batch = slots->batch;
+
+    if (batch == NULL)
+	return;
+    redis_slots_batch_flush(batch);
+    slots->batch = NULL;
+#if defined(HAVE_LIBUV)
+    uv_close((uv_handle_t *)&batch->timer, redis_slots_batch_release);
+#endif
+}
+
+/*
+ * Submit a request which may be held back briefly and then sent with
+ * others (see above), falling back to redisSlotsRequest when batching
+ * is disabled.  The given key is the key the command operates on.
+ */
+int
+redisSlotsBatchRequest(redisSlots *slots, const char *key, const sds cmd,
+		redisClusterCallbackFn *callback, void *arg)
+{
+    redisSlotsBatch	*batch = slots->batch;
+    redisSlotsQueued	*queued;
+
+    if (batch == NULL)
+	return redisSlotsRequest(slots, cmd, callback, arg);
+
+    if (UNLIKELY(slots->state != SLOTS_CONNECTED && slots->state != SLOTS_READY))
+	return -ENOTCONN;
+
+    queued = &batch->queue[batch->count];
+    queued->slot = slots->cluster ? redisClusterGetSlotByKey((char *)key) : 0;
+    queued->order = batch->count;
+    queued->cmd = sdsdup(cmd);
+    queued->callback = callback;
+    queued->arg = arg;
+
+    if (++batch->count >= batch->size)
+	redis_slots_batch_flush(batch);
+#if defined(HAVE_LIBUV)
+    else if (batch->count == 1)
+	uv_timer_start(&batch->timer, redis_slots_batch_timer,
+			batch->interval, 0);
+#endif
+    return REDIS_OK;
+}
+
+/* Send any queued requests now, e.g. at the end of a unit of work */
+void
+redisSlotsBatchFlush(redisSlots *slots)
+{
+    if (slots->batch)
+	redis_slots_batch_flush(slots->batch);
+}
+
 int
 redisSlotsProxyConnect(redisSlots *slots, redisInfoCallBack info,
 	redisReader **readerp, const char *buffer, ssize_t nread,
@@ -45,6 +45,9 @@ enum {
     SLOT_REQUESTS_INFLIGHT_BYTES,
     SLOT_REQUESTS_TOTAL_BYTES,
     SLOT_RESPONSES_TOTAL_BYTES,
+    SLOT_BATCHES_TOTAL,
+    SLOT_BATCHES_REQUESTS,
+    SLOT_BATCHES_TIME,
     NUM_SLOT_METRICS
 };
 
@@ -68,6 +71,7 @@ typedef struct redisSlots {
     mmv_registry_t	*registry;	/* MMV metrics for instrumentation */
     void		*map;		/* MMV mapped metric values handle */
     pmAtomValue		*metrics[NUM_SLOT_METRICS]; /* direct handle lookup */
+    struct redisSlotsBatch *batch;	/* requests queued to send together */
 } redisSlots;
 
 /* wraps the actual Redis callback and data */
@@ -92,6 +96,9 @@ extern void redisSlotsReconnect(redisSlots *, redisSlotsFlags,
 		redisInfoCallBack, redisDoneCallBack, void *, void *, void *);
 extern uint64_t redisSlotsInflightRequests(redisSlots *);
 extern int redisSlotsRequest(redisSlots *, sds, redisClusterCallbackFn *, void *);
+extern int redisSlotsBatchRequest(redisSlots *, const char *, sds,
+		redisClusterCallbackFn *, void *);
+extern void redisSlotsBatchFlush(redisSlots *);
 extern int redisSlotsRequestFirstNode(redisSlots *slots, const sds cmd,
 		redisClusterCallbackFn *callback, void *arg);
 extern void redisSlotsFree(redisSlots *);
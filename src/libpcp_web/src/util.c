@@ -1125,6 +1125,15 @@ pmwebapi_free_metric(metric_t *metric)
 	    pmwebapi_release_value(type, &metric->u.vlist->value[i].atom);
 	free(metric->u.vlist);
     }
+    if (metric->rollups) {
+	for (i = 0; i < MAX_ROLLUPS; i++)
+	    free(metric->rollups->values[i]);
+	free(metric->rollups);
+    }
+    if (metric->compact) {
+	compact_free(&metric->compact->block);
+	free(metric->compact);
+    }
 
     memset(metric, 0, sizeof(*metric));
     free(metric);
@@ -19,9 +19,6 @@
 
 #define MIN_CLIENTS_ALLOC 8
 
-int		maxClientFd = -1;	/* largest fd for a client */
-__pmFdSet	clientFds;		/* for client select() */
-
 static int	clientSize;
 
 /*
@@ -75,7 +72,7 @@ ClientInfo *
 AcceptNewClient(int reqfd)
 {
     static unsigned int	seq = 0;
-    int			i, fd;
+    int			i, fd, sts;
     __pmSockLen		addrlen;
     struct timeval	now;
 
@@ -103,12 +100,17 @@ AcceptNewClient(int reqfd)
 	DeleteClient(&client[i]);
 	return NULL;	
     }
-    if (fd > maxClientFd)
-	maxClientFd = fd;
+    if ((sts = ReadyWatch(fd, READY_CLIENT, i)) < 0) {
+	pmNotifyErr(LOG_ERR, "AcceptNewClient(%d): cannot wait for input "
+			"on fd %d: %s\n", reqfd, fd, pmErrStr(sts));
+	__pmCloseSocket(fd);
+	client[i].fd = -1;
+	DeleteClient(&client[i]);
+	return NULL;
+    }
 
     pmcd_openfds_sethi(fd);
 
-    __pmFD_SET(fd, &clientFds);
     __pmSetVersionIPC(fd, UNKNOWN_VERSION);	/* before negotiation */
     __pmSetSocketIPC(fd);
 
@@ -188,7 +190,7 @@ DeleteClient(ClientInfo *cp)
 	return;
     }
     if (cp->fd != -1) {
-	__pmFD_CLR(cp->fd, &clientFds);
+	ReadyIgnore(cp->fd);
 	__pmCloseSocket(cp->fd);
     }
     if (i == nClients-1) {
@@ -197,13 +199,6 @@ DeleteClient(ClientInfo *cp)
 	    i--;
 	nClients = (i >= 0) ? i + 1 : 0;
     }
-    if (cp->fd == maxClientFd) {
-	maxClientFd = -1;
-	for (i = 0; i < nClients; i++) {
-	    if (client[i].fd > maxClientFd)
-		maxClientFd = client[i].fd;
-	}
-    }
     hcp = &cp->profile;
     for (i = 0; i < hcp->hsize; i++) {
 	for (hp = hcp->hash[i]; hp != NULL; hp = hp->next) {
@@ -361,6 +361,127 @@ ExtractState(void *timestamp)
     return (int)byte;
 }
 
+/*
+ * Read and decode the reply to a fetch previously sent to a daemon
+ * agent by SendFetch().  Errors are converted into a result holding
+ * the failure status for each of the pmIDs sent to the agent.
+ */
+static pmResult *
+RecvFetch(DomPmidList *dpList, AgentInfo *aPtr, unsigned int *changes)
+{
+    pmResult	*result = NULL;
+    __pmResult	*rp;
+    __pmPDU	*pb;
+    int		pinpdu;
+    int		sts, s, i;
+
+    pinpdu = sts = __pmGetPDU(aPtr->outFd, ANY_SIZE, pmcd_timeout, &pb);
+    if (sts > 0)
+	pmcd_trace(TR_RECV_PDU, aPtr->outFd, sts, (int)((__psint_t)pb & 0xffffffff));
+    if (sts == PDU_RESULT) {
+	if ((sts = __pmDecodeResult(pb, &rp)) >= 0) {
+	    result = __pmOffsetResult(rp);
+	    if (result->numpmid == dpList->listSize) {
+		*changes |= ExtractState(&rp->timestamp);
+	    } else {
+		if (pmDebugOptions.appl0)
+		    pmNotifyErr(LOG_ERR, "DoFetch: \"%s\" agent given %d pmIDs, returned %d\n",
+				 aPtr->pmDomainLabel, dpList->listSize, result->numpmid);
+		__pmFreeResult(rp);
+		result = NULL;
+		sts = PM_ERR_IPC;
+	    }
+	}
+    }
+    else {
+	if (sts == PDU_ERROR) {
+	    if ((s = __pmDecodeError(pb, &sts)) < 0)
+		sts = s;
+	    else if (sts >= 0)
+		sts = PM_ERR_GENERIC;
+	    pmcd_trace(TR_RECV_ERR, aPtr->outFd, PDU_RESULT, sts);
+	}
+	else if (sts >= 0) {
+	    pmcd_trace(TR_WRONG_PDU, aPtr->outFd, PDU_RESULT, sts);
+	    sts = PM_ERR_IPC;
+	}
+    }
+    if (pinpdu > 0)
+	__pmUnpinPDUBuf(pb);
+
+    if (sts < 0) {
+	result = MakeBadResult(dpList->listSize, dpList->list, sts);
+
+	if (sts == PM_ERR_PMDANOTREADY) {
+	    /* the agent is indicating it can't handle PDUs for now */
+	    for (i = 0; i < dpList->listSize; i++)
+		result->vset[i]->numval = PM_ERR_AGAIN;
+	    sts = CheckError(aPtr, sts);
+	}
+
+	if (pmDebugOptions.appl0) {
+	    fprintf(stderr, "RESULT error from \"%s\" agent : %s\n",
+		    aPtr->pmDomainLabel, pmErrStr(sts));
+	}
+	if (sts == PM_ERR_IPC || sts == PM_ERR_TIMEOUT)
+	    CleanupAgent(aPtr, AT_COMM, aPtr->outFd);
+    }
+    return result;
+}
+
+/*
+ * Final result sent to clients, borrowing the pmValueSets from the
+ * per-agent results.  Grown as needed, never shrunk.
+ */
+static __pmResult *
+FetchEndResult(int nPmids)
+{
+    static __pmResult	*endResult = NULL;
+    static int		maxnpmids;	/* sizes endResult */
+
+    if (nPmids > maxnpmids) {
+	if (endResult != NULL) {
+	    endResult->numpmid = 0;	/* don't free vset's */
+	    __pmFreeResult(endResult);
+	}
+	if ((endResult = __pmAllocResult(nPmids)) == NULL) {
+	    pmNoMem("DoFetch.endResult", sizeof(__pmResult) + (nPmids - 1) * sizeof(pmValueSet *), PM_FATAL_ERR);
+	    /* NOTREACHED */
+	}
+	maxnpmids = nPmids;
+    }
+    endResult->numpmid = nPmids;
+    __pmGetTimestamp(&endResult->timestamp);
+    return endResult;
+}
+
+static void
+SendEndResult(ClientInfo *cip, int pdutype, __pmResult *endResult)
+{
+    int		sts = 0;
+
+    pmcd_trace(TR_XMIT_PDU, cip->fd, pdutype, endResult->numpmid);
+
+    if (cip->status.changes) {
+	/* notify client of PMCD state change */
+	sts = __pmSendError(cip->fd, FROM_ANON, (int)cip->status.changes);
+	if (sts > 0)
+	    sts = 0;
+	cip->status.changes = 0;
+    }
+    if (sts == 0)
+	sts = (pdutype == PDU_HIGHRES_FETCH) ?
+		__pmSendHighResResult(cip->fd, FROM_ANON, endResult) :
+		__pmSendResult(cip->fd, FROM_ANON, endResult);
+
+    if (sts < 0) {
+	pmcd_trace(TR_XMIT_ERR, cip->fd, pdutype, sts);
+	CleanupClient(cip, sts);
+    }
+}
+
+static int QueueFetch(ClientInfo *, int, int, int, pmID *);
+
 /*
  * Handle both the original and high resolution fetch PDU requests.
  * The input handling and PMDA interactions are the same, difference
@@ -376,8 +497,7 @@ HandleFetch(ClientInfo *cip, __pmPDU* pb, int pdutype)
     unsigned int	changes = 0;
     int			nPmids;
     pmID		*pmidList;
-    static __pmResult	*endResult = NULL;
-    static int		maxnpmids;	/* sizes endResult */
+    __pmResult		*endResult;
     DomPmidList		*dList;		/* NOTE: NOT indexed by agent index */
     static int		nDoms;
     static pmResult	**results;	/* array of replies from PMDAs */
@@ -428,16 +548,10 @@ HandleFetch(ClientInfo *cip, __pmPDU* pb, int pdutype)
 	return PM_ERR_NOPROFILE;
     }
 
-    if (nPmids > maxnpmids) {
-	if (endResult != NULL) {
-	    endResult->numpmid = 0;	/* don't free vset's */
-	    __pmFreeResult(endResult);
-	}
-	if ((endResult = __pmAllocResult(nPmids)) == NULL) {
-	    pmNoMem("DoFetch.endResult", sizeof(__pmResult) + (nPmids - 1) * sizeof(pmValueSet *), PM_FATAL_ERR);
-	    /* NOTREACHED */
-	}
-	maxnpmids = nPmids;
+    if (pmcd_async_fetch) {
+	sts = QueueFetch(cip, pdutype, ctxnum, nPmids, pmidList);
+	__pmUnpinPDUBuf(pmidList);
+	return sts;
     }
 
     dList = SplitPmidList(nPmids, pmidList);
@@ -513,111 +627,34 @@ HandleFetch(ClientInfo *cip, __pmPDU* pb, int pdutype)
 	/* Read results from agents that have them ready */
 	for (i = 0; i < nAgents; i++) {
 	    AgentInfo	*ap = &agent[i];
-	    int		pinpdu;
 	    if (!ap->status.busy || !__pmFD_ISSET(ap->outFd, &readyFds))
 		continue;
 	    ap->status.busy = 0;
 	    __pmFD_CLR(ap->outFd, &waitFds);
 	    nWait--;
-	    pinpdu = sts = __pmGetPDU(ap->outFd, ANY_SIZE, pmcd_timeout, &pb);
-	    if (sts > 0)
-		pmcd_trace(TR_RECV_PDU, ap->outFd, sts, (int)((__psint_t)pb & 0xffffffff));
-	    if (sts == PDU_RESULT) {
-		__pmResult *rp;
-		if ((sts = __pmDecodeResult(pb, &rp)) >= 0) {
-		    results[i] = __pmOffsetResult(rp);
-		    if (results[i]->numpmid == aFreq[i]) {
-			changes |= ExtractState(&rp->timestamp);
-		    } else {
-			if (pmDebugOptions.appl0)
-			    pmNotifyErr(LOG_ERR, "DoFetch: \"%s\" agent given %d pmIDs, returned %d\n",
-					 ap->pmDomainLabel, aFreq[i], results[i]->numpmid);
-			__pmFreeResult(rp);
-			results[i] = NULL;
-			sts = PM_ERR_IPC;
-		    }
-		}
-	    }
-	    else {
-		if (sts == PDU_ERROR) {
-		    int s;
-		    if ((s = __pmDecodeError(pb, &sts)) < 0)
-			sts = s;
-		    else if (sts >= 0)
-			sts = PM_ERR_GENERIC;
-		    pmcd_trace(TR_RECV_ERR, ap->outFd, PDU_RESULT, sts);
-		}
-		else if (sts >= 0) {
-		    pmcd_trace(TR_WRONG_PDU, ap->outFd, PDU_RESULT, sts);
-		    sts = PM_ERR_IPC;
-		}
-	    }
-	    if (pinpdu > 0)
-		__pmUnpinPDUBuf(pb);
-
-	    if (sts < 0) {
-		/* Find entry in dList for this agent */
-		for (j = 0; dList[j].domain != -1; j++)
-		    if (dList[j].domain == agent[i].pmDomainId)
-			break;
-		results[i] = MakeBadResult(dList[j].listSize,
-					   dList[j].list, sts);
-
-		if (sts == PM_ERR_PMDANOTREADY) {
-		    /* the agent is indicating it can't handle PDUs for now */
-		    int k;
-
-		    for (k = 0; k < dList[j].listSize; k++)
-			results[i]->vset[k]->numval = PM_ERR_AGAIN;
-		    sts = CheckError(&agent[i], sts);
-		}
-
-		if (pmDebugOptions.appl0) {
-		    fprintf(stderr, "RESULT error from \"%s\" agent : %s\n",
-			    ap->pmDomainLabel, pmErrStr(sts));
-		}
-		if (sts == PM_ERR_IPC || sts == PM_ERR_TIMEOUT)
-		    CleanupAgent(ap, AT_COMM, ap->outFd);
-	    }
+	    /* Find entry in dList for this agent */
+	    for (j = 0; dList[j].domain != -1; j++)
+		if (dList[j].domain == ap->pmDomainId)
+		    break;
+	    results[i] = RecvFetch(&dList[j], ap, &changes);
 	}
     }
 
     if (changes)
 	MarkStateChanges(changes);
 
-    endResult->numpmid = nPmids;
-    __pmGetTimestamp(&endResult->timestamp);
-
     /* The order of the pmIDs in the per-domain results is the same as in the
      * original request, but on a per-domain basis.  resIndex is an array of
      * indices (one per agent) of the next metric to be retrieved from each
      * per-domain result value set.
      */
+    endResult = FetchEndResult(nPmids);
     memset(resIndex, 0, (nAgents + 1) * sizeof(resIndex[0]));
     for (i = 0; i < nPmids; i++) {
 	j = mapdom[((__pmID_int *)&pmidList[i])->domain];
 	endResult->vset[i] = results[j]->vset[resIndex[j]++];
     }
-
-    pmcd_trace(TR_XMIT_PDU, cip->fd, pdutype, nPmids);
-
-    sts = 0;
-    if (cip->status.changes) {
-	/* notify client of PMCD state change */
-	sts = __pmSendError(cip->fd, FROM_ANON, (int)cip->status.changes);
-	if (sts > 0)
-	    sts = 0;
-	cip->status.changes = 0;
-    }
-    if (sts == 0)
-	sts = (pdutype == PDU_HIGHRES_FETCH) ?
-		__pmSendHighResResult(cip->fd, FROM_ANON, endResult) :
-		__pmSendResult(cip->fd, FROM_ANON, endResult);
-
-    if (sts < 0) {
-	pmcd_trace(TR_XMIT_ERR, cip->fd, pdutype, sts);
-	CleanupClient(cip, sts);
-    }
+    SendEndResult(cip, pdutype, endResult);
 
     /*
      * pmFreeResult() all the accumulated results.
@@ -643,6 +680,787 @@ HandleFetch(ClientInfo *cip, __pmPDU* pb, int pdutype)
     return 0;
 }
 
+/*
+ * Asynchronous fetch dispatch (pmcd -F).
+ *
+ * Instead of blocking in HandleFetch() until every daemon PMDA has
+ * replied, each client fetch becomes a FetchReq that is split into
+ * per-domain FetchWait entries, queued on the agents concerned.  An
+ * agent has at most one fetch in flight (the PMDA protocol has no
+ * request identifiers, so replies are matched to the request at the
+ * head of the agent queue).  Replies are picked up by ClientLoop()
+ * along with client input, and the client's result is sent as soon
+ * as its last outstanding domain has answered.
+ *
+ * While a client has a fetch pending its fd is not watched for input,
+ * so no further PDUs are read from it and replies stay in order.  Any
+ * other request/reply exchange with a daemon agent (descriptors,
+ * instances, labels, stores) first calls FetchQuiesceAgent() to let
+ * that agent's fetches complete, and reconfiguration calls FetchDrain()
+ * for all agents, so the synchronous code never sees a stray reply.
+ *
+ * With fetch coalescing (pmcd -C), when a daemon agent becomes idle
+ * any other queued requests for it that share pmIDs with the one at
+ * the head of the queue, come from clients with the same instance
+ * profile and (for agents that are sent client attributes) the same
+ * credentials and container, are merged into a single fetch of the
+ * union of their pmIDs.  The reply is then fanned out, each client
+ * being given the value sets for its own pmIDs.  A non-zero window
+ * holds back the first request for up to that many milliseconds to
+ * give other clients fetching at the same time a chance to join in.
+ */
+int		pmcd_async_fetch;	/* -F command line option */
+int		pmcd_fetch_coalesce;	/* -C command line option */
+int		pmcd_fetch_window;	/* -C coalescing window (msec) */
+
+struct FetchMerge;
+
+typedef struct FetchReq {
+    int			client;		/* index into client[] */
+    unsigned int	seq;		/* client[].seq at time of request */
+    int			ctxnum;
+    int			pdutype;
+    int			nPmids;
+    pmID		*pmidList;	/* private copy of request pmIDs */
+    int			*slot;		/* per-pmID index into results[] */
+    DomPmidList		*dList;		/* private copy of split pmidList */
+    int			nResults;	/* nAgents + 1 when queued */
+    pmResult		**results;	/* replies, indexed like agent[] */
+    struct FetchMerge	**merge;	/* shared reply behind results[] */
+    int			nWait;		/* replies still outstanding */
+    unsigned int	changes;	/* PMCD_* state changes from agents */
+} FetchReq;
+
+typedef struct FetchWait {
+    struct FetchWait	*next;
+    FetchReq		*req;
+    DomPmidList		*dp;		/* pmIDs for this agent */
+    struct timeval	queued;		/* time request was queued */
+    struct FetchWait	*also;		/* requests coalesced with this one */
+    struct FetchMerge	*merge;		/* union of pmIDs, if coalesced */
+} FetchWait;
+
+/*
+ * A single agent fetch shared by several coalesced requests.  The
+ * agent's reply is owned here and released once every request that
+ * references its value sets has been completed.
+ */
+typedef struct FetchMerge {
+    int			refcnt;
+    pmResult		*result;	/* agent reply for dl */
+    __pmHashCtl		index;		/* pmID -> position in dl.list */
+    DomPmidList		dl;		/* union of coalesced pmIDs */
+    int			maxlist;	/* allocated length of dl.list */
+} FetchMerge;
+
+typedef struct {
+    FetchWait		*head;		/* queued, not yet sent */
+    FetchWait		*tail;
+    FetchWait		*active;	/* sent, awaiting reply */
+    struct timeval	deadline;	/* reply timeout for active */
+} FetchQueue;
+
+static FetchQueue	*fetchq;	/* indexed like agent[] */
+static int		nFetchq;
+static int		nActive;	/* agents with a fetch in flight */
+
+static ClientInfo *
+FetchClient(FetchReq *rp)
+{
+    ClientInfo	*cip;
+
+    if (rp->client >= nClients)
+	return NULL;
+    cip = &client[rp->client];
+    if (!cip->status.connected || cip->seq != rp->seq)
+	return NULL;
+    return cip;
+}
+
+/*
+ * DSO agents reuse their pmResult skeleton on the next call, so take
+ * a private copy of the pmValueSet pointers for a result that may be
+ * held while other clients' requests are serviced.
+ */
+static pmResult *
+CopyDsoResult(pmResult *skel)
+{
+    pmResult	*result;
+    size_t	need;
+
+    need = sizeof(pmResult) + (skel->numpmid - 1) * sizeof(pmValueSet *);
+    if (need < sizeof(pmResult))
+	need = sizeof(pmResult);
+    if ((result = (pmResult *)malloc(need)) == NULL) {
+	pmNoMem("CopyDsoResult", need, PM_FATAL_ERR);
+	/* NOTREACHED */
+    }
+    memcpy(result, skel, need);
+    return result;
+}
+
+static void FetchMergeRelease(FetchMerge *);
+
+static void
+FetchComplete(FetchReq *rp)
+{
+    static int		*resIndex;
+    static int		nIndex;
+    ClientInfo		*cip;
+    __pmResult		*endResult;
+    int			i, j;
+
+    if (rp->changes)
+	MarkStateChanges(rp->changes);
+
+    if ((cip = FetchClient(rp)) != NULL) {
+	if (rp->nResults > nIndex) {
+	    if (resIndex != NULL)
+		free(resIndex);
+	    if ((resIndex = (int *)malloc(rp->nResults * sizeof(int))) == NULL) {
+		pmNoMem("FetchComplete.resIndex", rp->nResults * sizeof(int), PM_FATAL_ERR);
+		/* NOTREACHED */
+	    }
+	    nIndex = rp->nResults;
+	}
+	/* as for HandleFetch, per-agent results are in request order */
+	endResult = FetchEndResult(rp->nPmids);
+	memset(resIndex, 0, rp->nResults * sizeof(resIndex[0]));
+	for (i = 0; i < rp->nPmids; i++) {
+	    j = rp->slot[i];
+	    endResult->vset[i] = rp->results[j]->vset[resIndex[j]++];
+	}
+	SendEndResult(cip, rp->pdutype, endResult);
+	if (cip->status.connected)
+	    ReadyWatch(cip->fd, READY_CLIENT, rp->client);
+    }
+
+    for (i = 0; i < rp->nResults; i++) {
+	if (rp->merge[i] != NULL) {
+	    /* value sets belong to the shared reply */
+	    free(rp->results[i]);
+	    FetchMergeRelease(rp->merge[i]);
+	}
+	else if (rp->results[i] != NULL)
+	    pmFreeResult(rp->results[i]);
+    }
+    free(rp);
+}
+
+static void
+FetchReply(FetchReq *rp, int i, pmResult *result)
+{
+    rp->results[i] = result;
+    if (--rp->nWait == 0)
+	FetchComplete(rp);
+}
+
+static pmProfile *
+FetchProfile(FetchReq *rp, ClientInfo *cip)
+{
+    static pmProfile	defprofile = {PM_PROFILE_INCLUDE, 0, NULL};
+    __pmHashNode	*hp;
+
+    if ((hp = __pmHashSearch(rp->ctxnum, &cip->profile)) != NULL)
+	return (pmProfile *)hp->data;
+    return &defprofile;
+}
+
+static int
+ProfileEqual(pmProfile *a, pmProfile *b)
+{
+    pmInDomProfile	*pa, *pb;
+    int			i;
+
+    if (a == b)
+	return 1;
+    if (a->state != b->state || a->profile_len != b->profile_len)
+	return 0;
+    for (i = 0; i < a->profile_len; i++) {
+	pa = &a->profile[i];
+	pb = &b->profile[i];
+	if (pa->indom != pb->indom || pa->state != pb->state ||
+	    pa->instances_len != pb->instances_len)
+	    return 0;
+	if (pa->instances_len > 0 &&
+	    memcmp(pa->instances, pb->instances,
+		   pa->instances_len * sizeof(pa->instances[0])) != 0)
+	    return 0;
+    }
+    return 1;
+}
+
+static int
+AttrEqual(ClientInfo *a, ClientInfo *b, int attr)
+{
+    __pmHashNode	*na = __pmHashSearch(attr, &a->attrs);
+    __pmHashNode	*nb = __pmHashSearch(attr, &b->attrs);
+
+    if (na == NULL || nb == NULL)
+	return na == nb;
+    if (na->data == NULL || nb->data == NULL)
+	return na->data == nb->data;
+    return strcmp((char *)na->data, (char *)nb->data) == 0;
+}
+
+/*
+ * Can the request from client b share an agent fetch with client a?
+ * Agents given client attributes may answer differently for different
+ * users or containers, so those must match too.
+ */
+static int
+FetchCompatible(AgentInfo *ap, FetchReq *ra, ClientInfo *a,
+		FetchReq *rb, ClientInfo *b)
+{
+    if (!ProfileEqual(FetchProfile(ra, a), FetchProfile(rb, b)))
+	return 0;
+    if ((ap->status.flags & (PDU_FLAG_AUTH|PDU_FLAG_CONTAINER)) == 0)
+	return 1;
+    return AttrEqual(a, b, PCP_ATTR_USERID) &&
+	   AttrEqual(a, b, PCP_ATTR_GROUPID) &&
+	   AttrEqual(a, b, PCP_ATTR_CONTAINER);
+}
+
+static void
+FetchMergeRelease(FetchMerge *mp)
+{
+    if (--mp->refcnt > 0)
+	return;
+    if (mp->result != NULL)
+	pmFreeResult(mp->result);
+    __pmHashClear(&mp->index);
+    free(mp->dl.list);
+    free(mp);
+}
+
+/*
+ * Add the pmIDs of dp not already present to the union in mp.
+ */
+static void
+FetchMergeAdd(FetchMerge *mp, DomPmidList *dp)
+{
+    size_t	need;
+    int		i;
+
+    for (i = 0; i < dp->listSize; i++) {
+	if (__pmHashSearch(dp->list[i], &mp->index) != NULL)
+	    continue;
+	if (mp->dl.listSize == mp->maxlist) {
+	    mp->maxlist = mp->maxlist ? 2 * mp->maxlist : dp->listSize;
+	    need = mp->maxlist * sizeof(pmID);
+	    if ((mp->dl.list = (pmID *)realloc(mp->dl.list, need)) == NULL) {
+		pmNoMem("FetchMergeAdd", need, PM_FATAL_ERR);
+		/* NOTREACHED */
+	    }
+	}
+	if (__pmHashAdd(dp->list[i], (void *)(__psint_t)mp->dl.listSize,
+			&mp->index) < 0) {
+	    pmNoMem("FetchMergeAdd.index", sizeof(__pmHashNode), PM_FATAL_ERR);
+	    /* NOTREACHED */
+	}
+	mp->dl.list[mp->dl.listSize++] = dp->list[i];
+    }
+}
+
+static int
+FetchOverlap(FetchMerge *mp, DomPmidList *dp)
+{
+    int		i;
+
+    for (i = 0; i < dp->listSize; i++)
+	if (__pmHashSearch(dp->list[i], &mp->index) != NULL)
+	    return 1;
+    return 0;
+}
+
+/*
+ * Pull any queued requests for agent i that can share the fetch about
+ * to be sent for wp off the queue, chaining them onto wp->also and
+ * building the union of their pmIDs in wp->merge.
+ */
+static void
+FetchCoalesce(int i, FetchWait *wp, ClientInfo *cip)
+{
+    FetchQueue		*qp = &fetchq[i];
+    AgentInfo		*ap = &agent[i];
+    FetchWait		*prev = NULL;
+    FetchWait		*next;
+    FetchWait		*np;
+    FetchMerge		*mp = NULL;
+    ClientInfo		*ncip;
+    int			n = 1;
+
+    for (np = qp->head; np != NULL; np = next) {
+	next = np->next;
+	if ((ncip = FetchClient(np->req)) == NULL ||
+	    !FetchCompatible(ap, wp->req, cip, np->req, ncip)) {
+	    prev = np;
+	    continue;
+	}
+	if (mp == NULL) {
+	    if ((mp = (FetchMerge *)calloc(1, sizeof(FetchMerge))) == NULL) {
+		pmNoMem("FetchCoalesce", sizeof(FetchMerge), PM_RECOV_ERR);
+		return;
+	    }
+	    mp->dl.domain = wp->dp->domain;
+	    FetchMergeAdd(mp, wp->dp);
+	}
+	if (!FetchOverlap(mp, np->dp)) {
+	    prev = np;
+	    continue;
+	}
+	/* unlink from the agent queue, join the shared fetch */
+	if (prev != NULL)
+	    prev->next = next;
+	else
+	    qp->head = next;
+	if (qp->tail == np)
+	    qp->tail = prev;
+	FetchMergeAdd(mp, np->dp);
+	np->next = NULL;
+	np->also = wp->also;
+	wp->also = np;
+	n++;
+    }
+    if (n == 1) {
+	if (mp != NULL)
+	    FetchMergeRelease(mp);
+	return;
+    }
+    if (pmDebugOptions.appl0)
+	fprintf(stderr, "FetchCoalesce: %d requests, %d pmIDs to \"%s\" agent\n",
+		n, mp->dl.listSize, ap->pmDomainLabel);
+    mp->refcnt = n;
+    wp->merge = mp;
+}
+
+/*
+ * Deliver an agent reply for wp, splitting a coalesced reply up so
+ * each request is given the value sets for its own pmIDs.
+ */
+static void
+FetchFanout(int i, FetchWait *wp, pmResult *result, unsigned int changes)
+{
+    FetchMerge		*mp = wp->merge;
+    FetchWait		*next;
+    pmResult		*rp;
+    __pmHashNode	*hp;
+    size_t		need;
+    int			j;
+
+    if (mp == NULL) {
+	wp->req->changes |= changes;
+	FetchReply(wp->req, i, result);
+	return;
+    }
+    mp->result = result;
+    for (; wp != NULL; wp = next) {
+	next = wp->also;	/* wp is freed along with its request */
+	wp->req->changes |= changes;
+	need = sizeof(pmResult) + (wp->dp->listSize - 1) * sizeof(pmValueSet *);
+	if (need < sizeof(pmResult))
+	    need = sizeof(pmResult);
+	if ((rp = (pmResult *)malloc(need)) == NULL) {
+	    pmNoMem("FetchFanout", need, PM_FATAL_ERR);
+	    /* NOTREACHED */
+	}
+	rp->timestamp = result->timestamp;
+	rp->numpmid = wp->dp->listSize;
+	for (j = 0; j < wp->dp->listSize; j++) {
+	    hp = __pmHashSearch(wp->dp->list[j], &mp->index);
+	    rp->vset[j] = result->vset[(int)(__psint_t)hp->data];
+	}
+	wp->req->merge[i] = mp;
+	FetchReply(wp->req, i, rp);
+    }
+}
+
+/*
+ * With a coalescing window, an idle daemon agent holds back the
+ * request at the head of its queue until the window has passed.
+ * Returns non-zero and sets *until if the agent is being held.
+ */
+static int fetchFlush;		/* ignore the window (draining) */
+
+static int
+FetchHold(int i, struct timeval *until)
+{
+    FetchQueue		*qp = &fetchq[i];
+    struct timeval	now;
+    struct timeval	window;
+
+    if (pmcd_fetch_window <= 0 || fetchFlush || qp->active != NULL ||
+	qp->head == NULL || agent[i].ipcType == AGENT_DSO)
+	return 0;
+    window.tv_sec = pmcd_fetch_window / 1000;
+    window.tv_usec = (pmcd_fetch_window % 1000) * 1000;
+    *until = qp->head->queued;
+    pmtimevalInc(until, &window);
+    pmtimevalNow(&now);
+    return pmtimevalSub(until, &now) > 0;
+}
+
+/*
+ * Send the next queued request to agent i, unless it already has one
+ * in flight.  DSO agents and failures complete immediately, so keep
+ * going until the queue is empty or a daemon agent is busy.
+ */
+static void
+FetchDispatch(int i)
+{
+    FetchQueue		*qp = &fetchq[i];
+    AgentInfo		*ap = &agent[i];
+    FetchWait		*wp;
+    FetchReq		*rp;
+    ClientInfo		*cip;
+    DomPmidList		*dp;
+    pmResult		*result;
+    struct timeval	until;
+    unsigned int	changes;
+
+    while (qp->active == NULL && (wp = qp->head) != NULL) {
+	if (FetchHold(i, &until))
+	    break;
+	if ((qp->head = wp->next) == NULL)
+	    qp->tail = NULL;
+	rp = wp->req;
+	changes = 0;
+	if ((cip = FetchClient(rp)) == NULL) {
+	    /* client has gone away, nothing to be sent */
+	    result = NULL;
+	}
+	else {
+	    if (pmcd_fetch_coalesce && ap->ipcType != AGENT_DSO &&
+		qp->head != NULL)
+		FetchCoalesce(i, wp, cip);
+	    dp = wp->merge ? &wp->merge->dl : wp->dp;
+	    if (!ap->status.connected) {
+		result = MakeBadResult(dp->listSize, dp->list, PM_ERR_NOAGENT);
+	    }
+	    else {
+		result = SendFetch(dp, ap, cip, rp->ctxnum);
+		if (result == NULL) {
+		    /* Wait for agent's response */
+		    ap->status.busy = 1;
+		    qp->active = wp;
+		    pmtimevalNow(&qp->deadline);
+		    qp->deadline.tv_sec += pmcd_timeout;
+		    nActive++;
+		    break;
+		}
+		changes = ExtractState(&result->timestamp);
+		if (ap->ipcType == AGENT_DSO && !ap->status.madeDsoResult)
+		    result = CopyDsoResult(result);
+	    }
+	}
+	FetchFanout(i, wp, result, changes);
+    }
+}
+
+static void
+FetchQueueCheck(void)
+{
+    size_t	need;
+
+    if (nAgents <= nFetchq)
+	return;
+    need = nAgents * sizeof(FetchQueue);
+    if ((fetchq = (FetchQueue *)realloc(fetchq, need)) == NULL) {
+	pmNoMem("FetchQueueCheck", need, PM_FATAL_ERR);
+	/* NOTREACHED */
+    }
+    memset(&fetchq[nFetchq], 0, (nAgents - nFetchq) * sizeof(FetchQueue));
+    nFetchq = nAgents;
+}
+
+static int
+QueueFetch(ClientInfo *cip, int pdutype, int ctxnum, int nPmids, pmID *pmidList)
+{
+    DomPmidList		*dList;
+    FetchReq		*rp;
+    FetchWait		*wp;
+    FetchQueue		*qp;
+    pmID		*pmids;
+    size_t		need;
+    int			nGood;
+    int			i, j;
+
+    FetchQueueCheck();
+    dList = SplitPmidList(nPmids, pmidList);
+    for (nGood = 0; dList[nGood].domain != -1; nGood++)
+	;
+
+    /*
+     * One allocation holds the request, its results[] array, the
+     * per-agent queue entries, the copied DomPmidLists and pmIDs.
+     */
+    need = sizeof(FetchReq) +
+	   (nAgents + 1) * sizeof(pmResult *) +
+	   (nAgents + 1) * sizeof(FetchMerge *) +
+	   nGood * sizeof(FetchWait) +
+	   (nGood + 1) * sizeof(DomPmidList) +
+	   nPmids * sizeof(int) +
+	   2 * nPmids * sizeof(pmID);
+    if ((rp = (FetchReq *)calloc(1, need)) == NULL) {
+	pmNoMem("QueueFetch", need, PM_RECOV_ERR);
+	return -oserror();
+    }
+    rp->client = cip - client;
+    rp->seq = cip->seq;
+    rp->ctxnum = ctxnum;
+    rp->pdutype = pdutype;
+    rp->nPmids = nPmids;
+    rp->nResults = nAgents + 1;
+    rp->results = (pmResult **)&rp[1];
+    rp->merge = (FetchMerge **)&rp->results[nAgents + 1];
+    wp = (FetchWait *)&rp->merge[nAgents + 1];
+    rp->dList = (DomPmidList *)&wp[nGood];
+    pmids = (pmID *)&rp->dList[nGood + 1];
+    rp->pmidList = &pmids[nPmids];
+    rp->slot = (int *)&rp->pmidList[nPmids];
+
+    memcpy(rp->dList, dList, (nGood + 1) * sizeof(DomPmidList));
+    memcpy(pmids, &dList[nGood + 1], nPmids * sizeof(pmID));
+    for (i = 0; i <= nGood; i++)
+	rp->dList[i].list = pmids + (dList[i].list - (pmID *)&dList[nGood + 1]);
+    memcpy(rp->pmidList, pmidList, nPmids * sizeof(pmID));
+    for (i = 0; i < nPmids; i++)
+	rp->slot[i] = mapdom[((__pmID_int *)&pmidList[i])->domain];
+
+    /* Construct pmResult for bad-pmID list */
+    if (rp->dList[nGood].listSize != 0)
+	rp->results[nAgents] = MakeBadResult(rp->dList[nGood].listSize,
+				rp->dList[nGood].list, PM_ERR_NOAGENT);
+
+    /* no further input from this client until the result is sent */
+    ReadyIgnore(cip->fd);
+
+    /*
+     * Queue on each agent, holding one extra reference on the request
+     * so it cannot complete before every agent has been dispatched.
+     */
+    rp->nWait = nGood + 1;
+    if (nGood > 0 && pmcd_fetch_window > 0)
+	pmtimevalNow(&wp[0].queued);
+    for (i = 0; i < nGood; i++) {
+	j = mapdom[rp->dList[i].domain];
+	qp = &fetchq[j];
+	wp[i].req = rp;
+	wp[i].dp = &rp->dList[i];
+	wp[i].queued = wp[0].queued;
+	wp[i].next = NULL;
+	if (qp->tail != NULL)
+	    qp->tail->next = &wp[i];
+	else
+	    qp->head = &wp[i];
+	qp->tail = &wp[i];
+    }
+    for (i = 0; i < nGood; i++)
+	FetchDispatch(mapdom[rp->dList[i].domain]);
+    if (--rp->nWait == 0)
+	FetchComplete(rp);
+
+    return 0;
+}
+
+/*
+ * Add the agents with a fetch in flight to a select(2) fd set.
+ * Returns the (possibly increased) nfds argument for select.
+ */
+int
+FetchAgentFds(__pmFdSet *fds, int nfds)
+{
+    int		i, fd;
+
+    for (i = 0; i < nFetchq && nActive > 0; i++) {
+	if (fetchq[i].active == NULL || (fd = agent[i].outFd) < 0)
+	    continue;
+	__pmFD_SET(fd, fds);
+	if (fd >= nfds)
+	    nfds = fd + 1;
+    }
+    return nfds;
+}
+
+/*
+ * Time until the earliest agent reply deadline or end of a coalescing
+ * window, or NULL if select may block indefinitely.
+ */
+struct timeval *
+FetchTimeout(struct timeval *tv)
+{
+    struct timeval	now;
+    struct timeval	until;
+    struct timeval	*first = NULL;
+    int			i;
+
+    if ((nActive == 0 || pmcd_timeout == 0) && pmcd_fetch_window <= 0)
+	return NULL;
+    for (i = 0; i < nFetchq; i++) {
+	if (fetchq[i].active == NULL) {
+	    if (FetchHold(i, &until) &&
+		(first == NULL || pmtimevalSub(&until, first) < 0)) {
+		*tv = until;
+		first = tv;
+	    }
+	    continue;
+	}
+	if (pmcd_timeout == 0)
+	    continue;
+	if (first == NULL || pmtimevalSub(&fetchq[i].deadline, first) < 0)
+	    first = &fetchq[i].deadline;
+    }
+    if (first == NULL)
+	return NULL;
+    pmtimevalNow(&now);
+    if (pmtimevalSub(first, &now) <= 0) {
+	tv->tv_sec = 0;
+	tv->tv_usec = 0;
+    }
+    else {
+	until = *first;
+	tv->tv_sec = until.tv_sec - now.tv_sec;
+	tv->tv_usec = until.tv_usec - now.tv_usec;
+	if (tv->tv_usec < 0) {
+	    tv->tv_usec += 1000000;
+	    tv->tv_sec--;
+	}
+    }
+    return tv;
+}
+
+/*
+ * Collect replies from agents that are ready, time out those that
+ * have not answered within pmcd_timeout seconds, and start the next
+ * queued request on each agent that becomes idle.
+ */
+void
+HandleFetchReplies(__pmFdSet *readyFds)
+{
+    struct timeval	now;
+    FetchWait		*wp;
+    AgentInfo		*ap;
+    DomPmidList		*dp;
+    pmResult		*result;
+    unsigned int	changes;
+    int			i;
+
+    if (nActive == 0 && pmcd_fetch_window <= 0)
+	return;
+    pmtimevalNow(&now);
+    for (i = 0; i < nFetchq; i++) {
+	if ((wp = fetchq[i].active) == NULL) {
+	    /* end of coalescing window? */
+	    if (fetchq[i].head != NULL)
+		FetchDispatch(i);
+	    continue;
+	}
+	ap = &agent[i];
+	dp = wp->merge ? &wp->merge->dl : wp->dp;
+	changes = 0;
+	if (ap->status.connected && ap->outFd >= 0 &&
+	    __pmFD_ISSET(ap->outFd, readyFds)) {
+	    ap->status.busy = 0;
+	    result = RecvFetch(dp, ap, &changes);
+	}
+	else if (!ap->status.connected || ap->outFd < 0) {
+	    result = MakeBadResult(dp->listSize, dp->list, PM_ERR_NOAGENT);
+	}
+	else if (pmcd_timeout != 0 &&
+		 pmtimevalSub(&fetchq[i].deadline, &now) <= 0) {
+	    pmNotifyErr(LOG_INFO, "DoFetch: \"%s\" agent timeout",
+			ap->pmDomainLabel);
+	    result = MakeBadResult(dp->listSize, dp->list, PM_ERR_NOAGENT);
+	    pmcd_trace(TR_RECV_TIMEOUT, ap->outFd, PDU_RESULT, 0);
+	    CleanupAgent(ap, AT_COMM, ap->inFd);
+	}
+	else
+	    continue;
+	fetchq[i].active = NULL;
+	nActive--;
+	FetchFanout(i, wp, result, changes);
+	FetchDispatch(i);
+    }
+}
+
+/*
+ * Block until all outstanding asynchronous fetches have completed.
+ */
+void
+FetchDrain(void)
+{
+    __pmFdSet		readyFds;
+    struct timeval	timeout;
+    struct timeval	*tp;
+    int			nfds;
+    int			sts;
+    int			i;
+
+    /* send anything held back for coalescing now */
+    fetchFlush = 1;
+    for (i = 0; i < nFetchq; i++)
+	FetchDispatch(i);
+
+    while (nActive > 0) {
+	__pmFD_ZERO(&readyFds);
+	nfds = FetchAgentFds(&readyFds, 0);
+	tp = FetchTimeout(&timeout);
+	setoserror(0);
+	sts = __pmSelectRead(nfds, &readyFds, tp);
+	if (sts < 0) {
+	    if (neterror() == EINTR)
+		continue;
+	    /* this is not expected to happen! */
+	    pmNotifyErr(LOG_ERR, "FetchDrain: fatal select failure: %s\n",
+			netstrerror());
+	    Shutdown();
+	    exit(1);
+	}
+	if (sts == 0)
+	    __pmFD_ZERO(&readyFds);
+	HandleFetchReplies(&readyFds);
+    }
+    fetchFlush = 0;
+}
+
+/*
+ * Complete the fetches queued on, or in flight to, one agent ahead of
+ * a synchronous request to it.  Returns non-zero if the agent cannot
+ * accept PDUs now (not ready, or cleaned up while waiting).
+ */
+int
+FetchQuiesceAgent(AgentInfo *ap)
+{
+    FetchQueue		*qp;
+    __pmFdSet		readyFds;
+    struct timeval	timeout;
+    struct timeval	*tp;
+    int			sts;
+
+    if (nActive > 0 && ap >= agent && ap < &agent[nFetchq]) {
+	qp = &fetchq[ap - agent];
+	while (qp->active != NULL) {
+	    __pmFD_ZERO(&readyFds);
+	    __pmFD_SET(ap->outFd, &readyFds);
+	    tp = FetchTimeout(&timeout);
+	    setoserror(0);
+	    sts = __pmSelectRead(ap->outFd + 1, &readyFds, tp);
+	    if (sts < 0) {
+		if (neterror() == EINTR)
+		    continue;
+		pmNotifyErr(LOG_ERR, "FetchQuiesceAgent: fatal select failure: %s\n",
+			    netstrerror());
+		Shutdown();
+		exit(1);
+	    }
+	    if (sts == 0)
+		__pmFD_ZERO(&readyFds);
+	    HandleFetchReplies(&readyFds);
+	}
+    }
+    return ap->status.notReady || !ap->status.connected;
+}
+
 int
 DoFetch(ClientInfo *cip, __pmPDU *pb)
 {
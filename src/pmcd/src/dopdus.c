@@ -79,7 +79,7 @@ DoText(ClientInfo *cp, __pmPDU* pb)
 					  ap->ipc.dso.dispatch.version.any.ext);
     }
     else {
-	if (ap->status.notReady)
+	if (FetchQuiesceAgent(ap))
 	    return PM_ERR_AGAIN;
 	pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_TEXT_REQ, ident);
 	sts = __pmSendTextReq(ap->inFd, cp - client, ident, type);
@@ -202,7 +202,7 @@ GetDescs(ClientInfo *cp, int numpmid, pmID *pmids, pmDesc *descs)
 	    }
 	}
 	else {
-	    if (ap->status.notReady) {
+	    if (FetchQuiesceAgent(ap)) {
 		descs[i].pmid = PM_ID_NULL;
 		sts = PM_ERR_AGAIN;
 		continue;
@@ -346,7 +346,7 @@ DoInstance(ClientInfo *cp, __pmPDU *pb)
 					ap->ipc.dso.dispatch.version.any.ext);
     }
     else {
-	if (ap->status.notReady) {
+	if (FetchQuiesceAgent(ap)) {
 	    if (name != NULL) free(name);
 	    return PM_ERR_AGAIN;
 	}
@@ -547,7 +547,7 @@ DoLabel(ClientInfo *cp, __pmPDU *pb)
 	    nsets = sts;
     }
     else {
-	if (ap->status.notReady)
+	if (FetchQuiesceAgent(ap))
 	    return PM_ERR_AGAIN;
 
 	/* status.madeDsoResult is only used for DSO agents so don't waste time by
@@ -690,7 +690,7 @@ DoPMNSIDs(ClientInfo *cp, __pmPDU *pb)
 	}
 	else {
 	    /* daemon PMDA ... ship request on */
-	    if (ap->status.notReady)
+	    if (FetchQuiesceAgent(ap))
 		return PM_ERR_AGAIN;
 	    pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_PMNS_IDS, 1);
 	    sts = __pmSendIDList(ap->inFd, cp - client, 1, &idlist[0], 0);
@@ -808,7 +808,7 @@ DoPMNSNames(ClientInfo *cp, __pmPDU *pb)
 	    else {
 		/* daemon PMDA ... ship request on */
 		int		fdfail = -1;
-		if (ap->status.notReady)
+		if (FetchQuiesceAgent(ap))
 		    lsts = PM_ERR_AGAIN;
 		else {
 		    pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_PMNS_NAMES, 1);
@@ -941,7 +941,7 @@ DoPMNSChild(ClientInfo *cp, __pmPDU *pb)
 	else {
 	    /* daemon PMDA ... ship request on */
 	    int		fdfail = -1;
-	    if (ap->status.notReady)
+	    if (FetchQuiesceAgent(ap))
 		sts = PM_ERR_AGAIN;
 	    else {
 		pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_PMNS_CHILD, 1);
@@ -1124,7 +1124,7 @@ traverse_dynamic(ClientInfo *cp, char *start, int *num_names, char ***names)
 	    else {
 		/* daemon PMDA ... ship request on */
 		int		fdfail = -1;
-		if (ap->status.notReady)
+		if (FetchQuiesceAgent(ap))
 		    continue;
 		pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_PMNS_TRAVERSE, 1);
 		sts = __pmSendTraversePMNSReq(ap->inFd, cp - client, namelist[0]);
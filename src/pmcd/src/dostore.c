@@ -168,7 +168,7 @@ DoStore(ClientInfo *cp, __pmPDU* pb)
 					ap->ipc.dso.dispatch.version.any.ext);
 	}
 	else {
-	    if (ap->status.notReady == 0) {
+	    if (!FetchQuiesceAgent(ap)) {
 		/* agent is ready for PDUs */
 		pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_RESULT, dResult[i]->numpmid);
 		s = __pmSendResult(ap->inFd, cp - client, dResult[i]);
@@ -47,6 +47,7 @@ int		labelChanged;		/* For SIGHUP labels check */
 static int	timeToDie;		/* For SIGINT handling */
 static int	restart;		/* For SIGHUP restart */
 static int	maxReqPortFd;		/* Largest request port fd */
+static __pmFdSet	reqPortFds;	/* Request port fds */
 static char	configFileName[MAXPATHLEN]; /* path to pmcd.conf */
 static char	*logfile = "pmcd.log";	/* log file name */
 static int	run_daemon = 1;		/* run as a daemon, see -f */
@@ -111,6 +112,8 @@ static pmLongOptions longopts[] = {
     { "username", 1, 'U', "USER", "in daemon mode, run as named user [default pcp]" },
     PMAPI_OPTIONS_HEADER("Configuration options"),
     { "config", 1, 'c', "PATH", "path to configuration file" },
+    { "asyncfetch", 0, 'F', 0, "service other clients while PMDA fetches are pending" },
+    { "coalesce", 1, 'C', "MSEC", "coalesce PMDA fetches from clients arriving within MSEC (implies -F)" },
     { "", 1, 'L', "BYTES", "maximum size for PDUs from clients [default 65536]" },
     { "", 1, 'q', "TIME", "PMDA initial negotiation timeout (seconds) [default 3]" },
     { "", 1, 't', "TIME", "PMDA response timeout (seconds) [default 5]" },
@@ -130,7 +133,7 @@ static pmLongOptions longopts[] = {
 
 static pmOptions opts = {
     .flags = PM_OPTFLAG_POSIX,
-    .short_options = "Ac:D:fH:i:l:L:N:n:p:q:Qs:St:T:U:vx:?",
+    .short_options = "Ac:C:D:fFH:i:l:L:N:n:p:q:Qs:St:T:U:vx:?",
     .long_options = longopts,
 };
 
@@ -158,6 +161,20 @@ ParseOptions(int argc, char *argv[], int *nports)
 		strncpy(configFileName, opts.optarg, sizeof(configFileName)-1);
 		break;
 
+	    case 'C':
+		/* coalesce matching PMDA fetches from different clients */
+		val = (int)strtol(opts.optarg, &endptr, 10);
+		if (*endptr != '\0' || val < 0) {
+		    pmprintf("%s: -C requires a non-negative numeric argument\n",
+			pmGetProgname());
+		    opts.errors++;
+		} else {
+		    pmcd_fetch_coalesce = 1;
+		    pmcd_fetch_window = val;
+		    pmcd_async_fetch = 1;
+		}
+		break;
+
 	    case 'D':	/* debug options */
 		sts = pmSetDebug(opts.optarg);
 		if (sts < 0) {
@@ -172,6 +189,11 @@ ParseOptions(int argc, char *argv[], int *nports)
 		run_daemon = 0;
 		break;
 
+	    case 'F':
+		/* asynchronous, non-blocking fetch dispatch to PMDAs */
+		pmcd_async_fetch = 1;
+		break;
+
 	    case 'i':
 		/* one (of possibly several) interfaces for client requests */
 		__pmServerAddInterface(opts.optarg);
@@ -350,154 +372,149 @@ hostname_changed(void)
 }
 
 /*
- * Determine which clients (if any) have sent data to the server and handle it
- * as required.
+ * Handle input from a client that has sent data to the server.
  */
 void
-HandleClientInput(__pmFdSet *fdsPtr)
+HandleClientInput(int i)
 {
     int		sts;
-    int		i;
+    int		pinpdu;
     __pmPDU	*pb;
     __pmPDUHdr	*php;
     ClientInfo	*cp;
 
-    for (i = 0; i < nClients; i++) {
-	int		pinpdu;
-
-	if (!client[i].status.connected || !__pmFD_ISSET(client[i].fd, fdsPtr))
-	    continue;
+    if (!client[i].status.connected)
+	return;
 
-	cp = &client[i];
-	this_client_id = i;
+    cp = &client[i];
+    this_client_id = i;
 
-	pinpdu = sts = __pmGetPDU(cp->fd, LIMIT_SIZE, pmcd_timeout, &pb);
-	if (sts > 0) {
-	    pmcd_trace(TR_RECV_PDU, cp->fd, sts, (int)((__psint_t)pb & 0xffffffff));
-	} else {
-	    CleanupClient(cp, sts);
-	    continue;
-	}
+    pinpdu = sts = __pmGetPDU(cp->fd, LIMIT_SIZE, pmcd_timeout, &pb);
+    if (sts > 0) {
+	pmcd_trace(TR_RECV_PDU, cp->fd, sts, (int)((__psint_t)pb & 0xffffffff));
+    } else {
+	CleanupClient(cp, sts);
+	return;
+    }
 
-	php = (__pmPDUHdr *)pb;
-	if (__pmVersionIPC(cp->fd) == UNKNOWN_VERSION && php->type != PDU_CREDS) {
-	    /* old V1 client protocol, no longer supported */
-	    sts = PM_ERR_IPC;
-	    CleanupClient(cp, sts);
-	    __pmUnpinPDUBuf(pb);
-	    continue;
-	}
+    php = (__pmPDUHdr *)pb;
+    if (__pmVersionIPC(cp->fd) == UNKNOWN_VERSION && php->type != PDU_CREDS) {
+	/* old V1 client protocol, no longer supported */
+	sts = PM_ERR_IPC;
+	CleanupClient(cp, sts);
+	__pmUnpinPDUBuf(pb);
+	return;
+    }
 
-	if (pmDebugOptions.appl3)
-	    ShowClients(stderr);
+    if (pmDebugOptions.appl3)
+	ShowClients(stderr);
 
-	switch (php->type) {
-	    case PDU_PROFILE:
-		if (hostname_changed()) {
-		    sts = 0;
-		    break;
-		}
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoProfile(cp, pb);
+    switch (php->type) {
+	case PDU_PROFILE:
+	    if (hostname_changed()) {
+		sts = 0;
 		break;
+	    }
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoProfile(cp, pb);
+	    break;
 
-	    case PDU_FETCH:
-		if (hostname_changed()) {
-		    sts = 0;
-		    break;
-		}
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoFetch(cp, pb);
+	case PDU_FETCH:
+	    if (hostname_changed()) {
+		sts = 0;
 		break;
+	    }
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoFetch(cp, pb);
+	    break;
 
-	    case PDU_HIGHRES_FETCH:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoHighResFetch(cp, pb);
-		break;
+	case PDU_HIGHRES_FETCH:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoHighResFetch(cp, pb);
+	    break;
 
-	    case PDU_INSTANCE_REQ:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoInstance(cp, pb);
-		break;
+	case PDU_INSTANCE_REQ:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoInstance(cp, pb);
+	    break;
 
-	    case PDU_LABEL_REQ:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoLabel(cp, pb);
-		break;
+	case PDU_LABEL_REQ:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoLabel(cp, pb);
+	    break;
 
-	    case PDU_DESC_REQ:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoDesc(cp, pb);
-		break;
+	case PDU_DESC_REQ:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoDesc(cp, pb);
+	    break;
 
-	    case PDU_DESC_IDS:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoDescIDs(cp, pb);
-		break;
+	case PDU_DESC_IDS:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoDescIDs(cp, pb);
+	    break;
 
-	    case PDU_TEXT_REQ:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoText(cp, pb);
-		break;
+	case PDU_TEXT_REQ:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoText(cp, pb);
+	    break;
 
-	    case PDU_RESULT:
-		sts = (cp->denyOps & PMCD_OP_STORE) ?
-		      PM_ERR_PERMISSION : DoStore(cp, pb);
-		break;
+	case PDU_RESULT:
+	    sts = (cp->denyOps & PMCD_OP_STORE) ?
+		  PM_ERR_PERMISSION : DoStore(cp, pb);
+	    break;
 
-	    case PDU_PMNS_IDS:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoPMNSIDs(cp, pb);
-		break;
+	case PDU_PMNS_IDS:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoPMNSIDs(cp, pb);
+	    break;
 
-	    case PDU_PMNS_NAMES:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoPMNSNames(cp, pb);
-		break;
+	case PDU_PMNS_NAMES:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoPMNSNames(cp, pb);
+	    break;
 
-	    case PDU_PMNS_CHILD:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoPMNSChild(cp, pb);
-		break;
+	case PDU_PMNS_CHILD:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoPMNSChild(cp, pb);
+	    break;
 
-	    case PDU_PMNS_TRAVERSE:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoPMNSTraverse(cp, pb);
-		break;
+	case PDU_PMNS_TRAVERSE:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoPMNSTraverse(cp, pb);
+	    break;
 
-	    case PDU_CREDS:
-		sts = DoCreds(cp, pb);
-		break;
+	case PDU_CREDS:
+	    sts = DoCreds(cp, pb);
+	    break;
 
-	    default:
-		sts = PM_ERR_IPC;
-	}
-	if (sts < 0) {
-	    if (pmDebugOptions.appl0)
-		fprintf(stderr, "PDU:  %s client[%d]: %s\n",
-		    __pmPDUTypeStr(php->type), i, pmErrStr(sts));
-	    /* Make sure client still alive before sending. */
-	    if (cp->status.connected) {
-		pmcd_trace(TR_XMIT_PDU, cp->fd, PDU_ERROR, sts);
-		sts = __pmSendError(cp->fd, FROM_ANON, sts);
-		if (sts < 0)
-		    pmNotifyErr(LOG_ERR, "HandleClientInput: "
-			"error sending Error PDU to client[%d] %s\n", i, pmErrStr(sts));
-	    }
+	default:
+	    sts = PM_ERR_IPC;
+    }
+    if (sts < 0) {
+	if (pmDebugOptions.appl0)
+	    fprintf(stderr, "PDU:  %s client[%d]: %s\n",
+		__pmPDUTypeStr(php->type), i, pmErrStr(sts));
+	/* Make sure client still alive before sending. */
+	if (cp->status.connected) {
+	    pmcd_trace(TR_XMIT_PDU, cp->fd, PDU_ERROR, sts);
+	    sts = __pmSendError(cp->fd, FROM_ANON, sts);
+	    if (sts < 0)
+		pmNotifyErr(LOG_ERR, "HandleClientInput: "
+		    "error sending Error PDU to client[%d] %s\n", i, pmErrStr(sts));
 	}
-	if (pinpdu > 0)
-	    __pmUnpinPDUBuf(pb);
+    }
+    if (pinpdu > 0)
+	__pmUnpinPDUBuf(pb);
 
-	/*
-	 * May need to send connection attributes to interested PMDAs, if
-	 * something changed for this client during this PDU exchange.
-	 */
-	if (client[i].status.attributes) {
-	    if (pmDebugOptions.appl5)
-		fprintf(stderr, "Client idx=%d,seq=%d attrs reset\n",
-				i, client[i].seq);
-	    AgentsAttributes(i);
-	}
+    /*
+     * May need to send connection attributes to interested PMDAs, if
+     * something changed for this client during this PDU exchange.
+     */
+    if (client[i].status.attributes) {
+	if (pmDebugOptions.appl5)
+	    fprintf(stderr, "Client idx=%d,seq=%d attrs reset\n",
+			    i, client[i].seq);
+	AgentsAttributes(i);
     }
 }
 
@@ -833,54 +850,75 @@ static void
 ClientLoop(void)
 {
     int		i, fd, sts;
-    int		maxFd;
-    int		checkAgents;
     int		reload_namespace = 0;
     int		restartAgents = -1;	/* initial state unknown */
-    __pmFdSet	readableFds;
+    __pmFdSet	agentFds;
+    __pmFdSet	newFds;
+    ReadyEvent	*ep;
+    struct timeval	timeout;
+
+    ReadyInit();
+    for (fd = 0; fd <= maxReqPortFd; fd++) {
+	if (!__pmFD_ISSET(fd, &reqPortFds))
+	    continue;
+	if ((sts = ReadyWatch(fd, READY_REQPORT, 0)) < 0) {
+	    pmNotifyErr(LOG_ERR, "ClientLoop: request port %s: %s\n",
+			FdToString(fd), pmErrStr(sts));
+	    return;
+	}
+    }
 
     for (;;) {
 
-	/* Figure out which file descriptors to wait for input on.  Keep
-	 * track of the highest numbered descriptor for the select call.
-	 */
-	readableFds = clientFds;
-	maxFd = maxClientFd + 1;
-
 	/* If an agent was not ready, it may send an ERROR PDU to indicate it
-	 * is now ready.  Add such agents to the list of file descriptors.
+	 * is now ready, and with asynchronous fetches an agent may have a
+	 * reply pending.  Wait for input from such agents as well.
 	 */
-	checkAgents = 0;
 	for (i = 0; i < nAgents; i++) {
 	    AgentInfo	*ap = &agent[i];
 
 	    if (ap->status.notReady) {
-		fd = ap->outFd;
-		__pmFD_SET(fd, &readableFds);
-		if (fd > maxFd)
-		    maxFd = fd + 1;
-		checkAgents = 1;
+		ReadyOnce(ap->outFd, READY_AGENT, i);
 		if (pmDebugOptions.appl0)
 		    pmNotifyErr(LOG_INFO,
-				 "not ready: check %s agent on fd %d (max = %d)\n",
-				 ap->pmDomainLabel, fd, maxFd);
+				 "not ready: check %s agent on fd %d\n",
+				 ap->pmDomainLabel, ap->outFd);
 	    }
+	    else if (ap->status.busy && ap->status.connected)
+		ReadyOnce(ap->outFd, READY_AGENT, i);
 	}
 
-	sts = __pmSelectRead(maxFd, &readableFds, NULL);
-	if (sts > 0) {
-	    if (pmDebugOptions.appl0)
-		for (i = 0; i <= maxClientFd; i++)
-		    if (__pmFD_ISSET(i, &readableFds))
-			fprintf(stderr, "DATA: from %s (fd %d)\n",
-				FdToString(i), i);
-	    __pmServerAddNewClients(&readableFds, CheckNewClient);
-	    if (checkAgents)
-		reload_namespace = HandleReadyAgents(&readableFds);
-	    HandleClientInput(&readableFds);
+	sts = ReadyWait(pmcd_async_fetch ? FetchTimeout(&timeout) : NULL);
+	if (sts >= 0) {
+	    /*
+	     * Agents first (fetch replies may complete client requests),
+	     * then clients, and new connections last so a client slot
+	     * or fd released above cannot be confused with a new one.
+	     */
+	    __pmFD_ZERO(&agentFds);
+	    __pmFD_ZERO(&newFds);
+	    while ((ep = ReadyNext()) != NULL) {
+		if (pmDebugOptions.appl0)
+		    fprintf(stderr, "DATA: from %s (fd %d)\n",
+			    FdToString(ep->fd), ep->fd);
+		if (ep->kind == READY_AGENT)
+		    __pmFD_SET(ep->fd, &agentFds);
+	    }
+	    if (pmcd_async_fetch)
+		HandleFetchReplies(&agentFds);
+	    if (sts > 0)
+		reload_namespace = HandleReadyAgents(&agentFds);
+	    ReadyRewind();
+	    while ((ep = ReadyNext()) != NULL) {
+		if (ep->kind == READY_CLIENT)
+		    HandleClientInput(ep->index);
+		else if (ep->kind == READY_REQPORT)
+		    __pmFD_SET(ep->fd, &newFds);
+	    }
+	    __pmServerAddNewClients(&newFds, CheckNewClient);
 	}
-	else if (sts == -1 && neterror() != EINTR) {
-	    pmNotifyErr(LOG_ERR, "ClientLoop select: %s\n", netstrerror());
+	else if (neterror() != EINTR) {
+	    pmNotifyErr(LOG_ERR, "ClientLoop wait: %s\n", netstrerror());
 	    break;
 	}
 	if (AgentDied) {
@@ -910,6 +948,8 @@ ClientLoop(void)
 	if (restart) {
 	    restart = 0;
 	    reload_namespace = 1;
+	    if (pmcd_async_fetch)
+		FetchDrain();
 	    SignalRestart();
 	}
 	if (reload_namespace) {
@@ -1078,9 +1118,9 @@ main(int argc, char *argv[])
     __pmSetSignalHandler(SIGBUS, SigBad);
     __pmSetSignalHandler(SIGSEGV, SigBad);
 
-    if ((sts = __pmServerOpenRequestPorts(&clientFds, maxpending)) < 0)
+    if ((sts = __pmServerOpenRequestPorts(&reqPortFds, maxpending)) < 0)
 	DontStart();
-    maxReqPortFd = maxClientFd = sts;
+    maxReqPortFd = sts;
 
     /*
      * would prefer open log earlier so any messages up to this point
@@ -1270,9 +1310,6 @@ CleanupClient(ClientInfo *cp, int sts)
     pmcd_trace(TR_DEL_CLIENT, cp-client, cp->fd, sts);
     DeleteClient(cp);
 
-    if (maxClientFd < maxReqPortFd)
-	maxClientFd = maxReqPortFd;
-
     for (i = 0; i < nAgents; i++)
 	if (agent[i].profClient == cp)
 	    agent[i].profClient = NULL;
@@ -205,6 +205,11 @@ extern int pmcd_load_libpcp_pmda(void);
  */
 extern int DoFetch(ClientInfo *, __pmPDU *);
 extern int DoHighResFetch(ClientInfo *, __pmPDU *);
+extern int FetchAgentFds(__pmFdSet *, int);
+extern struct timeval *FetchTimeout(struct timeval *);
+extern void HandleFetchReplies(__pmFdSet *);
+extern void FetchDrain(void);
+extern int FetchQuiesceAgent(AgentInfo *);
 extern int DoProfile(ClientInfo *, __pmPDU *);
 extern int DoDesc(ClientInfo *, __pmPDU *);
 extern int DoDescIDs(ClientInfo *, __pmPDU *);
@@ -218,6 +223,27 @@ extern int DoPMNSNames(ClientInfo *, __pmPDU *);
 extern int DoPMNSChild(ClientInfo *, __pmPDU *);
 extern int DoPMNSTraverse(ClientInfo *, __pmPDU *);
 
+/*
+ * Main loop input readiness (epoll or select)
+ */
+#define READY_REQPORT	1		/* client request port */
+#define READY_CLIENT	2		/* client[index] connection */
+#define READY_AGENT	3		/* agent[index] output */
+
+typedef struct {
+    int		fd;
+    int		kind;			/* READY_* */
+    int		index;
+} ReadyEvent;
+
+extern void ReadyInit(void);
+extern int ReadyWatch(int, int, int);
+extern void ReadyIgnore(int);
+extern void ReadyOnce(int, int, int);
+extern int ReadyWait(struct timeval *);
+extern ReadyEvent *ReadyNext(void);
+extern void ReadyRewind(void);
+
 /*
  * General purpose routines
  */
@@ -261,4 +287,11 @@ PMCD_DATA extern int pmcd_seqnum;
 /* Flag indicating whether agents are currently fenced */
 PMCD_DATA extern int pmcd_fenced;
 
+/* Flag indicating fetches are dispatched asynchronously (-F) */
+extern int pmcd_async_fetch;
+
+/* Coalescing of matching fetches from different clients (-C) */
+extern int pmcd_fetch_coalesce;
+extern int pmcd_fetch_window;		/* milliseconds */
+
 #endif /* _PMCD_H */
@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * Input readiness for the pmcd main loop.
+ *
+ * Request ports and client connections are registered once (ReadyWatch)
+ * and stay registered until the connection is closed (ReadyIgnore), so
+ * with epoll(7) the cost of each ReadyWait() depends on the number of
+ * descriptors that are ready, not the number of connected clients.
+ * Agent descriptors are only of interest while the agent is not ready
+ * or has a fetch outstanding, so these are added for a single wait
+ * (ReadyOnce).
+ *
+ * Where epoll is unavailable the same interface is provided using
+ * select(2), with the usual FD_SETSIZE limit on descriptor numbers.
+ */
+
+#include "pmapi.h"
+#include "libpcp.h"
+#include "pmcd.h"
+#if defined(HAVE_SYS_EPOLL_H)
+#include <sys/epoll.h>
+#endif
+
+typedef struct {
+    int		kind;		/* READY_* or zero if not watched */
+    int		index;		/* client[] or agent[] index */
+} ReadyTag;
+
+static ReadyTag		*tags;		/* indexed by fd */
+static int		ntags;
+
+static ReadyEvent	*ready;		/* results from last ReadyWait */
+static int		nready;
+static int		maxready;
+static int		nextready;
+
+static int		once[MAXDOMID + 2];	/* fds for this wait only */
+static int		nonce;
+
+#if defined(HAVE_SYS_EPOLL_H)
+static int		epfd = -1;
+static struct epoll_event *epevents;
+static int		maxepevents;
+#endif
+static __pmFdSet	watchFds;	/* select(2) backend */
+static int		maxWatchFd = -1;
+
+static ReadyTag *
+ReadyTagFd(int fd)
+{
+    size_t	need;
+    int		n;
+
+    if (fd >= ntags) {
+	for (n = ntags ? ntags : 64; n <= fd; n *= 2)
+	    ;
+	need = n * sizeof(ReadyTag);
+	if ((tags = (ReadyTag *)realloc(tags, need)) == NULL) {
+	    pmNoMem("ReadyTagFd", need, PM_FATAL_ERR);
+	    /* NOTREACHED */
+	}
+	memset(&tags[ntags], 0, (n - ntags) * sizeof(ReadyTag));
+	ntags = n;
+    }
+    return &tags[fd];
+}
+
+/*
+ * Choose the readiness backend; epoll if the kernel supports it.
+ */
+void
+ReadyInit(void)
+{
+    maxready = 64;
+    if ((ready = (ReadyEvent *)malloc(maxready * sizeof(ReadyEvent))) == NULL) {
+	pmNoMem("ReadyInit", maxready * sizeof(ReadyEvent), PM_FATAL_ERR);
+	/* NOTREACHED */
+    }
+    __pmFD_ZERO(&watchFds);
+#if defined(HAVE_SYS_EPOLL_H)
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+	pmNotifyErr(LOG_WARNING, "ReadyInit: epoll_create1 failed, "
+			"using select: %s\n", osstrerror());
+	return;
+    }
+    maxepevents = 64;
+    if ((epevents = malloc(maxepevents * sizeof(struct epoll_event))) == NULL) {
+	pmNoMem("ReadyInit", maxepevents * sizeof(struct epoll_event), PM_FATAL_ERR);
+	/* NOTREACHED */
+    }
+    if (pmDebugOptions.appl0)
+	fprintf(stderr, "ReadyInit: using epoll (fd %d)\n", epfd);
+#endif
+}
+
+/*
+ * Start waiting for input on fd, tagged with what it is for.
+ * Returns 0 on success, else a negative error code.
+ */
+int
+ReadyWatch(int fd, int kind, int index)
+{
+    ReadyTag		*tp;
+#if defined(HAVE_SYS_EPOLL_H)
+    struct epoll_event	ev;
+#endif
+
+    if (fd < 0)
+	return -EBADF;
+    tp = ReadyTagFd(fd);
+    if (tp->kind != 0) {
+	/* already watched, just update the tag */
+	tp->kind = kind;
+	tp->index = index;
+	return 0;
+    }
+#if defined(HAVE_SYS_EPOLL_H)
+    if (epfd >= 0) {
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+	    return -oserror();
+    }
+    else
+#endif
+    {
+	if (fd >= FD_SETSIZE)
+	    return -EMFILE;
+	__pmFD_SET(fd, &watchFds);
+	if (fd > maxWatchFd)
+	    maxWatchFd = fd;
+    }
+    tp->kind = kind;
+    tp->index = index;
+    return 0;
+}
+
+static void
+ReadyRemove(int fd)
+{
+    int		i;
+
+    if (fd < 0 || fd >= ntags || tags[fd].kind == 0)
+	return;
+    tags[fd].kind = 0;
+#if defined(HAVE_SYS_EPOLL_H)
+    if (epfd >= 0) {
+	/* ev argument is ignored, but must be non-NULL on old kernels */
+	struct epoll_event	ev = { 0 };
+	epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev);
+    }
+    else
+#endif
+    {
+	__pmFD_CLR(fd, &watchFds);
+	if (fd == maxWatchFd) {
+	    for (i = fd - 1; i >= 0; i--)
+		if (i < ntags && tags[i].kind != 0)
+		    break;
+	    maxWatchFd = i;
+	}
+    }
+}
+
+/*
+ * Stop waiting for input on fd; must be called before fd is closed.
+ */
+void
+ReadyIgnore(int fd)
+{
+    int		i;
+
+    ReadyRemove(fd);
+    /* forget any pending event for the old use of this fd */
+    for (i = 0; i < nready; i++)
+	if (ready[i].fd == fd)
+	    ready[i].kind = 0;
+}
+
+/*
+ * Also wait for input on fd, but only in the next ReadyWait call.
+ */
+void
+ReadyOnce(int fd, int kind, int index)
+{
+    if (fd < 0 || nonce >= (int)(sizeof(once) / sizeof(once[0])))
+	return;
+    if (ReadyWatch(fd, kind, index) == 0)
+	once[nonce++] = fd;
+}
+
+static void
+ReadyAdd(int fd)
+{
+    size_t	need;
+
+    if (fd >= ntags || tags[fd].kind == 0)
+	return;
+    if (nready == maxready) {
+	maxready *= 2;
+	need = maxready * sizeof(ReadyEvent);
+	if ((ready = (ReadyEvent *)realloc(ready, need)) == NULL) {
+	    pmNoMem("ReadyAdd", need, PM_FATAL_ERR);
+	    /* NOTREACHED */
+	}
+    }
+    ready[nready].fd = fd;
+    ready[nready].kind = tags[fd].kind;
+    ready[nready].index = tags[fd].index;
+    nready++;
+}
+
+/*
+ * Wait for input on the watched descriptors, for up to timeout (or
+ * indefinitely if NULL).  Returns the number of ready descriptors,
+ * which can then be retrieved with ReadyNext, 0 on timeout or -1 on
+ * error (with errno set).
+ */
+int
+ReadyWait(struct timeval *timeout)
+{
+    __pmFdSet	readyFds;
+    int		sts, i, fd;
+    int		maxfd;
+    int		err;
+
+    nready = nextready = 0;
+#if defined(HAVE_SYS_EPOLL_H)
+    if (epfd >= 0) {
+	int	msec = -1;
+
+	if (timeout != NULL)
+	    msec = timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+	setoserror(0);
+	sts = epoll_wait(epfd, epevents, maxepevents, msec);
+	for (i = 0; i < sts; i++)
+	    ReadyAdd(epevents[i].data.fd);
+	if (sts == maxepevents) {
+	    /* may be more, grow the buffer for next time */
+	    struct epoll_event	*tmp;
+	    size_t		need = 2 * maxepevents * sizeof(*epevents);
+
+	    if ((tmp = realloc(epevents, need)) != NULL) {
+		epevents = tmp;
+		maxepevents *= 2;
+	    }
+	}
+	goto done;
+    }
+#endif
+    __pmFD_COPY(&readyFds, &watchFds);
+    maxfd = maxWatchFd;
+    setoserror(0);
+    sts = __pmSelectRead(maxfd + 1, &readyFds, timeout);
+    for (fd = 0; sts > 0 && fd <= maxfd; fd++) {
+	if (__pmFD_ISSET(fd, &readyFds))
+	    ReadyAdd(fd);
+    }
+
+#if defined(HAVE_SYS_EPOLL_H)
+done:
+#endif
+    err = oserror();
+    sts = sts < 0 ? -1 : nready;
+    for (i = 0; i < nonce; i++)
+	ReadyRemove(once[i]);
+    nonce = 0;
+    setoserror(err);
+    return sts;
+}
+
+/*
+ * Return the next ready descriptor from the last ReadyWait, or NULL
+ * when there are no more.
+ */
+ReadyEvent *
+ReadyNext(void)
+{
+    while (nextready < nready) {
+	ReadyEvent	*rp = &ready[nextready++];
+
+	if (rp->kind != 0)
+	    return rp;
+    }
+    return NULL;
+}
+
+/*
+ * Start another pass over the descriptors from the last ReadyWait.
+ */
+void
+ReadyRewind(void)
+{
+    nextready = 0;
+}
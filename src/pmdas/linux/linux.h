@@ -115,6 +115,7 @@ enum {
 	CLUSTER_FCHOST,		/* 91 /sys/class/fc_host metrics */
 	CLUSTER_WWID,		/* 92 multipath aggregated stats */
 	CLUSTER_PRESSURE_IRQ,	/* 93 /proc/pressure/irq metrics */
+	CLUSTER_REFRESH,	/* 94 pmdalinux refresh statistics */
 
 	NUM_CLUSTERS		/* one more than highest numbered cluster */
 };
@@ -192,6 +193,7 @@ enum {
 	INTERRUPT_CPU_INDOM,	/* 40 - per-CPU interrupt lines */
 	SOFTIRQ_CPU_INDOM,	/* 41 - per-CPU soft IRQs */
 	WWID_INDOM,		/* 42 - per-WWID multipath device */
+	REFRESH_INDOM,		/* 43 - pmdalinux refresh tasks */
 
 	NUM_INDOMS		/* one more than highest numbered cluster */
 };
@@ -0,0 +1,199 @@
+/*
+ * Linux netlink network statistics
+ *
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#include "linux.h"
+#include "netlink.h"
+#include <ctype.h>
+#include <sys/socket.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+
+static const char *netlink_names[NUM_NETLINK] = {
+    "net_dev", "net_tcp", "net_tcp6", "net_udp", "net_udp6", "net_unix"
+};
+static int netlink_enabled[NUM_NETLINK];
+
+/*
+ * Choose the clusters refreshed by netlink from a specification of
+ * the form "[0|1][,cluster=0|1]..." - the optional leading value
+ * applies to every cluster, the others to the named cluster only.
+ * By default netlink is used, except in QA mode where the /proc/net
+ * files from a QA stats tarball are used.
+ */
+int
+netlink_setup(const char *spec)
+{
+    const char		*p = spec;
+    char		*end;
+    size_t		length;
+    int			i, value;
+
+    value = (linux_test_mode & LINUX_TEST_STATSPATH) ? 0 : 1;
+    for (i = 0; i < NUM_NETLINK; i++)
+	netlink_enabled[i] = value;
+
+    while (p && *p != '\0') {
+	if (isdigit((int)*p)) {
+	    value = strtol(p, &end, 10);
+	    for (i = 0; i < NUM_NETLINK; i++)
+		netlink_enabled[i] = (value != 0);
+	}
+	else {
+	    if ((end = strchr(p, '=')) == NULL)
+		return -EINVAL;
+	    length = end - p;
+	    for (i = 0; i < NUM_NETLINK; i++) {
+		if (strncmp(netlink_names[i], p, length) == 0 &&
+		    netlink_names[i][length] == '\0')
+		    break;
+	    }
+	    if (i == NUM_NETLINK || !isdigit((int)end[1]))
+		return -EINVAL;
+	    netlink_enabled[i] = (strtol(end + 1, &end, 10) != 0);
+	}
+	if (*end == ',')
+	    end++;
+	else if (*end != '\0')
+	    return -EINVAL;
+	p = end;
+    }
+    return 0;
+}
+
+/*
+ * The dump for a cluster failed - unless this is a transient error,
+ * use the /proc/net file for that cluster from now on.
+ */
+static void
+netlink_failed(int cluster, int sts)
+{
+    if (sts == -EINTR || sts == -EAGAIN || sts == -ENOBUFS || sts == -ENOMEM)
+	return;
+    netlink_enabled[cluster] = 0;
+    pmNotifyErr(LOG_INFO, "netlink %s: %s, using /proc/net instead",
+		netlink_names[cluster], pmErrStr(sts));
+}
+
+/*
+ * Send a netlink dump request for a cluster, and pass each message of
+ * the reply to the callback.  The socket is opened for each dump, so
+ * the reply is from the network namespace of the current context.
+ * Returns zero on success, else a negative errno - the caller then
+ * uses the /proc/net file instead.
+ */
+int
+netlink_dump(int cluster, int protocol, struct nlmsghdr *req,
+		netlink_callback_t callback, void *arg)
+{
+    static char		buf[65536];	/* fetching thread only */
+    static __uint32_t	seq;
+    struct sockaddr_nl	addr = { .nl_family = AF_NETLINK };
+    struct nlmsghdr	*hdr;
+    struct nlmsgerr	*err;
+    ssize_t		bytes;
+    int			fd, done = 0, sts = 0;
+
+    if (!netlink_enabled[cluster])
+	return -EOPNOTSUPP;
+
+    if ((fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol)) < 0) {
+	sts = -oserror();
+	netlink_failed(cluster, sts);
+	return sts;
+    }
+
+    req->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req->nlmsg_seq = ++seq;
+    req->nlmsg_pid = 0;
+    if (sendto(fd, req, req->nlmsg_len, 0,
+		(struct sockaddr *)&addr, sizeof(addr)) < 0)
+	sts = -oserror();
+
+    while (sts == 0 && !done) {
+	if ((bytes = recv(fd, buf, sizeof(buf), 0)) < 0) {
+	    if ((sts = -oserror()) == -EINTR)
+		sts = 0;
+	    continue;
+	}
+	if (bytes == 0) {
+	    sts = -ENODATA;
+	    break;
+	}
+	for (hdr = (struct nlmsghdr *)buf; NLMSG_OK(hdr, bytes);
+	     hdr = NLMSG_NEXT(hdr, bytes)) {
+	    if (hdr->nlmsg_seq != seq)
+		continue;
+	    if (hdr->nlmsg_type == NLMSG_DONE) {
+		done = 1;
+		break;
+	    }
+	    if (hdr->nlmsg_type == NLMSG_ERROR) {
+		err = (struct nlmsgerr *)NLMSG_DATA(hdr);
+		sts = err->error ? err->error : -EPROTO;
+		break;
+	    }
+	    callback(hdr, arg);
+	}
+    }
+    close(fd);
+
+    if (sts < 0)
+	netlink_failed(cluster, sts);
+    return sts;
+}
+
+typedef struct {
+    unsigned int	*counts;
+    unsigned int	ncounts;
+} sock_states_t;
+
+static void
+sock_states_callback(struct nlmsghdr *hdr, void *arg)
+{
+    sock_states_t		*states = (sock_states_t *)arg;
+    struct inet_diag_msg	*msg = (struct inet_diag_msg *)NLMSG_DATA(hdr);
+
+    if (hdr->nlmsg_type != SOCK_DIAG_BY_FAMILY ||
+	hdr->nlmsg_len < NLMSG_LENGTH(sizeof(*msg)))
+	return;
+    if (msg->idiag_state < states->ncounts)
+	states->counts[msg->idiag_state]++;
+}
+
+/*
+ * Count the sockets of one family and protocol in each state, for the
+ * states in the given mask of (1 << state) bits, using inet_diag.
+ */
+int
+netlink_sock_states(int cluster, int family, int protocol,
+		unsigned int statemask, unsigned int *counts, unsigned int ncounts)
+{
+    struct {
+	struct nlmsghdr		hdr;
+	struct inet_diag_req_v2	req;
+    } request;
+    sock_states_t	states = { counts, ncounts };
+
+    memset(&request, 0, sizeof(request));
+    request.hdr.nlmsg_len = sizeof(request);
+    request.hdr.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    request.req.sdiag_family = family;
+    request.req.sdiag_protocol = protocol;
+    request.req.idiag_states = statemask;
+
+    memset(counts, 0, ncounts * sizeof(unsigned int));
+    return netlink_dump(cluster, NETLINK_SOCK_DIAG, &request.hdr,
+			sock_states_callback, &states);
+}
@@ -0,0 +1,43 @@
+/*
+ * Linux netlink network statistics
+ *
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#ifndef LINUX_NETLINK_H
+#define LINUX_NETLINK_H
+
+#include <linux/netlink.h>
+
+/*
+ * Network clusters that can be refreshed from netlink dumps (rtnetlink
+ * for interfaces, sock_diag for sockets) rather than /proc/net files.
+ * Each falls back to /proc when its netlink dump is unavailable.
+ */
+enum {
+    NETLINK_NET_DEV,		/* RTM_GETLINK, for /proc/net/dev */
+    NETLINK_NET_TCP,		/* inet_diag, for /proc/net/tcp */
+    NETLINK_NET_TCP6,		/* inet_diag, for /proc/net/tcp6 */
+    NETLINK_NET_UDP,		/* inet_diag, for /proc/net/udp */
+    NETLINK_NET_UDP6,		/* inet_diag, for /proc/net/udp6 */
+    NETLINK_NET_UNIX,		/* unix_diag, for /proc/net/unix */
+    NUM_NETLINK
+};
+
+typedef void (*netlink_callback_t)(struct nlmsghdr *, void *);
+
+extern int netlink_setup(const char *);
+extern int netlink_dump(int, int, struct nlmsghdr *, netlink_callback_t, void *);
+extern int netlink_sock_states(int, int, int, unsigned int,
+		unsigned int *, unsigned int);
+
+#endif /* LINUX_NETLINK_H */
@@ -71,6 +71,8 @@
 #include "sysfs_tapestats.h"
 #include "proc_tty.h"
 #include "proc_pressure.h"
+#include "refresh.h"
+#include "netlink.h"
 
 static proc_stat_t		proc_stat;
 static proc_meminfo_t		proc_meminfo;
@@ -371,6 +373,7 @@ static pmdaIndom indomtab[] = {
     { INTERRUPT_CPU_INDOM, 0, NULL },
     { SOFTIRQ_CPU_INDOM, 0, NULL },
     { WWID_INDOM, 0, NULL },
+    { REFRESH_INDOM, 0, NULL },
 };
 
 
@@ -7110,6 +7113,40 @@ static pmdaMetric metrictab[] = {
     { NULL, 
       { PMDA_PMID(CLUSTER_WWID,95), PM_TYPE_U64, WWID_INDOM, PM_SEM_INSTANT,
       PMDA_PMUNITS(0,0,0,0,0,0) }, },
+
+/*
+ * pmdalinux refresh statistics cluster
+ */
+
+/* pmda.refresh.count */
+    { NULL,
+      { PMDA_PMID(CLUSTER_REFRESH,0), PM_TYPE_U64, REFRESH_INDOM, PM_SEM_COUNTER,
+      PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) }, },
+
+/* pmda.refresh.time */
+    { NULL,
+      { PMDA_PMID(CLUSTER_REFRESH,1), PM_TYPE_U64, REFRESH_INDOM, PM_SEM_COUNTER,
+      PMDA_PMUNITS(0,1,0,0,PM_TIME_USEC,0) }, },
+
+/* pmda.refresh.threads */
+    { NULL,
+      { PMDA_PMID(CLUSTER_REFRESH,2), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_DISCRETE,
+      PMDA_PMUNITS(0,0,0,0,0,0) }, },
+
+/* pmda.refresh.interval */
+    { NULL,
+      { PMDA_PMID(CLUSTER_REFRESH,3), PM_TYPE_U32, REFRESH_INDOM, PM_SEM_DISCRETE,
+      PMDA_PMUNITS(0,1,0,0,PM_TIME_MSEC,0) }, },
+
+/* pmda.refresh.hits */
+    { NULL,
+      { PMDA_PMID(CLUSTER_REFRESH,4), PM_TYPE_U64, REFRESH_INDOM, PM_SEM_COUNTER,
+      PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) }, },
+
+/* pmda.refresh.misses */
+    { NULL,
+      { PMDA_PMID(CLUSTER_REFRESH,5), PM_TYPE_U64, REFRESH_INDOM, PM_SEM_COUNTER,
+      PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) }, },
 };
 
 typedef struct {
@@ -7152,64 +7189,152 @@ linux_ctx_container(int ctx)
     return NULL;
 }
 
+/*
+ * State shared by the refresh tasks for one fetch or instance request.
+ */
+typedef struct {
+    linux_container_t	*cp;
+    linux_access_t	*laccess;
+    int			ns_fds;
+} refresh_ctx_t;
+
 static int
-linux_refresh(pmdaExt *pmda, int *need_refresh, int context)
+partitions_needed(int *need_refresh)
 {
-    linux_container_t *cp = linux_ctx_container(context);
-    linux_access_t *laccess = access_ctx(context);
-    int need_net_ioctl = 0;
-    int ns_fds = 0;
-    int sts = 0;
-    int	lsts;
-
-    if (cp && (sts = container_lookup(rootfd, cp)) < 0)
-	return sts;
+    return need_refresh[CLUSTER_PARTITIONS] ||
+	   need_refresh[CLUSTER_WWID] ||
+	   need_refresh[CLUSTER_ZRAM_DEVICES] ||
+	   need_refresh[REFRESH_PROC_DISKSTATS] ||
+	   need_refresh[REFRESH_PROC_PARTITIONS];
+}
 
-    if (need_refresh[CLUSTER_PARTITIONS] ||
-	need_refresh[CLUSTER_WWID] ||
-	need_refresh[CLUSTER_ZRAM_DEVICES] ||
-	need_refresh[REFRESH_PROC_DISKSTATS] ||
-	need_refresh[REFRESH_PROC_PARTITIONS]) {
-    	lsts = refresh_proc_partitions(INDOM(DISK_INDOM),
+static int
+partitions_refresh(int *need_refresh, void *arg)
+{
+    return refresh_proc_partitions(INDOM(DISK_INDOM),
 			INDOM(PARTITIONS_INDOM), INDOM(ZRAM_INDOM),
 			INDOM(DM_INDOM), INDOM(MD_INDOM), INDOM(WWID_INDOM),
 			need_refresh[REFRESH_PROC_DISKSTATS],
 			need_refresh[REFRESH_PROC_PARTITIONS]);
-	if (lsts < 0 && sts == 0)
-	    sts = lsts;
-    }
+}
 
-    if (need_refresh[CLUSTER_STAT])
-	refresh_proc_stat(&proc_stat);
+static void
+partitions_store(int *need_refresh, void *arg)
+{
+    store_proc_partitions(INDOM(DISK_INDOM),
+			INDOM(PARTITIONS_INDOM), INDOM(ZRAM_INDOM),
+			INDOM(DM_INDOM), INDOM(MD_INDOM), INDOM(WWID_INDOM));
+}
 
-    if (need_refresh[CLUSTER_CPUINFO])
-	refresh_proc_cpuinfo();
+static int
+stat_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_stat(&proc_stat);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_MEMINFO])
-	refresh_proc_meminfo(&proc_meminfo);
+static void
+stat_store(int *need_refresh, void *arg)
+{
+    store_proc_stat();
+}
 
-    if (need_refresh[CLUSTER_NUMA_MEMINFO])
-	refresh_numa_meminfo();
+static int
+cpuinfo_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_cpuinfo();
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_LOADAVG])
-	refresh_proc_loadavg(&proc_loadavg);
+static int
+meminfo_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_meminfo(&proc_meminfo);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_NET_NFS]) {
-	refresh_proc_net_rpc(&proc_net_rpc);
-	refresh_proc_fs_nfsd(&proc_fs_nfsd);
-    }
+static int
+numa_meminfo_refresh(int *need_refresh, void *arg)
+{
+    refresh_numa_meminfo();
+    return 0;
+}
+
+static int
+loadavg_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_loadavg(&proc_loadavg);
+    return 0;
+}
+
+static int
+nfs_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_net_rpc(&proc_net_rpc);
+    refresh_proc_fs_nfsd(&proc_fs_nfsd);
+    return 0;
+}
+
+static int
+net_needed(int *need_refresh)
+{
+    return need_refresh[CLUSTER_NET_DEV] ||
+	   need_refresh[CLUSTER_NET_ADDR] ||
+	   need_refresh[CLUSTER_NET_SOCKSTAT] ||
+	   need_refresh[CLUSTER_NET_SOCKSTAT6] ||
+	   need_refresh[CLUSTER_NET_SNMP] ||
+	   need_refresh[CLUSTER_NET_SNMP6] ||
+	   need_refresh[CLUSTER_NET_RAW] ||
+	   need_refresh[CLUSTER_NET_RAW6] ||
+	   need_refresh[CLUSTER_NET_TCP] ||
+	   need_refresh[CLUSTER_NET_TCP6] ||
+	   need_refresh[CLUSTER_NET_UDP] ||
+	   need_refresh[CLUSTER_NET_UDP6] ||
+	   need_refresh[CLUSTER_NET_UNIX] ||
+	   need_refresh[CLUSTER_NET_NETSTAT] ||
+	   need_refresh[CLUSTER_FILESYS] ||
+	   need_refresh[CLUSTER_TMPFS] ||
+	   need_refresh[REFRESH_NET_MTU] ||
+	   need_refresh[REFRESH_NET_TYPE] ||
+	   need_refresh[REFRESH_NET_SPEED] ||
+	   need_refresh[REFRESH_NET_DUPLEX] ||
+	   need_refresh[REFRESH_NET_LINKUP] ||
+	   need_refresh[REFRESH_NET_RUNNING] ||
+	   need_refresh[REFRESH_NET_VIRTUAL] ||
+	   need_refresh[REFRESH_NET_WIRELESS] ||
+	   need_refresh[REFRESH_NETADDR_INET] ||
+	   need_refresh[REFRESH_NETADDR_IPV6] ||
+	   need_refresh[REFRESH_NETADDR_HW];
+}
+
+/*
+ * Network interface metrics and namespaces are complicated by a
+ * need to be in the right namespace at the right time (for /sys
+ * -> MNTNS, for /proc or ioctl -> NETNS) - and the two have been
+ * found to be mutually exclusive from the point of view of access
+ * via the setns(2) syscall.  We also have a further complicating
+ * factor where some values are available *either* by sysfs (newer
+ * kernels), *or* ioctl (older kernels).
+ */
+static int
+net_refresh(int *need_refresh, void *arg)
+{
+    refresh_ctx_t *ctx = (refresh_ctx_t *)arg;
+    linux_container_t *cp = ctx->cp;
+    pmInDom netaddr = INDOM(NET_ADDR_INDOM);
+    pmInDom netdev = INDOM(NET_DEV_INDOM);
+    int need_net_ioctl = 0;
+    int sts = 0;
+    int	lsts;
+
+    if (need_refresh[CLUSTER_NET_ADDR])
+	clear_net_addr_indom(netaddr);
+    if (need_refresh[REFRESH_NETADDR_INET])
+	need_net_ioctl = 1;
+    if (need_refresh[REFRESH_NETADDR_IPV6])
+	need_net_ioctl = 1;
 
-    /*
-     * Network interface metrics and namespaces are complicated by a
-     * need to be in the right namespace at the right time (for /sys
-     * -> MNTNS, for /proc or ioctl -> NETNS) - and the two have been
-     * found to be mutually exclusive from the point of view of access
-     * via the setns(2) syscall.  We also have a further complicating
-     * factor where some values are available *either* by sysfs (newer
-     * kernels), *or* ioctl (older kernels).
-     */
     if (need_refresh[CLUSTER_NET_DEV] ||
-	need_refresh[CLUSTER_NET_ADDR] ||
 	need_refresh[CLUSTER_NET_SOCKSTAT] ||
 	need_refresh[CLUSTER_NET_SOCKSTAT6] ||
 	need_refresh[CLUSTER_NET_SNMP] ||
@@ -7221,7 +7346,57 @@ linux_refresh(pmdaExt *pmda, int *need_refresh, int context)
 	need_refresh[CLUSTER_NET_UDP] ||
 	need_refresh[CLUSTER_NET_UDP6] ||
 	need_refresh[CLUSTER_NET_UNIX] ||
-	need_refresh[CLUSTER_NET_NETSTAT] ||
+	need_refresh[CLUSTER_NET_NETSTAT]) {
+
+	if ((lsts = container_nsenter(cp, LINUX_NAMESPACE_NET, &ctx->ns_fds)) < 0)
+	    return lsts;
+
+	if (need_refresh[CLUSTER_NET_DEV])
+	    refresh_proc_net_dev(netdev, cp);
+
+	if (need_refresh[CLUSTER_NET_DEV])
+	    refresh_proc_net_all(netdev, &proc_net_all);
+
+	if (need_refresh[CLUSTER_NET_SOCKSTAT])
+	    refresh_proc_net_sockstat(&proc_net_sockstat);
+
+	if (need_refresh[CLUSTER_NET_SOCKSTAT6])
+	    refresh_proc_net_sockstat6(&proc_net_sockstat6);
+
+	if (need_refresh[CLUSTER_NET_SNMP])
+	    refresh_proc_net_snmp(&_pm_proc_net_snmp);
+
+	if (need_refresh[CLUSTER_NET_SNMP6])
+	    refresh_proc_net_snmp6(_pm_proc_net_snmp6);
+
+	if (need_refresh[CLUSTER_NET_RAW])
+	    refresh_proc_net_raw(&proc_net_raw);
+
+	if (need_refresh[CLUSTER_NET_RAW6])
+	    refresh_proc_net_raw6(&proc_net_raw6);
+
+	if (need_refresh[CLUSTER_NET_TCP])
+	    refresh_proc_net_tcp(&proc_net_tcp);
+
+	if (need_refresh[CLUSTER_NET_TCP6])
+	    refresh_proc_net_tcp6(&proc_net_tcp6);
+
+	if (need_refresh[CLUSTER_NET_UDP])
+	    refresh_proc_net_udp(&proc_net_udp);
+
+	if (need_refresh[CLUSTER_NET_UDP6])
+	    refresh_proc_net_udp6(&proc_net_udp6);
+
+	if (need_refresh[CLUSTER_NET_UNIX])
+	    refresh_proc_net_unix(&proc_net_unix);
+
+	if (need_refresh[CLUSTER_NET_NETSTAT])
+	    sts = refresh_proc_net_netstat(&_pm_proc_net_netstat);
+
+	container_nsleave(cp, LINUX_NAMESPACE_NET);
+    }
+
+    if (need_refresh[CLUSTER_NET_DEV] ||
 	need_refresh[CLUSTER_FILESYS] ||
 	need_refresh[CLUSTER_TMPFS] ||
 	need_refresh[REFRESH_NET_MTU] ||
@@ -7235,250 +7410,393 @@ linux_refresh(pmdaExt *pmda, int *need_refresh, int context)
 	need_refresh[REFRESH_NETADDR_INET] ||
 	need_refresh[REFRESH_NETADDR_IPV6] ||
 	need_refresh[REFRESH_NETADDR_HW]) {
-	pmInDom netaddr = INDOM(NET_ADDR_INDOM);
-	pmInDom netdev = INDOM(NET_DEV_INDOM);
-
-	if (need_refresh[CLUSTER_NET_ADDR])
-	    clear_net_addr_indom(netaddr);
-	if (need_refresh[REFRESH_NETADDR_INET])
-	    need_net_ioctl = 1;
-	if (need_refresh[REFRESH_NETADDR_IPV6])
-	    need_net_ioctl = 1;
-
-	if (need_refresh[CLUSTER_NET_DEV] ||
-	    need_refresh[CLUSTER_NET_SOCKSTAT] ||
-	    need_refresh[CLUSTER_NET_SOCKSTAT6] ||
-	    need_refresh[CLUSTER_NET_SNMP] ||
-	    need_refresh[CLUSTER_NET_SNMP6] ||
-	    need_refresh[CLUSTER_NET_RAW] ||
-	    need_refresh[CLUSTER_NET_RAW6] ||
-	    need_refresh[CLUSTER_NET_TCP] ||
-	    need_refresh[CLUSTER_NET_TCP6] ||
-	    need_refresh[CLUSTER_NET_UDP] ||
-	    need_refresh[CLUSTER_NET_UDP6] ||
-	    need_refresh[CLUSTER_NET_UNIX] ||
-	    need_refresh[CLUSTER_NET_NETSTAT]) {
-
-	    if ((lsts = container_nsenter(cp, LINUX_NAMESPACE_NET, &ns_fds)) < 0) {
-		if (lsts < 0 && sts == 0)
-		    sts = lsts;
-		goto done;
-	    }
 
-	    if (need_refresh[CLUSTER_NET_DEV])
-		refresh_proc_net_dev(netdev, cp);
+	if ((lsts = container_nsenter(cp, LINUX_NAMESPACE_MNT, &ctx->ns_fds)) < 0)
+	    return sts < 0 ? sts : lsts;
 
-	    if (need_refresh[CLUSTER_NET_DEV])
-		refresh_proc_net_all(netdev, &proc_net_all);
+	refresh_net_addr_sysfs(netaddr, need_refresh);
+	need_net_ioctl |= refresh_net_sysfs(netdev, need_refresh);
+	if (need_refresh[CLUSTER_FILESYS] || need_refresh[CLUSTER_TMPFS])
+	    refresh_filesys(INDOM(FILESYS_INDOM), INDOM(TMPFS_INDOM), cp);
 
-	    if (need_refresh[CLUSTER_NET_SOCKSTAT])
-		refresh_proc_net_sockstat(&proc_net_sockstat);
-
-	    if (need_refresh[CLUSTER_NET_SOCKSTAT6])
-		refresh_proc_net_sockstat6(&proc_net_sockstat6);
+	container_nsleave(cp, LINUX_NAMESPACE_MNT);
+    }
 
-	    if (need_refresh[CLUSTER_NET_SNMP])
-		refresh_proc_net_snmp(&_pm_proc_net_snmp);
+    if (need_net_ioctl) {
+	if ((lsts = container_nsenter(cp, LINUX_NAMESPACE_NET, &ctx->ns_fds)) < 0)
+	    return sts < 0 ? sts : lsts;
+	refresh_net_addr_ioctl(netaddr, cp, need_refresh);
+	refresh_net_ioctl(netdev, cp, need_refresh);
+	container_nsleave(cp, LINUX_NAMESPACE_NET);
+    }
 
-	    if (need_refresh[CLUSTER_NET_SNMP6])
-		refresh_proc_net_snmp6(_pm_proc_net_snmp6);
+    if (need_refresh[CLUSTER_NET_ADDR])
+	store_net_addr_indom(netaddr, cp);
+    return sts;
+}
 
-	    if (need_refresh[CLUSTER_NET_RAW])
-		refresh_proc_net_raw(&proc_net_raw);
+static int
+uname_refresh(int *need_refresh, void *arg)
+{
+    refresh_ctx_t *ctx = (refresh_ctx_t *)arg;
+    int	sts;
 
-	    if (need_refresh[CLUSTER_NET_RAW6])
-		refresh_proc_net_raw6(&proc_net_raw6);
+    if ((sts = container_nsenter(ctx->cp, LINUX_NAMESPACE_UTS, &ctx->ns_fds)) < 0)
+	return sts;
+    uname(&kernel_uname);
+    container_nsleave(ctx->cp, LINUX_NAMESPACE_UTS);
+    return 0;
+}
 
-	    if (need_refresh[CLUSTER_NET_TCP])
-		refresh_proc_net_tcp(&proc_net_tcp);
+static int
+interrupts_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_interrupts();
+    return 0;
+}
 
-	    if (need_refresh[CLUSTER_NET_TCP6])
-		refresh_proc_net_tcp6(&proc_net_tcp6);
+static int
+softirqs_needed(int *need_refresh)
+{
+    return need_refresh[CLUSTER_SOFTIRQS] ||
+	   need_refresh[CLUSTER_SOFTIRQS_TOTAL];
+}
 
-	    if (need_refresh[CLUSTER_NET_UDP])
-		refresh_proc_net_udp(&proc_net_udp);
+static int
+softirqs_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_softirqs();
+    return 0;
+}
 
-	    if (need_refresh[CLUSTER_NET_UDP6])
-		refresh_proc_net_udp6(&proc_net_udp6);
+static int
+swapdev_refresh(int *need_refresh, void *arg)
+{
+    refresh_swapdev(INDOM(SWAPDEV_INDOM));
+    return 0;
+}
 
-	    if (need_refresh[CLUSTER_NET_UNIX])
-		refresh_proc_net_unix(&proc_net_unix);
+static int
+scsi_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_scsi(INDOM(SCSI_INDOM));
+    return 0;
+}
 
-	    if (need_refresh[CLUSTER_NET_NETSTAT]) {
-		lsts = refresh_proc_net_netstat(&_pm_proc_net_netstat);
-		if (lsts < 0 && sts == 0)
-		    sts = lsts;
-	    }
+static int
+slab_refresh(int *need_refresh, void *arg)
+{
+    linux_access_t *laccess = ((refresh_ctx_t *)arg)->laccess;
+
+    if (all_access ||
+	(laccess != NULL && laccess->uid == 0 && laccess->uid_flag)) {
+	proc_slabinfo.permission = 1;
+	refresh_proc_slabinfo(&proc_slabinfo);
+    } else {
+	proc_slabinfo.permission = 0;
+    }
+    return 0;
+}
 
-	    container_nsleave(cp, LINUX_NAMESPACE_NET);
-	}
+static void
+slab_store(int *need_refresh, void *arg)
+{
+    if (proc_slabinfo.permission)
+	store_proc_slabinfo(INDOM(SLAB_INDOM));
+}
 
-	if (need_refresh[CLUSTER_NET_DEV] ||
-	    need_refresh[CLUSTER_FILESYS] ||
-	    need_refresh[CLUSTER_TMPFS] ||
-	    need_refresh[REFRESH_NET_MTU] ||
-	    need_refresh[REFRESH_NET_TYPE] ||
-	    need_refresh[REFRESH_NET_SPEED] ||
-	    need_refresh[REFRESH_NET_DUPLEX] ||
-	    need_refresh[REFRESH_NET_LINKUP] ||
-	    need_refresh[REFRESH_NET_RUNNING] ||
-	    need_refresh[REFRESH_NET_VIRTUAL] ||
-	    need_refresh[REFRESH_NET_WIRELESS] ||
-	    need_refresh[REFRESH_NETADDR_INET] ||
-	    need_refresh[REFRESH_NETADDR_IPV6] ||
-	    need_refresh[REFRESH_NETADDR_HW]) {
-
-	    if ((lsts = container_nsenter(cp, LINUX_NAMESPACE_MNT, &ns_fds)) < 0) {
-		if (lsts < 0 && sts == 0)
-		    sts = lsts;
-		goto done;
-	    }
+static int
+sem_limits_refresh(int *need_refresh, void *arg)
+{
+    refresh_sem_limits(&sem_limits);
+    return 0;
+}
 
-	    refresh_net_addr_sysfs(netaddr, need_refresh);
-	    need_net_ioctl |= refresh_net_sysfs(netdev, need_refresh);
-	    if (need_refresh[CLUSTER_FILESYS] || need_refresh[CLUSTER_TMPFS])
-		refresh_filesys(INDOM(FILESYS_INDOM), INDOM(TMPFS_INDOM), cp);
+static int
+msg_limits_refresh(int *need_refresh, void *arg)
+{
+    refresh_msg_limits(&msg_limits);
+    return 0;
+}
 
-	    container_nsleave(cp, LINUX_NAMESPACE_MNT);
-	}
+static int
+shm_info_refresh(int *need_refresh, void *arg)
+{
+    refresh_shm_info(&shm_info);
+    return 0;
+}
 
-	if (need_net_ioctl) {
-	    if ((lsts = container_nsenter(cp, LINUX_NAMESPACE_NET, &ns_fds)) < 0) {
-		if (lsts < 0 && sts == 0)
-		    sts = lsts;
-		goto done;
-	    }
-	    refresh_net_addr_ioctl(netaddr, cp, need_refresh);
-	    refresh_net_ioctl(netdev, cp, need_refresh);
-	    container_nsleave(cp, LINUX_NAMESPACE_NET);
-	}
+static int
+sem_info_refresh(int *need_refresh, void *arg)
+{
+    refresh_sem_info(&sem_info);
+    return 0;
+}
 
-	if (need_refresh[CLUSTER_NET_ADDR])
-	    store_net_addr_indom(netaddr, cp);
-    }
+static int
+msg_info_refresh(int *need_refresh, void *arg)
+{
+    refresh_msg_info(&msg_info);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_KERNEL_UNAME]) {
-	if ((lsts = container_nsenter(cp, LINUX_NAMESPACE_UTS, &ns_fds)) < 0) {
-	    if (lsts < 0 && sts == 0)
-		sts = lsts;
-	    goto done;
-	}
-	uname(&kernel_uname);
-	container_nsleave(cp, LINUX_NAMESPACE_UTS);
-    }
+static int
+shm_limits_refresh(int *need_refresh, void *arg)
+{
+    refresh_shm_limits(&shm_limits);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_INTERRUPTS])
-	refresh_proc_interrupts();
+static int
+uptime_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_uptime(&proc_uptime);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_SOFTIRQS] ||
-	need_refresh[CLUSTER_SOFTIRQS_TOTAL])
-	refresh_proc_softirqs();
+static int
+utmp_refresh(int *need_refresh, void *arg)
+{
+    refresh_login_info(&login_info);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_SWAPDEV])
-	refresh_swapdev(INDOM(SWAPDEV_INDOM));
+static int
+vfs_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_sys_fs(&proc_sys_fs);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_SCSI])
-	refresh_proc_scsi(INDOM(SCSI_INDOM));
+static int
+locks_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_locks(&proc_locks);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_SLAB]) {
-	if (all_access ||
-	    (laccess != NULL && laccess->uid == 0 && laccess->uid_flag)) {
-	    proc_slabinfo.permission = 1;
-	    refresh_proc_slabinfo(INDOM(SLAB_INDOM), &proc_slabinfo);
-	} else {
-	    proc_slabinfo.permission = 0;
-	}
-    }
+static int
+sys_kernel_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_sys_kernel(&proc_sys_kernel);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_SEM_LIMITS])
-	refresh_sem_limits(&sem_limits);
+static int
+vmstat_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_vmstat(&_pm_proc_vmstat);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_MSG_LIMITS])
-        refresh_msg_limits(&msg_limits);
+static int
+sysfs_kernel_refresh(int *need_refresh, void *arg)
+{
+    refresh_sysfs_kernel(&sysfs_kernel, need_refresh);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_SHM_INFO])
-        refresh_shm_info(&shm_info);
+static int
+softnet_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_net_softnet(&proc_net_softnet);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_SEM_INFO])
-        refresh_sem_info(&sem_info);
+static int
+shm_stat_refresh(int *need_refresh, void *arg)
+{
+    refresh_shm_stat(INDOM(IPC_STAT_INDOM));
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_MSG_INFO])
-        refresh_msg_info(&msg_info);
+static int
+msg_stat_refresh(int *need_refresh, void *arg)
+{
+    refresh_msg_queue(INDOM(IPC_MSG_INDOM));
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_SHM_LIMITS])
-        refresh_shm_limits(&shm_limits);
+static int
+sem_stat_refresh(int *need_refresh, void *arg)
+{
+    refresh_sem_array(INDOM(IPC_SEM_INDOM));
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_UPTIME])
-        refresh_proc_uptime(&proc_uptime);
+static int
+buddyinfo_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_buddyinfo(&proc_buddyinfo);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_UTMP])
-        refresh_login_info(&login_info);
+static int
+zoneinfo_needed(int *need_refresh)
+{
+    return need_refresh[CLUSTER_ZONEINFO] ||
+	   need_refresh[CLUSTER_ZONEINFO_PROTECTION];
+}
 
-    if (need_refresh[CLUSTER_VFS])
-    	refresh_proc_sys_fs(&proc_sys_fs);
+static int
+zoneinfo_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_zoneinfo();
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_LOCKS])
-    	refresh_proc_locks(&proc_locks);
+static void
+zoneinfo_store(int *need_refresh, void *arg)
+{
+    store_proc_zoneinfo(INDOM(ZONEINFO_INDOM),
+			INDOM(ZONEINFO_PROTECTION_INDOM));
+}
 
-    if (need_refresh[CLUSTER_SYS_KERNEL])
-    	refresh_proc_sys_kernel(&proc_sys_kernel);
+static int
+ksm_refresh(int *need_refresh, void *arg)
+{
+    refresh_ksm_info(&ksm_info);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_VMSTAT])
-    	refresh_proc_vmstat(&_pm_proc_vmstat);
+static int
+tapedev_refresh(int *need_refresh, void *arg)
+{
+    refresh_sysfs_tapestats(INDOM(TAPEDEV_INDOM));
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_SYSFS_KERNEL])
-	refresh_sysfs_kernel(&sysfs_kernel, need_refresh);
+static int
+tty_refresh(int *need_refresh, void *arg)
+{
+    linux_access_t *laccess = ((refresh_ctx_t *)arg)->laccess;
+
+    if (all_access ||
+	(laccess != NULL && laccess->uid == 0 && laccess->uid_flag)) {
+	proc_tty_permission = 1;
+	refresh_tty(INDOM(TTY_INDOM));
+    } else {
+	proc_tty_permission = 0;
+    }
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_NET_SOFTNET])
-	refresh_proc_net_softnet(&proc_net_softnet);
+static int
+pressure_cpu_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_pressure_cpu(&proc_pressure);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_SHM_STAT])
-	refresh_shm_stat(INDOM(IPC_STAT_INDOM));
+static int
+pressure_mem_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_pressure_mem(&proc_pressure);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_MSG_STAT])
-	refresh_msg_queue(INDOM(IPC_MSG_INDOM));
+static int
+pressure_io_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_pressure_io(&proc_pressure);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_SEM_STAT])
-	refresh_sem_array(INDOM(IPC_SEM_INDOM));
+static int
+pressure_irq_refresh(int *need_refresh, void *arg)
+{
+    refresh_proc_pressure_irq(&proc_pressure);
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_BUDDYINFO])
-	refresh_proc_buddyinfo(&proc_buddyinfo);
+static int
+fchost_refresh(int *need_refresh, void *arg)
+{
+    refresh_sysfs_fchosts(INDOM(FCHOST_INDOM));
+    return 0;
+}
 
-    if (need_refresh[CLUSTER_ZONEINFO] ||
-        need_refresh[CLUSTER_ZONEINFO_PROTECTION])
-	refresh_proc_zoneinfo(INDOM(ZONEINFO_INDOM),
-			      INDOM(ZONEINFO_PROTECTION_INDOM));
+#define PARTITIONS_REFRESHES \
+	(REFRESH_BIT(REFRESH_PROC_DISKSTATS) | REFRESH_BIT(REFRESH_PROC_PARTITIONS))
+#define SYSFS_KERNEL_REFRESHES \
+	(REFRESH_BIT(REFRESH_SYSFS_KERNEL_UEVENTSEQ) | \
+	 REFRESH_BIT(REFRESH_SYSFS_KERNEL_EXTFRAG))
 
-    if (need_refresh[CLUSTER_KSM_INFO])
-	refresh_ksm_info(&ksm_info);
+/*
+ * Refresh tasks, in the order they are run from the fetching thread.
+ * The group column is the dependency table for the worker threads -
+ * group zero tasks stay in the fetching thread (pmdaCache, setns(2),
+ * strtok(3) or other shared state), and tasks sharing state with each
+ * other share a worker group (the pressure files share a format buffer,
+ * and the cheap System V IPC limits and info tasks are batched together).
+ * The partitions, stat, slab and zoneinfo tasks parse in their workers
+ * and update their instance domains from the store column afterward;
+ * softnet walks the online CPUs from stat, so it runs after that.
+ * Values from the per-context tasks are never reused within a refresh
+ * interval, and the refreshes columns list the fine-grained refreshes
+ * that must also have been done last time for values to be reused.
+ * The instance identifier for each task in REFRESH_INDOM is its index.
+ */
+static linux_refresh_t refreshtab[] = {
+    { "partitions", -1, partitions_needed, 13, 0, PARTITIONS_REFRESHES, partitions_refresh, partitions_store },
+    { "stat", CLUSTER_STAT, NULL, 14, 0, 0, stat_refresh, stat_store },
+    { "cpuinfo", CLUSTER_CPUINFO, NULL, 0, 0, 0, cpuinfo_refresh },
+    { "meminfo", CLUSTER_MEMINFO, NULL, 1, 0, 0, meminfo_refresh },
+    { "numa_meminfo", CLUSTER_NUMA_MEMINFO, NULL, 0, 0, 0, numa_meminfo_refresh },
+    { "loadavg", CLUSTER_LOADAVG, NULL, 2, 0, 0, loadavg_refresh },
+    { "nfs", CLUSTER_NET_NFS, NULL, 0, 0, 0, nfs_refresh },
+    { "net", -1, net_needed, 0, REFRESH_PERCONTEXT, 0, net_refresh },
+    { "uname", CLUSTER_KERNEL_UNAME, NULL, 0, REFRESH_PERCONTEXT, 0, uname_refresh },
+    { "interrupts", CLUSTER_INTERRUPTS, NULL, 0, 0, 0, interrupts_refresh },
+    { "softirqs", -1, softirqs_needed, 0, 0, 0, softirqs_refresh },
+    { "swapdev", CLUSTER_SWAPDEV, NULL, 0, 0, 0, swapdev_refresh },
+    { "scsi", CLUSTER_SCSI, NULL, 0, 0, 0, scsi_refresh },
+    { "slab", CLUSTER_SLAB, NULL, 15, REFRESH_PERCONTEXT, 0, slab_refresh, slab_store },
+    { "sem_limits", CLUSTER_SEM_LIMITS, NULL, 3, 0, 0, sem_limits_refresh },
+    { "msg_limits", CLUSTER_MSG_LIMITS, NULL, 3, 0, 0, msg_limits_refresh },
+    { "shm_info", CLUSTER_SHM_INFO, NULL, 3, 0, 0, shm_info_refresh },
+    { "sem_info", CLUSTER_SEM_INFO, NULL, 3, 0, 0, sem_info_refresh },
+    { "msg_info", CLUSTER_MSG_INFO, NULL, 3, 0, 0, msg_info_refresh },
+    { "shm_limits", CLUSTER_SHM_LIMITS, NULL, 3, 0, 0, shm_limits_refresh },
+    { "uptime", CLUSTER_UPTIME, NULL, 4, 0, 0, uptime_refresh },
+    { "utmp", CLUSTER_UTMP, NULL, 5, 0, 0, utmp_refresh },
+    { "vfs", CLUSTER_VFS, NULL, 6, 0, 0, vfs_refresh },
+    { "locks", CLUSTER_LOCKS, NULL, 7, 0, 0, locks_refresh },
+    { "sys_kernel", CLUSTER_SYS_KERNEL, NULL, 8, 0, 0, sys_kernel_refresh },
+    { "vmstat", CLUSTER_VMSTAT, NULL, 9, 0, 0, vmstat_refresh },
+    { "sysfs_kernel", CLUSTER_SYSFS_KERNEL, NULL, 0, 0, SYSFS_KERNEL_REFRESHES, sysfs_kernel_refresh },
+    { "softnet", CLUSTER_NET_SOFTNET, NULL, 0, REFRESH_LATE, 0, softnet_refresh },
+    { "shm_stat", CLUSTER_SHM_STAT, NULL, 0, 0, 0, shm_stat_refresh },
+    { "msg_stat", CLUSTER_MSG_STAT, NULL, 0, 0, 0, msg_stat_refresh },
+    { "sem_stat", CLUSTER_SEM_STAT, NULL, 0, 0, 0, sem_stat_refresh },
+    { "buddyinfo", CLUSTER_BUDDYINFO, NULL, 10, 0, 0, buddyinfo_refresh },
+    { "zoneinfo", -1, zoneinfo_needed, 16, 0, 0, zoneinfo_refresh, zoneinfo_store },
+    { "ksm", CLUSTER_KSM_INFO, NULL, 11, 0, 0, ksm_refresh },
+    { "tapedev", CLUSTER_TAPEDEV, NULL, 0, 0, 0, tapedev_refresh },
+    { "tty", CLUSTER_TTY, NULL, 0, REFRESH_PERCONTEXT, 0, tty_refresh },
+    { "pressure_cpu", CLUSTER_PRESSURE_CPU, NULL, 12, 0, 0, pressure_cpu_refresh },
+    { "pressure_mem", CLUSTER_PRESSURE_MEM, NULL, 12, 0, 0, pressure_mem_refresh },
+    { "pressure_io", CLUSTER_PRESSURE_IO, NULL, 12, 0, 0, pressure_io_refresh },
+    { "pressure_irq", CLUSTER_PRESSURE_IRQ, NULL, 12, 0, 0, pressure_irq_refresh },
+    { "fchost", CLUSTER_FCHOST, NULL, 0, 0, 0, fchost_refresh },
+};
 
-    if (need_refresh[CLUSTER_TAPEDEV])
-	refresh_sysfs_tapestats(INDOM(TAPEDEV_INDOM));
+static int
+linux_refresh(pmdaExt *pmda, int *need_refresh, int context)
+{
+    refresh_ctx_t ctx;
+    int sts;
 
-    if (need_refresh[CLUSTER_TTY]) {
-	if (all_access ||
-	    (laccess != NULL && laccess->uid == 0 && laccess->uid_flag)) {
-	    proc_tty_permission = 1;
-	    refresh_tty(INDOM(TTY_INDOM));
-	} else {
-	    proc_tty_permission = 0;
-	}
-    }
+    ctx.cp = linux_ctx_container(context);
+    ctx.laccess = access_ctx(context);
+    ctx.ns_fds = 0;
 
-    if (need_refresh[CLUSTER_PRESSURE_CPU])
-	refresh_proc_pressure_cpu(&proc_pressure);
-    if (need_refresh[CLUSTER_PRESSURE_MEM])
-	refresh_proc_pressure_mem(&proc_pressure);
-    if (need_refresh[CLUSTER_PRESSURE_IO])
-	refresh_proc_pressure_io(&proc_pressure);
-    if (need_refresh[CLUSTER_PRESSURE_IRQ])
-	refresh_proc_pressure_irq(&proc_pressure);
+    if (ctx.cp && (sts = container_lookup(rootfd, ctx.cp)) < 0)
+	return sts;
 
-    if (need_refresh[CLUSTER_FCHOST])
-	refresh_sysfs_fchosts(INDOM(FCHOST_INDOM));
+    sts = refresh_tasks(need_refresh, &ctx);
 
-done:
-    container_close(cp, ns_fds);
+    container_close(ctx.cp, ctx.ns_fds);
     return sts;
 }
 
@@ -9708,6 +10026,34 @@ linux_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 	}
 	break;
 
+    case CLUSTER_REFRESH:
+	if (item == 2) {	/* pmda.refresh.threads */
+	    atom->ul = refresh_threads;
+	    break;
+	}
+	if (inst >= sizeof(refreshtab)/sizeof(refreshtab[0]))
+	    return PM_ERR_INST;
+	switch (item) {
+	case 0:	/* pmda.refresh.count */
+	    atom->ull = refreshtab[inst].count;
+	    break;
+	case 1:	/* pmda.refresh.time */
+	    atom->ull = refreshtab[inst].time;
+	    break;
+	case 3:	/* pmda.refresh.interval */
+	    atom->ul = refreshtab[inst].interval;
+	    break;
+	case 4:	/* pmda.refresh.hits */
+	    atom->ull = refreshtab[inst].hits;
+	    break;
+	case 5:	/* pmda.refresh.misses */
+	    atom->ull = refreshtab[inst].misses;
+	    break;
+	default:
+	    return PM_ERR_PMID;
+	}
+	break;
+
     default: /* unknown cluster */
 	return PM_ERR_PMID;
     }
@@ -9861,6 +10207,40 @@ linux_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
     return pmdaFetch(numpmid, pmidlist, resp, pmda);
 }
 
+static int
+linux_store(pmResult *result, pmdaExt *pmda)
+{
+    linux_access_t	*laccess = access_ctx(pmda->e_context);
+    pmValueSet		*vsp;
+    pmAtomValue		av;
+    int			i, j, sts = 0;
+
+    for (i = 0; i < result->numpmid && sts == 0; i++) {
+	vsp = result->vset[i];
+	if (pmID_cluster(vsp->pmid) != CLUSTER_REFRESH ||
+	    pmID_item(vsp->pmid) != 3) {	/* pmda.refresh.interval */
+	    sts = PM_ERR_PERMISSION;
+	    break;
+	}
+	if (!all_access &&
+	    (laccess == NULL || laccess->uid != 0 || !laccess->uid_flag)) {
+	    sts = PM_ERR_PERMISSION;
+	    break;
+	}
+	for (j = 0; j < vsp->numval; j++) {
+	    if (vsp->vlist[j].inst >= sizeof(refreshtab)/sizeof(refreshtab[0])) {
+		sts = PM_ERR_INST;
+		break;
+	    }
+	    if ((sts = pmExtractValue(vsp->valfmt, &vsp->vlist[j],
+				PM_TYPE_U32, &av, PM_TYPE_U32)) < 0)
+		break;
+	    refreshtab[vsp->vlist[j].inst].interval = av.ul;
+	}
+    }
+    return sts;
+}
+
 static int
 linux_text(int ident, int type, char **buf, pmdaExt *pmda)
 {
@@ -10277,6 +10657,31 @@ linux_init(pmdaInterface *dp)
     }
     if ((envpath = getenv("LINUX_ACCESS")) != NULL)
 	all_access = atoi(envpath);
+    if ((envpath = getenv("LINUX_REFRESH_THREADS")) != NULL) {
+	/*
+	 * If $LINUX_REFRESH_THREADS is set, start this many worker
+	 * threads to refresh independent clusters concurrently with
+	 * the fetching thread (see refreshtab[]).  The default is
+	 * none, refreshing serially.  A worker that has to share a
+	 * CPU with the fetching thread costs more in dispatch than
+	 * it saves, so use at most one per additional online CPU -
+	 * except in QA mode, where the workers are always exercised.
+	 */
+	refresh_threads = atoi(envpath);
+	if (!(linux_test_mode & LINUX_TEST_MODE)) {
+	    long	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	    if (refresh_threads >= ncpus)
+		refresh_threads = ncpus > 1 ? ncpus - 1 : 0;
+	}
+    }
+    /*
+     * $LINUX_REFRESH_INTERVAL is checked after the refresh tasks
+     * are set up below - it sets the minimum interval between runs
+     * of any refresh task (and so the reuse of earlier values).
+     * Similarly $LINUX_NETLINK selects the network clusters that
+     * are refreshed using netlink rather than /proc/net files.
+     */
 
     if (_isDSO) {
 	char helppath[MAXPATHLEN];
@@ -10293,6 +10698,7 @@ linux_init(pmdaInterface *dp)
 
     dp->version.seven.instance = linux_instance;
     dp->version.seven.fetch = linux_fetch;
+    dp->version.seven.store = linux_store;
     dp->version.seven.text = linux_text;
     dp->version.seven.pmid = linux_pmid;
     dp->version.seven.name = linux_name;
@@ -10304,6 +10710,14 @@ linux_init(pmdaInterface *dp)
     pmdaSetFetchCallBack(dp, linux_fetchCallBack);
 
     proc_buddyinfo.indom = &indomtab[BUDDYINFO_INDOM];
+    refresh_tasks_init(refreshtab, sizeof(refreshtab)/sizeof(refreshtab[0]),
+			&indomtab[REFRESH_INDOM]);
+    if ((envpath = getenv("LINUX_REFRESH_INTERVAL")) != NULL &&
+	refresh_tasks_interval(envpath) < 0)
+	pmNotifyErr(LOG_ERR, "bad $LINUX_REFRESH_INTERVAL: %s", envpath);
+    envpath = getenv("LINUX_NETLINK");
+    if (netlink_setup(envpath) < 0)
+	pmNotifyErr(LOG_ERR, "bad $LINUX_NETLINK: %s", envpath);
 
     /*
      * Figure out kernel version.  The precision of certain metrics
@@ -10399,6 +10813,9 @@ linux_init(pmdaInterface *dp)
 
     /* string metrics use the pmdaCache API for value indexing */
     pmdaCacheOp(INDOM(STRINGS_INDOM), PMDA_CACHE_STRINGS);
+
+    /* CPU and node instances, before /proc/stat is parsed in a worker */
+    cpu_node_setup();
 }
 
 pmLongOptions	longopts[] = {
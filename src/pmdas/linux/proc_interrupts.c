@@ -15,11 +15,12 @@
 #include "linux.h"
 #include "filesys.h"
 #include "proc_interrupts.h"
+#include "proc_scan.h"
 #include <sys/stat.h>
 #include <ctype.h>
 
-static char *iobuf;			/* buffer sized based on CPU count */
-static unsigned int iobufsz;
+static proc_file_t interrupts_file = PROC_FILE_INIT("/proc/interrupts");
+static proc_file_t softirqs_file = PROC_FILE_INIT("/proc/softirqs");
 
 static online_cpu_t *online_cpumap;	/* maps input columns to CPU info */
 unsigned int irq_err_count;
@@ -34,15 +35,9 @@ setup_buffers(void)
     static int setup;
 
     if (!setup) {
-	if ((iobufsz = (_pm_ncpus * 64)) < BUFSIZ)
-	    iobufsz = BUFSIZ;
-	if ((iobuf = malloc(iobufsz)) == NULL)
-	    return;
 	online_cpumap = calloc(_pm_ncpus, sizeof(online_cpu_t));
-	if (!online_cpumap) {
-	    free(iobuf);
+	if (!online_cpumap)
 	    return;
-	}
 	setup = 1;
     }
 }
@@ -119,29 +114,46 @@ extract_interrupt_name(char *buffer, char **suffix)
     prev = end - 1;
     if (*prev == '_' || *prev == ':')	/* overwrite final non-name char */
 	end--;				/* and then move end of name */
+    *suffix = *end ? end + 1 : end;	/* mark values start */
     *end = '\0';			/* mark end of name */
-    *suffix = end + 1;			/* mark values start */
     return s;
 }
 
+/*
+ * Extract the count from a row like "ERR:     0", if buffer is one
+ */
+static int
+extract_interrupt_count(const char *buffer, const char *prefix, unsigned int *count)
+{
+    unsigned long long	value;
+    size_t		length = strlen(prefix);
+
+    if (strncmp(buffer, prefix, length) != 0 ||
+	proc_scan_ull(buffer + length, &value) == NULL)
+	return 0;
+    *count = (unsigned int)value;
+    return 1;
+}
+
 static int
 extract_interrupt_errors(char *buffer)
 {
-    return (sscanf(buffer, "ERR: %u", &irq_err_count) == 1 ||
-	    sscanf(buffer, "Err: %u", &irq_err_count) == 1  ||
-	    sscanf(buffer, "BAD: %u", &irq_err_count) == 1);
+    return (extract_interrupt_count(buffer, "ERR:", &irq_err_count) ||
+	    extract_interrupt_count(buffer, "Err:", &irq_err_count) ||
+	    extract_interrupt_count(buffer, "BAD:", &irq_err_count));
 }
 
 static int
 extract_interrupt_misses(char *buffer)
 {
-    return sscanf(buffer, "MIS: %u", &irq_mis_count) == 1;
+    return extract_interrupt_count(buffer, "MIS:", &irq_mis_count);
 }
 
 static int
 extract_interrupt_values(char *name, char *buffer, pmInDom intr, pmInDom cpuintr, int ncolumns)
 {
-    unsigned long i, cpuid, value;
+    unsigned long i, cpuid;
+    unsigned long long value;
     char *s = buffer, *end = NULL;
     char cpubuf[64];
     interrupt_cpu_t *cpuip;
@@ -157,8 +169,11 @@ extract_interrupt_values(char *name, char *buffer, pmInDom intr, pmInDom cpuintr
 
     ip->total = 0;
     for (i = 0; i < ncolumns; i++) {
-	value = strtoul(s, &end, 10);
-	if (!isspace(*end))
+	if ((end = proc_scan_ull(s, &value)) == NULL) {
+	    end = s;		/* short row, zero values as from strtoul */
+	    value = 0;
+	}
+	if (*end != '\0' && !isspace((int)*end))
 	    continue;
 	s = end;
 	cpuip = NULL;
@@ -189,9 +204,8 @@ int
 refresh_proc_interrupts(void)
 {
     static int setup;
-    FILE *fp;
-    char *name, *values;
-    int i, save, ncolumns;
+    char *line, *next, *name, *values;
+    int i, sts, save, ncolumns;
     pmInDom intr_indom = INDOM(INTERRUPT_INDOM);
     pmInDom cpu_intr_indom = INDOM(INTERRUPT_CPU_INDOM);
 
@@ -207,28 +221,26 @@ refresh_proc_interrupts(void)
     for (i = 0; i < _pm_ncpus; i++)
 	online_cpumap[i].intr_count = 0;
 
-    if ((fp = linux_statsfile("/proc/interrupts", iobuf, iobufsz)) == NULL)
-	return -oserror();
+    if ((sts = proc_file_read(&interrupts_file, 1)) < 0)
+	return sts;
+    next = interrupts_file.buf;
 
     /* first parse header, which maps online CPU number to column number */
-    if (fgets(iobuf, iobufsz, fp)) {
-	ncolumns = map_online_cpus(iobuf);
-    } else {
-	fclose(fp);
+    if ((line = proc_scan_line(&next)) != NULL)
+	ncolumns = map_online_cpus(line);
+    else
 	return -EINVAL;		/* unrecognised file format */
-    }
 
     save = 0;
-    while (fgets(iobuf, iobufsz, fp) != NULL) {
+    while ((line = proc_scan_line(&next)) != NULL) {
 	/* extract interrupt line (or other) and values from each row */
-	if (extract_interrupt_errors(iobuf))
+	if (extract_interrupt_errors(line))
 	    continue;
-	if (extract_interrupt_misses(iobuf))
+	if (extract_interrupt_misses(line))
 	    continue;
-	name = extract_interrupt_name(iobuf, &values);
+	name = extract_interrupt_name(line, &values);
 	save |= extract_interrupt_values(name, values, intr_indom, cpu_intr_indom, ncolumns);
     }
-    fclose(fp);
 
     if (save) {
 	pmdaCacheOp(cpu_intr_indom, PMDA_CACHE_SAVE);
@@ -240,7 +252,8 @@ refresh_proc_interrupts(void)
 static int
 extract_softirq_values(char *name, char *buffer, pmInDom sirq, pmInDom cpusirq, int ncolumns)
 {
-    unsigned long i, cpuid, value;
+    unsigned long i, cpuid;
+    unsigned long long value;
     char *s = buffer, *end = NULL;
     char cpubuf[64];
     interrupt_cpu_t *cpuip;
@@ -256,8 +269,11 @@ extract_softirq_values(char *name, char *buffer, pmInDom sirq, pmInDom cpusirq,
 
     ip->total = 0;
     for (i = 0; i < ncolumns; i++) {
-	value = strtoul(s, &end, 10);
-	if (!isspace(*end))
+	if ((end = proc_scan_ull(s, &value)) == NULL) {
+	    end = s;		/* short row, zero values as from strtoul */
+	    value = 0;
+	}
+	if (*end != '\0' && !isspace((int)*end))
 	    continue;
 	s = end;
 	cpuip = NULL;
@@ -288,9 +304,8 @@ int
 refresh_proc_softirqs(void)
 {
     static int setup;
-    FILE *fp;
-    char *name, *values;
-    int i = 0, save, ncolumns;
+    char *line, *next, *name, *values;
+    int i = 0, sts, save, ncolumns;
     pmInDom sirq_indom = INDOM(SOFTIRQ_INDOM);
     pmInDom cpu_sirq_indom = INDOM(SOFTIRQ_CPU_INDOM);
 
@@ -306,24 +321,22 @@ refresh_proc_softirqs(void)
     for (i = 0; i < _pm_ncpus; i++)
 	online_cpumap[i].sirq_count = 0;
 
-    if ((fp = linux_statsfile("/proc/softirqs", iobuf, iobufsz)) == NULL)
-	return -oserror();
+    if ((sts = proc_file_read(&softirqs_file, 1)) < 0)
+	return sts;
+    next = softirqs_file.buf;
 
     /* first parse header, which maps online CPU number to column number */
-    if (fgets(iobuf, iobufsz, fp)) {
-	ncolumns = map_online_cpus(iobuf);
-    } else {
-	fclose(fp);
+    if ((line = proc_scan_line(&next)) != NULL)
+	ncolumns = map_online_cpus(line);
+    else
 	return -EINVAL;		/* unrecognised file format */
-    }
 
     save = 0;
-    while (fgets(iobuf, iobufsz, fp) != NULL) {
+    while ((line = proc_scan_line(&next)) != NULL) {
 	/* extract values from all subsequent softirqs file lines */
-	name = extract_interrupt_name(iobuf, &values);
+	name = extract_interrupt_name(line, &values);
 	save |= extract_softirq_values(name, values, sirq_indom, cpu_sirq_indom, ncolumns);
     }
-    fclose(fp);
 
     if (save) {
 	pmdaCacheOp(cpu_sirq_indom, PMDA_CACHE_SAVE);
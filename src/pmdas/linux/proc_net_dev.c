@@ -21,6 +21,10 @@
 #include <sys/ioctl.h>
 #include "namespaces.h"
 #include "proc_net_dev.h"
+#include "proc_scan.h"
+#include "netlink.h"
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
 
 static int
 refresh_inet_socket(linux_container_t *container)
@@ -368,15 +372,160 @@ refresh_proc_net_all(pmInDom indom, proc_net_all_t *all)
     }
 }
 
+/*
+ * Find (or create) the cached instance for an interface, and mark it
+ * active - returns NULL if the instance domain cache cannot be updated.
+ */
+static net_interface_t *
+net_dev_instance(pmInDom indom, const char *name)
+{
+    static uint32_t	cache_err;	/* throttle messages */
+    net_interface_t	*netip;
+    int			sts;
+
+    sts = pmdaCacheLookupName(indom, name, NULL, (void **)&netip);
+    if (sts == PM_ERR_INST || (sts >= 0 && netip == NULL)) {
+	/* first time since re-loaded, else new one */
+	netip = (net_interface_t *)calloc(1, sizeof(net_interface_t));
+	if (pmDebugOptions.libpmda) {
+	    fprintf(stderr, "refresh_proc_net_dev: initialize \"%s\"\n", name);
+	}
+    }
+    else if (sts < 0) {
+	if (cache_err++ < 10) {
+	    fprintf(stderr, "refresh_proc_net_dev: pmdaCacheLookupName(%s, %s, ...) failed: %s\n",
+		pmInDomStr(indom), name, pmErrStr(sts));
+	}
+	return NULL;
+    }
+    if ((sts = pmdaCacheStore(indom, PMDA_CACHE_ADD, name, (void *)netip)) < 0) {
+	if (cache_err++ < 10) {
+	    fprintf(stderr, "refresh_proc_net_dev: pmdaCacheStore(%s, PMDA_CACHE_ADD, %s, " PRINTF_P_PFX "%p) failed: %s\n",
+		pmInDomStr(indom), name, netip, pmErrStr(sts));
+	}
+	return NULL;
+    }
+    memset(&netip->ioc, 0, sizeof(netip->ioc));
+    return netip;
+}
+
+/*
+ * Convert the RTM_NEWLINK statistics for one interface into counters
+ * in /proc/net/dev column order, as the kernel does in dev_seq_printf_stats.
+ */
+static void
+net_dev_link_callback(struct nlmsghdr *hdr, void *arg)
+{
+    struct ifinfomsg		*ifi = (struct ifinfomsg *)NLMSG_DATA(hdr);
+    struct rtnl_link_stats64	stats64, *s = NULL;
+    struct rtnl_link_stats	*stats32;
+    struct rtattr		*rta;
+    net_interface_t		*netip;
+    pmInDom			indom = *(pmInDom *)arg;
+    char			*name = NULL;
+    int				length;
+
+    if (hdr->nlmsg_type != RTM_NEWLINK ||
+	hdr->nlmsg_len < NLMSG_LENGTH(sizeof(*ifi)))
+	return;
+
+    length = hdr->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
+    for (rta = IFLA_RTA(ifi); RTA_OK(rta, length); rta = RTA_NEXT(rta, length)) {
+	switch (rta->rta_type) {
+	case IFLA_IFNAME:
+	    name = (char *)RTA_DATA(rta);
+	    break;
+	case IFLA_STATS64:
+	    if (RTA_PAYLOAD(rta) < sizeof(stats64))
+		break;
+	    memcpy(&stats64, RTA_DATA(rta), sizeof(stats64));
+	    s = &stats64;
+	    break;
+	case IFLA_STATS:
+	    if (s != NULL || RTA_PAYLOAD(rta) < sizeof(*stats32))
+		break;
+	    stats32 = (struct rtnl_link_stats *)RTA_DATA(rta);
+	    memset(&stats64, 0, sizeof(stats64));
+	    stats64.rx_packets = stats32->rx_packets;
+	    stats64.tx_packets = stats32->tx_packets;
+	    stats64.rx_bytes = stats32->rx_bytes;
+	    stats64.tx_bytes = stats32->tx_bytes;
+	    stats64.rx_errors = stats32->rx_errors;
+	    stats64.tx_errors = stats32->tx_errors;
+	    stats64.rx_dropped = stats32->rx_dropped;
+	    stats64.tx_dropped = stats32->tx_dropped;
+	    stats64.multicast = stats32->multicast;
+	    stats64.collisions = stats32->collisions;
+	    stats64.rx_length_errors = stats32->rx_length_errors;
+	    stats64.rx_over_errors = stats32->rx_over_errors;
+	    stats64.rx_crc_errors = stats32->rx_crc_errors;
+	    stats64.rx_frame_errors = stats32->rx_frame_errors;
+	    stats64.rx_fifo_errors = stats32->rx_fifo_errors;
+	    stats64.rx_missed_errors = stats32->rx_missed_errors;
+	    stats64.tx_aborted_errors = stats32->tx_aborted_errors;
+	    stats64.tx_carrier_errors = stats32->tx_carrier_errors;
+	    stats64.tx_fifo_errors = stats32->tx_fifo_errors;
+	    stats64.tx_heartbeat_errors = stats32->tx_heartbeat_errors;
+	    stats64.tx_window_errors = stats32->tx_window_errors;
+	    stats64.rx_compressed = stats32->rx_compressed;
+	    stats64.tx_compressed = stats32->tx_compressed;
+	    s = &stats64;
+	    break;
+	}
+    }
+    if (name == NULL || s == NULL)
+	return;
+    if ((netip = net_dev_instance(indom, name)) == NULL)
+	return;
+
+    netip->counters[0] = s->rx_bytes;
+    netip->counters[1] = s->rx_packets;
+    netip->counters[2] = s->rx_errors;
+    netip->counters[3] = s->rx_dropped + s->rx_missed_errors;
+    netip->counters[4] = s->rx_fifo_errors;
+    netip->counters[5] = s->rx_length_errors + s->rx_over_errors +
+			 s->rx_crc_errors + s->rx_frame_errors;
+    netip->counters[6] = s->rx_compressed;
+    netip->counters[7] = s->multicast;
+    netip->counters[8] = s->tx_bytes;
+    netip->counters[9] = s->tx_packets;
+    netip->counters[10] = s->tx_errors;
+    netip->counters[11] = s->tx_dropped;
+    netip->counters[12] = s->tx_fifo_errors;
+    netip->counters[13] = s->collisions;
+    netip->counters[14] = s->tx_carrier_errors + s->tx_aborted_errors +
+			  s->tx_window_errors + s->tx_heartbeat_errors;
+    netip->counters[15] = s->tx_compressed;
+}
+
+static int
+netlink_net_dev(pmInDom indom)
+{
+    struct {
+	struct nlmsghdr		hdr;
+	struct ifinfomsg	ifi;
+    } request;
+
+    memset(&request, 0, sizeof(request));
+    request.hdr.nlmsg_len = sizeof(request);
+    request.hdr.nlmsg_type = RTM_GETLINK;
+    request.ifi.ifi_family = AF_UNSPEC;
+
+    return netlink_dump(NETLINK_NET_DEV, NETLINK_ROUTE, &request.hdr,
+			net_dev_link_callback, &indom);
+}
+
 void
 refresh_proc_net_dev(pmInDom indom, linux_container_t *container)
 {
     static int		setup;		/* first pass through */
-    static uint32_t	cache_err;	/* throttle messages */
-    char		buf[1024];
-    FILE		*fp;
-    char		*p, *v;
-    int			j, sts;
+    /* kept open for the host only, as containers have a network namespace */
+    static proc_file_t	host_file = PROC_FILE_INIT("/proc/net/dev");
+    static proc_file_t	container_file = PROC_FILE_INIT("/proc/net/dev");
+    proc_file_t		*pf = container ? &container_file : &host_file;
+    unsigned long long	counters[PROC_DEV_COUNTERS_PER_LINE];
+    char		*line, *next, *p, *v;
+    int			j, n;
     net_interface_t	*netip;
 
     /*
@@ -390,8 +539,12 @@ refresh_proc_net_dev(pmInDom indom, linux_container_t *container)
 
     pmdaCacheOp(indom, PMDA_CACHE_INACTIVE);
 
-    if ((fp = linux_statsfile("/proc/net/dev", buf, sizeof(buf))) == NULL)
+    if (netlink_net_dev(indom) == 0)
+	goto done;
+
+    if (proc_file_read(pf, container == NULL) < 0)
 	return;
+    next = pf->buf;
 
     /*
 Inter-|   Receive                                                |  Transmit
@@ -400,46 +553,20 @@ Inter-|   Receive                                                |  Transmit
   eth0:       0  337614    0    0    0     0          0         0        0  267537    0    0    0 27346      62          0
      */
 
-    while (fgets(buf, sizeof(buf), fp) != NULL) {
-	if ((p = v = strchr(buf, ':')) == NULL)
+    while ((line = proc_scan_line(&next)) != NULL) {
+	if ((p = v = strchr(line, ':')) == NULL)
 	    continue;
 	*p = '\0';
-	for (p=buf; *p && isspace((int)*p); p++) {;}
+	for (p=line; *p && isspace((int)*p); p++) {;}
 
-	sts = pmdaCacheLookupName(indom, p, NULL, (void **)&netip);
-	if (sts == PM_ERR_INST || (sts >= 0 && netip == NULL)) {
-	    /* first time since re-loaded, else new one */
-	    netip = (net_interface_t *)calloc(1, sizeof(net_interface_t));
-	    if (pmDebugOptions.libpmda) {
-		fprintf(stderr, "refresh_proc_net_dev: initialize \"%s\"\n", p);
-	    }
-	}
-	else if (sts < 0) {
-	    if (cache_err++ < 10) {
-		fprintf(stderr, "refresh_proc_net_dev: pmdaCacheLookupName(%s, %s, ...) failed: %s\n",
-		    pmInDomStr(indom), p, pmErrStr(sts));
-	    }
+	if ((netip = net_dev_instance(indom, p)) == NULL)
 	    continue;
-	}
-	if ((sts = pmdaCacheStore(indom, PMDA_CACHE_ADD, p, (void *)netip)) < 0) {
-	    if (cache_err++ < 10) {
-		fprintf(stderr, "refresh_proc_net_dev: pmdaCacheStore(%s, PMDA_CACHE_ADD, %s, " PRINTF_P_PFX "%p) failed: %s\n",
-		    pmInDomStr(indom), p, netip, pmErrStr(sts));
-	    }
-	    continue;
-	}
-
-	memset(&netip->ioc, 0, sizeof(netip->ioc));
-	for (p=v, j=0; j < PROC_DEV_COUNTERS_PER_LINE; j++) {
-	    for (; !isdigit((int)*p); p++) {;}
-	    sscanf(p, "%llu", (long long unsigned int *)&netip->counters[j]);
-	    for (; !isspace((int)*p); p++) {;}
-	}
+	n = proc_scan_ulls(v + 1, counters, PROC_DEV_COUNTERS_PER_LINE, NULL);
+	for (j = 0; j < n; j++)
+	    netip->counters[j] = counters[j];
     }
 
-    /* success */
-    fclose(fp);
-
+done:
     if (!container)
 	pmdaCacheOp(indom, PMDA_CACHE_SAVE);
 }
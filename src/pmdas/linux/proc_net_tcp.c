@@ -16,6 +16,11 @@
 #include <ctype.h>
 #include "linux.h"
 #include "proc_net_tcp.h"
+#include "netlink.h"
+#include <netinet/in.h>
+
+/* the states counted, as inet_diag (1 << state) bits */
+#define TCPCONN_STATES	(((1U << _PM_TCP_LAST) - 1) & ~1U)
 
 static int
 refresh_tcpconn_stats(tcpconn_stats_t *conn, const char *path)
@@ -59,11 +64,17 @@ refresh_tcpconn_stats(tcpconn_stats_t *conn, const char *path)
 int
 refresh_proc_net_tcp(proc_net_tcp_t *proc_net_tcp)
 {
+    if (netlink_sock_states(NETLINK_NET_TCP, AF_INET, IPPROTO_TCP,
+			TCPCONN_STATES, proc_net_tcp->stat, _PM_TCP_LAST) == 0)
+	return 0;
     return refresh_tcpconn_stats(proc_net_tcp, "/proc/net/tcp");
 }
 
 int
 refresh_proc_net_tcp6(proc_net_tcp6_t *proc_net_tcp6)
 {
+    if (netlink_sock_states(NETLINK_NET_TCP6, AF_INET6, IPPROTO_TCP,
+			TCPCONN_STATES, proc_net_tcp6->stat, _PM_TCP_LAST) == 0)
+	return 0;
     return refresh_tcpconn_stats(proc_net_tcp6, "/proc/net/tcp6");
 }
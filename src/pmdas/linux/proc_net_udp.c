@@ -14,6 +14,27 @@
 #include <ctype.h>
 #include "linux.h"
 #include "proc_net_udp.h"
+#include "netlink.h"
+#include <netinet/in.h>
+
+/*
+ * Unconnected (listening) sockets are in the TCP_CLOSE state (0x07),
+ * and connected sockets are in the TCP_ESTABLISHED state (0x01).
+ */
+static int
+netlink_udpconn_stats(udpconn_stats_t *conn, int cluster, int family)
+{
+    unsigned int	counts[8];
+    int			sts;
+
+    sts = netlink_sock_states(cluster, family, IPPROTO_UDP,
+			(1 << 0x07) | (1 << 0x01), counts, 8);
+    if (sts < 0)
+	return sts;
+    conn->listen = counts[0x07];
+    conn->established = counts[0x01];
+    return 0;
+}
 
 static int
 refresh_udpconn_stats(udpconn_stats_t *conn, const char *path)
@@ -61,11 +82,15 @@ refresh_udpconn_stats(udpconn_stats_t *conn, const char *path)
 int
 refresh_proc_net_udp(proc_net_udp_t *proc_net_udp)
 {
+    if (netlink_udpconn_stats(proc_net_udp, NETLINK_NET_UDP, AF_INET) == 0)
+	return 0;
     return refresh_udpconn_stats(proc_net_udp, "/proc/net/udp");
 }
 
 int
 refresh_proc_net_udp6(proc_net_udp6_t *proc_net_udp6)
 {
+    if (netlink_udpconn_stats(proc_net_udp6, NETLINK_NET_UDP6, AF_INET6) == 0)
+	return 0;
     return refresh_udpconn_stats(proc_net_udp6, "/proc/net/udp6");
 }
@@ -13,6 +13,55 @@
  */
 #include "linux.h"
 #include "proc_net_unix.h"
+#include "netlink.h"
+#include <sys/socket.h>
+#include <linux/sock_diag.h>
+#include <linux/unix_diag.h>
+
+/*
+ * unix_diag reports the socket (sk_state) state, where /proc/net/unix
+ * reports the SS_* state - listening and unconnected stream sockets
+ * (TCP_LISTEN, TCP_CLOSE) are SS_UNCONNECTED there, and those in the
+ * TCP_ESTABLISHED state are SS_CONNECTED.
+ */
+static void
+netlink_unix_callback(struct nlmsghdr *hdr, void *arg)
+{
+    proc_net_unix_t	*up = (proc_net_unix_t *)arg;
+    struct unix_diag_msg *msg = (struct unix_diag_msg *)NLMSG_DATA(hdr);
+
+    if (hdr->nlmsg_type != SOCK_DIAG_BY_FAMILY ||
+	hdr->nlmsg_len < NLMSG_LENGTH(sizeof(*msg)))
+	return;
+    if (msg->udiag_type == SOCK_DGRAM)
+	up->datagram_count++;
+    else if (msg->udiag_type == SOCK_STREAM) {
+	if (msg->udiag_state == 0x0a || msg->udiag_state == 0x07)
+	    up->stream_listen++;
+	else if (msg->udiag_state == 0x01)
+	    up->stream_established++;
+	up->stream_count++;
+    }
+}
+
+static int
+netlink_net_unix(proc_net_unix_t *up)
+{
+    struct {
+	struct nlmsghdr		hdr;
+	struct unix_diag_req	req;
+    } request;
+
+    memset(&request, 0, sizeof(request));
+    request.hdr.nlmsg_len = sizeof(request);
+    request.hdr.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    request.req.sdiag_family = AF_UNIX;
+    request.req.udiag_states = ~0U;
+
+    memset(up, 0, sizeof(*up));
+    return netlink_dump(NETLINK_NET_UNIX, NETLINK_SOCK_DIAG, &request.hdr,
+			netlink_unix_callback, up);
+}
 
 int
 refresh_proc_net_unix(proc_net_unix_t *up)
@@ -24,6 +73,9 @@ refresh_proc_net_unix(proc_net_unix_t *up)
     ptrdiff_t		remnant = 0;
     unsigned int	type, state;
 
+    if (netlink_net_unix(up) == 0)
+	return 0;
+
     memset(up, 0, sizeof(*up));
 
     if ((fp = linux_statsfile("/proc/net/unix", buf, sizeof(buf))) == NULL)
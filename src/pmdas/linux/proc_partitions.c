@@ -507,15 +507,33 @@ _pm_scsi_id(const char *device)
     return id ? id : "unknown";
 }
 
-static partitions_entry_t *
+/*
+ * Devices parsed from /proc/diskstats and /proc/partitions, without using
+ * the pmdaCache API so that refresh_proc_partitions can be run in a worker
+ * thread, to update the instance domains from store_proc_partitions.
+ */
+typedef struct {
+    pmInDom		indom;
+    char		*name;		/* instance (persistent) name */
+    char		*dmname;	/* NULL if not a DM device */
+    char		*mdname;	/* NULL if not a MD device */
+    char		*wwid;		/* wwid of sd path, else NULL */
+    int			stats;		/* I/O statistics were parsed */
+    partitions_entry_t	values;
+} partitions_parsed_t;
+
+static partitions_parsed_t	*parsed;
+static int			nparsed;
+static int			maxparsed;
+
+static partitions_parsed_t *
 refresh_disk_indom(char *namebuf, size_t namelen, int devmaj, int devmin,
 		pmInDom disk_indom, pmInDom part_indom, pmInDom zram_indom,
-		pmInDom dm_indom, pmInDom md_indom, pmInDom wwid_indom,
-		int *indom_changes)
+		pmInDom dm_indom, pmInDom md_indom, pmInDom wwid_indom)
 {
-    int			indom, inst;
-    char		*dmname = NULL, *mdname = NULL, *wwid = NULL;
-    partitions_entry_t	*p = NULL;
+    int			indom, i;
+    char		*dmname = NULL, *mdname = NULL, *wwid;
+    partitions_parsed_t	*pp;
 
     if (_pm_isdm(namebuf)) {
 	indom = dm_indom;
@@ -549,64 +567,56 @@ refresh_disk_indom(char *namebuf, size_t namelen, int devmaj, int devmin,
 	/* continue with md devices that have no persistent mapping */
     }
 
-    if (pmdaCacheLookupName(indom, namebuf, &inst, (void **)&p) < 0 || !p) {
-	/* not found: allocate and add a new entry */
-	p = (partitions_entry_t *)calloc(1, sizeof(partitions_entry_t));
-	if (indom == zram_indom)
-	    p->zram = (zram_stat_t *)calloc(1, sizeof(zram_stat_t));
-	*indom_changes += 1;
-    } else {
-	if (p->dmname)
-	    free(p->dmname);
-	if (p->mdname)
-	    free(p->mdname);
-	if (p->zram)
-	    p->zram->uptodate = 0;	/* refreshing now required */
-	p->nr_blocks = 0;		/* zero if not read/needed */
+    /* in both /proc/diskstats and /proc/partitions - update that one */
+    for (i = 0; i < nparsed; i++) {
+	pp = &parsed[i];
+	if (pp->indom == indom && strcmp(pp->name, namebuf) == 0) {
+	    free(dmname);
+	    free(mdname);
+	    return pp;
+	}
     }
 
-    p->dmname = dmname;		/* NULL if not a DM device */
-    p->mdname = mdname;		/* NULL if not a MD device */
-
-    if (!p->namebuf) {
-	p->namebuf = strdup(namebuf);
-    } else if (strcmp(namebuf, p->namebuf) != 0) {
-	free(p->namebuf);
-	p->namebuf = strdup(namebuf);
+    if (nparsed == maxparsed) {
+	i = maxparsed ? maxparsed * 2 : 64;
+	if ((pp = realloc(parsed, i * sizeof(*pp))) == NULL) {
+	    free(dmname);
+	    free(mdname);
+	    return NULL;
+	}
+	parsed = pp;
+	maxparsed = i;
     }
-
-    /* activate and return this entry */
-    if (p->udevnamebuf)
-	/* long xscsi name */
-	pmdaCacheStore(indom, PMDA_CACHE_ADD, p->udevnamebuf, p);
-    else
-	/* short /proc/diskstats or /proc/partitions */
-	pmdaCacheStore(indom, PMDA_CACHE_ADD, namebuf, p);
+    pp = &parsed[nparsed];
+    memset(pp, 0, sizeof(*pp));
+    if ((pp->name = strdup(namebuf)) == NULL) {
+	free(dmname);
+	free(mdname);
+	return NULL;
+    }
+    nparsed++;
+    pp->indom = indom;
+    pp->dmname = dmname;
+    pp->mdname = mdname;
 
     /* if scsi device has a wwid, add it to the wwid indom */
     if (indom == disk_indom) {
-    	wwid = _pm_scsi_id(p->namebuf);
-	if (wwid && strncmp(wwid, "unknown", 7) != 0) {
-	    // fprintf(stderr, "DEBUG found wwid=%s for sd device %s\n", wwid, p->namebuf);
-	    if (p->wwidname)
-	    	free(p->wwidname);
-	    p->wwidname = strdup(wwid);
-	    pmdaCacheStore(wwid_indom, PMDA_CACHE_ADD, p->wwidname, NULL);
-	    pmdaCacheOp(wwid_indom, PMDA_CACHE_SAVE);
-	}
+    	wwid = _pm_scsi_id(pp->name);
+	if (wwid && strncmp(wwid, "unknown", 7) != 0)
+	    pp->wwid = strdup(wwid);
     }
-    return p;
+    return pp;
 }
 
-static int
+static void
 refresh_diskstats(FILE *fp, pmInDom disk_indom, pmInDom part_indom,
 		pmInDom zram_indom, pmInDom dm_indom, pmInDom md_indom,
 		pmInDom wwid_indom)
 {
-    int			indom_changes = 0;
     int			devmin, devmaj, n;
     char		buf[MAXPATHLEN];
     char		name[MAXPATHLEN];
+    partitions_parsed_t	*pp;
     partitions_entry_t	*p;
 
     while (fgets(buf, sizeof(buf), fp) != NULL) {
@@ -617,11 +627,12 @@ refresh_diskstats(FILE *fp, pmInDom disk_indom, pmInDom part_indom,
 	if ((n = sscanf(buf, "%d %d %s", &devmaj, &devmin, name)) != 3)
 	    continue;
 
-	if (!(p = refresh_disk_indom(name, sizeof(name), devmaj, devmin,
+	if (!(pp = refresh_disk_indom(name, sizeof(name), devmaj, devmin,
 			disk_indom, part_indom, zram_indom, dm_indom, md_indom,
-			wwid_indom, &indom_changes)))
+			wwid_indom)))
 	    continue;
-
+	p = &pp->values;
+	pp->stats = 1;
 	/* 2.6 style /proc/diskstats */
 	name[0] = '\0';
 	/* Linux source: block/genhd.c::diskstats_show(1) */
@@ -658,17 +669,16 @@ refresh_diskstats(FILE *fp, pmInDom disk_indom, pmInDom part_indom,
 	    p->fl_ios = p->fl_ticks = 0;
 	}
     }
-    return indom_changes;
 }
 
-static int
+static void
 refresh_partitions(FILE *fp, pmInDom disk_indom, pmInDom part_indom,
 		pmInDom zram_indom, pmInDom dm_indom, pmInDom md_indom,
 		pmInDom wwid_indom)
 {
-    int			indom_changes = 0;
     int			devmin, devmaj, n;
     unsigned long long	nop;
+    partitions_parsed_t	*pp;
     partitions_entry_t	*p;
     char		buf[MAXPATHLEN];
     char		name[MAXPATHLEN];
@@ -682,33 +692,135 @@ refresh_partitions(FILE *fp, pmInDom disk_indom, pmInDom part_indom,
 	if ((n = sscanf(buf, "%d %d %llu %s", &devmaj, &devmin, &nop, name)) != 4)
 	    continue;
 
-	if (!(p = refresh_disk_indom(name, sizeof(name), devmaj, devmin,
+	if (!(pp = refresh_disk_indom(name, sizeof(name), devmaj, devmin,
 			disk_indom, part_indom, zram_indom, dm_indom, md_indom,
-			wwid_indom, &indom_changes)))
+			wwid_indom)))
 	    continue;
+	p = &pp->values;
 
 	/* 2.4 format /proc/partitions (distro patched) */
 	name[0] = '\0';
-	sscanf(buf,
+	n = sscanf(buf,
 		"%u %u %llu %s %llu %llu %llu %u %llu %llu %llu %u %u %u %u",
 		&p->major, &p->minor, &p->nr_blocks, name,
 		&p->rd_ios, &p->rd_merges, &p->rd_sectors,
 		&p->rd_ticks, &p->wr_ios, &p->wr_merges,
 		&p->wr_sectors, &p->wr_ticks, &p->ios_in_flight,
 		&p->io_ticks, &p->aveq);
+	if (n > 4)
+	    pp->stats = 1;
     }
-    return indom_changes;
 }
 
+/*
+ * Parse the disk stats and/or capacities, with no pmdaCache calls so
+ * that this can be run in a worker thread - store_proc_partitions is
+ * then called from the fetching thread to update the instance domains.
+ */
 int
 refresh_proc_partitions(pmInDom disk_indom, pmInDom part_indom,
 			pmInDom zram_indom, pmInDom dm_indom, pmInDom md_indom,
 			pmInDom wwid_indom, int need_diskstats, int need_partitions)
 {
     FILE	*fp;
-    int		indom_changes = 0;
     char	buf[MAXPATHLEN];
-    static int	first = 1;
+
+    nparsed = 0;
+
+    /* 2.6 style disk stats */
+    if (need_diskstats) {
+	if ((fp = linux_statsfile("/proc/diskstats", buf, sizeof(buf)))) {
+	    refresh_diskstats(fp, disk_indom, part_indom,
+				zram_indom, dm_indom, md_indom, wwid_indom);
+	    fclose(fp);
+	} else {
+	    need_partitions = 1;
+	}
+    }
+
+    /* 2.4 style disk stats *and* device capacity */
+    if (need_partitions) {
+	if ((fp = linux_statsfile("/proc/partitions", buf, sizeof(buf)))) {
+	    refresh_partitions(fp, disk_indom, part_indom,
+				zram_indom, dm_indom, md_indom, wwid_indom);
+	    fclose(fp);
+	}
+    }
+
+    return 0;
+}
+
+/* activate the instance for one device parsed by refresh_proc_partitions */
+static void
+store_disk_indom(partitions_parsed_t *pp, pmInDom zram_indom,
+		pmInDom wwid_indom, int *indom_changes)
+{
+    partitions_entry_t	*p = NULL;
+    int			inst;
+
+    if (pmdaCacheLookupName(pp->indom, pp->name, &inst, (void **)&p) < 0 || !p) {
+	/* not found: allocate and add a new entry */
+	if ((p = (partitions_entry_t *)calloc(1, sizeof(partitions_entry_t))) == NULL)
+	    return;
+	if (pp->indom == zram_indom)
+	    p->zram = (zram_stat_t *)calloc(1, sizeof(zram_stat_t));
+	*indom_changes += 1;
+    } else {
+	if (p->dmname)
+	    free(p->dmname);
+	if (p->mdname)
+	    free(p->mdname);
+	if (p->zram)
+	    p->zram->uptodate = 0;	/* refreshing now required */
+    }
+
+    p->dmname = pp->dmname;	/* NULL if not a DM device */
+    p->mdname = pp->mdname;	/* NULL if not a MD device */
+    pp->dmname = pp->mdname = NULL;
+
+    if (!p->namebuf) {
+	p->namebuf = pp->name;
+	pp->name = NULL;
+    } else if (strcmp(pp->name, p->namebuf) != 0) {
+	free(p->namebuf);
+	p->namebuf = pp->name;
+	pp->name = NULL;
+    }
+
+    p->major = pp->values.major;
+    p->minor = pp->values.minor;
+    p->nr_blocks = pp->values.nr_blocks;	/* zero if not read/needed */
+    if (pp->stats)
+	memcpy(&p->rd_ios, &pp->values.rd_ios,
+		sizeof(*p) - offsetof(partitions_entry_t, rd_ios));
+
+    /* activate this entry */
+    if (p->udevnamebuf)
+	/* long xscsi name */
+	pmdaCacheStore(pp->indom, PMDA_CACHE_ADD, p->udevnamebuf, p);
+    else
+	/* short /proc/diskstats or /proc/partitions */
+	pmdaCacheStore(pp->indom, PMDA_CACHE_ADD, p->namebuf, p);
+
+    /* if scsi device has a wwid, add it to the wwid indom */
+    if (pp->wwid) {
+	if (p->wwidname)
+	    free(p->wwidname);
+	p->wwidname = pp->wwid;
+	pp->wwid = NULL;
+	pmdaCacheStore(wwid_indom, PMDA_CACHE_ADD, p->wwidname, NULL);
+	pmdaCacheOp(wwid_indom, PMDA_CACHE_SAVE);
+    }
+}
+
+void
+store_proc_partitions(pmInDom disk_indom, pmInDom part_indom,
+			pmInDom zram_indom, pmInDom dm_indom, pmInDom md_indom,
+			pmInDom wwid_indom)
+{
+    partitions_parsed_t	*pp;
+    int			indom_changes = 0;
+    static int		first = 1;
 
     if (first) {
 	/* initialize the instance domain caches */
@@ -729,25 +841,14 @@ refresh_proc_partitions(pmInDom disk_indom, pmInDom part_indom,
     pmdaCacheOp(md_indom, PMDA_CACHE_INACTIVE);
     pmdaCacheOp(wwid_indom, PMDA_CACHE_INACTIVE);
 
-    /* 2.6 style disk stats */
-    if (need_diskstats) {
-	if ((fp = linux_statsfile("/proc/diskstats", buf, sizeof(buf)))) {
-	    indom_changes += refresh_diskstats(fp, disk_indom, part_indom,
-						zram_indom, dm_indom, md_indom, wwid_indom);
-	    fclose(fp);
-	} else {
-	    need_partitions = 1;
-	}
-    }
-
-    /* 2.4 style disk stats *and* device capacity */
-    if (need_partitions) {
-	if ((fp = linux_statsfile("/proc/partitions", buf, sizeof(buf)))) {
-	    indom_changes += refresh_partitions(fp, disk_indom, part_indom,
-						zram_indom, dm_indom, md_indom, wwid_indom);
-	    fclose(fp);
-	}
+    for (pp = parsed; pp < &parsed[nparsed]; pp++) {
+	store_disk_indom(pp, zram_indom, wwid_indom, &indom_changes);
+	free(pp->name);
+	free(pp->dmname);
+	free(pp->mdname);
+	free(pp->wwid);
     }
+    nparsed = 0;
 
     /*
      * If any new disks or partitions have appeared then we
@@ -766,8 +867,6 @@ refresh_proc_partitions(pmInDom disk_indom, pmInDom part_indom,
 	pmdaCacheOp(md_indom, PMDA_CACHE_SAVE);
 	pmdaCacheOp(wwid_indom, PMDA_CACHE_SAVE);
     }
-
-    return 0;
 }
 
 /*
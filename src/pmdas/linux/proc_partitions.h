@@ -81,6 +81,7 @@ typedef struct {
 } partitions_entry_t;
 
 extern int refresh_proc_partitions(pmInDom, pmInDom, pmInDom, pmInDom, pmInDom, pmInDom, int, int);
+extern void store_proc_partitions(pmInDom, pmInDom, pmInDom, pmInDom, pmInDom, pmInDom);
 extern int is_partitions_metric(pmID);
 extern int is_capacity_metric(int, int);
 extern int proc_partitions_fetch(pmdaMetric *, unsigned int, pmAtomValue *);
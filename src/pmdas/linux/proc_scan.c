@@ -0,0 +1,144 @@
+/*
+ * Linux /proc file reading and integer field scanning
+ *
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#include "linux.h"
+#include "proc_scan.h"
+
+/*
+ * Read the whole file into pf->buf with pread(2) from offset zero, so
+ * an open descriptor can be reused without seeking.  The descriptor is
+ * kept open afterward if keepopen is set, except in QA mode.  Returns
+ * the number of bytes read, or a negative errno.
+ */
+int
+proc_file_read(proc_file_t *pf, int keepopen)
+{
+    char		path[MAXPATHLEN];
+    char		*p;
+    size_t		size;
+    ssize_t		bytes;
+
+    if (pf->fd < 0) {
+	pmsprintf(path, sizeof(path), "%s%s", linux_statspath, pf->path);
+	if ((pf->fd = open(path, O_RDONLY)) < 0)
+	    return -oserror();
+    }
+
+    pf->length = 0;
+    for (;;) {
+	if (pf->length + 1 >= pf->size) {
+	    size = pf->size ? pf->size * 2 : BUFSIZ;
+	    if ((p = (char *)realloc(pf->buf, size)) == NULL) {
+		proc_file_close(pf);
+		return -ENOMEM;
+	    }
+	    pf->buf = p;
+	    pf->size = size;
+	}
+	bytes = pread(pf->fd, pf->buf + pf->length,
+			pf->size - pf->length - 1, pf->length);
+	if (bytes <= 0)
+	    break;
+	pf->length += bytes;
+    }
+    pf->buf[pf->length] = '\0';
+
+    if (bytes < 0) {
+	bytes = -oserror();
+	proc_file_close(pf);
+	return bytes;
+    }
+    /* in test mode we replace procfs files (keeping fd open thwarts that) */
+    if (!keepopen || (linux_test_mode & LINUX_TEST_STATSPATH)) {
+	close(pf->fd);
+	pf->fd = -1;
+    }
+    return pf->length;
+}
+
+void
+proc_file_close(proc_file_t *pf)
+{
+    if (pf->fd >= 0)
+	close(pf->fd);
+    pf->fd = -1;
+}
+
+/*
+ * Return the line starting at *next with its end-of-line marker
+ * overwritten, and move *next to the start of the following line.
+ * Returns NULL at the end of the buffer.
+ */
+char *
+proc_scan_line(char **next)
+{
+    char		*line = *next, *end;
+
+    if (*line == '\0')
+	return NULL;
+    if ((end = strchr(line, '\n')) != NULL) {
+	*end = '\0';
+	*next = end + 1;
+    }
+    else
+	*next = line + strlen(line);
+    return line;
+}
+
+/*
+ * Scan one unsigned decimal field from p, after any spaces or tabs
+ * (but not across a line end).  Unlike sscanf(3) and strtoull(3)
+ * there is no locale, sign or base handling - /proc fields are plain
+ * digit runs.  Returns the position following the digits, or NULL if
+ * there is no field at p.
+ */
+char *
+proc_scan_ull(const char *p, unsigned long long *value)
+{
+    unsigned long long	v;
+    unsigned int	digit;
+
+    while (*p == ' ' || *p == '\t')
+	p++;
+    if ((digit = (unsigned char)*p - '0') > 9)
+	return NULL;
+    v = digit;
+    while ((digit = (unsigned char)*++p - '0') <= 9)
+	v = v * 10 + digit;
+    *value = v;
+    return (char *)p;
+}
+
+/*
+ * Scan up to count consecutive unsigned fields from p into values[],
+ * returning the number scanned (fewer if a line end or a non-numeric
+ * field is reached first).  If end is non-NULL, it is set to the
+ * position following the last field scanned.
+ */
+int
+proc_scan_ulls(const char *p, unsigned long long *values, int count, char **end)
+{
+    char		*next;
+    int			n;
+
+    for (n = 0; n < count; n++) {
+	if ((next = proc_scan_ull(p, &values[n])) == NULL)
+	    break;
+	p = next;
+    }
+    if (end)
+	*end = (char *)p;
+    return n;
+}
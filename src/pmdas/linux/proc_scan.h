@@ -0,0 +1,40 @@
+/*
+ * Linux /proc file reading and integer field scanning
+ *
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#ifndef LINUX_PROC_SCAN_H
+#define LINUX_PROC_SCAN_H
+
+/*
+ * A /proc file read whole into a buffer that is reused (and grown as
+ * needed) across refreshes.  The file descriptor is kept open between
+ * reads when requested, except in QA mode where the files are replaced.
+ */
+typedef struct {
+    const char		*path;		/* e.g. "/proc/stat" */
+    int			fd;		/* open file, or -1 */
+    char		*buf;		/* file contents, null-terminated */
+    size_t		size;		/* allocated size of buf */
+    size_t		length;		/* bytes read by the last refresh */
+} proc_file_t;
+
+#define PROC_FILE_INIT(path)	{ (path), -1, NULL, 0, 0 }
+
+extern int proc_file_read(proc_file_t *, int);
+extern void proc_file_close(proc_file_t *);
+extern char *proc_scan_line(char **);
+extern char *proc_scan_ull(const char *, unsigned long long *);
+extern int proc_scan_ulls(const char *, unsigned long long *, int, char **);
+
+#endif /* LINUX_PROC_SCAN_H */
@@ -18,32 +18,33 @@
 #include "linux.h"
 #include "proc_slabinfo.h"
 
+/*
+ * Caches parsed from /proc/slabinfo by refresh_proc_slabinfo, without
+ * using the pmdaCache API (worker thread), for store_proc_slabinfo.
+ */
+typedef struct {
+    char		name[128];
+    slab_cache_t	values;
+} slab_parsed_t;
+
+static slab_parsed_t	*parsed;
+static int		nparsed;
+static int		maxparsed;
+
 int
-refresh_proc_slabinfo(pmInDom slab_indom, proc_slabinfo_t *slabinfo)
+refresh_proc_slabinfo(proc_slabinfo_t *slabinfo)
 {
-    slab_cache_t sbuf, *s;
+    slab_cache_t sbuf;
+    slab_parsed_t *sp;
     char buf[BUFSIZ];
     char name[128];
     char *w, *p;
     FILE *fp;
-    int i, sts = 0, indom_change = 0;
+    int i, sts = 0;
     static int major_version = -1;
     static int minor_version = 0;
-    static int setup;
 
-    if (!setup) {
-	pmdaCacheOp(slab_indom, PMDA_CACHE_LOAD);
-	setup = 1;
-    }
-
-    for (pmdaCacheOp(slab_indom, PMDA_CACHE_WALK_REWIND);;) {
-	if ((i = pmdaCacheOp(slab_indom, PMDA_CACHE_WALK_NEXT)) < 0)
-	    break;
-	if (!pmdaCacheLookup(slab_indom, i, NULL, (void **)&s) || !s)
-	    continue;
-	s->seen = 0;
-    }
-    pmdaCacheOp(slab_indom, PMDA_CACHE_INACTIVE);
+    nparsed = 0;
 
     if ((fp = linux_statsfile("/proc/slabinfo", buf, sizeof(buf))) == NULL)
 	return -oserror();
@@ -148,37 +149,81 @@ refresh_proc_slabinfo(pmInDom slab_indom, proc_slabinfo_t *slabinfo)
 	    break;
 	}
 
-	sts = pmdaCacheLookupName(slab_indom, name, &i, (void **)&s);
+	if (nparsed == maxparsed) {
+	    i = maxparsed ? maxparsed * 2 : 256;
+	    if ((sp = realloc(parsed, i * sizeof(*sp))) == NULL) {
+		sts = -ENOMEM;
+		break;
+	    }
+	    parsed = sp;
+	    maxparsed = i;
+	}
+	sp = &parsed[nparsed++];
+	pmsprintf(sp->name, sizeof(sp->name), "%s", name);
+	sbuf.seen = major_version * 10 + minor_version;
+	sp->values = sbuf;
+    }
+    fclose(fp);
+
+    return sts;
+}
+
+/*
+ * Update the slab instance domain with the caches parsed last time,
+ * any others are now inactive.
+ */
+void
+store_proc_slabinfo(pmInDom slab_indom)
+{
+    slab_cache_t *s;
+    slab_parsed_t *sp;
+    int i, sts, indom_change = 0;
+    static int setup;
+
+    if (!setup) {
+	pmdaCacheOp(slab_indom, PMDA_CACHE_LOAD);
+	setup = 1;
+    }
+
+    for (pmdaCacheOp(slab_indom, PMDA_CACHE_WALK_REWIND);;) {
+	if ((i = pmdaCacheOp(slab_indom, PMDA_CACHE_WALK_NEXT)) < 0)
+	    break;
+	if (!pmdaCacheLookup(slab_indom, i, NULL, (void **)&s) || !s)
+	    continue;
+	s->seen = 0;
+    }
+    pmdaCacheOp(slab_indom, PMDA_CACHE_INACTIVE);
+
+    for (sp = parsed; sp < &parsed[nparsed]; sp++) {
+	sts = pmdaCacheLookupName(slab_indom, sp->name, &i, (void **)&s);
 	if (sts < 0 || !s) {
 	    /* new cache has appeared */
 	    if ((s = calloc(1, sizeof(*s))) == NULL)
 		continue;
 	    if (pmDebugOptions.libpmda)
-		fprintf(stderr, "refresh_slabinfo: added \"%s\"\n", name);
+		fprintf(stderr, "refresh_slabinfo: added \"%s\"\n", sp->name);
 	    indom_change++;
 	}
 
-	s->num_active_objs	= sbuf.num_active_objs;
-	s->total_objs		= sbuf.total_objs;
-	s->object_size		= sbuf.object_size;
-	s->num_active_slabs	= sbuf.num_active_slabs;
-	s->total_slabs		= sbuf.total_slabs;
-	s->pages_per_slab	= sbuf.pages_per_slab;
-	s->objects_per_slab	= sbuf.objects_per_slab;
-	s->total_size		= sbuf.total_size;
+	s->num_active_objs	= sp->values.num_active_objs;
+	s->total_objs		= sp->values.total_objs;
+	s->object_size		= sp->values.object_size;
+	s->num_active_slabs	= sp->values.num_active_slabs;
+	s->total_slabs		= sp->values.total_slabs;
+	s->pages_per_slab	= sp->values.pages_per_slab;
+	s->objects_per_slab	= sp->values.objects_per_slab;
+	s->total_size		= sp->values.total_size;
 
-	s->seen = major_version * 10 + minor_version;
+	s->seen = sp->values.seen;
 
-	pmdaCacheStore(slab_indom, PMDA_CACHE_ADD, name, s);
+	pmdaCacheStore(slab_indom, PMDA_CACHE_ADD, sp->name, s);
     }
-    fclose(fp);
 
     if (indom_change)
 	pmdaCacheOp(slab_indom, PMDA_CACHE_SAVE);
-
-    return sts;
 }
 
+
 int
 proc_slabinfo_fetch(pmInDom indom, int item, unsigned int inst, pmAtomValue *ap)
 {
@@ -42,6 +42,7 @@ typedef struct {
     pmdaIndom		*indom;
 } proc_slabinfo_t;
 
-extern int refresh_proc_slabinfo(pmInDom, proc_slabinfo_t *);
+extern int refresh_proc_slabinfo(proc_slabinfo_t *);
+extern void store_proc_slabinfo(pmInDom);
 extern int proc_slabinfo_fetch(pmInDom, int item, unsigned int, pmAtomValue *);
 
@@ -17,6 +17,7 @@
  */
 #include "linux.h"
 #include "proc_stat.h"
+#include "proc_scan.h"
 #include <sys/stat.h>
 #include <dirent.h>
 #include <ctype.h>
@@ -59,14 +60,39 @@ setup_cpu_info(cpuinfo_t *cip)
     cip->flags = -1;
 }
 
+/*
+ * The CPUs and nodes from cpu_node_setup(), indexed without using the
+ * pmdaCache API so that /proc/stat can be parsed in a worker thread,
+ * and the CPUs seen (online) in the last parse, for store_proc_stat().
+ */
+static percpu_t		**cpu_map;	/* indexed by CPU identifier */
+static unsigned int	cpu_mapsize;
+static pernode_t	**node_list;
+static unsigned int	node_count;
+static percpu_t		**cpu_online;
+static unsigned int	cpu_nonline;
+static percpu_t		**cpu_stored;	/* cpu_online when last stored */
+static int		cpu_nstored = -1;
+static int		cpu_indom_size;
+
 static void
 cpu_add(pmInDom cpus, unsigned int cpuid, pernode_t *np)
 {
-    percpu_t	*cpu;
+    percpu_t	*cpu, **map;
     char	name[64];
-
+    size_t	size;
+
+    if (cpuid >= cpu_mapsize) {
+	size = (cpuid + 1) * sizeof(percpu_t *);
+	if ((map = (percpu_t **)realloc(cpu_map, size)) == NULL)
+	    return;
+	memset(map + cpu_mapsize, 0, (cpuid + 1 - cpu_mapsize) * sizeof(percpu_t *));
+	cpu_map = map;
+	cpu_mapsize = cpuid + 1;
+    }
     if ((cpu = (percpu_t *)calloc(1, sizeof(percpu_t))) == NULL)
 	return;
+    cpu_map[cpuid] = cpu;
     cpu->cpuid = cpuid;
     cpu->node = np;
     setup_cpu_info(&cpu->info);
@@ -77,11 +103,16 @@ cpu_add(pmInDom cpus, unsigned int cpuid, pernode_t *np)
 static pernode_t *
 node_add(pmInDom nodes, unsigned int nodeid)
 {
-    pernode_t	*node;
+    pernode_t	*node, **list;
     char	name[64];
+    size_t	size = (node_count + 1) * sizeof(pernode_t *);
 
+    if ((list = (pernode_t **)realloc(node_list, size)) == NULL)
+	return NULL;
+    node_list = list;
     if ((node = (pernode_t *)calloc(1, sizeof(pernode_t))) == NULL)
 	return NULL;
+    node_list[node_count++] = node;
     node->nodeid = nodeid;
     pmsprintf(name, sizeof(name)-1, "node%u", nodeid);
     node->instid = pmdaCacheStore(nodes, PMDA_CACHE_ADD, name, (void*)node);
@@ -142,6 +173,11 @@ done:
 	    free(node_files[i]);
 	free(node_files);
     }
+    cpu_indom_size = pmdaCacheOp(cpus, PMDA_CACHE_SIZE);
+    if (cpu_mapsize > 0 &&
+	((cpu_online = (percpu_t **)calloc(cpu_mapsize, sizeof(percpu_t *))) == NULL ||
+	 (cpu_stored = (percpu_t **)calloc(cpu_mapsize, sizeof(percpu_t *))) == NULL))
+	cpu_mapsize = 0;
 }
 
 static int
@@ -160,77 +196,69 @@ find_line_format(const char *fmt, int fmtlen, char **bufindex, int nbufindex, in
     return -1;
 }
 
+/*
+ * Scan the CPU time fields of a cpu line, in /proc/stat order.  Older
+ * kernels have fewer fields, the missing ones are left unchanged.
+ */
+static void
+scan_cpuacct(const char *p, cpuacct_t *acct)
+{
+    unsigned long long	v[10];
+    int			n;
+
+    n = proc_scan_ulls(p, v, 10, NULL);
+    switch (n) {
+    case 10: acct->guest_nice = v[9];	/* FALLTHROUGH */
+    case 9: acct->guest = v[8];		/* FALLTHROUGH */
+    case 8: acct->steal = v[7];		/* FALLTHROUGH */
+    case 7: acct->sirq = v[6];		/* FALLTHROUGH */
+    case 6: acct->irq = v[5];		/* FALLTHROUGH */
+    case 5: acct->wait = v[4];		/* FALLTHROUGH */
+    case 4: acct->idle = v[3];		/* FALLTHROUGH */
+    case 3: acct->sys = v[2];		/* FALLTHROUGH */
+    case 2: acct->nice = v[1];		/* FALLTHROUGH */
+    case 1: acct->user = v[0];		/* FALLTHROUGH */
+    default: break;
+    }
+}
+
 #define WAITIO_SLOP 100
 
 /*
  * We use /proc/stat as a single source of truth regarding online/offline
  * state for CPUs (its per-CPU stats are for online CPUs only).
  * This drives the contents of the CPU indom for all per-CPU metrics, so
- * it is important to ensure this refresh routine is called first before
- * refreshing any other per-CPU metrics (e.g. interrupts, softnet).
+ * it is important to ensure store_proc_stat is called first before
+ * refreshing any other per-CPU metrics (e.g. softnet).
+ *
+ * No pmdaCache calls are made here (cpu_node_setup has been called
+ * already, from linux_init) so this can be run in a worker thread.
  */
 int
 refresh_proc_stat(proc_stat_t *proc_stat)
 {
     pernode_t	*np;
     percpu_t	*cp;
-    pmInDom	cpus, nodes;
-    char	buf[MAXPATHLEN], *name, *sp, **bp;
-    char	cpuname[32];
+    char	*statbuf, **bp;
+    char	*sp;
     int		n = 0, i, size;
+    unsigned long long	cpuid;
     static unsigned long long	prev_wait;
 
-    static int fd = -1; /* kept open until exit(), unless testing */
-    static char *statbuf;
-    static int maxstatbuf;
+    static proc_file_t stat_file = PROC_FILE_INIT("/proc/stat");
     static char **bufindex;
     static int nbufindex;
     static int maxbufindex;
 
-    cpu_node_setup();
-    cpus = INDOM(CPU_INDOM);
-    pmdaCacheOp(cpus, PMDA_CACHE_INACTIVE);
-    nodes = INDOM(NODE_INDOM);
+    cpu_nonline = 0;
 
     /* reset per-node aggregate CPU utilisation stats */
-    for (pmdaCacheOp(nodes, PMDA_CACHE_WALK_REWIND);;) {
-	if ((i = pmdaCacheOp(nodes, PMDA_CACHE_WALK_NEXT)) < 0)
-	    break;
-	if (!pmdaCacheLookup(nodes, i, NULL, (void **)&np) || !np)
-	    continue;
-	memset(&np->stat, 0, sizeof(np->stat));
-    }
+    for (i = 0; i < node_count; i++)
+	memset(&node_list[i]->stat, 0, sizeof(node_list[i]->stat));
 
-    /* in test mode we replace procfs files (keeping fd open thwarts that) */
-    if (fd >= 0 && (linux_test_mode & LINUX_TEST_STATSPATH)) {
-	close(fd);
-	fd = -1;
-    }
-
-    if (fd >= 0) {
-	if (lseek(fd, 0, SEEK_SET) < 0)
-	    return -oserror();
-    } else {
-	pmsprintf(buf, sizeof(buf), "%s/proc/stat", linux_statspath);
-	if ((fd = open(buf, O_RDONLY)) < 0)
-	    return -oserror();
-    }
-
-    for (;;) {
-	while (n >= maxstatbuf) {
-	    size = maxstatbuf + 512;
-	    if ((sp = (char *)realloc(statbuf, size)) == NULL)
-		return -ENOMEM;
-	    statbuf = sp;
-	    maxstatbuf = size;
-	}
-	size = (statbuf + maxstatbuf) - (statbuf + n);
-	if ((i = read(fd, statbuf + n, size)) > 0)
-	    n += i;
-	else
-	    break;
-    }
-    statbuf[n] = '\0';
+    if ((n = proc_file_read(&stat_file, 1)) < 0)
+	return n;
+    statbuf = stat_file.buf;
 
     if (bufindex == NULL) {
 	size = 16 * sizeof(char *);
@@ -255,13 +283,9 @@ refresh_proc_stat(proc_stat_t *proc_stat)
 	}
     }
 
-#define ALLCPU_FMT "cpu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu"
-    n = sscanf((const char *)bufindex[0], ALLCPU_FMT,
-	&proc_stat->all.user, &proc_stat->all.nice,
-	&proc_stat->all.sys, &proc_stat->all.idle,
-	&proc_stat->all.wait, &proc_stat->all.irq,
-	&proc_stat->all.sirq, &proc_stat->all.steal,
-	&proc_stat->all.guest, &proc_stat->all.guest_nice);
+    /* e.g. cpu  95379 4 20053 6502503 ... */
+    if (strncmp("cpu ", bufindex[0], 4) == 0)
+	scan_cpuacct(bufindex[0] + 4, &proc_stat->all);
     if (proc_stat->all.prev_wait > 0 &&
 	    proc_stat->all.wait < proc_stat->all.prev_wait &&
 	    proc_stat->all.wait > proc_stat->all.prev_wait - WAITIO_SLOP) {
@@ -280,7 +304,6 @@ refresh_proc_stat(proc_stat_t *proc_stat)
     else
 	proc_stat->all.prev_wait = proc_stat->all.wait;
 
-#define PERCPU_FMT "cpu%u %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu"
     /*
      * per-CPU stats
      * e.g. cpu0 95379 4 20053 6502503
@@ -290,33 +313,29 @@ refresh_proc_stat(proc_stat_t *proc_stat)
      * In the single-CPU system case, don't bother scanning, use "all";
      * this handles non-SMP kernels with no line starting with "cpu0".
      */
-    if ((size = pmdaCacheOp(cpus, PMDA_CACHE_SIZE)) == 1) {
-	(void)pmdaCacheLookup(cpus, 0, &name, (void **)&cp);
-	memcpy(&cp->stat, &proc_stat->all, sizeof(cp->stat));
-	pmdaCacheStore(cpus, PMDA_CACHE_ADD, name, (void *)cp);
-	(void)pmdaCacheLookup(nodes, 0, NULL, (void **)&np);
-	memcpy(&np->stat, &proc_stat->all, sizeof(np->stat));
+    if ((size = cpu_indom_size) == 1) {
+	if (cpu_mapsize > 0 && (cp = cpu_map[0]) != NULL) {
+	    memcpy(&cp->stat, &proc_stat->all, sizeof(cp->stat));
+	    cpu_online[cpu_nonline++] = cp;
+	    if ((np = cp->node) != NULL)
+		memcpy(&np->stat, &proc_stat->all, sizeof(np->stat));
+	}
     }
     else {
 	for (n = 0; n < nbufindex; n++) {
 	    if (strncmp("cpu", bufindex[n], 3) != 0 ||
 		!isdigit((int)bufindex[n][3]))
 		continue;
-	    cp = NULL;
-	    np = NULL;
-	    i = atoi(&bufindex[n][3]);	/* extract CPU identifier */
-	    pmsprintf(cpuname, sizeof(cpuname), "cpu%u", i); /* instance name */
-	    if (pmdaCacheLookupName(cpus, cpuname, &i, (void **)&cp) < 0 || !cp)
+	    if ((sp = proc_scan_ull(&bufindex[n][3], &cpuid)) == NULL)
+		continue;
+	    if (cpuid >= cpu_mapsize || (cp = cpu_map[cpuid]) == NULL ||
+		cpu_nonline >= cpu_mapsize)
 		continue;
 	    /* need to NOT zero out the prev_wait field, as it is used below */
 	    prev_wait = cp->stat.prev_wait;
 	    memset(&cp->stat, 0, sizeof(cp->stat));
 	    cp->stat.prev_wait = prev_wait;
-	    sscanf(bufindex[n], PERCPU_FMT, &i,
-		    &cp->stat.user, &cp->stat.nice, &cp->stat.sys,
-		    &cp->stat.idle, &cp->stat.wait, &cp->stat.irq,
-		    &cp->stat.sirq, &cp->stat.steal, &cp->stat.guest,
-		    &cp->stat.guest_nice);
+	    scan_cpuacct(sp, &cp->stat);
 	    /* see comment above re kernel waitio */
 	    if (cp->stat.prev_wait > 0 &&
 		    cp->stat.wait < cp->stat.prev_wait &&
@@ -326,10 +345,10 @@ refresh_proc_stat(proc_stat_t *proc_stat)
 	    else
 		cp->stat.prev_wait = cp->stat.wait;
 
-	    pmdaCacheStore(cpus, PMDA_CACHE_ADD, cpuname, (void *)cp);
+	    cpu_online[cpu_nonline++] = cp;
 
 	    /* update per-node aggregate CPU utilisation stats as well */
-	    if (pmdaCacheLookup(nodes, cp->node->instid, NULL, (void **)&np) < 0 || !np)
+	    if ((np = cp->node) == NULL)
 		continue;
 	    np->stat.user += cp->stat.user;
 	    np->stat.nice += cp->stat.nice;
@@ -383,3 +402,29 @@ refresh_proc_stat(proc_stat_t *proc_stat)
     /* success */
     return 0;
 }
+
+/*
+ * Mark the CPU instances online from the last refresh_proc_stat as
+ * the active ones, the rest (offline CPUs) are inactive - unless the
+ * online CPUs are unchanged since last time, as is usually the case.
+ */
+void
+store_proc_stat(void)
+{
+    pmInDom		cpus = INDOM(CPU_INDOM);
+    char		name[64];
+    unsigned int	i;
+
+    if (cpu_nstored == (int)cpu_nonline &&
+	memcmp(cpu_stored, cpu_online, cpu_nonline * sizeof(percpu_t *)) == 0)
+	return;
+    if (cpu_nonline > 0)
+	memcpy(cpu_stored, cpu_online, cpu_nonline * sizeof(percpu_t *));
+    cpu_nstored = cpu_nonline;
+
+    pmdaCacheOp(cpus, PMDA_CACHE_INACTIVE);
+    for (i = 0; i < cpu_nonline; i++) {
+	pmsprintf(name, sizeof(name)-1, "cpu%u", cpu_online[i]->cpuid);
+	pmdaCacheStore(cpus, PMDA_CACHE_ADD, name, (void *)cpu_online[i]);
+    }
+}
@@ -29,5 +29,6 @@ typedef struct {
 } proc_stat_t;
 
 extern int refresh_proc_stat(proc_stat_t *);
+extern void store_proc_stat(void);
 extern void setup_cpu_info(cpuinfo_t *);
 extern void cpu_node_setup(void);
@@ -17,31 +17,68 @@
 #include "linux.h"
 #include "proc_zoneinfo.h"
 
+/*
+ * Zones, per-node stats and protection values parsed from /proc/zoneinfo
+ * by refresh_proc_zoneinfo, without using the pmdaCache API (so it can
+ * run in a worker thread), in instance order for store_proc_zoneinfo.
+ */
+typedef struct {
+    char		name[64];
+    int			zone;	/* zone, rather than per-node, instance */
+    zoneinfo_entry_t	info;
+} zoneinfo_parsed_t;
+
+typedef struct {
+    char		name[64];
+    zoneprot_entry_t	prot;
+} zoneprot_parsed_t;
+
+static zoneinfo_parsed_t	*parsed;
+static int			nparsed;
+static int			maxparsed;
+static zoneprot_parsed_t	*parsed_prot;
+static int			nparsed_prot;
+static int			maxparsed_prot;
+
+static void *
+zoneinfo_next(void *array, int *count, int *maxcount, size_t size)
+{
+    void	*p;
+    int		max;
+
+    if (*count == *maxcount) {
+	max = *maxcount ? *maxcount * 2 : 16;
+	if ((p = realloc(*(void **)array, max * size)) == NULL)
+	    return NULL;
+	*(void **)array = p;
+	*maxcount = max;
+    }
+    p = (char *)*(void **)array + (*count)++ * size;
+    memset(p, 0, size);
+    return p;
+}
+
 static void
 extract_zone_protection(const char *bp, int node, const char *zonetype,
-			const char *instname, pmInDom protected)
+			const char *instname)
 {
-    zoneprot_entry_t *prot;
-    char *endp, prot_name[64];
+    zoneprot_parsed_t *pp;
+    char *endp;
     unsigned long long value;
     unsigned int lowmem;
-    int sts;
 
     for (lowmem = 0;; lowmem++) {
 	value = strtoul(bp, &endp, 10);
-	pmsprintf(prot_name, sizeof(prot_name),
+	pp = zoneinfo_next(&parsed_prot, &nparsed_prot, &maxparsed_prot,
+			   sizeof(*pp));
+	if (pp == NULL)
+	    break;
+	pmsprintf(pp->name, sizeof(pp->name),
 		 "%s::lowmem_reserved%u", instname, lowmem);
-	/* replace existing value if one exists, else need space for new one */
-	prot = NULL;
-	sts = pmdaCacheLookupName(protected, prot_name, NULL, (void **)&prot);
-	if ((sts < 0 && prot == NULL) &&
-	    (prot = (zoneprot_entry_t *)calloc(1, sizeof(*prot))) == NULL)
-	    continue;
-	prot->node = node;
-	prot->value = value;
-	prot->lowmem = lowmem;
-	pmsprintf(prot->zone, ZONE_NAMELEN, "%s", zonetype);
-	pmdaCacheStore(protected, PMDA_CACHE_ADD, prot_name, (void *)prot);
+	pp->prot.node = node;
+	pp->prot.value = value;
+	pp->prot.lowmem = lowmem;
+	pmsprintf(pp->prot.zone, ZONE_NAMELEN, "%s", zonetype);
 	if (*endp != ',')
 	    break;
 	bp = endp + 2;   /* skip comma and space, then continue */
@@ -49,27 +86,22 @@ extract_zone_protection(const char *bp, int node, const char *zonetype,
 }
 
 int
-refresh_proc_zoneinfo(pmInDom indom, pmInDom protection_indom)
+refresh_proc_zoneinfo(void)
 {
     int node;
     zoneinfo_entry_t *info;
-    zoneinfo_entry_t *perzone;
-    zoneinfo_entry_t *pernode;
+    zoneinfo_entry_t perzone;
+    zoneinfo_entry_t pernode;
+    zoneinfo_parsed_t *zp;
     unsigned long long value;
     char zonetype[ZONE_NAMELEN];
     char instname[64];
     char nodename[64];
     char buf[BUFSIZ];
-    static int setup;
-    int changed = 0;
+    int havenode;
     FILE *fp;
 
-    if (!setup) {
-	pmdaCacheOp(indom, PMDA_CACHE_LOAD);
-	setup = 1;
-    }
-
-    pmdaCacheOp(indom, PMDA_CACHE_INACTIVE);
+    nparsed = nparsed_prot = 0;
     if ((fp = linux_statsfile("/proc/zoneinfo", buf, sizeof(buf))) == NULL)
 	return -oserror();
 
@@ -79,18 +111,12 @@ refresh_proc_zoneinfo(pmInDom indom, pmInDom protection_indom)
 	if (sscanf(buf, "Node %d, zone   %s", &node, zonetype) != 2)
 	    continue;
 
-	info = pernode = perzone = NULL;
+	havenode = 0;
 	pmsprintf(instname, sizeof(instname), "%s::node%u", zonetype, node);
-	if (pmdaCacheLookupName(indom, instname, NULL, (void **)&info) < 0 ||
-	    info == NULL) {
-	    /* not found: allocate and add a new entry */
-	    info = (zoneinfo_entry_t *)calloc(1, sizeof(zoneinfo_entry_t));
-	    changed = 1;
-	}
-	info->node = node;
-	pmsprintf(info->zone, ZONE_NAMELEN, "%s", zonetype);
-	info->flags = 0;
-	perzone = info;
+	memset(&perzone, 0, sizeof(perzone));
+	perzone.node = node;
+	pmsprintf(perzone.zone, ZONE_NAMELEN, "%s", zonetype);
+	info = &perzone;
 
 	/* inner loop to extract all values for this node */
 	while ((!feof(fp)) && fgets(buf, sizeof(buf), fp) != NULL) {
@@ -103,19 +129,13 @@ refresh_proc_zoneinfo(pmInDom indom, pmInDom protection_indom)
 
 	    /* switch to/from kernel section with per-node metrics */
 	    if (strncmp(buf, "  per-node stats", 16) == 0) {
-		info = NULL;
 		pmsprintf(nodename, sizeof(nodename), "node%u", node);
-		if (pmdaCacheLookupName(indom, nodename, NULL, (void **)&info) < 0 ||
-		    info == NULL) {
-		    /* not found: allocate and add a new entry */
-		    info = (zoneinfo_entry_t *)calloc(1, sizeof(zoneinfo_entry_t));
-		    changed = 1;
-		}
-		info->node = node;
-		info->flags = 0;
-		pernode = info;
+		memset(&pernode, 0, sizeof(pernode));
+		pernode.node = node;
+		havenode = 1;
+		info = &pernode;
 	    } else if (strncmp(buf, "  pages ", 8) == 0) {
-		info = perzone;
+		info = &perzone;
 	    }
 
 	    if ((sscanf(buf, " pages free %llu", &value)) == 1) {
@@ -388,30 +408,97 @@ refresh_proc_zoneinfo(pmInDom indom, pmInDom protection_indom)
 		info->flags1 |= (1ULL << (ZONE_NR_ZONE_WRITE_PENDING - ZONE_VALUES0));
 	    }
 	    else if (strncmp(buf, "        protection: (", 20) == 0) {
-		extract_zone_protection(buf+20+1, node, zonetype, instname,
-					protection_indom);
+		extract_zone_protection(buf+20+1, node, zonetype, instname);
 	    }
 	}
 
-	if (pernode) {
-	    pmdaCacheStore(indom, PMDA_CACHE_ADD, nodename, (void *)pernode);
-	    pernode = NULL;
+	if (havenode &&
+	    (zp = zoneinfo_next(&parsed, &nparsed, &maxparsed,
+				sizeof(*zp))) != NULL) {
+	    pmsprintf(zp->name, sizeof(zp->name), "%s", nodename);
+	    zp->info = pernode;
+	}
+	if ((zp = zoneinfo_next(&parsed, &nparsed, &maxparsed,
+				sizeof(*zp))) != NULL) {
+	    pmsprintf(zp->name, sizeof(zp->name), "%s", instname);
+	    zp->zone = 1;
+	    zp->info = perzone;
+	}
+    }
+    fclose(fp);
+
+    return 0;
+}
+
+/*
+ * Update an instance with the values parsed this time - any values
+ * not in this kernel (flags) keep their previous contents.
+ */
+static void
+zoneinfo_update(zoneinfo_entry_t *info, const zoneinfo_entry_t *update)
+{
+    int		i;
+
+    info->node = update->node;
+    memcpy(info->zone, update->zone, ZONE_NAMELEN);
+    info->flags = update->flags;
+    info->flags1 |= update->flags1;
+    for (i = 0; i < ZONE_VALUES0; i++) {
+	if (update->flags & (1ULL << i))
+	    info->values[i] = update->values[i];
+    }
+    for (i = ZONE_VALUES0; i < ZONE_VALUES1; i++) {
+	if (update->flags1 & (1ULL << (i - ZONE_VALUES0)))
+	    info->values[i] = update->values[i];
+    }
+}
+
+void
+store_proc_zoneinfo(pmInDom indom, pmInDom protection_indom)
+{
+    zoneinfo_entry_t *info;
+    zoneinfo_parsed_t *zp;
+    zoneprot_entry_t *prot;
+    zoneprot_parsed_t *pp;
+    static int setup;
+    int changed = 0;
+
+    if (!setup) {
+	pmdaCacheOp(indom, PMDA_CACHE_LOAD);
+	setup = 1;
+    }
 
-	    if (pmDebugOptions.libpmda)
-		fprintf(stderr, "%s: instance %s\n", __FUNCTION__, nodename);
+    for (pp = parsed_prot; pp < &parsed_prot[nparsed_prot]; pp++) {
+	/* replace existing value if one exists, else need space for new one */
+	prot = NULL;
+	if ((pmdaCacheLookupName(protection_indom, pp->name, NULL, (void **)&prot) < 0 ||
+	     prot == NULL) &&
+	    (prot = (zoneprot_entry_t *)calloc(1, sizeof(*prot))) == NULL)
+	    continue;
+	*prot = pp->prot;
+	pmdaCacheStore(protection_indom, PMDA_CACHE_ADD, pp->name, (void *)prot);
+    }
+
+    pmdaCacheOp(indom, PMDA_CACHE_INACTIVE);
+    for (zp = parsed; zp < &parsed[nparsed]; zp++) {
+	info = NULL;
+	if (pmdaCacheLookupName(indom, zp->name, NULL, (void **)&info) < 0 ||
+	    info == NULL) {
+	    /* not found: allocate and add a new entry */
+	    if ((info = (zoneinfo_entry_t *)calloc(1, sizeof(*info))) == NULL)
+		continue;
+	    changed = 1;
 	}
+	zoneinfo_update(info, &zp->info);
 
-	pmdaCacheStore(indom, PMDA_CACHE_ADD, instname, (void *)perzone);
-	if (info->values[ZONE_PRESENT] == 0)
-	    pmdaCacheStore(indom, PMDA_CACHE_HIDE, instname, (void *)perzone);
+	pmdaCacheStore(indom, PMDA_CACHE_ADD, zp->name, (void *)info);
+	if (zp->zone && info->values[ZONE_PRESENT] == 0)
+	    pmdaCacheStore(indom, PMDA_CACHE_HIDE, zp->name, (void *)info);
 
 	if (pmDebugOptions.libpmda)
-	    fprintf(stderr, "%s: instance %s\n", __FUNCTION__, instname);
+	    fprintf(stderr, "%s: instance %s\n", __FUNCTION__, zp->name);
     }
-    fclose(fp);
 
     if (changed)
 	pmdaCacheOp(indom, PMDA_CACHE_SAVE);
-
-    return 0;
 }
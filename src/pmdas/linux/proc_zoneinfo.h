@@ -109,5 +109,6 @@ typedef struct {
     __uint64_t	value;
 } zoneprot_entry_t;
 
-extern int refresh_proc_zoneinfo(pmInDom indom,
-                                 pmInDom zoneinfo_protection_indom);
+extern int refresh_proc_zoneinfo(void);
+extern void store_proc_zoneinfo(pmInDom indom,
+                                pmInDom zoneinfo_protection_indom);
@@ -0,0 +1,401 @@
+/*
+ * Linux refresh task scheduling
+ *
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#include "linux.h"
+#include "refresh.h"
+#include <ctype.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#if defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#endif
+
+int refresh_threads;			/* worker threads, zero for none */
+
+static linux_refresh_t	*tasks;
+static int		ntasks;
+static int		ngroups;	/* one more than highest task group */
+
+static __uint64_t
+refresh_now(void)
+{
+    struct timespec	now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (__uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static int
+refresh_needed(linux_refresh_t *tp, int *need_refresh)
+{
+    if (tp->needed)
+	return tp->needed(need_refresh);
+    return need_refresh[tp->cluster];
+}
+
+/* the fine-grained refreshes this task does for need_refresh[] */
+static unsigned int
+refresh_subset(linux_refresh_t *tp, int *need_refresh)
+{
+    unsigned int	done = 0;
+    int			r;
+
+    for (r = NUM_CLUSTERS; r < NUM_REFRESHES; r++) {
+	if ((tp->refreshes & REFRESH_BIT(r)) && need_refresh[r])
+	    done |= REFRESH_BIT(r);
+    }
+    return done;
+}
+
+/*
+ * Decide which tasks are to be run, skipping those with values from
+ * a recent enough previous run (a hit for the refresh interval).
+ */
+static void
+refresh_mark(int *need_refresh)
+{
+    linux_refresh_t	*tp;
+    __uint64_t		now = refresh_now();
+
+    for (tp = tasks; tp < &tasks[ntasks]; tp++) {
+	tp->pending = refresh_needed(tp, need_refresh);
+	if (!tp->pending || tp->interval == 0 ||
+	    (tp->flags & REFRESH_PERCONTEXT))
+	    continue;
+	if (tp->last != 0 && now - tp->last < (__uint64_t)tp->interval * 1000 &&
+	    (refresh_subset(tp, need_refresh) & ~tp->done) == 0) {
+	    tp->pending = 0;
+	    tp->hits++;
+	}
+	else
+	    tp->misses++;
+    }
+}
+
+static int
+refresh_task(linux_refresh_t *tp, int *need_refresh, void *arg)
+{
+    __uint64_t		start;
+    int			sts;
+
+    start = refresh_now();
+    sts = tp->refresh(need_refresh, arg);
+    tp->count++;
+    tp->time += refresh_now() - start;
+    /* failed refreshes are not reused */
+    tp->last = sts < 0 ? 0 : start;
+    tp->done = refresh_subset(tp, need_refresh);
+    return sts;
+}
+
+/* pmdaCache updates from a task, always made in the fetching thread */
+static void
+refresh_store(linux_refresh_t *tp, int *need_refresh, void *arg)
+{
+    __uint64_t		start;
+
+    if (tp->store == NULL)
+	return;
+    start = refresh_now();
+    tp->store(need_refresh, arg);
+    tp->time += refresh_now() - start;
+}
+
+/*
+ * Run the pending tasks from one group (or from every group, if
+ * group is negative) in table order, returning the first error.
+ * Values are stored as each task completes, except in the worker
+ * threads (positive groups); the REFRESH_LATE tasks are left for
+ * refresh_late() when group zero is run alongside the workers.
+ */
+static int
+refresh_group(int group, int *need_refresh, void *arg)
+{
+    linux_refresh_t	*tp;
+    int			sts = 0, lsts;
+
+    for (tp = tasks; tp < &tasks[ntasks]; tp++) {
+	if (group >= 0 && tp->group != group)
+	    continue;
+	if (!tp->pending)
+	    continue;
+	if (group == 0 && (tp->flags & REFRESH_LATE))
+	    continue;
+	if ((lsts = refresh_task(tp, need_refresh, arg)) < 0 && sts == 0)
+	    sts = lsts;
+	if (group <= 0)
+	    refresh_store(tp, need_refresh, arg);
+    }
+    return sts;
+}
+
+#if defined(HAVE_PTHREAD_H)
+
+/*
+ * Worker pool state - pending[] flags the groups waiting for a worker,
+ * and outstanding counts the groups that are pending or being run.
+ */
+static pthread_mutex_t	refresh_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	refresh_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	refresh_done = PTHREAD_COND_INITIALIZER;
+static int		*pending;
+static int		outstanding;
+static int		nworkers;	/* number of workers started */
+static int		*work_need;	/* need_refresh from the current fetch */
+static void		*work_arg;
+static int		work_sts;
+
+static void *
+refresh_worker(void *unused)
+{
+    int			group, sts;
+
+    (void)unused;
+#if defined(HAVE_SETNS) && defined(CLONE_FS)
+    /*
+     * setns(2) into a mount namespace fails for any thread sharing
+     * its filesystem attributes with another, so stop sharing them
+     * with the fetching thread (container metrics need this).
+     */
+    if (unshare(CLONE_FS) < 0)
+	pmNotifyErr(LOG_ERR, "refresh_worker: unshare: %s", osstrerror());
+#endif
+
+    pthread_mutex_lock(&refresh_lock);
+    nworkers++;
+    pthread_cond_signal(&refresh_done);
+    for (;;) {
+	for (group = 1; group < ngroups; group++)
+	    if (pending[group])
+		break;
+	if (group == ngroups) {
+	    pthread_cond_wait(&refresh_work, &refresh_lock);
+	    continue;
+	}
+	pending[group] = 0;
+	pthread_mutex_unlock(&refresh_lock);
+
+	sts = refresh_group(group, work_need, work_arg);
+
+	pthread_mutex_lock(&refresh_lock);
+	if (sts < 0 && work_sts == 0)
+	    work_sts = sts;
+	if (--outstanding == 0)
+	    pthread_cond_signal(&refresh_done);
+    }
+    /*NOTREACHED*/
+    return NULL;
+}
+
+/*
+ * Start the worker threads, with all signals blocked so that these
+ * continue to be delivered to the main thread, and wait for them to
+ * be ready.  Returns the number of workers started.
+ */
+static int
+refresh_start(void)
+{
+    pthread_t		tid;
+    sigset_t		all, save;
+    int			i, sts;
+
+    if ((pending = (int *)calloc(ngroups, sizeof(int))) == NULL) {
+	pmNoMem("refresh_start", ngroups * sizeof(int), PM_RECOV_ERR);
+	return 0;
+    }
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &save);
+    for (i = 0; i < refresh_threads; i++) {
+	if ((sts = pthread_create(&tid, NULL, refresh_worker, NULL)) != 0) {
+	    pmNotifyErr(LOG_ERR, "refresh_start: pthread_create: %s",
+			pmErrStr(-sts));
+	    break;
+	}
+	pthread_detach(tid);
+    }
+    pthread_sigmask(SIG_SETMASK, &save, NULL);
+
+    pthread_mutex_lock(&refresh_lock);
+    while (nworkers < i)
+	pthread_cond_wait(&refresh_done, &refresh_lock);
+    pthread_mutex_unlock(&refresh_lock);
+    return i;
+}
+
+/*
+ * Once the worker threads are finished, store the values from their
+ * tasks then run the REFRESH_LATE tasks, all in table order.
+ */
+static int
+refresh_late(int *need_refresh, void *arg)
+{
+    linux_refresh_t	*tp;
+    int			sts = 0, lsts;
+
+    for (tp = tasks; tp < &tasks[ntasks]; tp++) {
+	if (!tp->pending)
+	    continue;
+	if (tp->group == 0) {
+	    if (!(tp->flags & REFRESH_LATE))
+		continue;
+	    if ((lsts = refresh_task(tp, need_refresh, arg)) < 0 && sts == 0)
+		sts = lsts;
+	}
+	refresh_store(tp, need_refresh, arg);
+    }
+    return sts;
+}
+
+/*
+ * Hand each group with a pending task to the worker threads, run
+ * the group zero tasks here, then wait for the workers to finish
+ * before storing their values and running any REFRESH_LATE tasks.
+ */
+static int
+refresh_parallel(int *need_refresh, void *arg)
+{
+    linux_refresh_t	*tp;
+    int			sts, lsts;
+
+    pthread_mutex_lock(&refresh_lock);
+    work_need = need_refresh;
+    work_arg = arg;
+    work_sts = 0;
+    for (tp = tasks; tp < &tasks[ntasks]; tp++) {
+	if (tp->group == 0 || !tp->pending || pending[tp->group])
+	    continue;
+	pending[tp->group] = 1;
+	outstanding++;
+    }
+    if (outstanding)
+	pthread_cond_broadcast(&refresh_work);
+    pthread_mutex_unlock(&refresh_lock);
+
+    sts = refresh_group(0, need_refresh, arg);
+
+    pthread_mutex_lock(&refresh_lock);
+    while (outstanding > 0)
+	pthread_cond_wait(&refresh_done, &refresh_lock);
+    if (sts == 0)
+	sts = work_sts;
+    pthread_mutex_unlock(&refresh_lock);
+
+    if ((lsts = refresh_late(need_refresh, arg)) < 0 && sts == 0)
+	sts = lsts;
+    return sts;
+}
+
+#endif /* HAVE_PTHREAD_H */
+
+/*
+ * Run the needed refresh tasks, concurrently if worker threads
+ * have been enabled, returning the first error encountered.
+ */
+int
+refresh_tasks(int *need_refresh, void *arg)
+{
+#if defined(HAVE_PTHREAD_H)
+    static int		started;
+#endif
+
+    refresh_mark(need_refresh);
+
+#if defined(HAVE_PTHREAD_H)
+    if (refresh_threads > 0 && ngroups > 1) {
+	if (!started) {
+	    started = 1;
+	    refresh_threads = refresh_start();
+	}
+	if (refresh_threads > 0)
+	    return refresh_parallel(need_refresh, arg);
+    }
+#endif
+    return refresh_group(-1, need_refresh, arg);
+}
+
+/*
+ * Set refresh intervals from a specification of the form
+ * "[msec][,task=msec]..." - the optional leading value applies
+ * to every task, the others to the named tasks only.
+ */
+int
+refresh_tasks_interval(const char *spec)
+{
+    const char		*p = spec;
+    char		*end;
+    unsigned long	msec;
+    size_t		length;
+    int			i;
+
+    while (*p != '\0') {
+	if (isdigit((int)*p)) {
+	    msec = strtoul(p, &end, 10);
+	    for (i = 0; i < ntasks; i++)
+		tasks[i].interval = msec;
+	}
+	else {
+	    if ((end = strchr(p, '=')) == NULL)
+		return -EINVAL;
+	    length = end - p;
+	    for (i = 0; i < ntasks; i++) {
+		if (strncmp(tasks[i].name, p, length) == 0 &&
+		    tasks[i].name[length] == '\0')
+		    break;
+	    }
+	    if (i == ntasks || !isdigit((int)end[1]))
+		return -EINVAL;
+	    tasks[i].interval = strtoul(end + 1, &end, 10);
+	}
+	if (*end == ',')
+	    end++;
+	else if (*end != '\0')
+	    return -EINVAL;
+	p = end;
+    }
+    return 0;
+}
+
+/*
+ * Register the table of refresh tasks, and set up the instance
+ * domain of the pmda.refresh metrics with an instance per task.
+ */
+void
+refresh_tasks_init(linux_refresh_t *table, int count, pmdaIndom *indomp)
+{
+    pmdaInstid		*set;
+    int			i;
+
+    tasks = table;
+    ntasks = count;
+    for (i = 0; i < count; i++) {
+	if (ngroups <= table[i].group)
+	    ngroups = table[i].group + 1;
+    }
+#if !defined(HAVE_PTHREAD_H)
+    refresh_threads = 0;
+#endif
+
+    if ((set = (pmdaInstid *)calloc(count, sizeof(pmdaInstid))) == NULL) {
+	pmNoMem("refresh_tasks_init", count * sizeof(pmdaInstid), PM_RECOV_ERR);
+	return;
+    }
+    for (i = 0; i < count; i++) {
+	set[i].i_inst = i;
+	set[i].i_name = (char *)table[i].name;
+    }
+    indomp->it_numinst = count;
+    indomp->it_set = set;
+}
@@ -0,0 +1,75 @@
+/*
+ * Linux refresh task scheduling
+ *
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#ifndef LINUX_REFRESH_H
+#define LINUX_REFRESH_H
+
+/*
+ * One entry in the table of refresh tasks, run in table order.
+ *
+ * A task is needed when need_refresh[cluster] is set, or if the
+ * needed() predicate is given, when that returns non-zero.
+ *
+ * Tasks in group zero always run in the fetching thread - these
+ * use the pmdaCache API, the setns(2) calls for container namespaces,
+ * strtok(3), or other state shared with other tasks.  Tasks with the
+ * same non-zero group share state with each other (but nothing else)
+ * and are run in order by one worker thread, concurrently with any
+ * other groups, when worker threads are enabled.
+ *
+ * The refresh() of a task in a worker group only parses the values
+ * into private state; its optional store() then makes any pmdaCache
+ * updates from the fetching thread, immediately after refresh() when
+ * run serially, else once all of the worker threads are finished.
+ * Group zero tasks that need those updates (e.g. the online CPUs) are
+ * REFRESH_LATE, which runs them after the stores in the threaded case.
+ *
+ * A needed task is skipped if it last ran within its interval, unless
+ * it is REFRESH_PERCONTEXT (values depend on the container or access
+ * rights of the requesting context) or the fine-grained refreshes it
+ * needs (refreshes, a mask of REFRESH_BIT values) were not all done
+ * last time.
+ */
+typedef struct {
+    const char		*name;		/* REFRESH_INDOM instance name */
+    int			cluster;
+    int			(*needed)(int *);
+    int			group;
+    int			flags;
+    unsigned int	refreshes;	/* fine-grained refreshes used */
+    int			(*refresh)(int *, void *);
+    void		(*store)(int *, void *);
+    unsigned int	interval;	/* pmda.refresh.interval (msec) */
+    int			pending;	/* to be run in this refresh */
+    unsigned int	done;		/* fine-grained refreshes last run */
+    __uint64_t		last;		/* start of last run (usec) */
+    __uint64_t		count;		/* pmda.refresh.count */
+    __uint64_t		time;		/* pmda.refresh.time (usec) */
+    __uint64_t		hits;		/* pmda.refresh.hits */
+    __uint64_t		misses;		/* pmda.refresh.misses */
+} linux_refresh_t;
+
+#define REFRESH_PERCONTEXT	(1<<0)	/* never reuse values from last run */
+#define REFRESH_LATE		(1<<1)	/* group zero, after the worker stores */
+
+#define REFRESH_BIT(r)		(1U << ((r) - NUM_CLUSTERS))
+
+extern int refresh_threads;		/* $LINUX_REFRESH_THREADS */
+
+extern void refresh_tasks_init(linux_refresh_t *, int, pmdaIndom *);
+extern int refresh_tasks_interval(const char *);
+extern int refresh_tasks(int *, void *);
+
+#endif /* LINUX_REFRESH_H */
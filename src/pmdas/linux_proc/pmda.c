@@ -64,6 +64,7 @@ static int			have_access;	/* =1 recvd uid/gid */
 static int			autogroup = -1;	/* =1 autogroup enabled */
 static unsigned int		threads;	/* control.all.threads */
 static char *			cgroups;	/* control.all.cgroups */
+static char *			pidevents;	/* full /proc scan interval */
 size_t				_pm_system_pagesize;
 long				_pm_hertz;
 
@@ -3816,6 +3817,8 @@ proc_init(pmdaInterface *dp)
 	threads = atoi(envpath);
     if ((envpath = getenv("PROC_ACCESS")) != NULL)
 	all_access = atoi(envpath);
+    if ((envpath = getenv("PROC_EVENTS")) != NULL)
+	pidevents = envpath;
 
     if (_isDSO) {
 	char helppath[MAXPATHLEN];
@@ -3865,6 +3868,8 @@ proc_init(pmdaInterface *dp)
     indomtab[CGROUP2_PERDEV_INDOM].it_indom = CGROUP2_PERDEV_INDOM;
 
     proc_pid.indom = &indomtab[PROC_INDOM];
+    if (pidevents)
+	proc_pid_events_init(pidevents);
 
     indomtab[HOTPROC_INDOM].it_indom = HOTPROC_INDOM;
     hotproc_pid.indom = &indomtab[HOTPROC_INDOM];
@@ -3912,6 +3917,7 @@ pmLongOptions	longopts[] = {
     PMDAOPT_DOMAIN,
     PMDAOPT_LOGFILE,
     { "with-threads", 0, 'L', 0, "include threads in the all-processes instance domain" },
+    { "pid-events", 1, 'e', "INTERVAL", "track processes from kernel events, rescanning /proc at INTERVAL" },
     { "from-cgroup", 1, 'r', "NAME", "restrict monitoring to processes in the named cgroup" },
     PMDAOPT_USERNAME,
     PMOPT_HELP,
@@ -3919,7 +3925,7 @@ pmLongOptions	longopts[] = {
 };
 
 pmdaOptions	opts = {
-    .short_options = "AD:d:l:Lr:U:?",
+    .short_options = "AD:d:e:l:Lr:U:?",
     .long_options = longopts,
 };
 
@@ -3942,6 +3948,9 @@ main(int argc, char **argv)
 	case 'A':
 	    all_access = 1;
 	    break;
+	case 'e':
+	    pidevents = opts.optarg;
+	    break;
 	case 'L':
 	    threads = 1;
 	    break;
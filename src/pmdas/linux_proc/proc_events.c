@@ -0,0 +1,195 @@
+/*
+ * Linux process creation and exit events, from the kernel proc connector
+ *
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include "pmapi.h"
+#include "libpcp.h"
+#include <ctype.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#include "proc_events.h"
+
+#define PROC_EVENTS_RCVBUF	(8 * 1024 * 1024)
+
+static int	eventfd = -1;
+
+/*
+ * The kernel only sends events with pids from the initial pid namespace,
+ * so these cannot be used from within a (nested) pid namespace - there
+ * the NSpid line of /proc/self/status has more than one field.
+ */
+static int
+proc_events_pidns(void)
+{
+    FILE	*fp;
+    char	buf[256], *p;
+    int		sts = 0;
+
+    if ((fp = fopen("/proc/self/status", "r")) == NULL)
+	return -oserror();
+    while (fgets(buf, sizeof(buf), fp) != NULL) {
+	if (strncmp(buf, "NSpid:", 6) != 0)
+	    continue;
+	strtol(buf + 6, &p, 10);
+	while (isspace((int)*p))
+	    p++;
+	if (*p != '\0')
+	    sts = -EOPNOTSUPP;
+	break;
+    }
+    fclose(fp);
+    return sts;
+}
+
+static int
+proc_events_control(int fd, enum proc_cn_mcast_op op)
+{
+    char		buf[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(op))];
+    struct nlmsghdr	*hdr = (struct nlmsghdr *)buf;
+    struct cn_msg	*msg = (struct cn_msg *)NLMSG_DATA(hdr);
+
+    memset(buf, 0, sizeof(buf));
+    hdr->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(op));
+    hdr->nlmsg_type = NLMSG_DONE;
+    hdr->nlmsg_pid = getpid();
+    msg->id.idx = CN_IDX_PROC;
+    msg->id.val = CN_VAL_PROC;
+    msg->len = sizeof(op);
+    memcpy(msg->data, &op, sizeof(op));
+
+    if (send(fd, buf, hdr->nlmsg_len, 0) < 0)
+	return -oserror();
+    return 0;
+}
+
+/*
+ * Subscribe to the proc connector multicast group.  This needs the
+ * CAP_NET_ADMIN capability; the kernel acknowledges the request with
+ * a PROC_EVENT_NONE message holding any error.
+ */
+int
+proc_events_open(void)
+{
+    struct sockaddr_nl	addr = { .nl_family = AF_NETLINK };
+    struct nlmsghdr	*hdr;
+    struct cn_msg	*msg;
+    struct proc_event	*ev;
+    char		buf[4096];
+    ssize_t		bytes;
+    int			fd, size = PROC_EVENTS_RCVBUF, sts;
+
+    if (eventfd >= 0)
+	return 0;
+    if ((sts = proc_events_pidns()) < 0)
+	return sts;
+
+    if ((fd = socket(AF_NETLINK, SOCK_DGRAM|SOCK_NONBLOCK|SOCK_CLOEXEC,
+			NETLINK_CONNECTOR)) < 0)
+	return -oserror();
+    /* bursts of process creation must not overflow the socket buffer */
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0)
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    addr.nl_groups = CN_IDX_PROC;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	(sts = proc_events_control(fd, PROC_CN_MCAST_LISTEN)) < 0) {
+	sts = sts < 0 ? sts : -oserror();
+	close(fd);
+	return sts;
+    }
+
+    /* the acknowledgement is queued before send returns, if at all */
+    while ((bytes = recv(fd, buf, sizeof(buf), 0)) > 0) {
+	for (hdr = (struct nlmsghdr *)buf; NLMSG_OK(hdr, bytes);
+	     hdr = NLMSG_NEXT(hdr, bytes)) {
+	    msg = (struct cn_msg *)NLMSG_DATA(hdr);
+	    ev = (struct proc_event *)msg->data;
+	    if (ev->what == PROC_EVENT_NONE && ev->event_data.ack.err != 0) {
+		close(fd);
+		return -ev->event_data.ack.err;
+	    }
+	}
+    }
+
+    eventfd = fd;
+    return 0;
+}
+
+/*
+ * Pass each queued fork and exit event to the callback (if any, else
+ * the events are discarded).  Returns the
+ * number of events, else -ENOBUFS when events were lost because the
+ * socket buffer overflowed, in which case the caller must rescan /proc.
+ */
+int
+proc_events_read(proc_events_callback_t callback, void *arg)
+{
+    struct sockaddr_nl	addr;
+    socklen_t		addrlen;
+    struct nlmsghdr	*hdr;
+    struct cn_msg	*msg;
+    struct proc_event	*ev;
+    char		buf[16384];
+    ssize_t		bytes;
+    int			count = 0, lost = 0;
+
+    if (eventfd < 0)
+	return -ENOTCONN;
+
+    for (;;) {
+	addrlen = sizeof(addr);
+	bytes = recvfrom(eventfd, buf, sizeof(buf), 0,
+			(struct sockaddr *)&addr, &addrlen);
+	if (bytes < 0) {
+	    if (oserror() == EINTR)
+		continue;
+	    if (oserror() == ENOBUFS) {
+		lost = 1;
+		continue;
+	    }
+	    break;	/* EAGAIN - no more events queued */
+	}
+	if (addr.nl_pid != 0)	/* only believe the kernel */
+	    continue;
+	for (hdr = (struct nlmsghdr *)buf; NLMSG_OK(hdr, bytes);
+	     hdr = NLMSG_NEXT(hdr, bytes)) {
+	    if (hdr->nlmsg_len < NLMSG_LENGTH(sizeof(*msg) + sizeof(*ev)))
+		continue;
+	    msg = (struct cn_msg *)NLMSG_DATA(hdr);
+	    if (msg->id.idx != CN_IDX_PROC || msg->id.val != CN_VAL_PROC)
+		continue;
+	    ev = (struct proc_event *)msg->data;
+	    switch (ev->what) {
+	    case PROC_EVENT_FORK:
+		if (callback)
+		    callback(ev->event_data.fork.child_pid,
+			     ev->event_data.fork.child_tgid, 0, arg);
+		count++;
+		break;
+	    case PROC_EVENT_EXIT:
+		if (callback)
+		    callback(ev->event_data.exit.process_pid,
+			     ev->event_data.exit.process_tgid, 1, arg);
+		count++;
+		break;
+	    default:
+		break;
+	    }
+	}
+    }
+    return lost ? -ENOBUFS : count;
+}
@@ -0,0 +1,29 @@
+/*
+ * Linux process creation and exit events
+ *
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#ifndef PROC_EVENTS_H
+#define PROC_EVENTS_H
+
+/*
+ * Called for each task (thread) created or exited, in the order the
+ * kernel reported them - the task id, its thread group (process) id,
+ * and a flag set for an exit rather than a creation event.
+ */
+typedef void (*proc_events_callback_t)(int, int, int, void *);
+
+extern int proc_events_open(void);
+extern int proc_events_read(proc_events_callback_t, void *);
+
+#endif /* PROC_EVENTS_H */
@@ -29,6 +29,7 @@
 #include "indom.h"
 #include "cgroups.h"
 #include "hotproc.h"
+#include "proc_events.h"
 
 static size_t	procbuflen;
 static char	*procbuf;
@@ -762,14 +763,192 @@ refresh_proc_runq(proc_pid_entry_t *ep, proc_runq_t *runq)
     }
 }
 
+/*
+ * Find the hash table entry for a pid, else add a new entry for it,
+ * named from its command line - cmdline, status or stat.
+ */
+static proc_pid_entry_t *
+proc_pid_entry_add(proc_pid_t *proc_pid, int pid)
+{
+    int			fd;
+    char		*p, buf[MAXPATHLEN];
+    __pmHashNode	*node;
+    proc_pid_entry_t	*ep;
+
+    node = __pmHashSearch(pid, &proc_pid->pidhash);
+    if (node)
+	ep = (proc_pid_entry_t *)node->data;
+    else {
+	int k = 0;
+
+	ep = (proc_pid_entry_t *)malloc(sizeof(proc_pid_entry_t));
+	memset(ep, 0, sizeof(proc_pid_entry_t));
+
+	ep->id = pid;
+
+	pmsprintf(buf, sizeof(buf), "%s/proc/%d/cmdline", proc_statspath, pid);
+	if ((fd = open(buf, O_RDONLY)) >= 0) {
+	    int numlen = pmsprintf(buf, sizeof(buf), "%06d ", pid);
+	    if ((k = read(fd, buf+numlen, sizeof(buf)-numlen)) > 0) {
+		p = buf + k + numlen;
+		if (p - buf >= sizeof(buf))
+		    p--;
+		*p-- = '\0';
+		/* Skip trailing nils, i.e. don't replace them */
+		while (buf+numlen < p) {
+		    if (*p-- != '\0') {
+			    break;
+		    }
+		}
+		/* Remove NULL terminators from cmdline string array */
+		while (buf+numlen < p) {
+		    if (*p == '\0') *p = ' ';
+		    p--;
+		}
+	    }
+	    close(fd);
+	}
+	else if (pmDebugOptions.appl1 && pmDebugOptions.desperate) {
+	    fprintf(stderr, "%s: open(\"%s\", O_RDONLY) failed: %s\n",
+		    "refresh_proc_pidlist", buf, pmErrStr(-oserror()));
+	}
+	if (k == 0) {
+	    /*
+	     * If a process is swapped out, /proc/<pid>/cmdline
+	     * returns an empty string so we have to get it
+	     * from /proc/<pid>/status or /proc/<pid>/stat
+	     */
+	    pmsprintf(buf, sizeof(buf), "%s/proc/%d/status", proc_statspath, pid);
+	    if ((fd = open(buf, O_RDONLY)) >= 0) {
+		/* We engage in a bit of a hanky-panky here:
+		 * the string should look like "123456 (name)",
+		 * we get it from /proc/XX/status as "Name:   name\n...",
+		 * to fit the 6 digits of PID and opening parenthesis, 
+		 * save 2 bytes at the start of the buffer. 
+		 * And don't forget to leave 2 bytes for the trailing 
+		 * parenthesis and the nil. Here is
+		 * an example of what we're trying to achieve:
+		 * +--+--+--+--+--+--+--+--+--+--+--+--+--+--+
+		 * |  |  | N| a| m| e| :|\t| i| n| i| t|\n| S|...
+		 * +--+--+--+--+--+--+--+--+--+--+--+--+--+--+
+		 * | 0| 0| 0| 0| 0| 1|  | (| i| n| i| t| )|\0|...
+		 * +--+--+--+--+--+--+--+--+--+--+--+--+--+--+ */
+		if ((k = read(fd, buf+2, sizeof(buf)-4)) > 0) {
+		    int bc;
+
+		    if ((p = strchr(buf+2, '\n')) == NULL)
+			p = buf+k;
+		    p[0] = ')'; 
+		    p[1] = '\0';
+		    bc = pmsprintf(buf, sizeof(buf), "%06d ", pid); 
+		    buf[bc] = '(';
+		}
+		close(fd);
+	    }
+	    else if (pmDebugOptions.appl1 && pmDebugOptions.desperate) {
+		fprintf(stderr, "%s: open(\"%s\", O_RDONLY) failed: %s\n",
+			"refresh_proc_pidlist", buf, pmErrStr(-oserror()));
+	    }
+	}
+
+	if (k <= 0) {
+	    /* hmm .. must be exiting */
+	    pmsprintf(buf, sizeof(buf), "%06d <exiting>", pid);
+	}
+
+	if ((ep->name = strdup(buf)) != NULL)
+	    ep->psargs = index(ep->name, ' ') + 1;
+	else
+	    ep->psargs = NULL;
+
+	__pmHashAdd(pid, (void *)ep, &proc_pid->pidhash);
+	//fprintf(stderr, "key %d : ADDED \"%s\" to hash table\n", pid, buf);
+    }
+
+    if (ep->instname == NULL) {
+       /*
+	 * The external instance name is the pid followed by
+	 * a copy of the psargs truncated at the first space.
+	 * e.g. "012345 /path/to/command". Command line args,
+	 * if any, are truncated. The full command line is
+	 * available in the proc.psinfo.psargs metric.
+	 */
+	if ((p = strchr(ep->name, ' ')) != NULL) {
+	    if ((p = strchr(p+1, ' ')) != NULL) {
+		int len = p - ep->name;
+		if (len > PROC_PID_STAT_CMD_MAXLEN)
+		    len = PROC_PID_STAT_CMD_MAXLEN;
+		ep->instname = (char *)malloc(len+1);
+		strncpy(ep->instname, ep->name, len);
+		ep->instname[len] = '\0';
+	    }
+	}
+	if (ep->instname == NULL) /* no spaces found, so use the full name */
+	    ep->instname = strndup(ep->name, PROC_PID_STAT_CMD_MAXLEN);
+    }
+    return ep;
+}
+
+static void
+proc_pid_entry_free(proc_pid_entry_t *ep)
+{
+    if (ep->instname != NULL)
+	free(ep->instname);
+    if (ep->name != NULL)
+	free(ep->name);
+    if (ep->stat.cmd != NULL)
+	free(ep->stat.cmd);
+    if (ep->maps_buf != NULL)
+	free(ep->maps_buf);
+    if (ep->wchan_buf != NULL)
+	free(ep->wchan_buf);
+    if (ep->environ_buf != NULL)
+	free(ep->environ_buf);
+    free(ep);
+}
+
+/*
+ * At this point, the hash table contains only valid pids.  Finally:
+ * - refresh the indom table, based on the updated process hash table.
+ *   (indom table instance names are shared with the hash table entry,
+ *    so must not be freed).
+ * - if runq metrics are being gathered, sample stat files now for all
+ *   active processes and accumulate the values - and do this in a way
+ *   that sets the FETCHED flag for these files such that they're only
+ *   read once for each sample (fetch).
+ */
+static void
+refresh_proc_indom(proc_pid_t *proc_pid, int numinst, proc_runq_t *runq)
+{
+    int			i, idx = 0;
+    __pmHashNode	*node;
+    proc_pid_entry_t	*ep;
+    pmdaIndom		*indomp = proc_pid->indom;
+
+    /* Reset accounting of the runqueue metrics, initially all zeroes */
+    if (runq)
+	memset(runq, 0, sizeof(proc_runq_t));
+
+    indomp->it_numinst = numinst;
+    indomp->it_set = (pmdaInstid *)realloc(indomp->it_set, numinst * sizeof(pmdaInstid));
+    for (i=0; i < proc_pid->pidhash.hsize; i++) {
+	for (node=proc_pid->pidhash.hash[i]; node != NULL; node=node->next) {
+	    ep = (proc_pid_entry_t *)node->data;
+	    if (runq) {
+		refresh_proc_pid_stat(ep);
+		refresh_proc_runq(ep, runq);
+	    }
+	    refresh_proc_indom_entry(ep, indomp, idx++);
+	}
+    }
+}
+
 static void
 refresh_proc_pidlist(proc_pid_t *proc_pid, proc_pid_list_t *pids, proc_runq_t *runq)
 {
-    int			i, fd, numinst, idx = 0;
-    char		*p, buf[MAXPATHLEN];
+    int			i, numinst;
     __pmHashNode	*node, *next, *prev;
     proc_pid_entry_t	*ep;
-    pmdaIndom		*indomp = proc_pid->indom;
 
     /*
      * invalidate all entries so we can harvest pids that have exited
@@ -786,118 +965,8 @@ refresh_proc_pidlist(proc_pid_t *proc_pid, proc_pid_list_t *pids, proc_runq_t *r
      * marking entries valid as we go ...
      */
     for (i=0; i < pids->count; i++) {
-	node = __pmHashSearch(pids->pids[i], &proc_pid->pidhash);
-	if (node)
-	    ep = (proc_pid_entry_t *)node->data;
-	else {
-	    int k = 0;
-
-	    ep = (proc_pid_entry_t *)malloc(sizeof(proc_pid_entry_t));
-	    memset(ep, 0, sizeof(proc_pid_entry_t));
-
-	    ep->id = pids->pids[i];
-
-	    pmsprintf(buf, sizeof(buf), "%s/proc/%d/cmdline", proc_statspath, pids->pids[i]);
-	    if ((fd = open(buf, O_RDONLY)) >= 0) {
-		int numlen = pmsprintf(buf, sizeof(buf), "%06d ", pids->pids[i]);
-		if ((k = read(fd, buf+numlen, sizeof(buf)-numlen)) > 0) {
-		    p = buf + k + numlen;
-		    if (p - buf >= sizeof(buf))
-			p--;
-		    *p-- = '\0';
-		    /* Skip trailing nils, i.e. don't replace them */
-		    while (buf+numlen < p) {
-			if (*p-- != '\0') {
-				break;
-			}
-		    }
-		    /* Remove NULL terminators from cmdline string array */
-		    while (buf+numlen < p) {
-			if (*p == '\0') *p = ' ';
-			p--;
-		    }
-		}
-		close(fd);
-	    }
-	    else if (pmDebugOptions.appl1 && pmDebugOptions.desperate) {
-		fprintf(stderr, "%s: open(\"%s\", O_RDONLY) failed: %s\n",
-			"refresh_proc_pidlist", buf, pmErrStr(-oserror()));
-	    }
-	    if (k == 0) {
-		/*
-		 * If a process is swapped out, /proc/<pid>/cmdline
-		 * returns an empty string so we have to get it
-		 * from /proc/<pid>/status or /proc/<pid>/stat
-		 */
-		pmsprintf(buf, sizeof(buf), "%s/proc/%d/status", proc_statspath, pids->pids[i]);
-		if ((fd = open(buf, O_RDONLY)) >= 0) {
-		    /* We engage in a bit of a hanky-panky here:
-		     * the string should look like "123456 (name)",
-		     * we get it from /proc/XX/status as "Name:   name\n...",
-		     * to fit the 6 digits of PID and opening parenthesis, 
-	             * save 2 bytes at the start of the buffer. 
-	             * And don't forget to leave 2 bytes for the trailing 
-		     * parenthesis and the nil. Here is
-		     * an example of what we're trying to achieve:
-		     * +--+--+--+--+--+--+--+--+--+--+--+--+--+--+
-		     * |  |  | N| a| m| e| :|\t| i| n| i| t|\n| S|...
-		     * +--+--+--+--+--+--+--+--+--+--+--+--+--+--+
-		     * | 0| 0| 0| 0| 0| 1|  | (| i| n| i| t| )|\0|...
-		     * +--+--+--+--+--+--+--+--+--+--+--+--+--+--+ */
-		    if ((k = read(fd, buf+2, sizeof(buf)-4)) > 0) {
-			int bc;
-
-			if ((p = strchr(buf+2, '\n')) == NULL)
-			    p = buf+k;
-			p[0] = ')'; 
-			p[1] = '\0';
-			bc = pmsprintf(buf, sizeof(buf), "%06d ", pids->pids[i]); 
-			buf[bc] = '(';
-		    }
-		    close(fd);
-		}
-		else if (pmDebugOptions.appl1 && pmDebugOptions.desperate) {
-		    fprintf(stderr, "%s: open(\"%s\", O_RDONLY) failed: %s\n",
-			    "refresh_proc_pidlist", buf, pmErrStr(-oserror()));
-		}
-	    }
-
-	    if (k <= 0) {
-		/* hmm .. must be exiting */
-	    	pmsprintf(buf, sizeof(buf), "%06d <exiting>", pids->pids[i]);
-	    }
-
-	    if ((ep->name = strdup(buf)) != NULL)
-		ep->psargs = index(ep->name, ' ') + 1;
-	    else
-		ep->psargs = NULL;
+	ep = proc_pid_entry_add(proc_pid, pids->pids[i]);
 
-	    __pmHashAdd(pids->pids[i], (void *)ep, &proc_pid->pidhash);
-	    //fprintf(stderr, "key %d : ADDED \"%s\" to hash table\n", pids->pids[i], buf);
-	}
-
-	if (ep->instname == NULL) {
-	   /*
-	     * The external instance name is the pid followed by
-	     * a copy of the psargs truncated at the first space.
-	     * e.g. "012345 /path/to/command". Command line args,
-	     * if any, are truncated. The full command line is
-	     * available in the proc.psinfo.psargs metric.
-	     */
-	    if ((p = strchr(ep->name, ' ')) != NULL) {
-	        if ((p = strchr(p+1, ' ')) != NULL) {
-	            int len = p - ep->name;
-		    if (len > PROC_PID_STAT_CMD_MAXLEN)
-			len = PROC_PID_STAT_CMD_MAXLEN;
-	            ep->instname = (char *)malloc(len+1);
-	            strncpy(ep->instname, ep->name, len);
-	            ep->instname[len] = '\0';
-	        }
-	    }
-	    if (ep->instname == NULL) /* no spaces found, so use the full name */
-	        ep->instname = strndup(ep->name, PROC_PID_STAT_CMD_MAXLEN);
-	}
-	
 	/* mark pid as valid (new or still running) */
 	ep->fetched |= PROC_PID_FLAG_VALID;
 	ep->success |= PROC_PID_FLAG_VALID;
@@ -918,25 +987,11 @@ refresh_proc_pidlist(proc_pid_t *proc_pid, proc_pid_list_t *pids, proc_runq_t *r
 	    	prev = node;
 	    }
 	    else {
-		// This process has exited.
-	        //fprintf(stderr, "DELETED key=%d name=\"%s\"\n", ep->id, ep->name);
-		if (ep->instname != NULL)
-		    free(ep->instname);
-		if (ep->name != NULL)
-		    free(ep->name);
-		if (ep->stat.cmd != NULL)
-		    free(ep->stat.cmd);
-		if (ep->maps_buf != NULL)
-		    free(ep->maps_buf);
-		if (ep->wchan_buf != NULL)
-		    free(ep->wchan_buf);
-		if (ep->environ_buf != NULL)
-		    free(ep->environ_buf);
 	    	if (prev == NULL)
 		    proc_pid->pidhash.hash[i] = node->next;
 		else
 		    prev->next = node->next;
-		free(ep);
+		proc_pid_entry_free(ep);
 		free(node);
 	    }
 	    if ((node = next) == NULL)
@@ -944,32 +999,183 @@ refresh_proc_pidlist(proc_pid_t *proc_pid, proc_pid_list_t *pids, proc_runq_t *r
 	}
     }
 
-    /* Reset accounting of the runqueue metrics, initially all zeroes */
-    if (runq)
-	memset(runq, 0, sizeof(proc_runq_t));
+    refresh_proc_indom(proc_pid, numinst, runq);
+}
 
-    /*
-     * At this point, the hash table contains only valid pids.  Finally:
-     * - refresh the indom table, based on the updated process hash table.
-     *   (indom table instance names are shared with the hash table entry,
-     *    so must not be freed).
-     * - if runq metrics are being gathered, sample stat files now for all
-     *   active processes and accumulate the values - and do this in a way
-     *   that sets the FETCHED flag for these files such that they're only
-     *   read once for each sample (fetch).
-     */
-    indomp->it_numinst = numinst;
-    indomp->it_set = (pmdaInstid *)realloc(indomp->it_set, numinst * sizeof(pmdaInstid));
+/*
+ * Incremental maintenance of the all-processes hash table, from the
+ * process creation and exit events since the previous refresh rather
+ * than a readdir of /proc (and /proc/PID/task, for threads) each time.
+ * A full scan is still used with cgroup filtering, when the threads
+ * setting changes, when events were lost and at the resync interval.
+ *
+ * Exit events are sent before a process is reaped, and there is no
+ * event for that - exited processes stay (as zombies) until they are
+ * no longer in /proc, which is checked on each refresh.
+ */
+#define PIDEVENT_CREATED	1	/* created since the last refresh */
+#define PIDEVENT_EXITED		2	/* exited since the last refresh */
+#define PIDEVENT_REPLACED	3	/* exited, then the pid was reused */
+
+static struct {
+    int		enabled;	/* proc connector events are available */
+    int		synced;		/* hash table matches the last full scan */
+    int		threads;	/* hash table has threads, not processes */
+    double	resync;		/* seconds between full scans of /proc */
+    double	scanned;	/* time of the last full scan of /proc */
+    __pmHashCtl	pending;	/* PIDEVENT_* state for each pid */
+    __pmHashCtl	exited;		/* exited pids that may not be reaped yet */
+} pidevents;
+
+int
+proc_pid_events_init(const char *interval)
+{
+    struct timeval	tv;
+    char		*errmsg;
+    int			sts;
+
+    if (pmParseInterval(interval, &tv, &errmsg) < 0) {
+	pmNotifyErr(LOG_ERR, "bad process events resync interval: %s", interval);
+	free(errmsg);
+	return PM_ERR_CONV;
+    }
+    /* QA mode - events do not describe the processes under PROC_STATSPATH */
+    if (proc_statspath[0] != '\0')
+	return -EOPNOTSUPP;
+    if ((sts = proc_events_open()) < 0) {
+	pmNotifyErr(LOG_INFO, "process events unavailable, scanning /proc: %s",
+			pmErrStr(sts));
+	return sts;
+    }
+    pidevents.resync = pmtimevalToReal(&tv);
+    pidevents.enabled = 1;
+    return 0;
+}
+
+static void
+pidevents_pending(int pid, int tgid, int exited, void *arg)
+{
+    __pmHashNode	*node;
+    long		state;
+
+    if (!pidevents.threads && pid != tgid)
+	return;
+    if ((node = __pmHashSearch(pid, &pidevents.pending)) == NULL) {
+	state = exited ? PIDEVENT_EXITED : PIDEVENT_CREATED;
+	__pmHashAdd(pid, (void *)state, &pidevents.pending);
+	return;
+    }
+    state = (long)node->data;
+    if (exited)
+	state = PIDEVENT_EXITED;
+    else if (state == PIDEVENT_EXITED)
+	state = PIDEVENT_REPLACED;
+    node->data = (void *)state;
+}
+
+static int
+pidevents_reaped(int pid)
+{
+    char		path[MAXPATHLEN];
+
+    pmsprintf(path, sizeof(path), "%s/proc/%d", proc_statspath, pid);
+    return access(path, F_OK) < 0;
+}
+
+static void
+pidevents_remove(proc_pid_t *proc_pid, int pid)
+{
+    proc_pid_entry_t	*ep;
+
+    if ((ep = proc_pid_entry_lookup(pid, proc_pid)) != NULL) {
+	__pmHashDel(pid, (void *)ep, &proc_pid->pidhash);
+	proc_pid_entry_free(ep);
+    }
+    __pmHashDel(pid, NULL, &pidevents.exited);
+}
+
+/*
+ * Apply the final state of each pid with events to the hash table,
+ * then drop exited pids once they have been reaped.  After a full scan
+ * the hash table is current, and only the exited pids are of interest.
+ */
+static void
+pidevents_apply(proc_pid_t *proc_pid, int scanned)
+{
+    __pmHashNode	*node, *next;
+    long		state;
+    int			i, pid;
+
+    for (i=0; i < pidevents.pending.hsize; i++) {
+	for (node=pidevents.pending.hash[i]; node != NULL; node=node->next) {
+	    pid = node->key;
+	    state = (long)node->data;
+	    if (state == PIDEVENT_EXITED) {
+		if (__pmHashSearch(pid, &pidevents.exited) == NULL)
+		    __pmHashAdd(pid, NULL, &pidevents.exited);
+		continue;
+	    }
+	    if (scanned)
+		continue;
+	    /* created with no exit event means reaped, then pid reused */
+	    if (state == PIDEVENT_REPLACED ||
+		__pmHashSearch(pid, &pidevents.exited) != NULL)
+		pidevents_remove(proc_pid, pid);
+	    proc_pid_entry_add(proc_pid, pid);
+	}
+    }
+    __pmHashFree(&pidevents.pending);
+    __pmHashInit(&pidevents.pending);
+
+    if (scanned)
+	return;
+    for (i=0; i < pidevents.exited.hsize; i++) {
+	for (node=pidevents.exited.hash[i]; node != NULL; node=next) {
+	    next = node->next;
+	    pid = node->key;
+	    if (proc_pid_entry_lookup(pid, proc_pid) == NULL)
+		__pmHashDel(pid, NULL, &pidevents.exited);
+	    else if (pidevents_reaped(pid))
+		pidevents_remove(proc_pid, pid);
+	}
+    }
+}
+
+static int
+refresh_events_pidlist(proc_pid_t *proc_pid, proc_runq_t *runq, int want_threads)
+{
+    struct timeval	now;
+    __pmHashNode	*node;
+    proc_pid_entry_t	*ep;
+    int			i, sts, numinst = 0;
+
+    pmtimevalNow(&now);
+    if (!pidevents.synced || pidevents.threads != want_threads ||
+	pmtimevalToReal(&now) - pidevents.scanned >= pidevents.resync)
+	return -EAGAIN;
+
+    if ((sts = proc_events_read(pidevents_pending, NULL)) < 0) {
+	pidevents.synced = 0;
+	return sts;
+    }
+    pidevents_apply(proc_pid, 0);
+
+    /* every entry is now valid, but nothing has been fetched for it */
     for (i=0; i < proc_pid->pidhash.hsize; i++) {
 	for (node=proc_pid->pidhash.hash[i]; node != NULL; node=node->next) {
 	    ep = (proc_pid_entry_t *)node->data;
-	    if (runq) {
-		refresh_proc_pid_stat(ep);
-		refresh_proc_runq(ep, runq);
-	    }
-	    refresh_proc_indom_entry(ep, indomp, idx++);
+	    ep->fetched = ep->success = PROC_PID_FLAG_VALID;
+	    numinst++;
 	}
     }
+
+    if (pmDebugOptions.appl1)
+	fprintf(stderr, "%s: %d events, %d pids (threads=%d)\n",
+		"refresh_events_pidlist", sts, numinst, want_threads);
+
+    procpids.threads = want_threads;
+    refresh_proc_indom(proc_pid, numinst, runq);
+    return 0;
 }
 
 int
@@ -977,6 +1183,7 @@ refresh_proc_pid(proc_pid_t *proc_pid, proc_runq_t *proc_runq,
 		 int want_threads, const char *cgroups,
 		 const char *container, int namelen)
 {
+    struct timeval	now;
     char		path[MAXPATHLEN];
     int			sts, want_cgroups;
     const char		*filter = cgroups;
@@ -990,6 +1197,19 @@ refresh_proc_pid(proc_pid_t *proc_pid, proc_runq_t *proc_runq,
     if (container)
 	filter = cgroup_container_path(path, sizeof(path), container);
 
+    if (pidevents.enabled) {
+	if (!want_cgroups &&
+	    refresh_events_pidlist(proc_pid, proc_runq, want_threads) == 0)
+	    return 0;
+	/*
+	 * The full scan below includes the effect of any queued events,
+	 * but the exited processes may still need to be reaped.
+	 */
+	pidevents.threads = want_threads;
+	pidevents.synced = 0;
+	proc_events_read(pidevents_pending, NULL);
+    }
+
     sts = !want_cgroups ?
 	refresh_global_pidlist(want_threads, &procpids) :
 	refresh_cgroup_pidlist(want_threads, &procpids, filter);
@@ -1002,6 +1222,13 @@ refresh_proc_pid(proc_pid_t *proc_pid, proc_runq_t *proc_runq,
 		container ? "container" : "cgroups", filter ? filter : "");
 
     refresh_proc_pidlist(proc_pid, &procpids, proc_runq);
+
+    if (pidevents.enabled) {
+	pidevents_apply(proc_pid, 1);
+	pmtimevalNow(&now);
+	pidevents.scanned = pmtimevalToReal(&now);
+	pidevents.synced = !want_cgroups;
+    }
     return 0;
 }
 
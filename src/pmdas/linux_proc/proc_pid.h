@@ -306,6 +306,9 @@ extern proc_pid_entry_t *proc_pid_entry_lookup(int, proc_pid_t *);
 /* refresh the proc indom, reset all "fetched" flags */
 extern int refresh_proc_pid(proc_pid_t *, proc_runq_t *, int, const char *, const char *, int);
 
+/* use process creation and exit events, with a full /proc scan interval */
+extern int proc_pid_events_init(const char *);
+
 /* refresh the hotproc indom, checking against the current configuration */
 extern int refresh_hotproc_pid(proc_pid_t *, int, const char *);
 
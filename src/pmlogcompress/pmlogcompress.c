@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * Compress PCP archive files into the zstd seekable format ... the input
+ * is split into fixed size chunks, each compressed as an independent zstd
+ * frame, followed by a seek table in a skippable frame so that libpcp can
+ * decompress just the frames needed for random access into the archive.
+ *
+ * The output is a regular zstd stream, so zstd(1) can decompress it.
+ */
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <zstd.h>
+#include "pmapi.h"
+#include "libpcp.h"
+
+#define SEEKABLE_TABLE_MAGIC	0x184D2A5EU
+#define SEEKABLE_FOOTER_MAGIC	0x8F92EAB1U
+#define SEEKABLE_FOOTER_SIZE	9
+
+static int	level = 3;			/* zstd default */
+static size_t	framesize = 1024 * 1024;	/* uncompressed frame size */
+static int	keep;				/* -k, don't remove input */
+static int	vflag;
+
+static pmLongOptions longopts[] = {
+    PMAPI_OPTIONS_HEADER("Options"),
+    { "frame-size", 1, 'b', "N", "uncompressed bytes per frame [default 1MiB]" },
+    PMOPT_DEBUG,
+    { "keep", 0, 'k', 0, "keep (don't delete) input files" },
+    { "level", 1, 'l', "N", "zstd compression level [default 3]" },
+    { "verbose", 0, 'v', 0, "report compression ratio for each file" },
+    PMOPT_HELP,
+    PMAPI_OPTIONS_END
+};
+
+static pmOptions opts = {
+    .short_options = "b:D:kl:v?",
+    .long_options = longopts,
+    .short_usage = "[options] file ...",
+};
+
+static void
+put32(unsigned char *p, __uint32_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+static int
+writeall(int fd, const void *buf, size_t len)
+{
+    const char	*p = (const char *)buf;
+    ssize_t	n;
+
+    while (len > 0) {
+	if ((n = write(fd, p, len)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	p += n;
+	len -= n;
+    }
+    return 0;
+}
+
+static ssize_t
+readall(int fd, void *buf, size_t len)
+{
+    char	*p = (char *)buf;
+    ssize_t	n;
+    size_t	got = 0;
+
+    while (got < len) {
+	if ((n = read(fd, p + got, len - got)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	if (n == 0)
+	    break;
+	got += n;
+    }
+    return got;
+}
+
+/*
+ * Compress one file, return 0 on success, else -1 after reporting
+ * the problem.
+ */
+static int
+do_compress(ZSTD_CCtx *cctx, const char *path)
+{
+    char		outpath[MAXPATHLEN];
+    char		*ibuf = NULL;
+    char		*obuf = NULL;
+    unsigned char	*table = NULL;
+    unsigned char	*tp;
+    const char		*suffix;
+    size_t		obuflen = ZSTD_compressBound(framesize);
+    size_t		tablen;
+    size_t		csize;
+    ssize_t		n;
+    __uint32_t		nframes = 0;
+    __uint32_t		maxframes = 0;
+    long long		insize = 0;
+    long long		outsize = 0;
+    struct stat		sbuf;
+    struct timespec	times[2];
+    int			ifd, ofd = -1;
+
+    if ((suffix = strrchr(path, '.')) != NULL && __pmLogCompressedSuffix(suffix)) {
+	fprintf(stderr, "%s: %s: already compressed, skipped\n",
+		pmGetProgname(), path);
+	return 0;
+    }
+    if ((ifd = open(path, O_RDONLY)) < 0 || fstat(ifd, &sbuf) < 0) {
+	fprintf(stderr, "%s: %s: %s\n", pmGetProgname(), path, osstrerror());
+	if (ifd >= 0)
+	    close(ifd);
+	return -1;
+    }
+    if (!S_ISREG(sbuf.st_mode)) {
+	fprintf(stderr, "%s: %s: not a regular file, skipped\n",
+		pmGetProgname(), path);
+	close(ifd);
+	return 0;
+    }
+    pmsprintf(outpath, sizeof(outpath), "%s.zst", path);
+    if ((ofd = open(outpath, O_WRONLY|O_CREAT|O_EXCL, sbuf.st_mode & 0777)) < 0) {
+	fprintf(stderr, "%s: %s: %s\n", pmGetProgname(), outpath, osstrerror());
+	close(ifd);
+	return -1;
+    }
+    if ((ibuf = (char *)malloc(framesize)) == NULL ||
+	(obuf = (char *)malloc(obuflen)) == NULL) {
+	fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	goto fail;
+    }
+
+    while ((n = readall(ifd, ibuf, framesize)) > 0) {
+	csize = ZSTD_compress2(cctx, obuf, obuflen, ibuf, n);
+	if (ZSTD_isError(csize)) {
+	    fprintf(stderr, "%s: %s: %s\n", pmGetProgname(), path,
+		    ZSTD_getErrorName(csize));
+	    goto fail;
+	}
+	if (writeall(ofd, obuf, csize) < 0) {
+	    fprintf(stderr, "%s: %s: write: %s\n", pmGetProgname(), outpath,
+		    osstrerror());
+	    goto fail;
+	}
+	if (nframes == maxframes) {
+	    unsigned char	*tmp;
+
+	    maxframes = maxframes == 0 ? 64 : 2 * maxframes;
+	    if ((tmp = (unsigned char *)realloc(table, 8 * maxframes)) == NULL) {
+		fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+		goto fail;
+	    }
+	    table = tmp;
+	}
+	put32(&table[8 * nframes], csize);
+	put32(&table[8 * nframes + 4], n);
+	nframes++;
+	insize += n;
+	outsize += csize;
+    }
+    if (n < 0) {
+	fprintf(stderr, "%s: %s: read: %s\n", pmGetProgname(), path, osstrerror());
+	goto fail;
+    }
+
+    /*
+     * Seek table: skippable frame header, 8 bytes per frame (no
+     * checksums, these are in the frames themselves), then footer.
+     */
+    tablen = 8 + 8 * nframes + SEEKABLE_FOOTER_SIZE;
+    if ((tp = (unsigned char *)malloc(tablen)) == NULL) {
+	fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	goto fail;
+    }
+    put32(&tp[0], SEEKABLE_TABLE_MAGIC);
+    put32(&tp[4], tablen - 8);
+    if (nframes > 0)
+	memcpy(&tp[8], table, 8 * nframes);
+    put32(&tp[tablen - 9], nframes);
+    tp[tablen - 5] = 0;		/* descriptor: no checksums */
+    put32(&tp[tablen - 4], SEEKABLE_FOOTER_MAGIC);
+    n = writeall(ofd, tp, tablen);
+    free(tp);
+    if (n < 0 || fsync(ofd) < 0) {
+	fprintf(stderr, "%s: %s: write: %s\n", pmGetProgname(), outpath,
+		osstrerror());
+	goto fail;
+    }
+    outsize += tablen;
+
+    /* like xz(1) and gzip(1), output inherits the input's timestamps */
+    times[0] = sbuf.st_atim;
+    times[1] = sbuf.st_mtim;
+    futimens(ofd, times);
+    if (close(ofd) < 0) {
+	ofd = -1;
+	fprintf(stderr, "%s: %s: close: %s\n", pmGetProgname(), outpath,
+		osstrerror());
+	goto fail;
+    }
+    close(ifd);
+    if (!keep && unlink(path) < 0)
+	fprintf(stderr, "%s: %s: unlink: %s\n", pmGetProgname(), path,
+		osstrerror());
+    if (vflag)
+	printf("%s: %lld -> %lld bytes (%.1f%%), %u frames\n", path,
+		insize, outsize,
+		insize ? 100.0 * outsize / insize : 0.0, nframes);
+    free(table);
+    free(obuf);
+    free(ibuf);
+    return 0;
+
+fail:
+    if (ofd >= 0)
+	close(ofd);
+    unlink(outpath);
+    close(ifd);
+    free(table);
+    free(obuf);
+    free(ibuf);
+    return -1;
+}
+
+int
+main(int argc, char **argv)
+{
+    ZSTD_CCtx	*cctx;
+    char	*endnum;
+    long	val;
+    int		c;
+    int		sts = 0;
+
+    while ((c = pmGetOptions(argc, argv, &opts)) != EOF) {
+	switch (c) {
+
+	case 'b':	/* frame size, optional K or M suffix */
+	    val = strtol(opts.optarg, &endnum, 10);
+	    if (*endnum == 'K' || *endnum == 'k') {
+		val *= 1024;
+		endnum++;
+	    }
+	    else if (*endnum == 'M' || *endnum == 'm') {
+		val *= 1024 * 1024;
+		endnum++;
+	    }
+	    if (*endnum != '\0' || val < 4096 || val > 64 * 1024 * 1024) {
+		fprintf(stderr, "%s: -b requires a size between 4K and 64M\n",
+			pmGetProgname());
+		opts.errors++;
+	    }
+	    else
+		framesize = val;
+	    break;
+
+	case 'k':
+	    keep = 1;
+	    break;
+
+	case 'l':
+	    val = strtol(opts.optarg, &endnum, 10);
+	    if (*endnum != '\0' ||
+		val < ZSTD_minCLevel() || val > ZSTD_maxCLevel()) {
+		fprintf(stderr, "%s: -l requires a level between %d and %d\n",
+			pmGetProgname(), ZSTD_minCLevel(), ZSTD_maxCLevel());
+		opts.errors++;
+	    }
+	    else
+		level = val;
+	    break;
+
+	case 'v':
+	    vflag = 1;
+	    break;
+
+	case '?':
+	default:
+	    opts.errors++;
+	    break;
+	}
+    }
+
+    if (opts.optind >= argc)
+	opts.errors++;
+
+    if (opts.errors) {
+	pmUsageMessage(&opts);
+	exit(1);
+    }
+
+    if ((cctx = ZSTD_createCCtx()) == NULL) {
+	fprintf(stderr, "%s: cannot create zstd context\n", pmGetProgname());
+	exit(1);
+    }
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+
+    for (c = opts.optind; c < argc; c++) {
+	if (do_compress(cctx, argv[c]) < 0)
+	    sts = 1;
+    }
+
+    ZSTD_freeCCtx(cctx);
+    exit(sts);
+}